@@ -0,0 +1,18 @@
+#!/bin/sh
+# Linux command line tools, the game itself is built on Windows with build.bat
+
+set -e
+
+common_compiler_flags="-std=c++17 -O2 -g -Wall -Wextra -Wno-unused-function"
+
+g++ src/neural_network_benchmark_linux.cpp $common_compiler_flags -pthread -o neural_network_benchmark
+g++ src/trainer_linux.cpp $common_compiler_flags -o trainer
+g++ src/pruner_linux.cpp $common_compiler_flags -o pruner
+g++ src/convolution_benchmark_linux.cpp $common_compiler_flags -o convolution_benchmark
+g++ src/tuner_linux.cpp $common_compiler_flags -o tuner
+g++ src/compressor_linux.cpp $common_compiler_flags -o compressor
+g++ src/deduplicator_linux.cpp $common_compiler_flags -o deduplicator
+g++ src/columnizer_linux.cpp $common_compiler_flags -o columnizer
+g++ src/decoder_benchmark_linux.cpp $common_compiler_flags -o decoder_benchmark
+g++ src/dataset_linux.cpp $common_compiler_flags -o dataset
+g++ src/self_play_linux.cpp $common_compiler_flags -o self_play
@@ -0,0 +1,76 @@
+#include "all_reduce.h"
+
+static u32 ring_chunk_start(const u32 chunk, const u32 count, const u32 rank_count) {
+    return static_cast<u32>(static_cast<u64>(count) * chunk / rank_count);
+}
+
+// Sums data across every rank in place, scratch must hold count / rank_count + 1 floats.
+//
+// Reduce-scatter then all-gather, each in rank_count - 1 steps of one chunk per rank. Chunk c is summed
+// starting from rank c's values and going round the ring, always in that order, so the result only depends on
+// the rank count and every rank ends up with bit identical values.
+static bool ring_all_reduce(const AllReduceTransport& transport, f32* const data, const u32 count, f32* const scratch) {
+    const u32 rank_count = transport.rank_count;
+    const u32 rank = transport.rank;
+    if (rank_count == 1) {
+        return true;
+    }
+
+    for (u32 step = 0; step + 1 < rank_count; ++step) {
+        const u32 send_chunk = (rank + rank_count - step) % rank_count;
+        const u32 receive_chunk = (rank + rank_count - step - 1) % rank_count;
+
+        const u32 send_start = ring_chunk_start(send_chunk, count, rank_count);
+        const u32 send_count = ring_chunk_start(send_chunk + 1, count, rank_count) - send_start;
+        if (!transport.send_to_next_rank(transport.context, data + send_start, send_count)) {
+            return false;
+        }
+
+        const u32 receive_start = ring_chunk_start(receive_chunk, count, rank_count);
+        const u32 receive_count = ring_chunk_start(receive_chunk + 1, count, rank_count) - receive_start;
+        if (!transport.receive_from_previous_rank(transport.context, scratch, receive_count)) {
+            return false;
+        }
+
+        for (u32 i = 0; i < receive_count; ++i) {
+            data[receive_start + i] = scratch[i] + data[receive_start + i];
+        }
+    }
+
+    // rank r now holds the complete sum for chunk r + 1, pass the finished chunks round
+    for (u32 step = 0; step + 1 < rank_count; ++step) {
+        const u32 send_chunk = (rank + 1 + rank_count - step) % rank_count;
+        const u32 receive_chunk = (rank + rank_count - step) % rank_count;
+
+        const u32 send_start = ring_chunk_start(send_chunk, count, rank_count);
+        const u32 send_count = ring_chunk_start(send_chunk + 1, count, rank_count) - send_start;
+        if (!transport.send_to_next_rank(transport.context, data + send_start, send_count)) {
+            return false;
+        }
+
+        const u32 receive_start = ring_chunk_start(receive_chunk, count, rank_count);
+        const u32 receive_count = ring_chunk_start(receive_chunk + 1, count, rank_count) - receive_start;
+        if (!transport.receive_from_previous_rank(transport.context, data + receive_start, receive_count)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Sums leaf_count buffers, leaf_stride floats apart, into the first one but only for floats [first, last).
+//
+// Neighbouring leaves are added pairwise, then neighbouring pairs and so on, so each float's additions happen
+// in an order fixed by leaf_count alone. Splitting [first, last) between ranks doesn't change any result,
+// unlike ring_all_reduce where the order follows the rank count.
+static void pairwise_tree_reduce(f32* const leaves, const u32 leaf_count, const u32 leaf_stride, const u32 first, const u32 last) {
+    for (u32 step = 1; step < leaf_count; step *= 2) {
+        for (u32 leaf = 0; leaf + step < leaf_count; leaf += 2 * step) {
+            f32* const sum = leaves + static_cast<u64>(leaf) * leaf_stride;
+            const f32* const addend = leaves + static_cast<u64>(leaf + step) * leaf_stride;
+            for (u32 i = first; i < last; ++i) {
+                sum[i] = sum[i] + addend[i];
+            }
+        }
+    }
+}
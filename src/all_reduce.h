@@ -0,0 +1,21 @@
+#ifndef ALL_REDUCE_H
+#define ALL_REDUCE_H
+
+#include "types.h"
+
+// Moves blocks of floats between neighbouring ranks of a ring. The reduction only talks to the ring through
+// this so the same code runs over shared memory between local processes or over sockets between machines.
+struct AllReduceTransport {
+    void* context;
+    u32 rank;
+    u32 rank_count;
+
+    // both block until the whole block has been handed over, false means the ring is broken
+    bool(*send_to_next_rank)(void* context, const f32* data, u32 count);
+    bool(*receive_from_previous_rank)(void* context, f32* data, u32 count);
+};
+
+static bool ring_all_reduce(const AllReduceTransport& transport, f32* data, u32 count, f32* scratch);
+static void pairwise_tree_reduce(f32* leaves, u32 leaf_count, u32 leaf_stride, u32 first, u32 last);
+
+#endif
@@ -0,0 +1,168 @@
+#include "columnar_training_data.h"
+#include "tetris.h"
+#include "util.h"
+
+static constexpr i8 COLUMNAR_TRAINING_DATA_MAGIC[] = {'T', 'A', 'I', 'C', 'O', 'L', 'U', 'M'};
+
+static u32 columnar_block_count(const u32 record_count) {
+    return static_cast<u32>((static_cast<u64>(record_count) + COLUMNAR_BLOCK_RECORD_COUNT - 1) / COLUMNAR_BLOCK_RECORD_COUNT);
+}
+
+static u64 columnar_training_data_size(const u32 record_count) {
+    return sizeof(ColumnarTrainingDataHeader) + static_cast<u64>(columnar_block_count(record_count)) * sizeof(ColumnarTrainingDataBlock);
+}
+
+// Writes the columnar file into buffer (columnar_training_data_size() bytes, 64 byte aligned) and returns its size
+static u64 columnize_training_data(const TrainingDataView& training_data, i8* const buffer) {
+    const u32 block_count = columnar_block_count(training_data.record_count);
+    ColumnarTrainingDataBlock* const blocks = reinterpret_cast<ColumnarTrainingDataBlock*>(buffer + sizeof(ColumnarTrainingDataHeader));
+
+    u64* const block_words = reinterpret_cast<u64*>(blocks);
+    const u64 block_word_count = static_cast<u64>(block_count) * sizeof(ColumnarTrainingDataBlock) / sizeof(u64);
+    for (u64 i = 0; i < block_word_count; ++i) {
+        block_words[i] = 0;
+    }
+
+    for (u32 record_index = 0; record_index < training_data.record_count; ++record_index) {
+        const i8* const record = training_record(training_data, record_index);
+        ColumnarTrainingDataBlock& block = blocks[record_index / COLUMNAR_BLOCK_RECORD_COUNT];
+        const u32 slot = record_index % COLUMNAR_BLOCK_RECORD_COUNT;
+
+        // see game_state_to_binary_game_state() for where everything is in a record
+        copy_bytes(record, sizeof(i32), reinterpret_cast<i8*>(&block.difficulty_levels[slot]));
+        copy_bytes(record + 4, sizeof(i32), reinterpret_cast<i8*>(&block.rows_cleared[slot]));
+        block.next_tetrimino_types[slot] = record[8];
+        block.current_tetrimino_types[slot] = record[9];
+        for (u32 coordinate = 0; coordinate < 8; ++coordinate) {
+            block.block_coordinates[coordinate][slot] = record[10 + coordinate];
+        }
+
+        pack_grid_bitmap(record + BINARY_GRID_OFFSET, block.grid_bitmaps[slot]);
+        copy_bytes(record + BINARY_GAME_STATE_SIZE, sizeof(u16), reinterpret_cast<i8*>(&block.player_inputs[slot]));
+    }
+
+    ColumnarTrainingDataHeader header = {};
+    copy_bytes(COLUMNAR_TRAINING_DATA_MAGIC, sizeof(COLUMNAR_TRAINING_DATA_MAGIC), header.magic);
+    header.version = COLUMNAR_TRAINING_DATA_VERSION;
+    header.record_count = training_data.record_count;
+    header.block_count = block_count;
+    header.block_record_count = COLUMNAR_BLOCK_RECORD_COUNT;
+    copy_bytes(reinterpret_cast<const i8*>(&header), sizeof(header), buffer);
+
+    return columnar_training_data_size(training_data.record_count);
+}
+
+static bool is_columnar_training_data(const void* const data, const u64 size) {
+    return data != nullptr && size >= sizeof(ColumnarTrainingDataHeader) &&
+        compare_bytes(static_cast<const i8*>(data), COLUMNAR_TRAINING_DATA_MAGIC, sizeof(COLUMNAR_TRAINING_DATA_MAGIC)) == 0;
+}
+
+// The data has to be 64 byte aligned (a mapping always is)
+static bool view_columnar_training_data(const void* const data, const u64 size, ColumnarTrainingDataView& view) {
+    view = {};
+    if (!is_columnar_training_data(data, size) || reinterpret_cast<u64>(data) % alignof(ColumnarTrainingDataBlock) != 0) {
+        return false;
+    }
+
+    ColumnarTrainingDataHeader header = {};
+    copy_bytes(static_cast<const i8*>(data), sizeof(header), reinterpret_cast<i8*>(&header));
+    const bool valid_header = header.version == COLUMNAR_TRAINING_DATA_VERSION &&
+        header.record_count > 0 &&
+        header.block_record_count == COLUMNAR_BLOCK_RECORD_COUNT &&
+        header.block_count == columnar_block_count(header.record_count) &&
+        size == columnar_training_data_size(header.record_count);
+    if (!valid_header) {
+        return false;
+    }
+
+    view.blocks = reinterpret_cast<const ColumnarTrainingDataBlock*>(static_cast<const i8*>(data) + sizeof(header));
+    view.record_count = header.record_count;
+    view.block_count = header.block_count;
+
+    return true;
+}
+
+// Writes out the record as it was in the file the view was made from, bar any grid row bits past the last column
+static void columnar_training_record(const ColumnarTrainingDataView& view, const u32 record_index, i8* const record) {
+    static constexpr u64 ROW_MASK = (1 << Tetris::Grid::COLUMN_COUNT) - 1;
+
+    const ColumnarTrainingDataBlock& block = view.blocks[record_index / COLUMNAR_BLOCK_RECORD_COUNT];
+    const u32 slot = record_index % COLUMNAR_BLOCK_RECORD_COUNT;
+    copy_bytes(reinterpret_cast<const i8*>(&block.difficulty_levels[slot]), sizeof(i32), record);
+    copy_bytes(reinterpret_cast<const i8*>(&block.rows_cleared[slot]), sizeof(i32), record + 4);
+    record[8] = block.next_tetrimino_types[slot];
+    record[9] = block.current_tetrimino_types[slot];
+    for (u32 coordinate = 0; coordinate < 8; ++coordinate) {
+        record[10 + coordinate] = block.block_coordinates[coordinate][slot];
+    }
+
+    const u64* const grid_bitmap = block.grid_bitmaps[slot];
+    for (i32 row = 0; row < Tetris::Grid::ROW_COUNT; ++row) {
+        const u32 first_bit = INPUT_FEATURE_COUNT + row * Tetris::Grid::COLUMN_COUNT;
+        const u32 shift = first_bit % 64;
+        u64 row_bits = grid_bitmap[first_bit / 64] >> shift;
+        if (shift + Tetris::Grid::COLUMN_COUNT > 64) {
+            row_bits |= grid_bitmap[first_bit / 64 + 1] << (64 - shift);
+        }
+
+        const u16 encoded_row = static_cast<u16>(row_bits & ROW_MASK);
+        copy_bytes(reinterpret_cast<const i8*>(&encoded_row), sizeof(encoded_row), record + BINARY_GRID_OFFSET + row * sizeof(encoded_row));
+    }
+
+    copy_bytes(reinterpret_cast<const i8*>(&block.player_inputs[slot]), sizeof(u16), record + BINARY_GAME_STATE_SIZE);
+}
+
+// Records [first_record, first_record + record_count) of the block into consecutive inputs and targets, the
+// same values decode_training_records() gives for the records the block was made from
+static void decode_columnar_training_data(
+    const ColumnarTrainingDataBlock& block,
+    const u32 first_record,
+    const u32 record_count,
+    const KernelVariant variant,
+    NeuralNetwork::InputLayer* const inputs,
+    NeuralNetwork::OutputLayer* const targets
+) {
+    for (u32 i = 0; i < record_count; ++i) {
+        const u32 slot = first_record + i;
+
+        f32 features[16] = {};
+        features[0] = static_cast<f32>(block.difficulty_levels[slot]);
+        features[1] = static_cast<f32>(block.rows_cleared[slot]);
+        features[2] = static_cast<f32>(block.next_tetrimino_types[slot]);
+        features[3] = static_cast<f32>(block.current_tetrimino_types[slot]);
+        for (u32 coordinate = 0; coordinate < 8; ++coordinate) {
+            features[4 + coordinate] = static_cast<f32>(block.block_coordinates[coordinate][slot]);
+        }
+
+        expand_neural_network_input(features, block.grid_bitmaps[slot], variant, inputs[i]);
+        binary_player_input_to_neural_network_output(block.player_inputs[slot], targets[i]);
+    }
+}
+
+// Same delta as accumulate_training_delta() over the records the file was made from, in the same order
+static void accumulate_training_delta(
+    const PackedNeuralNetwork& neural_network,
+    const ColumnarTrainingDataView& training_data,
+    const u32 first_record,
+    const u32 record_count,
+    PackedNeuralNetworkDelta& neural_network_delta
+) {
+    alignas(64) NeuralNetwork::InputLayer inputs[TRAINING_DECODE_BATCH_SIZE];
+    NeuralNetwork::OutputLayer targets[TRAINING_DECODE_BATCH_SIZE];
+    const u32 last_record = first_record + record_count;
+    for (u32 record = first_record; record < last_record;) {
+        // batches never straddle a block
+        const u32 slot = record % COLUMNAR_BLOCK_RECORD_COUNT;
+        const u32 block_records_left = COLUMNAR_BLOCK_RECORD_COUNT - slot;
+        const u32 records_left = last_record - record;
+        u32 batch_size = (records_left < block_records_left) ? records_left : block_records_left;
+        batch_size = (batch_size < TRAINING_DECODE_BATCH_SIZE) ? batch_size : TRAINING_DECODE_BATCH_SIZE;
+
+        decode_columnar_training_data(training_data.blocks[record / COLUMNAR_BLOCK_RECORD_COUNT], slot, batch_size, KernelVariant::AVX512, inputs, targets);
+        for (u32 i = 0; i < batch_size; ++i) {
+            back_propagate(neural_network, inputs[i], targets[i], 1.0f, neural_network_delta);
+        }
+
+        record += batch_size;
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef COLUMNAR_TRAINING_DATA_H
+#define COLUMNAR_TRAINING_DATA_H
+
+#include "neural_network.h"
+#include "training_data.h"
+#include "types.h"
+
+// Columnar training data layout (all offsets from start of file):
+//  - ColumnarTrainingDataHeader
+//  - ColumnarTrainingDataBlock[block_count], the last one zero padded past record_count
+// Each part of a record sits in its own array inside a block, so a block decodes a field at a time rather
+// than pulling every record apart. The 18 grid rows are already packed into the grid bitmap (see
+// pack_grid_bitmap()) so decoding only has to expand it.
+struct ColumnarTrainingDataHeader {
+    i8 magic[8];
+    u32 version;
+    u32 record_count;
+    u32 block_count;
+    u32 block_record_count;
+    u32 reserved[10];   // pads the blocks out to a cache line boundary
+};
+
+static constexpr u32 COLUMNAR_TRAINING_DATA_VERSION = 1;
+static constexpr u32 COLUMNAR_BLOCK_RECORD_COUNT = 1024;
+
+struct alignas(64) ColumnarTrainingDataBlock {
+    i32 difficulty_levels[COLUMNAR_BLOCK_RECORD_COUNT];
+    i32 rows_cleared[COLUMNAR_BLOCK_RECORD_COUNT];
+    i8 next_tetrimino_types[COLUMNAR_BLOCK_RECORD_COUNT];
+    i8 current_tetrimino_types[COLUMNAR_BLOCK_RECORD_COUNT];
+    i8 block_coordinates[8][COLUMNAR_BLOCK_RECORD_COUNT];  // x then y of each of the four blocks
+    u64 grid_bitmaps[COLUMNAR_BLOCK_RECORD_COUNT][GRID_BITMAP_WORD_COUNT];
+    u16 player_inputs[COLUMNAR_BLOCK_RECORD_COUNT];
+};
+
+static_assert(sizeof(ColumnarTrainingDataHeader) == 64);
+static_assert(sizeof(ColumnarTrainingDataBlock) == 44 * COLUMNAR_BLOCK_RECORD_COUNT);
+
+struct ColumnarTrainingDataView {
+    const ColumnarTrainingDataBlock* blocks;
+    u32 record_count;
+    u32 block_count;
+};
+
+static u64 columnar_training_data_size(u32 record_count);
+static u64 columnize_training_data(const TrainingDataView& training_data, i8* buffer);
+static bool is_columnar_training_data(const void* data, u64 size);
+static bool view_columnar_training_data(const void* data, u64 size, ColumnarTrainingDataView& view);
+static void columnar_training_record(const ColumnarTrainingDataView& view, u32 record_index, i8* record);
+static void decode_columnar_training_data(const ColumnarTrainingDataBlock& block, u32 first_record, u32 record_count, KernelVariant variant, NeuralNetwork::InputLayer* inputs, NeuralNetwork::OutputLayer* targets);
+static void accumulate_training_delta(const PackedNeuralNetwork& neural_network, const ColumnarTrainingDataView& training_data, u32 first_record, u32 record_count, PackedNeuralNetworkDelta& neural_network_delta);
+
+#endif
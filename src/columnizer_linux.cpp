@@ -0,0 +1,126 @@
+// Converts the game's recorded training data to the columnar format, where each part of a record has its own
+// array and the grid is packed into a bitmap in network input order. The converted file is checked to decode to
+// exactly the inputs and targets the records give, and both ways of getting there are timed over the whole file.
+//
+// Usage: columnizer [--training-data FILE] [--output FILE]
+
+#include "neural_network.h"
+#include "kernel_tuning.h"
+#include "convolutional_neural_network.h"
+#include "training_data.h"
+#include "columnar_training_data.h"
+
+#include "util.cpp"
+#include "simd.cpp"
+#include "neural_network.cpp"
+#include "kernel_tuning.cpp"
+#include "convolutional_neural_network.cpp"
+#include "training_data.cpp"
+#include "columnar_training_data.cpp"
+#include "tools_linux.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static constexpr u32 DECODE_BATCH_SIZE = 64;
+
+struct DecodeBatch {
+    alignas(64) NeuralNetwork::InputLayer inputs[DECODE_BATCH_SIZE];
+    NeuralNetwork::OutputLayer targets[DECODE_BATCH_SIZE];
+};
+
+static void decode_records(const TrainingDataView& training_data, const u32 first_record, const u32 record_count, DecodeBatch& batch) {
+    for (u32 i = 0; i < record_count; ++i) {
+        const i8* const record = training_record(training_data, first_record + i);
+
+        BinaryGameState binary_game_state = {};
+        copy_bytes(record, sizeof(binary_game_state), reinterpret_cast<i8*>(binary_game_state));
+        binary_game_state_to_neural_network_input(binary_game_state, batch.inputs[i]);
+
+        BinaryPlayerInput encoded_player_input = 0;
+        copy_bytes(record + sizeof(binary_game_state), sizeof(encoded_player_input), reinterpret_cast<i8*>(&encoded_player_input));
+        binary_player_input_to_neural_network_output(encoded_player_input, batch.targets[i]);
+    }
+}
+
+static void decode_columns(const ColumnarTrainingDataView& training_data, const u32 first_record, const u32 record_count, DecodeBatch& batch) {
+    const u32 slot = first_record % COLUMNAR_BLOCK_RECORD_COUNT;
+    decode_columnar_training_data(training_data.blocks[first_record / COLUMNAR_BLOCK_RECORD_COUNT], slot, record_count, KernelVariant::AVX512, batch.inputs, batch.targets);
+}
+
+int main(const int argc, const char* const* const argv) {
+    const char* training_data_file_name = "training_data_manifest.bin";
+    const char* output_file_name = "training_data_columnar.bin";
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--training-data") == 0 && i + 1 < argc) {
+            training_data_file_name = argv[++i];
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output_file_name = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--training-data FILE] [--output FILE]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    TrainingDataView training_data = {};
+    if (!load_training_data(training_data_file_name, MADV_SEQUENTIAL, training_data)) {
+        return 1;
+    }
+
+    const u64 columnar_size = columnar_training_data_size(training_data.record_count);
+    i8* const buffer = static_cast<i8*>(aligned_alloc(alignof(ColumnarTrainingDataBlock), columnar_size));
+    const f64 columnize_start = seconds_now();
+    columnize_training_data(training_data, buffer);
+    const f64 columnize_seconds = seconds_now() - columnize_start;
+
+    ColumnarTrainingDataView columnar_training_data = {};
+    if (!view_columnar_training_data(buffer, columnar_size, columnar_training_data)) {
+        fprintf(stderr, "columnar file didn't validate\n");
+        return 1;
+    }
+
+    // batches line up with blocks since the block size is a multiple of the batch size
+    static_assert(COLUMNAR_BLOCK_RECORD_COUNT % DECODE_BATCH_SIZE == 0);
+    DecodeBatch* const record_batch = static_cast<DecodeBatch*>(aligned_alloc(alignof(DecodeBatch), sizeof(DecodeBatch)));
+    DecodeBatch* const column_batch = static_cast<DecodeBatch*>(aligned_alloc(alignof(DecodeBatch), sizeof(DecodeBatch)));
+    f64 record_seconds = 0.0;
+    f64 column_seconds = 0.0;
+    bool same = true;
+    for (u32 first_record = 0; first_record < training_data.record_count && same; first_record += DECODE_BATCH_SIZE) {
+        const u32 records_left = training_data.record_count - first_record;
+        const u32 record_count = (records_left < DECODE_BATCH_SIZE) ? records_left : DECODE_BATCH_SIZE;
+
+        const f64 record_start = seconds_now();
+        decode_records(training_data, first_record, record_count, *record_batch);
+        const f64 column_start = seconds_now();
+        decode_columns(columnar_training_data, first_record, record_count, *column_batch);
+        const f64 column_end = seconds_now();
+        record_seconds += column_start - record_start;
+        column_seconds += column_end - column_start;
+
+        same = memcmp(record_batch->inputs, column_batch->inputs, record_count * sizeof(NeuralNetwork::InputLayer)) == 0 &&
+            memcmp(record_batch->targets, column_batch->targets, record_count * sizeof(NeuralNetwork::OutputLayer)) == 0;
+    }
+
+    if (!same) {
+        fprintf(stderr, "columnar file didn't decode to the same inputs as the records\n");
+        return 1;
+    }
+
+    if (!replace_whole_file(output_file_name, buffer, columnar_size)) {
+        fprintf(stderr, "couldn't write %s\n", output_file_name);
+        return 1;
+    }
+
+    printf("records: %u\n", training_data.record_count);
+    printf("blocks: %u\n", columnar_training_data.block_count);
+    printf("record bytes: %llu\n", static_cast<unsigned long long>(static_cast<u64>(training_data.record_count) * TRAINING_RECORD_SIZE));
+    printf("columnar bytes: %llu\n", static_cast<unsigned long long>(columnar_size));
+    printf("columnize seconds: %.3f\n", columnize_seconds);
+    printf("decode ns per record from records: %.1f\n", record_seconds * 1e9 / training_data.record_count);
+    printf("decode ns per record from columns: %.1f\n", column_seconds * 1e9 / training_data.record_count);
+    printf("written to: %s\n", output_file_name);
+
+    return 0;
+}
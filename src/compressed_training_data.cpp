@@ -0,0 +1,351 @@
+#include "compressed_training_data.h"
+#include "tetris.h"
+#include "util.h"
+
+static constexpr i8 COMPRESSED_TRAINING_DATA_MAGIC[] = {'T', 'A', 'I', 'D', 'E', 'L', 'T', 'A'};
+
+// Where each part of a record starts, see game_state_to_binary_game_state()
+static constexpr u32 LEVEL_AND_ROWS_CLEARED_OFFSET = 0;
+static constexpr u32 TETRIMINO_TYPES_OFFSET = 8;
+static constexpr u32 BLOCKS_OFFSET = 10;
+static constexpr u32 GRID_OFFSET = 18;
+static constexpr u32 PLAYER_INPUT_OFFSET = BINARY_GAME_STATE_SIZE;
+
+static_assert(GRID_OFFSET + Tetris::Grid::ROW_COUNT * sizeof(u16) == BINARY_GAME_STATE_SIZE);
+static_assert(Tetris::Grid::ROW_COUNT <= 24);
+
+static bool is_compressed_training_data(const i8* const data, const u64 size) {
+    return data != nullptr && size >= sizeof(CompressedTrainingDataHeader) &&
+        compare_bytes(data, COMPRESSED_TRAINING_DATA_MAGIC, sizeof(COMPRESSED_TRAINING_DATA_MAGIC)) == 0;
+}
+
+static u32 compressed_block_count(const u32 record_count, const u32 block_record_count) {
+    return static_cast<u32>((static_cast<u64>(record_count) + block_record_count - 1) / block_record_count);
+}
+
+static u64 max_compressed_training_data_size(const u32 record_count) {
+    const u64 block_count = compressed_block_count(record_count, COMPRESSED_BLOCK_RECORD_COUNT);
+    return sizeof(CompressedTrainingDataHeader) + block_count * (MAX_COMPRESSED_BLOCK_SIZE + sizeof(CompressedTrainingDataBlock)) + alignof(u64);
+}
+
+// Every block moved by the same small amount is how most ticks with the tetrimino falling or sliding look
+static bool blocks_moved_together(const i8* const previous_blocks, const i8* const blocks, i8& packed_move) {
+    const i32 x_move = static_cast<i8>(blocks[0] - previous_blocks[0]);
+    const i32 y_move = static_cast<i8>(blocks[1] - previous_blocks[1]);
+    if (x_move < -8 || x_move > 7 || y_move < -8 || y_move > 7) {
+        return false;
+    }
+
+    for (u32 block = 1; block < 4; ++block) {
+        const bool same_move =
+            static_cast<i8>(blocks[2 * block] - previous_blocks[2 * block]) == x_move &&
+            static_cast<i8>(blocks[2 * block + 1] - previous_blocks[2 * block + 1]) == y_move;
+        if (!same_move) {
+            return false;
+        }
+    }
+
+    packed_move = static_cast<i8>((x_move & 0x0F) | ((y_move & 0x0F) << 4));
+    return true;
+}
+
+static u32 write_repeat(const u32 repeat_count, i8* const buffer) {
+    u32 bytes_written = 0;
+    for (u32 repeats_left = repeat_count; repeats_left > 0;) {
+        const u32 run = (repeats_left < 128) ? repeats_left : 128;
+        buffer[bytes_written++] = static_cast<i8>(CompressedRecordChange::REPEAT | (run - 1));
+        repeats_left -= run;
+    }
+
+    return bytes_written;
+}
+
+// The buffer has to hold MAX_COMPRESSED_BLOCK_SIZE bytes, returns how many were used
+static u32 compress_training_data_block(const i8* const records, const u32 record_count, i8* const buffer) {
+    u32 bytes_written = copy_bytes(records, TRAINING_RECORD_SIZE, buffer);
+
+    u32 repeat_count = 0;
+    for (u32 i = 1; i < record_count; ++i) {
+        const i8* const previous = records + static_cast<u64>(i - 1) * TRAINING_RECORD_SIZE;
+        const i8* const record = previous + TRAINING_RECORD_SIZE;
+        if (compare_bytes(previous, record, TRAINING_RECORD_SIZE) == 0) {
+            ++repeat_count;
+            continue;
+        }
+
+        bytes_written += write_repeat(repeat_count, buffer + bytes_written);
+        repeat_count = 0;
+
+        i8* const op = buffer + bytes_written++;
+        u8 changes = 0;
+
+        if (compare_bytes(previous + LEVEL_AND_ROWS_CLEARED_OFFSET, record + LEVEL_AND_ROWS_CLEARED_OFFSET, 8) != 0) {
+            changes |= CompressedRecordChange::LEVEL_AND_ROWS_CLEARED;
+            bytes_written += copy_bytes(record + LEVEL_AND_ROWS_CLEARED_OFFSET, 8, buffer + bytes_written);
+        }
+
+        if (compare_bytes(previous + TETRIMINO_TYPES_OFFSET, record + TETRIMINO_TYPES_OFFSET, 2) != 0) {
+            changes |= CompressedRecordChange::TETRIMINO_TYPES;
+            bytes_written += copy_bytes(record + TETRIMINO_TYPES_OFFSET, 2, buffer + bytes_written);
+        }
+
+        if (compare_bytes(previous + BLOCKS_OFFSET, record + BLOCKS_OFFSET, 8) != 0) {
+            i8 packed_move = 0;
+            if (blocks_moved_together(previous + BLOCKS_OFFSET, record + BLOCKS_OFFSET, packed_move)) {
+                changes |= CompressedRecordChange::BLOCKS_MOVED;
+                buffer[bytes_written++] = packed_move;
+            } else {
+                changes |= CompressedRecordChange::BLOCKS;
+                bytes_written += copy_bytes(record + BLOCKS_OFFSET, 8, buffer + bytes_written);
+            }
+        }
+
+        u32 changed_rows = 0;
+        for (i32 row = 0; row < Tetris::Grid::ROW_COUNT; ++row) {
+            const u32 row_offset = GRID_OFFSET + row * sizeof(u16);
+            changed_rows |= static_cast<u32>(compare_bytes(previous + row_offset, record + row_offset, sizeof(u16)) != 0) << row;
+        }
+
+        if (changed_rows != 0) {
+            changes |= CompressedRecordChange::GRID_ROWS;
+            buffer[bytes_written++] = static_cast<i8>(changed_rows);
+            buffer[bytes_written++] = static_cast<i8>(changed_rows >> 8);
+            buffer[bytes_written++] = static_cast<i8>(changed_rows >> 16);
+            for (i32 row = 0; row < Tetris::Grid::ROW_COUNT; ++row) {
+                if ((changed_rows & (1u << row)) != 0) {
+                    bytes_written += copy_bytes(record + GRID_OFFSET + row * sizeof(u16), sizeof(u16), buffer + bytes_written);
+                }
+            }
+        }
+
+        if (compare_bytes(previous + PLAYER_INPUT_OFFSET, record + PLAYER_INPUT_OFFSET, sizeof(BinaryPlayerInput)) != 0) {
+            changes |= CompressedRecordChange::PLAYER_INPUT;
+            bytes_written += copy_bytes(record + PLAYER_INPUT_OFFSET, sizeof(BinaryPlayerInput), buffer + bytes_written);
+        }
+
+        *op = static_cast<i8>(changes);
+    }
+
+    bytes_written += write_repeat(repeat_count, buffer + bytes_written);
+
+    return bytes_written;
+}
+
+// Returns the compressed size, the buffer has to hold max_compressed_training_data_size() bytes
+static u64 compress_training_data(const TrainingDataView& training_data, i8* const buffer, const u64 buffer_size) {
+    if (buffer_size < max_compressed_training_data_size(training_data.record_count)) {
+        return 0;
+    }
+
+    CompressedTrainingDataHeader header = {};
+    copy_bytes(COMPRESSED_TRAINING_DATA_MAGIC, sizeof(COMPRESSED_TRAINING_DATA_MAGIC), header.magic);
+    header.version = COMPRESSED_TRAINING_DATA_VERSION;
+    header.record_count = training_data.record_count;
+    header.block_count = compressed_block_count(training_data.record_count, COMPRESSED_BLOCK_RECORD_COUNT);
+    header.block_record_count = COMPRESSED_BLOCK_RECORD_COUNT;
+
+    // the index can only be written once every block's size is known, so it goes on the end
+    u64 bytes_written = sizeof(header);
+    CompressedTrainingDataBlock* const index = reinterpret_cast<CompressedTrainingDataBlock*>(
+        buffer + buffer_size - header.block_count * sizeof(CompressedTrainingDataBlock)
+    );
+    for (u32 block_index = 0; block_index < header.block_count; ++block_index) {
+        const u32 first_record = block_index * COMPRESSED_BLOCK_RECORD_COUNT;
+        const u32 records_left = training_data.record_count - first_record;
+
+        CompressedTrainingDataBlock block = {};
+        block.offset = bytes_written;
+        block.record_count = (records_left < COMPRESSED_BLOCK_RECORD_COUNT) ? records_left : COMPRESSED_BLOCK_RECORD_COUNT;
+        block.size = compress_training_data_block(training_record(training_data, first_record), block.record_count, buffer + bytes_written);
+        copy_bytes(reinterpret_cast<const i8*>(&block), sizeof(block), reinterpret_cast<i8*>(index + block_index));
+        bytes_written += block.size;
+    }
+
+    header.index_offset = (bytes_written + alignof(u64) - 1) / alignof(u64) * alignof(u64);
+    for (u64 i = bytes_written; i < header.index_offset; ++i) {
+        buffer[i] = 0;
+    }
+
+    const u64 index_size = header.block_count * sizeof(CompressedTrainingDataBlock);
+    for (u64 i = 0; i < index_size; ++i) {
+        buffer[header.index_offset + i] = reinterpret_cast<const i8*>(index)[i];
+    }
+
+    copy_bytes(reinterpret_cast<const i8*>(&header), sizeof(header), buffer);
+
+    return header.index_offset + index_size;
+}
+
+static CompressedTrainingDataBlock compressed_training_data_block(const CompressedTrainingDataView& view, const u32 block_index) {
+    CompressedTrainingDataBlock block = {};
+    const i8* const entry = view.data + view.header.index_offset + static_cast<u64>(block_index) * sizeof(block);
+    copy_bytes(entry, sizeof(block), reinterpret_cast<i8*>(&block));
+
+    return block;
+}
+
+// Checks the header and that the index covers every record with blocks inside the file, not the blocks themselves
+static bool view_compressed_training_data(const i8* const data, const u64 size, CompressedTrainingDataView& view) {
+    view = {};
+    if (!is_compressed_training_data(data, size)) {
+        return false;
+    }
+
+    CompressedTrainingDataHeader header = {};
+    copy_bytes(data, sizeof(header), reinterpret_cast<i8*>(&header));
+    const bool valid_header = header.version == COMPRESSED_TRAINING_DATA_VERSION &&
+        header.block_record_count > 0 &&
+        header.record_count > 0 &&
+        header.block_count == compressed_block_count(header.record_count, header.block_record_count) &&
+        header.index_offset >= sizeof(header) &&
+        header.index_offset <= size &&
+        (size - header.index_offset) / sizeof(CompressedTrainingDataBlock) >= header.block_count;
+    if (!valid_header) {
+        return false;
+    }
+
+    view.data = data;
+    view.size = size;
+    view.header = header;
+
+    u64 record_count = 0;
+    for (u32 block_index = 0; block_index < header.block_count; ++block_index) {
+        const CompressedTrainingDataBlock block = compressed_training_data_block(view, block_index);
+        const u32 expected_record_count = (block_index + 1 < header.block_count) ? header.block_record_count : header.record_count - static_cast<u32>(record_count);
+        const bool valid_block = block.offset >= sizeof(header) &&
+            block.offset <= header.index_offset &&
+            block.size <= header.index_offset - block.offset &&
+            block.record_count == expected_record_count;
+        if (!valid_block) {
+            view = {};
+            return false;
+        }
+
+        record_count += block.record_count;
+    }
+
+    return true;
+}
+
+// records has to have room for record_count records. False if the block doesn't decode to exactly that many,
+// which is as far as a damaged block can be caught without a checksum.
+static bool decompress_training_data_block(const i8* const block, const u32 block_size, const u32 record_count, i8* const records) {
+    if (record_count == 0 || block_size < TRAINING_RECORD_SIZE) {
+        return false;
+    }
+
+    u32 bytes_read = copy_bytes(block, TRAINING_RECORD_SIZE, records);
+    u32 decoded_count = 1;
+    while (decoded_count < record_count && bytes_read < block_size) {
+        const u8 op = static_cast<u8>(block[bytes_read++]);
+        const i8* const previous = records + static_cast<u64>(decoded_count - 1) * TRAINING_RECORD_SIZE;
+        i8* const record = records + static_cast<u64>(decoded_count) * TRAINING_RECORD_SIZE;
+
+        if ((op & CompressedRecordChange::REPEAT) != 0) {
+            const u32 run = (op & 0x7F) + 1u;
+            if (run > record_count - decoded_count) {
+                return false;
+            }
+
+            for (u32 i = 0; i < run; ++i) {
+                copy_bytes(previous, TRAINING_RECORD_SIZE, record + i * TRAINING_RECORD_SIZE);
+            }
+
+            decoded_count += run;
+            continue;
+        }
+
+        // no op's changes can take up more than a compressed record (even with both kinds of block change set),
+        // so only ops near the end of the block need checking part by part
+        const bool room_for_anything = block_size - bytes_read >= MAX_COMPRESSED_RECORD_SIZE;
+        copy_bytes(previous, TRAINING_RECORD_SIZE, record);
+
+        if ((op & CompressedRecordChange::LEVEL_AND_ROWS_CLEARED) != 0) {
+            if (!room_for_anything && block_size - bytes_read < 8) {
+                return false;
+            }
+
+            bytes_read += copy_bytes(block + bytes_read, 8, record + LEVEL_AND_ROWS_CLEARED_OFFSET);
+        }
+
+        if ((op & CompressedRecordChange::TETRIMINO_TYPES) != 0) {
+            if (!room_for_anything && block_size - bytes_read < 2) {
+                return false;
+            }
+
+            bytes_read += copy_bytes(block + bytes_read, 2, record + TETRIMINO_TYPES_OFFSET);
+        }
+
+        if ((op & CompressedRecordChange::BLOCKS_MOVED) != 0) {
+            if (!room_for_anything && block_size - bytes_read < 1) {
+                return false;
+            }
+
+            // sign extend each nibble
+            const u8 packed_move = static_cast<u8>(block[bytes_read++]);
+            const i8 x_move = static_cast<i8>(((packed_move & 0x0F) ^ 0x08) - 0x08);
+            const i8 y_move = static_cast<i8>(((packed_move >> 4) ^ 0x08) - 0x08);
+            for (u32 i = 0; i < 4; ++i) {
+                record[BLOCKS_OFFSET + 2 * i] = static_cast<i8>(record[BLOCKS_OFFSET + 2 * i] + x_move);
+                record[BLOCKS_OFFSET + 2 * i + 1] = static_cast<i8>(record[BLOCKS_OFFSET + 2 * i + 1] + y_move);
+            }
+        }
+
+        if ((op & CompressedRecordChange::BLOCKS) != 0) {
+            if (!room_for_anything && block_size - bytes_read < 8) {
+                return false;
+            }
+
+            bytes_read += copy_bytes(block + bytes_read, 8, record + BLOCKS_OFFSET);
+        }
+
+        if ((op & CompressedRecordChange::GRID_ROWS) != 0) {
+            if (!room_for_anything && block_size - bytes_read < 3) {
+                return false;
+            }
+
+            const u32 changed_rows =
+                static_cast<u32>(static_cast<u8>(block[bytes_read])) |
+                (static_cast<u32>(static_cast<u8>(block[bytes_read + 1])) << 8) |
+                (static_cast<u32>(static_cast<u8>(block[bytes_read + 2])) << 16);
+            bytes_read += 3;
+
+            for (i32 row = 0; row < Tetris::Grid::ROW_COUNT; ++row) {
+                if ((changed_rows & (1u << row)) == 0) {
+                    continue;
+                }
+
+                if (!room_for_anything && block_size - bytes_read < sizeof(u16)) {
+                    return false;
+                }
+
+                bytes_read += copy_bytes(block + bytes_read, sizeof(u16), record + GRID_OFFSET + row * sizeof(u16));
+            }
+        }
+
+        if ((op & CompressedRecordChange::PLAYER_INPUT) != 0) {
+            if (!room_for_anything && block_size - bytes_read < sizeof(BinaryPlayerInput)) {
+                return false;
+            }
+
+            bytes_read += copy_bytes(block + bytes_read, sizeof(BinaryPlayerInput), record + PLAYER_INPUT_OFFSET);
+        }
+
+        ++decoded_count;
+    }
+
+    return decoded_count == record_count && bytes_read == block_size;
+}
+
+// records has to have room for every record in the file
+static bool decompress_training_data(const CompressedTrainingDataView& view, i8* const records) {
+    for (u32 block_index = 0; block_index < view.header.block_count; ++block_index) {
+        const CompressedTrainingDataBlock block = compressed_training_data_block(view, block_index);
+        i8* const block_records = records + static_cast<u64>(block_index) * view.header.block_record_count * TRAINING_RECORD_SIZE;
+        if (!decompress_training_data_block(view.data + block.offset, block.size, block.record_count, block_records)) {
+            return false;
+        }
+    }
+
+    return true;
+}
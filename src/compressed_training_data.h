@@ -0,0 +1,63 @@
+#ifndef COMPRESSED_TRAINING_DATA_H
+#define COMPRESSED_TRAINING_DATA_H
+
+#include "training_data.h"
+#include "types.h"
+
+// Compressed training data layout (all offsets from start of file):
+//  - CompressedTrainingDataHeader
+//  - blocks, each a whole keyframe record followed by one op per record after it
+//  - CompressedTrainingDataBlock[block_count], the block index
+// Every block bar the last holds block_record_count records and decodes on its own, so finding a record's
+// block is a division and a lookup.
+//
+// An op starts with a byte. With the top bit set it repeats the record before it (low 7 bits + 1) times,
+// otherwise it's a mask of the parts that changed and their new values follow in mask bit order.
+struct CompressedTrainingDataHeader {
+    i8 magic[8];
+    u32 version;
+    u32 record_count;
+    u32 block_count;
+    u32 block_record_count;
+    u64 index_offset;
+};
+
+struct CompressedTrainingDataBlock {
+    u64 offset;
+    u32 size;
+    u32 record_count;
+};
+
+static_assert(sizeof(CompressedTrainingDataHeader) == 32);
+static_assert(sizeof(CompressedTrainingDataBlock) == 16);
+
+enum CompressedRecordChange : u8 {
+    LEVEL_AND_ROWS_CLEARED = 0x01,  // 8 bytes as recorded
+    TETRIMINO_TYPES = 0x02,         // next and current, 1 byte each
+    BLOCKS_MOVED = 0x04,            // 1 byte, every block moved by the same x (low nibble) and y (high nibble)
+    BLOCKS = 0x08,                  // 8 bytes, block coordinates as recorded
+    GRID_ROWS = 0x10,               // 3 byte mask of the rows that changed, then each of those rows
+    PLAYER_INPUT = 0x20,            // 2 bytes
+    REPEAT = 0x80
+};
+
+static constexpr u32 COMPRESSED_TRAINING_DATA_VERSION = 1;
+static constexpr u32 COMPRESSED_BLOCK_RECORD_COUNT = 4096;
+static constexpr u32 MAX_COMPRESSED_RECORD_SIZE = 1 + 3 + TRAINING_RECORD_SIZE;   // op, row mask and every part changed
+static constexpr u32 MAX_COMPRESSED_BLOCK_SIZE = TRAINING_RECORD_SIZE + (COMPRESSED_BLOCK_RECORD_COUNT - 1) * MAX_COMPRESSED_RECORD_SIZE;
+
+struct CompressedTrainingDataView {
+    const i8* data;
+    u64 size;
+    CompressedTrainingDataHeader header;
+};
+
+static bool is_compressed_training_data(const i8* data, u64 size);
+static u64 max_compressed_training_data_size(u32 record_count);
+static u64 compress_training_data(const TrainingDataView& training_data, i8* buffer, u64 buffer_size);
+static bool view_compressed_training_data(const i8* data, u64 size, CompressedTrainingDataView& view);
+static CompressedTrainingDataBlock compressed_training_data_block(const CompressedTrainingDataView& view, u32 block_index);
+static bool decompress_training_data_block(const i8* block, u32 block_size, u32 record_count, i8* records);
+static bool decompress_training_data(const CompressedTrainingDataView& view, i8* records);
+
+#endif
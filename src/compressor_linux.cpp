@@ -0,0 +1,153 @@
+// Converts the game's recorded training data to the block compressed format and back. Compressing checks the
+// file decodes back to the same records and reports the ratio, along with how fast blocks decode next to how
+// fast one process trains, since decoding has to keep ahead of the trainer.
+//
+// Usage: compressor [--training-data FILE] [--output FILE] [--decompress]
+// With --decompress the training data file is the compressed one and the output is plain records.
+
+#include "neural_network.h"
+#include "kernel_tuning.h"
+#include "convolutional_neural_network.h"
+#include "training_data.h"
+#include "compressed_training_data.h"
+
+#include "util.cpp"
+#include "simd.cpp"
+#include "neural_network.cpp"
+#include "kernel_tuning.cpp"
+#include "convolutional_neural_network.cpp"
+#include "training_data.cpp"
+#include "compressed_training_data.cpp"
+#include "tools_linux.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Records per second through one process's back propagation, the rate decoding is measured against
+static f64 time_training(const TrainingDataView& training_data) {
+    static constexpr u32 MAX_TIMED_RECORD_COUNT = 20000;
+
+    NeuralNetwork* const neural_network = static_cast<NeuralNetwork*>(aligned_alloc(alignof(NeuralNetwork), sizeof(NeuralNetwork)));
+    PackedNeuralNetwork* const packed_neural_network = static_cast<PackedNeuralNetwork*>(aligned_alloc(alignof(PackedNeuralNetwork), sizeof(PackedNeuralNetwork)));
+    PackedNeuralNetworkDelta* const neural_network_delta = static_cast<PackedNeuralNetworkDelta*>(aligned_alloc(alignof(PackedNeuralNetworkDelta), sizeof(PackedNeuralNetworkDelta)));
+    *neural_network = random_neural_network(1);
+    invalidate_packed_neural_network(*packed_neural_network);
+    memset(neural_network_delta, 0, sizeof(PackedNeuralNetworkDelta));
+
+    const u32 record_count = (training_data.record_count < MAX_TIMED_RECORD_COUNT) ? training_data.record_count : MAX_TIMED_RECORD_COUNT;
+    const f64 start = seconds_now();
+    accumulate_training_delta(pack_neural_network(*neural_network, *packed_neural_network), training_data.records, 0, record_count, *neural_network_delta);
+    const f64 seconds = seconds_now() - start;
+
+    free(neural_network_delta);
+    free(packed_neural_network);
+    free(neural_network);
+
+    return static_cast<f64>(record_count) / seconds;
+}
+
+static int decompress(const char* const input_file_name, const char* const output_file_name) {
+    u64 input_size = 0;
+    const i8* const input = static_cast<const i8*>(map_whole_file(input_file_name, MADV_SEQUENTIAL, input_size));
+    CompressedTrainingDataView compressed_training_data = {};
+    if (!view_compressed_training_data(input, input_size, compressed_training_data)) {
+        fprintf(stderr, "%s isn't compressed training data\n", input_file_name);
+        return 1;
+    }
+
+    const u64 records_size = static_cast<u64>(compressed_training_data.header.record_count) * TRAINING_RECORD_SIZE;
+    i8* const records = static_cast<i8*>(malloc(records_size));
+    if (!decompress_training_data(compressed_training_data, records)) {
+        fprintf(stderr, "%s is damaged\n", input_file_name);
+        return 1;
+    }
+
+    FILE* const output = fopen(output_file_name, "wb");
+    const bool written = output != nullptr && fwrite(records, 1, records_size, output) == records_size;
+    if (output == nullptr || fclose(output) != 0 || !written) {
+        fprintf(stderr, "couldn't write %s\n", output_file_name);
+        return 1;
+    }
+
+    printf("records: %u\n", compressed_training_data.header.record_count);
+    printf("written to: %s\n", output_file_name);
+
+    return 0;
+}
+
+int main(const int argc, const char* const* const argv) {
+    const char* training_data_file_name = "training_data_manifest.bin";
+    const char* output_file_name = nullptr;
+    bool decompressing = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--training-data") == 0 && i + 1 < argc) {
+            training_data_file_name = argv[++i];
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output_file_name = argv[++i];
+        } else if (strcmp(argv[i], "--decompress") == 0) {
+            decompressing = true;
+        } else {
+            fprintf(stderr, "usage: %s [--training-data FILE] [--output FILE] [--decompress]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (decompressing) {
+        return decompress(training_data_file_name, (output_file_name != nullptr) ? output_file_name : "training_data_decompressed.bin");
+    }
+
+    output_file_name = (output_file_name != nullptr) ? output_file_name : "training_data_compressed.bin";
+
+    TrainingDataView training_data = {};
+    if (!load_training_data(training_data_file_name, MADV_SEQUENTIAL, training_data)) {
+        return 1;
+    }
+
+    const u64 buffer_size = max_compressed_training_data_size(training_data.record_count);
+    i8* const buffer = static_cast<i8*>(malloc(buffer_size));
+    const f64 compress_start = seconds_now();
+    const u64 compressed_size = compress_training_data(training_data, buffer, buffer_size);
+    const f64 compress_seconds = seconds_now() - compress_start;
+
+    // decode every block a few times over and keep the quickest pass
+    static constexpr u32 DECODE_PASS_COUNT = 5;
+    const u64 records_size = static_cast<u64>(training_data.record_count) * TRAINING_RECORD_SIZE;
+    i8* const decoded_records = static_cast<i8*>(malloc(records_size));
+    CompressedTrainingDataView compressed_training_data = {};
+    bool round_trip = view_compressed_training_data(buffer, compressed_size, compressed_training_data);
+    f64 decode_seconds = 1e30;
+    for (u32 pass = 0; pass < DECODE_PASS_COUNT && round_trip; ++pass) {
+        const f64 start = seconds_now();
+        round_trip = decompress_training_data(compressed_training_data, decoded_records);
+        const f64 seconds = seconds_now() - start;
+        decode_seconds = (seconds < decode_seconds) ? seconds : decode_seconds;
+    }
+
+    round_trip = round_trip && memcmp(decoded_records, training_data.records, records_size) == 0;
+    if (!round_trip) {
+        fprintf(stderr, "compressed records didn't decode back to the originals\n");
+        return 1;
+    }
+
+    if (!replace_whole_file(output_file_name, buffer, compressed_size)) {
+        fprintf(stderr, "couldn't write %s\n", output_file_name);
+        return 1;
+    }
+
+    const f64 decoded_records_per_second = static_cast<f64>(training_data.record_count) / decode_seconds;
+    const f64 trained_records_per_second = time_training(training_data);
+    printf("records: %u\n", training_data.record_count);
+    printf("blocks: %u\n", compressed_training_data.header.block_count);
+    printf("uncompressed bytes: %llu\n", static_cast<unsigned long long>(records_size));
+    printf("compressed bytes: %llu\n", static_cast<unsigned long long>(compressed_size));
+    printf("compression ratio: %.2f\n", static_cast<f64>(records_size) / static_cast<f64>(compressed_size));
+    printf("compress MB/s: %.0f\n", static_cast<f64>(records_size) / compress_seconds / 1e6);
+    printf("decompress MB/s: %.0f\n", static_cast<f64>(records_size) / decode_seconds / 1e6);
+    printf("decompressed records per second: %.0f\n", decoded_records_per_second);
+    printf("trained records per second (one process): %.0f\n", trained_records_per_second);
+    printf("decode headroom: %.1fx\n", decoded_records_per_second / trained_records_per_second);
+    printf("written to: %s\n", output_file_name);
+
+    return 0;
+}
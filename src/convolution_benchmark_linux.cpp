@@ -0,0 +1,226 @@
+// Compares the convolutional network against the dense one on the same data. Both are trained from random
+// weights with the same full batch training the game does, then scored on held out records and timed.
+//
+// Usage: convolution_benchmark [--epochs N] [--seed N] [--training-data FILE] [--held-out FRACTION]
+// Held out records are the last FRACTION of the training data, the rest is trained on.
+
+#include "neural_network.h"
+#include "kernel_tuning.h"
+#include "convolutional_neural_network.h"
+#include "training_data.h"
+
+#include "util.cpp"
+#include "simd.cpp"
+#include "neural_network.cpp"
+#include "kernel_tuning.cpp"
+#include "convolutional_neural_network.cpp"
+#include "training_data.cpp"
+#include "tools_linux.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct HeldOutRecords {
+    NeuralNetwork::InputLayer* dense_inputs;
+    ConvolutionalInput* convolutional_inputs;
+    NeuralNetwork::OutputLayer* targets;
+    u32 count;
+};
+
+struct BenchmarkResult {
+    u32 parameter_count;
+    u32 multiply_add_count;
+    f64 training_seconds;
+    f64 nanoseconds_per_inference;
+    Evaluation evaluation;
+};
+
+static volatile f32 sink;
+
+static BenchmarkResult benchmark_dense(const i8* const training_data, const u32 training_record_count, const HeldOutRecords& records, const u32 epoch_count, const u32 rng_seed) {
+    BenchmarkResult result = {};
+    result.parameter_count = LEGACY_NEURAL_NETWORK_SIZE / sizeof(f32);
+    result.multiply_add_count = NeuralNetwork::INPUT_LAYER_SIZE * NeuralNetwork::HIDDEN_LAYER_SIZE + NeuralNetwork::HIDDEN_LAYER_SIZE * NeuralNetwork::OUTPUT_LAYER_SIZE;
+
+    NeuralNetwork* const neural_network = static_cast<NeuralNetwork*>(aligned_alloc(alignof(NeuralNetwork), sizeof(NeuralNetwork)));
+    PackedNeuralNetwork* const packed_neural_network = static_cast<PackedNeuralNetwork*>(aligned_alloc(alignof(PackedNeuralNetwork), sizeof(PackedNeuralNetwork)));
+    PackedNeuralNetworkDelta* const neural_network_delta = static_cast<PackedNeuralNetworkDelta*>(aligned_alloc(alignof(PackedNeuralNetworkDelta), sizeof(PackedNeuralNetworkDelta)));
+    *neural_network = random_neural_network(rng_seed);
+    invalidate_packed_neural_network(*packed_neural_network);
+
+    const f64 start = seconds_now();
+    for (u32 epoch = 0; epoch < epoch_count; ++epoch) {
+        memset(neural_network_delta, 0, sizeof(PackedNeuralNetworkDelta));
+        accumulate_training_delta(pack_neural_network(*neural_network, *packed_neural_network), training_data, 0, training_record_count, *neural_network_delta);
+        apply_delta(*neural_network, *neural_network_delta, LEARNING_RATE / static_cast<f32>(training_record_count));
+        invalidate_packed_neural_network(*packed_neural_network);
+    }
+
+    result.training_seconds = seconds_now() - start;
+
+    const PackedNeuralNetwork& trained_neural_network = pack_neural_network(*neural_network, *packed_neural_network);
+    for (u32 record = 0; record < records.count; ++record) {
+        NeuralNetwork::OutputLayer output = {};
+        feed_forward(trained_neural_network, records.dense_inputs[record], output);
+        add_to_evaluation(output, records.targets[record], result.evaluation);
+    }
+
+    finish_evaluation(result.evaluation, records.count);
+
+    u64 inference_count = 0;
+    const f64 timing_start = seconds_now();
+    f64 elapsed = 0.0;
+    while (elapsed < 0.2) {
+        for (u32 record = 0; record < records.count; ++record) {
+            NeuralNetwork::OutputLayer output = {};
+            feed_forward(trained_neural_network, records.dense_inputs[record], output);
+            sink = output[0];
+        }
+
+        inference_count += records.count;
+        elapsed = seconds_now() - timing_start;
+    }
+
+    result.nanoseconds_per_inference = elapsed / static_cast<f64>(inference_count) * 1e9;
+
+    free(neural_network_delta);
+    free(packed_neural_network);
+    free(neural_network);
+
+    return result;
+}
+
+static BenchmarkResult benchmark_convolutional(const i8* const training_data, const u32 training_record_count, const HeldOutRecords& records, const u32 epoch_count, const u32 rng_seed) {
+    static constexpr u32 KERNEL_TAP_COUNT = ConvolutionalNeuralNetwork::KERNEL_SIZE * ConvolutionalNeuralNetwork::KERNEL_SIZE;
+
+    BenchmarkResult result = {};
+    result.parameter_count =
+        ConvolutionalNeuralNetwork::GRID_CHANNEL_COUNT * (KERNEL_TAP_COUNT + 1) +
+        ConvolutionalNeuralNetwork::ROW_CHANNEL_COUNT * (ConvolutionalNeuralNetwork::GRID_CHANNEL_COUNT * ConvolutionalNeuralNetwork::COLUMN_COUNT + 1) +
+        (ConvolutionalNeuralNetwork::HEAD_INPUT_SIZE + 1) * ConvolutionalNeuralNetwork::HIDDEN_LAYER_SIZE +
+        (ConvolutionalNeuralNetwork::HIDDEN_LAYER_SIZE + 1) * NeuralNetwork::OUTPUT_LAYER_SIZE;
+    result.multiply_add_count = convolutional_neural_network_multiply_add_count();
+
+    ConvolutionalNeuralNetwork* const neural_network = static_cast<ConvolutionalNeuralNetwork*>(aligned_alloc(alignof(ConvolutionalNeuralNetwork), sizeof(ConvolutionalNeuralNetwork)));
+    ConvolutionalNeuralNetwork* const neural_network_delta = static_cast<ConvolutionalNeuralNetwork*>(aligned_alloc(alignof(ConvolutionalNeuralNetwork), sizeof(ConvolutionalNeuralNetwork)));
+    *neural_network = random_convolutional_neural_network(rng_seed);
+
+    const f64 start = seconds_now();
+    for (u32 epoch = 0; epoch < epoch_count; ++epoch) {
+        memset(neural_network_delta, 0, sizeof(ConvolutionalNeuralNetwork));
+        accumulate_training_delta(*neural_network, training_data, 0, training_record_count, *neural_network_delta);
+        apply_delta(*neural_network, *neural_network_delta, LEARNING_RATE / static_cast<f32>(training_record_count));
+    }
+
+    result.training_seconds = seconds_now() - start;
+
+    for (u32 record = 0; record < records.count; ++record) {
+        NeuralNetwork::OutputLayer output = {};
+        feed_forward(*neural_network, records.convolutional_inputs[record], output);
+        add_to_evaluation(output, records.targets[record], result.evaluation);
+    }
+
+    finish_evaluation(result.evaluation, records.count);
+
+    u64 inference_count = 0;
+    const f64 timing_start = seconds_now();
+    f64 elapsed = 0.0;
+    while (elapsed < 0.2) {
+        for (u32 record = 0; record < records.count; ++record) {
+            NeuralNetwork::OutputLayer output = {};
+            feed_forward(*neural_network, records.convolutional_inputs[record], output);
+            sink = output[0];
+        }
+
+        inference_count += records.count;
+        elapsed = seconds_now() - timing_start;
+    }
+
+    result.nanoseconds_per_inference = elapsed / static_cast<f64>(inference_count) * 1e9;
+
+    free(neural_network_delta);
+    free(neural_network);
+
+    return result;
+}
+
+static void print_benchmark_result(const char* const name, const BenchmarkResult& result) {
+    printf("%s parameters: %u\n", name, result.parameter_count);
+    printf("%s multiply-adds per inference: %u\n", name, result.multiply_add_count);
+    printf("%s training seconds: %.3f\n", name, result.training_seconds);
+    printf("%s ns per inference: %.1f\n", name, result.nanoseconds_per_inference);
+    print_evaluation(name, result.evaluation);
+}
+
+int main(const int argc, const char* const* const argv) {
+    u32 epoch_count = 100;
+    u32 rng_seed = 1;
+    f32 held_out_fraction = 0.1f;
+    const char* training_data_file_name = "training_data_manifest.bin";
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--epochs") == 0 && i + 1 < argc) {
+            epoch_count = static_cast<u32>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            rng_seed = static_cast<u32>(strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--training-data") == 0 && i + 1 < argc) {
+            training_data_file_name = argv[++i];
+        } else if (strcmp(argv[i], "--held-out") == 0 && i + 1 < argc) {
+            held_out_fraction = static_cast<f32>(atof(argv[++i]));
+        } else {
+            held_out_fraction = -1.0f;
+            break;
+        }
+    }
+
+    if (held_out_fraction <= 0.0f || held_out_fraction >= 1.0f) {
+        fprintf(stderr, "usage: %s [--epochs N] [--seed N] [--training-data FILE] [--held-out FRACTION]\n", argv[0]);
+        fprintf(stderr, "the held out fraction is between 0 and 1\n");
+        return 1;
+    }
+
+    // both networks train over the records in file order every epoch
+    TrainingDataView training_data = {};
+    if (!load_training_data(training_data_file_name, MADV_SEQUENTIAL, training_data)) {
+        return 1;
+    }
+
+    if (training_data.record_count < 2) {
+        fprintf(stderr, "not enough training records in %s\n", training_data_file_name);
+        return 1;
+    }
+
+    HeldOutRecords records = {};
+    records.count = static_cast<u32>(static_cast<f64>(training_data.record_count) * held_out_fraction);
+    records.count = (records.count == 0) ? 1 : records.count;
+    records.dense_inputs = static_cast<NeuralNetwork::InputLayer*>(malloc(records.count * sizeof(NeuralNetwork::InputLayer)));
+    records.convolutional_inputs = static_cast<ConvolutionalInput*>(aligned_alloc(alignof(ConvolutionalInput), records.count * sizeof(ConvolutionalInput)));
+    records.targets = static_cast<NeuralNetwork::OutputLayer*>(malloc(records.count * sizeof(NeuralNetwork::OutputLayer)));
+    const u32 training_record_count = training_data.record_count - records.count;
+    for (u32 i = 0; i < records.count; ++i) {
+        const i8* const record = training_record(training_data, training_record_count + i);
+
+        BinaryGameState binary_game_state = {};
+        copy_bytes(record, sizeof(binary_game_state), reinterpret_cast<i8*>(binary_game_state));
+        binary_game_state_to_neural_network_input(binary_game_state, records.dense_inputs[i]);
+        binary_game_state_to_convolutional_input(binary_game_state, records.convolutional_inputs[i]);
+
+        BinaryPlayerInput encoded_player_input = 0;
+        copy_bytes(record + sizeof(binary_game_state), sizeof(encoded_player_input), reinterpret_cast<i8*>(&encoded_player_input));
+        binary_player_input_to_neural_network_output(encoded_player_input, records.targets[i]);
+    }
+
+    const BenchmarkResult dense_result = benchmark_dense(training_data.records, training_record_count, records, epoch_count, rng_seed);
+    const BenchmarkResult convolutional_result = benchmark_convolutional(training_data.records, training_record_count, records, epoch_count, rng_seed);
+
+    printf("training records: %u\n", training_record_count);
+    printf("held out records: %u\n", records.count);
+    printf("epochs: %u\n", epoch_count);
+    print_benchmark_result("dense", dense_result);
+    print_benchmark_result("convolutional", convolutional_result);
+    printf("output accuracy change: %+.4f\n", convolutional_result.evaluation.output_accuracy - dense_result.evaluation.output_accuracy);
+    printf("multiply-add ratio: %.2f\n", static_cast<f64>(convolutional_result.multiply_add_count) / dense_result.multiply_add_count);
+    printf("speedup: %.2f\n", dense_result.nanoseconds_per_inference / convolutional_result.nanoseconds_per_inference);
+
+    return 0;
+}
@@ -0,0 +1,532 @@
+#include "convolutional_neural_network.h"
+#include "simd.h"
+#include "util.h"
+
+static_assert(ConvolutionalNeuralNetwork::ROW_WIDTH == 16, "rows are two AVX2 registers");
+static_assert(ConvolutionalNeuralNetwork::COLUMN_COUNT < ConvolutionalNeuralNetwork::ROW_WIDTH, "right hand padding column reads zero");
+static_assert(NeuralNetwork::INPUT_LAYER_SIZE == ConvolutionalNeuralNetwork::FEATURE_COUNT + ConvolutionalNeuralNetwork::ROW_COUNT * ConvolutionalNeuralNetwork::COLUMN_COUNT);
+
+// Multiplied into the grid channels after the ReLU, keeps the columns past the edge of the grid at zero
+alignas(64) static constexpr f32 CONVOLUTION_COLUMN_MASK[ConvolutionalNeuralNetwork::ROW_WIDTH] = {
+    1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f
+};
+
+// Everything back propagation needs from the forward pass. Head inputs are the features followed by the row
+// values row by row, i.e. channel c of row r is head_inputs[FEATURE_COUNT + r * ROW_CHANNEL_COUNT + c].
+struct ConvolutionalActivations {
+    alignas(64) f32 grid_channels[ConvolutionalNeuralNetwork::GRID_CHANNEL_COUNT][ConvolutionalNeuralNetwork::ROW_COUNT][ConvolutionalNeuralNetwork::ROW_WIDTH];
+    alignas(64) f32 head_inputs[ConvolutionalNeuralNetwork::HEAD_INPUT_SIZE];
+    alignas(64) f32 hidden_activations[ConvolutionalNeuralNetwork::HIDDEN_LAYER_SIZE];
+    alignas(64) f32 output_activations[ConvolutionalNeuralNetwork::OUTPUT_WIDTH];
+};
+
+// Same distribution as random_neural_network() uses
+static f32 random_weight(u32& rng_seed) {
+    rng_seed = random_number(rng_seed);
+    const f32 random_numerator = static_cast<f32>(rng_seed % 1000);
+    return random_numerator / 500.0f - 1.0f;
+}
+
+// The padding columns of the row kernels and padding outputs stay zero
+static ConvolutionalNeuralNetwork random_convolutional_neural_network(u32 rng_seed) {
+    ConvolutionalNeuralNetwork neural_network = {};
+
+    for (i32 channel = 0; channel < ConvolutionalNeuralNetwork::GRID_CHANNEL_COUNT; ++channel) {
+        for (i32 dy = 0; dy < ConvolutionalNeuralNetwork::KERNEL_SIZE; ++dy) {
+            for (i32 dx = 0; dx < ConvolutionalNeuralNetwork::KERNEL_SIZE; ++dx) {
+                neural_network.grid_kernels[channel][dy][dx] = random_weight(rng_seed);
+            }
+        }
+
+        neural_network.grid_biases[channel] = random_weight(rng_seed);
+    }
+
+    for (i32 row_channel = 0; row_channel < ConvolutionalNeuralNetwork::ROW_CHANNEL_COUNT; ++row_channel) {
+        for (i32 grid_channel = 0; grid_channel < ConvolutionalNeuralNetwork::GRID_CHANNEL_COUNT; ++grid_channel) {
+            for (i32 column = 0; column < ConvolutionalNeuralNetwork::COLUMN_COUNT; ++column) {
+                neural_network.row_kernels[row_channel][grid_channel][column] = random_weight(rng_seed);
+            }
+        }
+
+        neural_network.row_biases[row_channel] = random_weight(rng_seed);
+    }
+
+    for (i32 input = 0; input < ConvolutionalNeuralNetwork::HEAD_INPUT_SIZE; ++input) {
+        for (i32 hidden = 0; hidden < ConvolutionalNeuralNetwork::HIDDEN_LAYER_SIZE; ++hidden) {
+            neural_network.head_weights[input][hidden] = random_weight(rng_seed);
+        }
+    }
+
+    for (i32 i = 0; i < ConvolutionalNeuralNetwork::HIDDEN_LAYER_SIZE; ++i) {
+        neural_network.hidden_biases[i] = random_weight(rng_seed);
+    }
+
+    for (i32 row = 0; row < NeuralNetwork::OUTPUT_LAYER_SIZE; ++row) {
+        for (i32 column = 0; column < ConvolutionalNeuralNetwork::HIDDEN_LAYER_SIZE; ++column) {
+            neural_network.hidden_to_output_weights[column][row] = random_weight(rng_seed);
+        }
+    }
+
+    for (i32 i = 0; i < NeuralNetwork::OUTPUT_LAYER_SIZE; ++i) {
+        neural_network.output_biases[i] = random_weight(rng_seed);
+    }
+
+    return neural_network;
+}
+
+// Grid cells come straight from the encoded row bitmasks, bit n of a row is column n
+static void make_convolutional_input(const f32* const features, const u16* const encoded_rows, ConvolutionalInput& input) {
+    for (i32 row = 0; row < ConvolutionalNeuralNetwork::ROW_COUNT + 2; ++row) {
+        for (i32 column = 0; column < ConvolutionalInput::PADDED_ROW_WIDTH; ++column) {
+            input.grid[row][column] = 0.0f;
+        }
+    }
+
+    for (i32 row = 0; row < ConvolutionalNeuralNetwork::ROW_COUNT; ++row) {
+        for (i32 column = 0; column < ConvolutionalNeuralNetwork::COLUMN_COUNT; ++column) {
+            input.grid[row + 1][column + 1] = static_cast<f32>((encoded_rows[row] >> column) & 1);
+        }
+    }
+
+    for (i32 i = 0; i < ConvolutionalNeuralNetwork::FEATURE_COUNT; ++i) {
+        input.features[i] = features[i];
+    }
+}
+
+// Per inference, only counting the columns inside the grid even though the kernels work on whole padded rows
+static u32 convolutional_neural_network_multiply_add_count() {
+    static constexpr u32 CELL_COUNT = ConvolutionalNeuralNetwork::ROW_COUNT * ConvolutionalNeuralNetwork::COLUMN_COUNT;
+    static constexpr u32 KERNEL_TAP_COUNT = ConvolutionalNeuralNetwork::KERNEL_SIZE * ConvolutionalNeuralNetwork::KERNEL_SIZE;
+
+    const u32 grid_convolution = ConvolutionalNeuralNetwork::GRID_CHANNEL_COUNT * CELL_COUNT * KERNEL_TAP_COUNT;
+    const u32 row_convolution = ConvolutionalNeuralNetwork::ROW_CHANNEL_COUNT * ConvolutionalNeuralNetwork::GRID_CHANNEL_COUNT * CELL_COUNT;
+    const u32 hidden_layer = ConvolutionalNeuralNetwork::HEAD_INPUT_SIZE * ConvolutionalNeuralNetwork::HIDDEN_LAYER_SIZE;
+    const u32 output_layer = ConvolutionalNeuralNetwork::HIDDEN_LAYER_SIZE * NeuralNetwork::OUTPUT_LAYER_SIZE;
+
+    return grid_convolution + row_convolution + hidden_layer + output_layer;
+}
+
+static f32 relu(const f32 x) {
+    return (x > 0.0f) ? x : 0.0f;
+}
+
+static void convolutional_forward(const ConvolutionalNeuralNetwork& neural_network, const ConvolutionalInput& input, ConvolutionalActivations& activations) {
+    static constexpr i32 ROW_COUNT = ConvolutionalNeuralNetwork::ROW_COUNT;
+    static constexpr i32 ROW_WIDTH = ConvolutionalNeuralNetwork::ROW_WIDTH;
+    static constexpr i32 KERNEL_SIZE = ConvolutionalNeuralNetwork::KERNEL_SIZE;
+    static constexpr i32 ROW_CHANNEL_COUNT = ConvolutionalNeuralNetwork::ROW_CHANNEL_COUNT;
+
+    for (i32 channel = 0; channel < ConvolutionalNeuralNetwork::GRID_CHANNEL_COUNT; ++channel) {
+        for (i32 row = 0; row < ROW_COUNT; ++row) {
+            for (i32 column = 0; column < ROW_WIDTH; ++column) {
+                f32 z = neural_network.grid_biases[channel];
+                for (i32 dy = 0; dy < KERNEL_SIZE; ++dy) {
+                    for (i32 dx = 0; dx < KERNEL_SIZE; ++dx) {
+                        z += neural_network.grid_kernels[channel][dy][dx] * input.grid[row + dy][column + dx];
+                    }
+                }
+
+                activations.grid_channels[channel][row][column] = relu(z) * CONVOLUTION_COLUMN_MASK[column];
+            }
+        }
+    }
+
+    for (i32 i = 0; i < ConvolutionalNeuralNetwork::FEATURE_COUNT; ++i) {
+        activations.head_inputs[i] = input.features[i];
+    }
+
+    for (i32 row_channel = 0; row_channel < ROW_CHANNEL_COUNT; ++row_channel) {
+        for (i32 row = 0; row < ROW_COUNT; ++row) {
+            f32 z = neural_network.row_biases[row_channel];
+            for (i32 grid_channel = 0; grid_channel < ConvolutionalNeuralNetwork::GRID_CHANNEL_COUNT; ++grid_channel) {
+                for (i32 column = 0; column < ROW_WIDTH; ++column) {
+                    z += neural_network.row_kernels[row_channel][grid_channel][column] * activations.grid_channels[grid_channel][row][column];
+                }
+            }
+
+            activations.head_inputs[ConvolutionalNeuralNetwork::FEATURE_COUNT + row * ROW_CHANNEL_COUNT + row_channel] = relu(z);
+        }
+    }
+
+    for (i32 hidden = 0; hidden < ConvolutionalNeuralNetwork::HIDDEN_LAYER_SIZE; ++hidden) {
+        activations.hidden_activations[hidden] = neural_network.hidden_biases[hidden];
+    }
+
+    for (i32 head_input = 0; head_input < ConvolutionalNeuralNetwork::HEAD_INPUT_SIZE; ++head_input) {
+        for (i32 hidden = 0; hidden < ConvolutionalNeuralNetwork::HIDDEN_LAYER_SIZE; ++hidden) {
+            activations.hidden_activations[hidden] += neural_network.head_weights[head_input][hidden] * activations.head_inputs[head_input];
+        }
+    }
+
+    for (i32 hidden = 0; hidden < ConvolutionalNeuralNetwork::HIDDEN_LAYER_SIZE; ++hidden) {
+        activations.hidden_activations[hidden] = sigmoid(activations.hidden_activations[hidden]);
+    }
+
+    for (i32 output = 0; output < NeuralNetwork::OUTPUT_LAYER_SIZE; ++output) {
+        f32 z = neural_network.output_biases[output];
+        for (i32 hidden = 0; hidden < ConvolutionalNeuralNetwork::HIDDEN_LAYER_SIZE; ++hidden) {
+            z += neural_network.hidden_to_output_weights[hidden][output] * activations.hidden_activations[hidden];
+        }
+
+        activations.output_activations[output] = sigmoid(z);
+    }
+}
+
+// Direct convolution, a padded row is two registers and the kernel taps are unaligned loads of the padded
+// input shifted by dx so there's no im2col copy. Every channel of a row is done at once so each tap is loaded
+// once and the accumulators are independent chains, the same goes for the row kernels and the head.
+TARGET_AVX2 static void convolutional_forward_avx2(const ConvolutionalNeuralNetwork& neural_network, const ConvolutionalInput& input, ConvolutionalActivations& activations) {
+    static constexpr i32 ROW_COUNT = ConvolutionalNeuralNetwork::ROW_COUNT;
+    static constexpr i32 KERNEL_SIZE = ConvolutionalNeuralNetwork::KERNEL_SIZE;
+    static constexpr i32 GRID_CHANNEL_COUNT = ConvolutionalNeuralNetwork::GRID_CHANNEL_COUNT;
+    static constexpr i32 ROW_CHANNEL_COUNT = ConvolutionalNeuralNetwork::ROW_CHANNEL_COUNT;
+
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 column_mask_0 = _mm256_load_ps(CONVOLUTION_COLUMN_MASK);
+    const __m256 column_mask_1 = _mm256_load_ps(CONVOLUTION_COLUMN_MASK + 8);
+    for (i32 row = 0; row < ROW_COUNT; ++row) {
+        __m256 z[GRID_CHANNEL_COUNT][2];
+        #pragma GCC unroll 16
+        for (i32 channel = 0; channel < GRID_CHANNEL_COUNT; ++channel) {
+            z[channel][0] = _mm256_broadcast_ss(neural_network.grid_biases + channel);
+            z[channel][1] = z[channel][0];
+        }
+
+        #pragma GCC unroll 16
+        for (i32 dy = 0; dy < KERNEL_SIZE; ++dy) {
+            #pragma GCC unroll 16
+            for (i32 dx = 0; dx < KERNEL_SIZE; ++dx) {
+                const __m256 x_0 = _mm256_loadu_ps(input.grid[row + dy] + dx);
+                const __m256 x_1 = _mm256_loadu_ps(input.grid[row + dy] + dx + 8);
+                #pragma GCC unroll 16
+                for (i32 channel = 0; channel < GRID_CHANNEL_COUNT; ++channel) {
+                    const __m256 weight = _mm256_broadcast_ss(&neural_network.grid_kernels[channel][dy][dx]);
+                    z[channel][0] = _mm256_fmadd_ps(weight, x_0, z[channel][0]);
+                    z[channel][1] = _mm256_fmadd_ps(weight, x_1, z[channel][1]);
+                }
+            }
+        }
+
+        #pragma GCC unroll 16
+        for (i32 channel = 0; channel < GRID_CHANNEL_COUNT; ++channel) {
+            _mm256_store_ps(activations.grid_channels[channel][row], _mm256_mul_ps(_mm256_max_ps(z[channel][0], zero), column_mask_0));
+            _mm256_store_ps(activations.grid_channels[channel][row] + 8, _mm256_mul_ps(_mm256_max_ps(z[channel][1], zero), column_mask_1));
+        }
+    }
+
+    for (i32 i = 0; i < ConvolutionalNeuralNetwork::FEATURE_COUNT; ++i) {
+        activations.head_inputs[i] = input.features[i];
+    }
+
+    static_assert(ROW_CHANNEL_COUNT == 4);
+    const __m128 row_biases = _mm_load_ps(neural_network.row_biases);
+    for (i32 row = 0; row < ROW_COUNT; ++row) {
+        __m256 z[ROW_CHANNEL_COUNT];
+        #pragma GCC unroll 16
+        for (i32 row_channel = 0; row_channel < ROW_CHANNEL_COUNT; ++row_channel) {
+            z[row_channel] = zero;
+        }
+
+        #pragma GCC unroll 16
+        for (i32 grid_channel = 0; grid_channel < GRID_CHANNEL_COUNT; ++grid_channel) {
+            const __m256 x_0 = _mm256_load_ps(activations.grid_channels[grid_channel][row]);
+            const __m256 x_1 = _mm256_load_ps(activations.grid_channels[grid_channel][row] + 8);
+            #pragma GCC unroll 16
+            for (i32 row_channel = 0; row_channel < ROW_CHANNEL_COUNT; ++row_channel) {
+                z[row_channel] = _mm256_fmadd_ps(_mm256_load_ps(neural_network.row_kernels[row_channel][grid_channel]), x_0, z[row_channel]);
+                z[row_channel] = _mm256_fmadd_ps(_mm256_load_ps(neural_network.row_kernels[row_channel][grid_channel] + 8), x_1, z[row_channel]);
+            }
+        }
+
+        // two levels of horizontal adds leave each channel's sum split over the two halves in channel order
+        const __m256 partial_sums = _mm256_hadd_ps(_mm256_hadd_ps(z[0], z[1]), _mm256_hadd_ps(z[2], z[3]));
+        const __m128 row_values = _mm_add_ps(_mm_add_ps(_mm256_castps256_ps128(partial_sums), _mm256_extractf128_ps(partial_sums, 1)), row_biases);
+        _mm_storeu_ps(activations.head_inputs + ConvolutionalNeuralNetwork::FEATURE_COUNT + row * ROW_CHANNEL_COUNT, _mm_max_ps(row_values, _mm_setzero_ps()));
+    }
+
+    // even and odd head inputs go to separate accumulators to halve the length of the dependency chains
+    static_assert(ConvolutionalNeuralNetwork::HIDDEN_LAYER_SIZE == 32 && ConvolutionalNeuralNetwork::HEAD_INPUT_SIZE % 2 == 0);
+    __m256 hidden[2][4];
+    #pragma GCC unroll 16
+    for (i32 i = 0; i < 4; ++i) {
+        hidden[0][i] = _mm256_load_ps(neural_network.hidden_biases + i * 8);
+        hidden[1][i] = zero;
+    }
+
+    for (i32 head_input = 0; head_input < ConvolutionalNeuralNetwork::HEAD_INPUT_SIZE; head_input += 2) {
+        #pragma GCC unroll 16
+        for (i32 j = 0; j < 2; ++j) {
+            const __m256 x = _mm256_broadcast_ss(activations.head_inputs + head_input + j);
+            #pragma GCC unroll 16
+            for (i32 i = 0; i < 4; ++i) {
+                hidden[j][i] = _mm256_fmadd_ps(_mm256_load_ps(neural_network.head_weights[head_input + j] + i * 8), x, hidden[j][i]);
+            }
+        }
+    }
+
+    #pragma GCC unroll 16
+    for (i32 i = 0; i < 4; ++i) {
+        hidden[0][i] = sigmoid_avx2(_mm256_add_ps(hidden[0][i], hidden[1][i]));
+        _mm256_store_ps(activations.hidden_activations + i * 8, hidden[0][i]);
+    }
+
+    static_assert(ConvolutionalNeuralNetwork::OUTPUT_WIDTH == 8);
+    __m256 output[4] = {_mm256_load_ps(neural_network.output_biases), zero, zero, zero};
+#pragma GCC unroll 16
+    for (i32 hidden_row = 0; hidden_row < ConvolutionalNeuralNetwork::HIDDEN_LAYER_SIZE; ++hidden_row) {
+        const __m256 x = _mm256_broadcast_ss(activations.hidden_activations + hidden_row);
+        output[hidden_row % 4] = _mm256_fmadd_ps(_mm256_load_ps(neural_network.hidden_to_output_weights[hidden_row]), x, output[hidden_row % 4]);
+    }
+
+    const __m256 z = _mm256_add_ps(_mm256_add_ps(output[0], output[1]), _mm256_add_ps(output[2], output[3]));
+    _mm256_store_ps(activations.output_activations, sigmoid_avx2(z));
+}
+
+static void feed_forward(const ConvolutionalNeuralNetwork& neural_network, const ConvolutionalInput& input, NeuralNetwork::OutputLayer& output) {
+    ConvolutionalActivations activations;
+    if (cpu_features().avx2) {
+        convolutional_forward_avx2(neural_network, input, activations);
+    } else {
+        convolutional_forward(neural_network, input, activations);
+    }
+
+    for (i32 i = 0; i < NeuralNetwork::OUTPUT_LAYER_SIZE; ++i) {
+        output[i] = activations.output_activations[i];
+    }
+}
+
+// From the hidden layer gradient (already through the sigmoid derivative) back to the grid kernels
+static void convolution_back_propagate(
+    const ConvolutionalNeuralNetwork& neural_network,
+    const ConvolutionalInput& input,
+    const ConvolutionalActivations& activations,
+    const f32* const hidden_gradient,
+    ConvolutionalNeuralNetwork& neural_network_delta
+) {
+    static constexpr i32 ROW_COUNT = ConvolutionalNeuralNetwork::ROW_COUNT;
+    static constexpr i32 ROW_WIDTH = ConvolutionalNeuralNetwork::ROW_WIDTH;
+    static constexpr i32 KERNEL_SIZE = ConvolutionalNeuralNetwork::KERNEL_SIZE;
+    static constexpr i32 GRID_CHANNEL_COUNT = ConvolutionalNeuralNetwork::GRID_CHANNEL_COUNT;
+    static constexpr i32 ROW_CHANNEL_COUNT = ConvolutionalNeuralNetwork::ROW_CHANNEL_COUNT;
+
+    for (i32 head_input = 0; head_input < ConvolutionalNeuralNetwork::HEAD_INPUT_SIZE; ++head_input) {
+        for (i32 hidden = 0; hidden < ConvolutionalNeuralNetwork::HIDDEN_LAYER_SIZE; ++hidden) {
+            neural_network_delta.head_weights[head_input][hidden] += hidden_gradient[hidden] * activations.head_inputs[head_input];
+        }
+    }
+
+    f32 row_gradient[ROW_COUNT][ROW_CHANNEL_COUNT] = {};
+    for (i32 row_channel = 0; row_channel < ROW_CHANNEL_COUNT; ++row_channel) {
+        for (i32 row = 0; row < ROW_COUNT; ++row) {
+            const i32 head_input = ConvolutionalNeuralNetwork::FEATURE_COUNT + row * ROW_CHANNEL_COUNT + row_channel;
+            f32 gradient = 0.0f;
+            for (i32 hidden = 0; hidden < ConvolutionalNeuralNetwork::HIDDEN_LAYER_SIZE; ++hidden) {
+                gradient += neural_network.head_weights[head_input][hidden] * hidden_gradient[hidden];
+            }
+
+            row_gradient[row][row_channel] = (activations.head_inputs[head_input] > 0.0f) ? gradient : 0.0f;
+            neural_network_delta.row_biases[row_channel] += row_gradient[row][row_channel];
+        }
+    }
+
+    f32 grid_gradient[GRID_CHANNEL_COUNT][ROW_COUNT][ROW_WIDTH] = {};
+    for (i32 row_channel = 0; row_channel < ROW_CHANNEL_COUNT; ++row_channel) {
+        for (i32 grid_channel = 0; grid_channel < GRID_CHANNEL_COUNT; ++grid_channel) {
+            for (i32 row = 0; row < ROW_COUNT; ++row) {
+                for (i32 column = 0; column < ROW_WIDTH; ++column) {
+                    neural_network_delta.row_kernels[row_channel][grid_channel][column] += row_gradient[row][row_channel] * activations.grid_channels[grid_channel][row][column];
+                    grid_gradient[grid_channel][row][column] += row_gradient[row][row_channel] * neural_network.row_kernels[row_channel][grid_channel][column];
+                }
+            }
+        }
+    }
+
+    // padding columns are zero after the ReLU so this also stops any gradient leaking out of the grid
+    for (i32 channel = 0; channel < GRID_CHANNEL_COUNT; ++channel) {
+        for (i32 row = 0; row < ROW_COUNT; ++row) {
+            for (i32 column = 0; column < ROW_WIDTH; ++column) {
+                const f32 gradient = (activations.grid_channels[channel][row][column] > 0.0f) ? grid_gradient[channel][row][column] : 0.0f;
+                neural_network_delta.grid_biases[channel] += gradient;
+                for (i32 dy = 0; dy < KERNEL_SIZE; ++dy) {
+                    for (i32 dx = 0; dx < KERNEL_SIZE; ++dx) {
+                        neural_network_delta.grid_kernels[channel][dy][dx] += gradient * input.grid[row + dy][column + dx];
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Same order of operations as the forward pass. A row's four channel gradients come out of one horizontal
+// reduction, and the grid kernel gradients keep all nine taps' partial sums in registers over the rows of a
+// channel and only sum them horizontally at the end.
+TARGET_AVX2 static void convolution_back_propagate_avx2(
+    const ConvolutionalNeuralNetwork& neural_network,
+    const ConvolutionalInput& input,
+    const ConvolutionalActivations& activations,
+    const f32* const hidden_gradient,
+    ConvolutionalNeuralNetwork& neural_network_delta
+) {
+    static constexpr i32 ROW_COUNT = ConvolutionalNeuralNetwork::ROW_COUNT;
+    static constexpr i32 KERNEL_SIZE = ConvolutionalNeuralNetwork::KERNEL_SIZE;
+    static constexpr i32 GRID_CHANNEL_COUNT = ConvolutionalNeuralNetwork::GRID_CHANNEL_COUNT;
+    static constexpr i32 ROW_CHANNEL_COUNT = ConvolutionalNeuralNetwork::ROW_CHANNEL_COUNT;
+    static_assert(ConvolutionalNeuralNetwork::HIDDEN_LAYER_SIZE == 32 && ROW_CHANNEL_COUNT == 4);
+
+    __m256 gradient[4];
+    #pragma GCC unroll 16
+    for (i32 i = 0; i < 4; ++i) {
+        gradient[i] = _mm256_loadu_ps(hidden_gradient + i * 8);
+    }
+
+    for (i32 head_input = 0; head_input < ConvolutionalNeuralNetwork::HEAD_INPUT_SIZE; ++head_input) {
+        const __m256 x = _mm256_broadcast_ss(activations.head_inputs + head_input);
+        f32* const delta = neural_network_delta.head_weights[head_input];
+        #pragma GCC unroll 16
+        for (i32 i = 0; i < 4; ++i) {
+            _mm256_store_ps(delta + i * 8, _mm256_fmadd_ps(gradient[i], x, _mm256_load_ps(delta + i * 8)));
+        }
+    }
+
+    alignas(16) f32 row_gradient[ROW_COUNT][ROW_CHANNEL_COUNT];
+    __m128 row_bias_delta = _mm_load_ps(neural_network_delta.row_biases);
+    for (i32 row = 0; row < ROW_COUNT; ++row) {
+        const i32 first_head_input = ConvolutionalNeuralNetwork::FEATURE_COUNT + row * ROW_CHANNEL_COUNT;
+        __m256 sum[ROW_CHANNEL_COUNT];
+        #pragma GCC unroll 16
+        for (i32 row_channel = 0; row_channel < ROW_CHANNEL_COUNT; ++row_channel) {
+            const f32* const weights = neural_network.head_weights[first_head_input + row_channel];
+            sum[row_channel] = _mm256_mul_ps(_mm256_load_ps(weights), gradient[0]);
+            #pragma GCC unroll 16
+            for (i32 i = 1; i < 4; ++i) {
+                sum[row_channel] = _mm256_fmadd_ps(_mm256_load_ps(weights + i * 8), gradient[i], sum[row_channel]);
+            }
+        }
+
+        const __m256 partial_sums = _mm256_hadd_ps(_mm256_hadd_ps(sum[0], sum[1]), _mm256_hadd_ps(sum[2], sum[3]));
+        const __m128 active = _mm_cmpgt_ps(_mm_loadu_ps(activations.head_inputs + first_head_input), _mm_setzero_ps());
+        const __m128 gradients = _mm_and_ps(_mm_add_ps(_mm256_castps256_ps128(partial_sums), _mm256_extractf128_ps(partial_sums, 1)), active);
+        _mm_store_ps(row_gradient[row], gradients);
+        row_bias_delta = _mm_add_ps(row_bias_delta, gradients);
+    }
+
+    _mm_store_ps(neural_network_delta.row_biases, row_bias_delta);
+
+    for (i32 row_channel = 0; row_channel < ROW_CHANNEL_COUNT; ++row_channel) {
+        for (i32 grid_channel = 0; grid_channel < GRID_CHANNEL_COUNT; ++grid_channel) {
+            f32* const delta = neural_network_delta.row_kernels[row_channel][grid_channel];
+            __m256 delta_0 = _mm256_load_ps(delta);
+            __m256 delta_1 = _mm256_load_ps(delta + 8);
+            for (i32 row = 0; row < ROW_COUNT; ++row) {
+                const __m256 row_gradient_broadcast = _mm256_broadcast_ss(&row_gradient[row][row_channel]);
+                delta_0 = _mm256_fmadd_ps(row_gradient_broadcast, _mm256_load_ps(activations.grid_channels[grid_channel][row]), delta_0);
+                delta_1 = _mm256_fmadd_ps(row_gradient_broadcast, _mm256_load_ps(activations.grid_channels[grid_channel][row] + 8), delta_1);
+            }
+
+            _mm256_store_ps(delta, delta_0);
+            _mm256_store_ps(delta + 8, delta_1);
+        }
+    }
+
+    const __m256 zero = _mm256_setzero_ps();
+    for (i32 channel = 0; channel < GRID_CHANNEL_COUNT; ++channel) {
+        __m256 bias_delta = zero;
+        __m256 kernel_delta[KERNEL_SIZE][KERNEL_SIZE];
+        #pragma GCC unroll 16
+        for (i32 dy = 0; dy < KERNEL_SIZE; ++dy) {
+            #pragma GCC unroll 16
+            for (i32 dx = 0; dx < KERNEL_SIZE; ++dx) {
+                kernel_delta[dy][dx] = zero;
+            }
+        }
+
+        for (i32 row = 0; row < ROW_COUNT; ++row) {
+            __m256 grid_gradient_0 = zero;
+            __m256 grid_gradient_1 = zero;
+            #pragma GCC unroll 16
+            for (i32 row_channel = 0; row_channel < ROW_CHANNEL_COUNT; ++row_channel) {
+                const __m256 row_gradient_broadcast = _mm256_broadcast_ss(&row_gradient[row][row_channel]);
+                grid_gradient_0 = _mm256_fmadd_ps(row_gradient_broadcast, _mm256_load_ps(neural_network.row_kernels[row_channel][channel]), grid_gradient_0);
+                grid_gradient_1 = _mm256_fmadd_ps(row_gradient_broadcast, _mm256_load_ps(neural_network.row_kernels[row_channel][channel] + 8), grid_gradient_1);
+            }
+
+            // padding columns are zero after the ReLU so this also stops any gradient leaking out of the grid
+            const f32* const grid_row = activations.grid_channels[channel][row];
+            grid_gradient_0 = _mm256_and_ps(grid_gradient_0, _mm256_cmp_ps(_mm256_load_ps(grid_row), zero, _CMP_GT_OQ));
+            grid_gradient_1 = _mm256_and_ps(grid_gradient_1, _mm256_cmp_ps(_mm256_load_ps(grid_row + 8), zero, _CMP_GT_OQ));
+            bias_delta = _mm256_add_ps(bias_delta, _mm256_add_ps(grid_gradient_0, grid_gradient_1));
+            #pragma GCC unroll 16
+            for (i32 dy = 0; dy < KERNEL_SIZE; ++dy) {
+                #pragma GCC unroll 16
+                for (i32 dx = 0; dx < KERNEL_SIZE; ++dx) {
+                    kernel_delta[dy][dx] = _mm256_fmadd_ps(grid_gradient_0, _mm256_loadu_ps(input.grid[row + dy] + dx), kernel_delta[dy][dx]);
+                    kernel_delta[dy][dx] = _mm256_fmadd_ps(grid_gradient_1, _mm256_loadu_ps(input.grid[row + dy] + dx + 8), kernel_delta[dy][dx]);
+                }
+            }
+        }
+
+        neural_network_delta.grid_biases[channel] += horizontal_sum_avx2(bias_delta);
+        for (i32 dy = 0; dy < KERNEL_SIZE; ++dy) {
+            for (i32 dx = 0; dx < KERNEL_SIZE; ++dx) {
+                neural_network_delta.grid_kernels[channel][dy][dx] += horizontal_sum_avx2(kernel_delta[dy][dx]);
+            }
+        }
+    }
+}
+
+// Same cost as back_propagate() for the dense network. The output and hidden layer gradients are done here in
+// scalar code, they're small and it keeps the SSE code out from between the AVX2 forward and backward kernels.
+static void back_propagate(
+    const ConvolutionalNeuralNetwork& neural_network,
+    const ConvolutionalInput& input,
+    const NeuralNetwork::OutputLayer& target,
+    ConvolutionalNeuralNetwork& neural_network_delta
+) {
+    const bool avx2 = cpu_features().avx2;
+
+    ConvolutionalActivations activations;
+    if (avx2) {
+        convolutional_forward_avx2(neural_network, input, activations);
+    } else {
+        convolutional_forward(neural_network, input, activations);
+    }
+
+    NeuralNetwork::OutputLayer output_gradient = {};
+    for (i32 i = 0; i < NeuralNetwork::OUTPUT_LAYER_SIZE; ++i) {
+        const f32 activation = activations.output_activations[i];
+        output_gradient[i] = cost_derivative(activation, target[i]) * activation * (1.0f - activation);
+        neural_network_delta.output_biases[i] += output_gradient[i];
+    }
+
+    alignas(32) f32 hidden_gradient[ConvolutionalNeuralNetwork::HIDDEN_LAYER_SIZE] = {};
+    for (i32 row = 0; row < NeuralNetwork::OUTPUT_LAYER_SIZE; ++row) {
+        for (i32 column = 0; column < ConvolutionalNeuralNetwork::HIDDEN_LAYER_SIZE; ++column) {
+            neural_network_delta.hidden_to_output_weights[column][row] += output_gradient[row] * activations.hidden_activations[column];
+            hidden_gradient[column] += neural_network.hidden_to_output_weights[column][row] * output_gradient[row];
+        }
+    }
+
+    for (i32 i = 0; i < ConvolutionalNeuralNetwork::HIDDEN_LAYER_SIZE; ++i) {
+        const f32 activation = activations.hidden_activations[i];
+        hidden_gradient[i] *= activation * (1.0f - activation);
+        neural_network_delta.hidden_biases[i] += hidden_gradient[i];
+    }
+
+    if (avx2) {
+        convolution_back_propagate_avx2(neural_network, input, activations, hidden_gradient, neural_network_delta);
+    } else {
+        convolution_back_propagate(neural_network, input, activations, hidden_gradient, neural_network_delta);
+    }
+}
+
+// Every member is f32 so the whole struct goes as one array, the alignment padding between members is never read.
+// The padding columns of the row kernels and padding outputs get zero deltas so they stay zero.
+static void apply_delta(ConvolutionalNeuralNetwork& neural_network, const ConvolutionalNeuralNetwork& neural_network_delta, const f32 step_size) {
+    static_assert(sizeof(ConvolutionalNeuralNetwork) % sizeof(f32) == 0);
+
+    f32* const weights = reinterpret_cast<f32*>(&neural_network);
+    const f32* const deltas = reinterpret_cast<const f32*>(&neural_network_delta);
+    for (u32 i = 0; i < sizeof(ConvolutionalNeuralNetwork) / sizeof(f32); ++i) {
+        weights[i] -= step_size * deltas[i];
+    }
+}
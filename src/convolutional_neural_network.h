@@ -0,0 +1,51 @@
+#ifndef CONVOLUTIONAL_NEURAL_NETWORK_H
+#define CONVOLUTIONAL_NEURAL_NETWORK_H
+
+#include "neural_network.h"
+#include "types.h"
+
+// Alternative to the dense NeuralNetwork that looks at the grid through convolutions instead of a weight per cell:
+//  - 3x3 kernels over the grid, GRID_CHANNEL_COUNT channels, zero padded so each channel is the grid's size
+//  - 1xCOLUMN_COUNT kernels over each row of those, ROW_CHANNEL_COUNT values per grid row
+//  - a dense sigmoid head over the non-grid inputs plus the row values, same outputs as NeuralNetwork
+// Convolutions use ReLU, the Taylor series sigmoid isn't accurate over the range their sums cover.
+// Grid rows are ROW_WIDTH floats with the columns past COLUMN_COUNT always zero so a row is whole registers.
+struct ConvolutionalNeuralNetwork {
+    static constexpr i32 ROW_COUNT = 18;
+    static constexpr i32 COLUMN_COUNT = 10;
+    static constexpr i32 ROW_WIDTH = 16;
+    static constexpr i32 KERNEL_SIZE = 3;
+    static constexpr i32 GRID_CHANNEL_COUNT = 4;
+    static constexpr i32 ROW_CHANNEL_COUNT = 4;
+    static constexpr i32 FEATURE_COUNT = 12;    // the inputs before the grid in NeuralNetwork::InputLayer
+    static constexpr i32 HEAD_INPUT_SIZE = FEATURE_COUNT + ROW_CHANNEL_COUNT * ROW_COUNT;
+    static constexpr i32 HIDDEN_LAYER_SIZE = 32;
+    static constexpr i32 OUTPUT_WIDTH = 8;      // outputs padded to one AVX2 register, the padding is always zero
+
+    alignas(64) f32 grid_kernels[GRID_CHANNEL_COUNT][KERNEL_SIZE][KERNEL_SIZE];
+    alignas(64) f32 grid_biases[GRID_CHANNEL_COUNT];
+    alignas(64) f32 row_kernels[ROW_CHANNEL_COUNT][GRID_CHANNEL_COUNT][ROW_WIDTH];  // zero past COLUMN_COUNT
+    alignas(64) f32 row_biases[ROW_CHANNEL_COUNT];
+    alignas(64) f32 head_weights[HEAD_INPUT_SIZE][HIDDEN_LAYER_SIZE];   // input major, one input against every hidden unit
+    alignas(64) f32 hidden_biases[HIDDEN_LAYER_SIZE];
+    alignas(64) f32 hidden_to_output_weights[HIDDEN_LAYER_SIZE][OUTPUT_WIDTH];  // hidden major like the head weights
+    alignas(64) f32 output_biases[OUTPUT_WIDTH];
+};
+
+// Grid cells are stored with a row of zeros above and below and a column of zeros on the left, so the kernel
+// taps for output column x of row r are grid[r + dy][x + dx] with no bounds checks
+struct ConvolutionalInput {
+    static constexpr i32 PADDED_ROW_WIDTH = ConvolutionalNeuralNetwork::ROW_WIDTH + 8;
+
+    alignas(64) f32 grid[ConvolutionalNeuralNetwork::ROW_COUNT + 2][PADDED_ROW_WIDTH];
+    alignas(64) f32 features[ConvolutionalNeuralNetwork::FEATURE_COUNT];
+};
+
+static ConvolutionalNeuralNetwork random_convolutional_neural_network(u32 rng_seed);
+static void make_convolutional_input(const f32* features, const u16* encoded_rows, ConvolutionalInput& input);
+static u32 convolutional_neural_network_multiply_add_count();
+static void feed_forward(const ConvolutionalNeuralNetwork& neural_network, const ConvolutionalInput& input, NeuralNetwork::OutputLayer& output);
+static void back_propagate(const ConvolutionalNeuralNetwork& neural_network, const ConvolutionalInput& input, const NeuralNetwork::OutputLayer& target, ConvolutionalNeuralNetwork& neural_network_delta);
+static void apply_delta(ConvolutionalNeuralNetwork& neural_network, const ConvolutionalNeuralNetwork& neural_network_delta, f32 step_size);
+
+#endif
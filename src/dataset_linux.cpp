@@ -0,0 +1,788 @@
+// Tools for preparing training data before a run. Anything that reads training data takes plain records, a
+// file from the compressor or columnizer, a framed file the game recorded, or a manifest for a set of shards,
+// which reads as all their records in shard order once every finished shard has been checked against its
+// checksum. Anything that writes goes through a temporary file and a rename so a failure never leaves half a
+// file behind.
+//
+// Usage:
+//  dataset stats FILE
+//      record count, level and tetrimino distributions and how often each action is taken
+//  dataset validate FILE
+//      checks every record is a game state the game could have recorded, exits with 1 if any aren't
+//  dataset merge --output FILE FILE...
+//      concatenates the records of every file in order
+//  dataset split [--validation-fraction F] [--seed N] --train FILE --validation FILE FILE
+//      sends runs of SPLIT_SEGMENT_RECORD_COUNT consecutive records to one side or the other at random, ticks
+//      next to each other are nearly identical so splitting record by record would leak them across
+//  dataset convert --to records|compressed|columnar|weighted --output FILE FILE
+//  dataset shuffle [--seed N] [--memory-mb N] --output FILE FILE
+//      uniform random order using at most about --memory-mb of buffers however big the file is, plus one
+//      shard's records when it's a manifest of framed shards. The file is cut into runs that fit in memory,
+//      each is shuffled and written to a temporary file, then the runs are merged by repeatedly taking the
+//      next record of a run chosen with probability proportional to how many records it has left, which makes
+//      every order of the whole file equally likely.
+//  dataset shard [--shard-mb N] --output MANIFEST FILE
+//      cuts the records into shard files of at most --shard-mb each (64 by default, like the game records),
+//      named after the manifest and put next to it, so each training thread can read a shard of its own
+// Plain record files are mapped and streamed through, the other formats are decoded into memory first. merge
+// and shuffle go through a manifest a shard at a time, the rest copy all its shards into memory together.
+
+#include "neural_network.h"
+#include "kernel_tuning.h"
+#include "convolutional_neural_network.h"
+#include "training_data.h"
+#include "compressed_training_data.h"
+#include "columnar_training_data.h"
+
+#include "util.cpp"
+#include "simd.cpp"
+#include "neural_network.cpp"
+#include "kernel_tuning.cpp"
+#include "convolutional_neural_network.cpp"
+#include "training_data.cpp"
+#include "compressed_training_data.cpp"
+#include "columnar_training_data.cpp"
+#include "tools_linux.cpp"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static constexpr u32 SPLIT_SEGMENT_RECORD_COUNT = 1024;
+static constexpr u32 MAX_REPORTED_LEVEL = 30;
+
+static bool is_decoded_dataset(const void* const data, const u64 size) {
+    return is_weighted_training_data(data, size) || is_compressed_training_data(static_cast<const i8*>(data), size) || is_columnar_training_data(data, size);
+}
+
+// Sets view to the records of a mapped compressed or columnar file, decoded into memory, taking the mapping over
+static bool decode_dataset(const char* const file_name, const void* const data, const u64 size, TrainingDataView& view) {
+    if (is_weighted_training_data(data, size)) {
+        fprintf(stderr, "%s is weighted, the record order is gone so use the file it was made from\n", file_name);
+        return false;
+    }
+
+    if (is_compressed_training_data(static_cast<const i8*>(data), size)) {
+        CompressedTrainingDataView compressed_training_data = {};
+        i8* records = nullptr;
+        bool decoded = view_compressed_training_data(static_cast<const i8*>(data), size, compressed_training_data);
+        if (decoded) {
+            records = static_cast<i8*>(malloc(static_cast<u64>(compressed_training_data.header.record_count) * TRAINING_RECORD_SIZE));
+            decoded = decompress_training_data(compressed_training_data, records);
+        }
+
+        munmap(const_cast<void*>(data), size);
+        if (!decoded) {
+            fprintf(stderr, "%s is damaged\n", file_name);
+            return false;
+        }
+
+        return view_training_data(records, static_cast<u64>(compressed_training_data.header.record_count) * TRAINING_RECORD_SIZE, view);
+    }
+
+    ColumnarTrainingDataView columnar_training_data = {};
+    if (!view_columnar_training_data(data, size, columnar_training_data)) {
+        fprintf(stderr, "%s is damaged\n", file_name);
+        return false;
+    }
+
+    const u64 records_size = static_cast<u64>(columnar_training_data.record_count) * TRAINING_RECORD_SIZE;
+    i8* const records = static_cast<i8*>(malloc(records_size));
+    for (u32 record_index = 0; record_index < columnar_training_data.record_count; ++record_index) {
+        columnar_training_record(columnar_training_data, record_index, records + static_cast<u64>(record_index) * TRAINING_RECORD_SIZE);
+    }
+
+    munmap(const_cast<void*>(data), size);
+    return view_training_data(records, records_size, view);
+}
+
+// Sets view to the file's records in the plain layout, decoding into memory first if the file is compressed or
+// columnar, see view_training_data_file() for the rest
+static bool load_dataset(const char* const file_name, const int advice, TrainingDataView& view) {
+    u64 size = 0;
+    const void* const data = map_whole_file(file_name, advice, size);
+    if (data == nullptr) {
+        fprintf(stderr, "couldn't map %s\n", file_name);
+        return false;
+    }
+
+    return is_decoded_dataset(data, size) ? decode_dataset(file_name, data, size, view) : view_training_data_file(file_name, data, size, view);
+}
+
+// Same a piece at a time for going through a manifest's shards without needing them all in memory together,
+// a compressed or columnar file is still decoded whole
+static bool open_dataset_pieces(const char* const file_name, TrainingDataPieces& pieces) {
+    u64 size = 0;
+    const void* const data = map_whole_file(file_name, MADV_SEQUENTIAL, size);
+    if (data == nullptr) {
+        fprintf(stderr, "couldn't map %s\n", file_name);
+        return false;
+    }
+
+    if (is_decoded_dataset(data, size)) {
+        TrainingDataView training_data = {};
+        return decode_dataset(file_name, data, size, training_data) &&
+            open_training_data_pieces(file_name, training_data.records, static_cast<u64>(training_data.record_count) * TRAINING_RECORD_SIZE, pieces);
+    }
+
+    return open_training_data_pieces(file_name, data, size, pieces);
+}
+
+// In [0, count) without the bias of a modulo
+static u64 random_below(u64& state, const u64 count) {
+    return static_cast<u64>((static_cast<unsigned __int128>(next_random(state)) * count) >> 64);
+}
+
+struct RecordFields {
+    i32 difficulty_level;
+    i32 rows_cleared;
+    i8 next_tetrimino_type;
+    i8 current_tetrimino_type;
+    i8 block_coordinates[8];
+    u16 encoded_rows[Tetris::Grid::ROW_COUNT];
+    BinaryPlayerInput player_input;
+};
+
+static RecordFields record_fields(const i8* const record) {
+    RecordFields fields = {};
+    copy_bytes(record, sizeof(fields.difficulty_level), reinterpret_cast<i8*>(&fields.difficulty_level));
+    copy_bytes(record + 4, sizeof(fields.rows_cleared), reinterpret_cast<i8*>(&fields.rows_cleared));
+    fields.next_tetrimino_type = record[8];
+    fields.current_tetrimino_type = record[9];
+    copy_bytes(record + 10, sizeof(fields.block_coordinates), fields.block_coordinates);
+    copy_bytes(record + BINARY_GRID_OFFSET, sizeof(fields.encoded_rows), reinterpret_cast<i8*>(fields.encoded_rows));
+    copy_bytes(record + BINARY_GAME_STATE_SIZE, sizeof(fields.player_input), reinterpret_cast<i8*>(&fields.player_input));
+
+    return fields;
+}
+
+static constexpr const char* ACTION_NAMES[NeuralNetwork::OUTPUT_LAYER_SIZE] = {"down", "left", "right", "clockwise", "anti clockwise"};
+
+static int stats(const char* const file_name) {
+    TrainingDataView training_data = {};
+    if (!load_dataset(file_name, MADV_SEQUENTIAL, training_data)) {
+        return 1;
+    }
+
+    u64 level_counts[MAX_REPORTED_LEVEL + 1] = {};
+    u64 tetrimino_counts[Tetris::Tetrimino::Type::COUNT + 1] = {};
+    u64 action_counts[NeuralNetwork::OUTPUT_LAYER_SIZE] = {};
+    u64 combination_counts[1 << NeuralNetwork::OUTPUT_LAYER_SIZE] = {};
+    i32 most_rows_cleared = 0;
+    for (u32 record_index = 0; record_index < training_data.record_count; ++record_index) {
+        const RecordFields fields = record_fields(training_record(training_data, record_index));
+        const i32 level = (fields.difficulty_level < 0) ? 0 : fields.difficulty_level;
+        ++level_counts[(level < static_cast<i32>(MAX_REPORTED_LEVEL)) ? level : MAX_REPORTED_LEVEL];
+
+        const u32 tetrimino_type = static_cast<u8>(fields.current_tetrimino_type);
+        ++tetrimino_counts[(tetrimino_type < Tetris::Tetrimino::Type::COUNT) ? tetrimino_type : static_cast<u32>(Tetris::Tetrimino::Type::COUNT)];
+
+        const u32 combination = fields.player_input & ((1 << NeuralNetwork::OUTPUT_LAYER_SIZE) - 1);
+        ++combination_counts[combination];
+        for (i32 action = 0; action < NeuralNetwork::OUTPUT_LAYER_SIZE; ++action) {
+            action_counts[action] += (combination >> action) & 1;
+        }
+
+        most_rows_cleared = (fields.rows_cleared > most_rows_cleared) ? fields.rows_cleared : most_rows_cleared;
+    }
+
+    const f64 percent_per_record = 100.0 / training_data.record_count;
+    printf("records: %u\n", training_data.record_count);
+    printf("most rows cleared: %d\n", most_rows_cleared);
+
+    printf("levels:\n");
+    for (u32 level = 0; level <= MAX_REPORTED_LEVEL; ++level) {
+        if (level_counts[level] != 0) {
+            printf("  %2u%s %12llu %6.2f%%\n", level, (level == MAX_REPORTED_LEVEL) ? "+" : " ", static_cast<unsigned long long>(level_counts[level]), level_counts[level] * percent_per_record);
+        }
+    }
+
+    static constexpr const char* TETRIMINO_NAMES[Tetris::Tetrimino::Type::COUNT + 1] = {"T", "L", "RL", "S", "Z", "square", "long", "invalid"};
+    printf("current tetriminos:\n");
+    for (u32 type = 0; type <= Tetris::Tetrimino::Type::COUNT; ++type) {
+        if (tetrimino_counts[type] != 0) {
+            printf("  %-14s %12llu %6.2f%%\n", TETRIMINO_NAMES[type], static_cast<unsigned long long>(tetrimino_counts[type]), tetrimino_counts[type] * percent_per_record);
+        }
+    }
+
+    printf("actions held:\n");
+    for (i32 action = 0; action < NeuralNetwork::OUTPUT_LAYER_SIZE; ++action) {
+        printf("  %-14s %12llu %6.2f%%\n", ACTION_NAMES[action], static_cast<unsigned long long>(action_counts[action]), action_counts[action] * percent_per_record);
+    }
+
+    printf("action combinations:\n");
+    for (u32 combination = 0; combination < (1 << NeuralNetwork::OUTPUT_LAYER_SIZE); ++combination) {
+        if (combination_counts[combination] == 0) {
+            continue;
+        }
+
+        char name[128] = "none";
+        u32 name_length = 0;
+        for (i32 action = 0; action < NeuralNetwork::OUTPUT_LAYER_SIZE; ++action) {
+            if ((combination >> action) & 1) {
+                name_length += snprintf(name + name_length, sizeof(name) - name_length, "%s%s", (name_length == 0) ? "" : " + ", ACTION_NAMES[action]);
+            }
+        }
+
+        printf("  %-40s %12llu %6.2f%%\n", name, static_cast<unsigned long long>(combination_counts[combination]), combination_counts[combination] * percent_per_record);
+    }
+
+    return 0;
+}
+
+enum RecordProblem : u32 {
+    LEVEL_MISMATCH = 0,
+    TETRIMINO_TYPE = 1,
+    BLOCK_OUTSIDE_GRID = 2,
+    BLOCK_OVERLAPS = 3,
+    GRID_ROW_BITS = 4,
+    PLAYER_INPUT_BITS = 5,
+    COUNT = 6
+};
+
+static constexpr const char* RECORD_PROBLEM_NAMES[RecordProblem::COUNT] = {
+    "level doesn't match rows cleared",
+    "tetrimino type out of range",
+    "block outside the grid",
+    "block overlaps another or a filled cell",
+    "grid row bits past the last column",
+    "player input bits past the last action"
+};
+
+// A mask of the RecordProblems the record has
+static u32 record_problems(const i8* const record) {
+    const RecordFields fields = record_fields(record);
+    u32 problems = 0;
+
+    // see calculate_difficulty_level()
+    if (fields.rows_cleared < 0 || fields.difficulty_level != fields.rows_cleared / 10 + 1) {
+        problems |= 1 << RecordProblem::LEVEL_MISMATCH;
+    }
+
+    const bool valid_types = static_cast<u8>(fields.next_tetrimino_type) < Tetris::Tetrimino::Type::COUNT &&
+        static_cast<u8>(fields.current_tetrimino_type) < Tetris::Tetrimino::Type::COUNT;
+    if (!valid_types) {
+        problems |= 1 << RecordProblem::TETRIMINO_TYPE;
+    }
+
+    for (u32 block = 0; block < Tetris::Tetrimino::Blocks::COUNT; ++block) {
+        const i32 x = fields.block_coordinates[2 * block];
+        const i32 y = fields.block_coordinates[2 * block + 1];
+        if (x < 0 || x >= Tetris::Grid::COLUMN_COUNT || y < 0 || y >= Tetris::Grid::ROW_COUNT) {
+            problems |= 1 << RecordProblem::BLOCK_OUTSIDE_GRID;
+            continue;
+        }
+
+        // the falling tetrimino is never part of the grid until it lands
+        bool overlaps = (fields.encoded_rows[y] >> x) & 1;
+        for (u32 other_block = 0; other_block < block; ++other_block) {
+            overlaps = overlaps || (fields.block_coordinates[2 * other_block] == x && fields.block_coordinates[2 * other_block + 1] == y);
+        }
+
+        if (overlaps) {
+            problems |= 1 << RecordProblem::BLOCK_OVERLAPS;
+        }
+    }
+
+    for (i32 row = 0; row < Tetris::Grid::ROW_COUNT; ++row) {
+        if ((fields.encoded_rows[row] >> Tetris::Grid::COLUMN_COUNT) != 0) {
+            problems |= 1 << RecordProblem::GRID_ROW_BITS;
+        }
+    }
+
+    if ((fields.player_input >> NeuralNetwork::OUTPUT_LAYER_SIZE) != 0) {
+        problems |= 1 << RecordProblem::PLAYER_INPUT_BITS;
+    }
+
+    return problems;
+}
+
+static int validate(const char* const file_name) {
+    TrainingDataView training_data = {};
+    if (!load_dataset(file_name, MADV_SEQUENTIAL, training_data)) {
+        return 1;
+    }
+
+    u64 problem_counts[RecordProblem::COUNT] = {};
+    u64 first_problem_records[RecordProblem::COUNT] = {};
+    u64 bad_record_count = 0;
+    for (u32 record_index = 0; record_index < training_data.record_count; ++record_index) {
+        const u32 problems = record_problems(training_record(training_data, record_index));
+        bad_record_count += (problems != 0) ? 1 : 0;
+        for (u32 problem = 0; problem < RecordProblem::COUNT; ++problem) {
+            if ((problems >> problem) & 1) {
+                first_problem_records[problem] = (problem_counts[problem] == 0) ? record_index : first_problem_records[problem];
+                ++problem_counts[problem];
+            }
+        }
+    }
+
+    printf("records: %u\n", training_data.record_count);
+    printf("trailing bytes: %u\n", training_data.trailing_byte_count);
+    printf("bad records: %llu\n", static_cast<unsigned long long>(bad_record_count));
+    for (u32 problem = 0; problem < RecordProblem::COUNT; ++problem) {
+        if (problem_counts[problem] != 0) {
+            printf("  %-42s %12llu (first at record %llu)\n", RECORD_PROBLEM_NAMES[problem], static_cast<unsigned long long>(problem_counts[problem]), static_cast<unsigned long long>(first_problem_records[problem]));
+        }
+    }
+
+    return (bad_record_count == 0 && training_data.trailing_byte_count == 0) ? 0 : 1;
+}
+
+static int merge(const char* const output_file_name, const char* const* const input_file_names, const u32 input_file_count) {
+    DatasetWriter writer = {};
+    if (!open_dataset_writer(output_file_name, writer)) {
+        return 1;
+    }
+
+    u64 record_count = 0;
+    for (u32 i = 0; i < input_file_count; ++i) {
+        TrainingDataPieces pieces = {};
+        if (!open_dataset_pieces(input_file_names[i], pieces)) {
+            fclose(writer.file);
+            remove(writer.temp_file_name);
+            return 1;
+        }
+
+        TrainingDataView piece = {};
+        while (next_training_data_piece(pieces, piece)) {
+            write_dataset(writer, piece.records, static_cast<u64>(piece.record_count) * TRAINING_RECORD_SIZE);
+            record_count += piece.record_count;
+        }
+
+        const bool failed = pieces.failed;
+        close_training_data_pieces(pieces);
+        if (failed) {
+            fclose(writer.file);
+            remove(writer.temp_file_name);
+            return 1;
+        }
+    }
+
+    if (record_count > MAX_TRAINING_RECORD_COUNT) {
+        fprintf(stderr, "warning: %llu records is more than one file can be trained on\n", static_cast<unsigned long long>(record_count));
+    }
+
+    if (!close_dataset_writer(writer)) {
+        return 1;
+    }
+
+    printf("records: %llu\n", static_cast<unsigned long long>(record_count));
+    printf("written to: %s\n", output_file_name);
+
+    return 0;
+}
+
+static int split(const char* const input_file_name, const char* const train_file_name, const char* const validation_file_name, const f64 validation_fraction, u64 rng_state) {
+    TrainingDataView training_data = {};
+    if (!load_dataset(input_file_name, MADV_SEQUENTIAL, training_data)) {
+        return 1;
+    }
+
+    DatasetWriter train_writer = {};
+    DatasetWriter validation_writer = {};
+    if (!open_dataset_writer(train_file_name, train_writer) || !open_dataset_writer(validation_file_name, validation_writer)) {
+        return 1;
+    }
+
+    u64 validation_record_count = 0;
+    for (u32 first_record = 0; first_record < training_data.record_count; first_record += SPLIT_SEGMENT_RECORD_COUNT) {
+        const u32 records_left = training_data.record_count - first_record;
+        const u32 segment_record_count = (records_left < SPLIT_SEGMENT_RECORD_COUNT) ? records_left : SPLIT_SEGMENT_RECORD_COUNT;
+        const bool validation = static_cast<f64>(next_random(rng_state) >> 11) * 0x1.0p-53 < validation_fraction;
+        write_dataset(validation ? validation_writer : train_writer, training_record(training_data, first_record), static_cast<u64>(segment_record_count) * TRAINING_RECORD_SIZE);
+        validation_record_count += validation ? segment_record_count : 0;
+    }
+
+    const bool train_saved = close_dataset_writer(train_writer);
+    const bool validation_saved = close_dataset_writer(validation_writer);
+    if (!train_saved || !validation_saved) {
+        return 1;
+    }
+
+    printf("records: %u\n", training_data.record_count);
+    printf("train records: %llu\n", static_cast<unsigned long long>(training_data.record_count - validation_record_count));
+    printf("validation records: %llu\n", static_cast<unsigned long long>(validation_record_count));
+    printf("written to: %s, %s\n", train_file_name, validation_file_name);
+
+    return 0;
+}
+
+static int convert(const char* const input_file_name, const char* const output_file_name, const char* const format) {
+    TrainingDataView training_data = {};
+    if (!load_dataset(input_file_name, MADV_SEQUENTIAL, training_data)) {
+        return 1;
+    }
+
+    const i8* output = nullptr;
+    u64 output_size = 0;
+    if (strcmp(format, "records") == 0) {
+        output = training_data.records;
+        output_size = static_cast<u64>(training_data.record_count) * TRAINING_RECORD_SIZE;
+    } else if (strcmp(format, "compressed") == 0) {
+        const u64 buffer_size = max_compressed_training_data_size(training_data.record_count);
+        i8* const buffer = static_cast<i8*>(malloc(buffer_size));
+        output_size = compress_training_data(training_data, buffer, buffer_size);
+        output = buffer;
+    } else if (strcmp(format, "columnar") == 0) {
+        i8* const buffer = static_cast<i8*>(aligned_alloc(alignof(ColumnarTrainingDataBlock), columnar_training_data_size(training_data.record_count)));
+        output_size = columnize_training_data(training_data, buffer);
+        output = buffer;
+    } else if (strcmp(format, "weighted") == 0) {
+        u32* const table = static_cast<u32*>(malloc(deduplication_table_size(training_data.record_count)));
+        i8* const buffer = static_cast<i8*>(aligned_alloc(alignof(WeightedTrainingSample), max_weighted_training_data_size(training_data.record_count)));
+        output_size = deduplicate_training_data(training_data, table, buffer);
+        output = buffer;
+        free(table);
+    } else {
+        fprintf(stderr, "unknown format %s, expected records, compressed, columnar or weighted\n", format);
+        return 1;
+    }
+
+    if (output_size == 0 || !replace_whole_file(output_file_name, output, output_size)) {
+        fprintf(stderr, "couldn't write %s\n", output_file_name);
+        return 1;
+    }
+
+    printf("records: %u\n", training_data.record_count);
+    printf("bytes: %llu\n", static_cast<unsigned long long>(output_size));
+    printf("written to: %s\n", output_file_name);
+
+    return 0;
+}
+
+static void shuffle_records(i8* const records, const u32 record_count, u64& rng_state) {
+    i8 swap[TRAINING_RECORD_SIZE];
+    for (u32 i = record_count; i > 1; --i) {
+        const u32 j = static_cast<u32>(random_below(rng_state, i));
+        i8* const last = records + static_cast<u64>(i - 1) * TRAINING_RECORD_SIZE;
+        i8* const other = records + static_cast<u64>(j) * TRAINING_RECORD_SIZE;
+        memcpy(swap, last, TRAINING_RECORD_SIZE);
+        memcpy(last, other, TRAINING_RECORD_SIZE);
+        memcpy(other, swap, TRAINING_RECORD_SIZE);
+    }
+}
+
+// A run being merged, records [next_record, record_count) still to go of which [buffer_start, buffer_end) are buffered
+struct ShuffleRun {
+    u64 file_offset;
+    u32 record_count;
+    u32 next_record;
+    i8* buffer;
+    u32 buffer_start;
+    u32 buffer_end;
+};
+
+// Fenwick tree over the records each run has left, picks a run in proportion to them in log time
+static void add_remaining(u32* const tree, const u32 run_count, const u32 run, const i32 amount) {
+    for (u32 i = run + 1; i <= run_count; i += i & (0 - i)) {
+        tree[i] += amount;
+    }
+}
+
+// The run holding the target'th record left, counting through the runs in order
+static u32 find_run(const u32* const tree, const u32 run_count, u64 target) {
+    u32 step = 1;
+    while (step * 2 <= run_count) {
+        step *= 2;
+    }
+
+    u32 position = 0;
+    for (; step != 0; step /= 2) {
+        if (position + step <= run_count && tree[position + step] <= target) {
+            position += step;
+            target -= tree[position];
+        }
+    }
+
+    return position;
+}
+
+// Shuffles the records in memory and adds them to the end of the runs file as a run of their own
+static bool spill_shuffle_run(const int runs_file, i8* const memory, const u32 record_count, u64& rng_state, ShuffleRun*& runs, u32& run_count) {
+    const u64 file_offset = (run_count > 0) ? runs[run_count - 1].file_offset + static_cast<u64>(runs[run_count - 1].record_count) * TRAINING_RECORD_SIZE : 0;
+    runs = static_cast<ShuffleRun*>(realloc(runs, (run_count + 1) * sizeof(ShuffleRun)));
+    runs[run_count] = {};
+    runs[run_count].file_offset = file_offset;
+    runs[run_count].record_count = record_count;
+    ++run_count;
+
+    const u64 run_size = static_cast<u64>(record_count) * TRAINING_RECORD_SIZE;
+    shuffle_records(memory, record_count, rng_state);
+    return pwrite(runs_file, memory, run_size, static_cast<off_t>(file_offset)) == static_cast<ssize_t>(run_size);
+}
+
+static int shuffle(const char* const input_file_name, const char* const output_file_name, const u64 memory_size, u64 rng_state) {
+    const u64 memory_record_count = memory_size / TRAINING_RECORD_SIZE;
+    if (memory_record_count < 2) {
+        fprintf(stderr, "not enough memory for a shuffle\n");
+        return 1;
+    }
+
+    TrainingDataPieces pieces = {};
+    if (!open_dataset_pieces(input_file_name, pieces)) {
+        return 1;
+    }
+
+    DatasetWriter writer = {};
+    if (!open_dataset_writer(output_file_name, writer)) {
+        return 1;
+    }
+
+    // runs go one after another in a scratch file next to the output, read back with positional reads so every
+    // run keeps its own place without seeking
+    char runs_file_name[4096] = {};
+    snprintf(runs_file_name, sizeof(runs_file_name), "%s.runs", output_file_name);
+    int runs_file = -1;
+
+    // records fill memory as the pieces are read and each time it's full, with more to come, the run in it is
+    // spilled, so a run can span shards and only the last one is ever short
+    const u32 run_record_count = (memory_record_count < MAX_TRAINING_RECORD_COUNT) ? static_cast<u32>(memory_record_count) : static_cast<u32>(MAX_TRAINING_RECORD_COUNT);
+    i8* const memory = static_cast<i8*>(malloc(static_cast<u64>(run_record_count) * TRAINING_RECORD_SIZE));
+    ShuffleRun* runs = nullptr;
+    u32 run_count = 0;
+    u32 memory_count = 0;
+    u64 record_count = 0;
+    bool failed = false;
+    const f64 start = seconds_now();
+    TrainingDataView piece = {};
+    while (!failed && next_training_data_piece(pieces, piece)) {
+        record_count += piece.record_count;
+        if (record_count > MAX_TRAINING_RECORD_COUNT) {
+            fprintf(stderr, "more than %llu records to shuffle\n", static_cast<unsigned long long>(MAX_TRAINING_RECORD_COUNT));
+            failed = true;
+        }
+
+        for (u32 piece_record = 0; piece_record < piece.record_count && !failed;) {
+            if (memory_count == run_record_count) {
+                if (runs_file < 0) {
+                    runs_file = open(runs_file_name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+                    if (runs_file < 0) {
+                        fprintf(stderr, "couldn't create %s\n", runs_file_name);
+                        failed = true;
+                        break;
+                    }
+
+                    unlink(runs_file_name);
+                }
+
+                failed = !spill_shuffle_run(runs_file, memory, memory_count, rng_state, runs, run_count);
+                memory_count = 0;
+            }
+
+            const u32 copy_count = (piece.record_count - piece_record < run_record_count - memory_count) ? piece.record_count - piece_record : run_record_count - memory_count;
+            memcpy(memory + static_cast<u64>(memory_count) * TRAINING_RECORD_SIZE, training_record(piece, piece_record), static_cast<u64>(copy_count) * TRAINING_RECORD_SIZE);
+            memory_count += copy_count;
+            piece_record += copy_count;
+        }
+    }
+
+    failed = failed || pieces.failed;
+    close_training_data_pieces(pieces);
+    if (!failed && record_count == 0) {
+        fprintf(stderr, "no training records in %s\n", input_file_name);
+        failed = true;
+    }
+
+    if (!failed && run_count == 0) {
+        shuffle_records(memory, memory_count, rng_state);
+        write_dataset(writer, memory, static_cast<u64>(memory_count) * TRAINING_RECORD_SIZE);
+        if (!close_dataset_writer(writer)) {
+            return 1;
+        }
+
+        printf("records: %llu\n", static_cast<unsigned long long>(record_count));
+        printf("runs: 1\n");
+        printf("seconds: %.3f\n", seconds_now() - start);
+        printf("written to: %s\n", output_file_name);
+        return 0;
+    }
+
+    failed = failed || !spill_shuffle_run(runs_file, memory, memory_count, rng_state, runs, run_count);
+    free(memory);
+    if (failed) {
+        fclose(writer.file);
+        remove(writer.temp_file_name);
+        return 1;
+    }
+
+    // the same memory split between a buffer per run and one for the output
+    const u32 buffer_record_count = static_cast<u32>(memory_record_count / (run_count + 1)) > 0 ? static_cast<u32>(memory_record_count / (run_count + 1)) : 1;
+    i8* const buffers = static_cast<i8*>(malloc(static_cast<u64>(run_count + 1) * buffer_record_count * TRAINING_RECORD_SIZE));
+    i8* const output_buffer = buffers + static_cast<u64>(run_count) * buffer_record_count * TRAINING_RECORD_SIZE;
+    u32* const tree = static_cast<u32*>(calloc(run_count + 1, sizeof(u32)));
+    for (u32 run = 0; run < run_count; ++run) {
+        runs[run].buffer = buffers + static_cast<u64>(run) * buffer_record_count * TRAINING_RECORD_SIZE;
+        add_remaining(tree, run_count, run, static_cast<i32>(runs[run].record_count));
+    }
+
+    u32 output_buffer_count = 0;
+    for (u64 records_left = record_count; records_left > 0 && !failed; --records_left) {
+        ShuffleRun& run = runs[find_run(tree, run_count, random_below(rng_state, records_left))];
+        if (run.buffer_start == run.buffer_end) {
+            const u32 run_records_left = run.record_count - run.next_record;
+            const u32 read_count = (run_records_left < buffer_record_count) ? run_records_left : buffer_record_count;
+            const u64 read_size = static_cast<u64>(read_count) * TRAINING_RECORD_SIZE;
+            const u64 read_offset = run.file_offset + static_cast<u64>(run.next_record) * TRAINING_RECORD_SIZE;
+            failed = pread(runs_file, run.buffer, read_size, static_cast<off_t>(read_offset)) != static_cast<ssize_t>(read_size);
+            run.buffer_start = 0;
+            run.buffer_end = read_count;
+        }
+
+        memcpy(output_buffer + static_cast<u64>(output_buffer_count) * TRAINING_RECORD_SIZE, run.buffer + static_cast<u64>(run.buffer_start) * TRAINING_RECORD_SIZE, TRAINING_RECORD_SIZE);
+        ++run.buffer_start;
+        ++run.next_record;
+        add_remaining(tree, run_count, static_cast<u32>(&run - runs), -1);
+
+        if (++output_buffer_count == buffer_record_count || records_left == 1) {
+            write_dataset(writer, output_buffer, static_cast<u64>(output_buffer_count) * TRAINING_RECORD_SIZE);
+            output_buffer_count = 0;
+        }
+    }
+
+    close(runs_file);
+    writer.failed = writer.failed || failed;
+    if (!close_dataset_writer(writer)) {
+        return 1;
+    }
+
+    printf("records: %llu\n", static_cast<unsigned long long>(record_count));
+    printf("runs: %u of up to %u records\n", run_count, run_record_count);
+    printf("merge buffer records per run: %u\n", buffer_record_count);
+    printf("seconds: %.3f\n", seconds_now() - start);
+    printf("written to: %s\n", output_file_name);
+
+    return 0;
+}
+
+static int shard(const char* const input_file_name, const char* const manifest_file_name, const u64 max_shard_size) {
+    TrainingDataView training_data = {};
+    if (!load_dataset(input_file_name, MADV_SEQUENTIAL, training_data)) {
+        return 1;
+    }
+
+    const u64 shard_record_count = max_shard_size / TRAINING_RECORD_SIZE;
+    const u64 shard_count = (shard_record_count > 0) ? (training_data.record_count + shard_record_count - 1) / shard_record_count : 0;
+    if (shard_count == 0 || shard_count > MAX_TRAINING_DATA_SHARD_COUNT) {
+        fprintf(stderr, "shards have to hold at least one record and there can't be more than %u of them\n", MAX_TRAINING_DATA_SHARD_COUNT);
+        return 1;
+    }
+
+    TrainingDataShard* const shards = static_cast<TrainingDataShard*>(calloc(shard_count, sizeof(TrainingDataShard)));
+    for (u32 i = 0; i < shard_count; ++i) {
+        TrainingDataShard& shard = shards[i];
+        if (!manifest_shard_file_name(manifest_file_name, i, shard.file_name, sizeof(shard.file_name))) {
+            fprintf(stderr, "%s makes shard file names longer than %u characters\n", manifest_file_name, static_cast<u32>(sizeof(shard.file_name) - 1));
+            return 1;
+        }
+
+        const u32 first_record = static_cast<u32>(i * shard_record_count);
+        const u32 records_left = training_data.record_count - first_record;
+        shard.record_count = (records_left < shard_record_count) ? records_left : shard_record_count;
+        shard.checksum = crc32c(training_record(training_data, first_record), shard.record_count * TRAINING_RECORD_SIZE);
+        shard.flags = TRAINING_DATA_SHARD_FINISHED;
+
+        char shard_file_name[4096] = {};
+        shard_file_path(manifest_file_name, shard.file_name, shard_file_name, sizeof(shard_file_name));
+        DatasetWriter writer = {};
+        if (!open_dataset_writer(shard_file_name, writer)) {
+            return 1;
+        }
+
+        write_dataset(writer, training_record(training_data, first_record), shard.record_count * TRAINING_RECORD_SIZE);
+        if (!close_dataset_writer(writer)) {
+            return 1;
+        }
+    }
+
+    // the manifest goes last so there's never one listing shards that aren't all there
+    const u64 manifest_size = training_data_manifest_size(static_cast<u32>(shard_count));
+    i8* const manifest = static_cast<i8*>(malloc(manifest_size));
+    write_training_data_manifest(shards, static_cast<u32>(shard_count), manifest);
+    if (!replace_whole_file(manifest_file_name, manifest, manifest_size)) {
+        fprintf(stderr, "couldn't write %s\n", manifest_file_name);
+        return 1;
+    }
+
+    printf("records: %u\n", training_data.record_count);
+    printf("shards: %llu\n", static_cast<unsigned long long>(shard_count));
+    printf("records per shard: %llu\n", static_cast<unsigned long long>(shard_record_count));
+    printf("written to: %s\n", manifest_file_name);
+
+    return 0;
+}
+
+static int usage(const char* const program) {
+    fprintf(stderr,
+        "usage: %s stats FILE\n"
+        "       %s validate FILE\n"
+        "       %s merge --output FILE FILE...\n"
+        "       %s split [--validation-fraction F] [--seed N] --train FILE --validation FILE FILE\n"
+        "       %s convert --to records|compressed|columnar|weighted --output FILE FILE\n"
+        "       %s shuffle [--seed N] [--memory-mb N] --output FILE FILE\n"
+        "       %s shard [--shard-mb N] --output MANIFEST FILE\n",
+        program, program, program, program, program, program, program);
+    return 1;
+}
+
+int main(const int argc, const char* const* const argv) {
+    if (argc < 3) {
+        return usage(argv[0]);
+    }
+
+    const char* const command = argv[1];
+    const char* output_file_name = nullptr;
+    const char* train_file_name = nullptr;
+    const char* validation_file_name = nullptr;
+    const char* format = nullptr;
+    f64 validation_fraction = 0.1;
+    u64 rng_seed = 1;
+    u64 memory_mb = 1024;
+    u64 shard_mb = 64;
+    const char* input_file_names[256] = {};
+    u32 input_file_count = 0;
+    for (int i = 2; i < argc; ++i) {
+        if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output_file_name = argv[++i];
+        } else if (strcmp(argv[i], "--train") == 0 && i + 1 < argc) {
+            train_file_name = argv[++i];
+        } else if (strcmp(argv[i], "--validation") == 0 && i + 1 < argc) {
+            validation_file_name = argv[++i];
+        } else if (strcmp(argv[i], "--to") == 0 && i + 1 < argc) {
+            format = argv[++i];
+        } else if (strcmp(argv[i], "--validation-fraction") == 0 && i + 1 < argc) {
+            validation_fraction = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            rng_seed = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--memory-mb") == 0 && i + 1 < argc) {
+            memory_mb = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--shard-mb") == 0 && i + 1 < argc) {
+            shard_mb = strtoull(argv[++i], nullptr, 10);
+        } else if (argv[i][0] != '-' && input_file_count < sizeof(input_file_names) / sizeof(input_file_names[0])) {
+            input_file_names[input_file_count++] = argv[i];
+        } else {
+            return usage(argv[0]);
+        }
+    }
+
+    const bool one_input = input_file_count == 1;
+    if (strcmp(command, "stats") == 0 && one_input) {
+        return stats(input_file_names[0]);
+    } else if (strcmp(command, "validate") == 0 && one_input) {
+        return validate(input_file_names[0]);
+    } else if (strcmp(command, "merge") == 0 && input_file_count > 0 && output_file_name != nullptr) {
+        return merge(output_file_name, input_file_names, input_file_count);
+    } else if (strcmp(command, "split") == 0 && one_input && train_file_name != nullptr && validation_file_name != nullptr) {
+        return split(input_file_names[0], train_file_name, validation_file_name, validation_fraction, rng_seed);
+    } else if (strcmp(command, "convert") == 0 && one_input && format != nullptr && output_file_name != nullptr) {
+        return convert(input_file_names[0], output_file_name, format);
+    } else if (strcmp(command, "shuffle") == 0 && one_input && output_file_name != nullptr) {
+        return shuffle(input_file_names[0], output_file_name, memory_mb * 1024 * 1024, rng_seed);
+    } else if (strcmp(command, "shard") == 0 && one_input && output_file_name != nullptr) {
+        return shard(input_file_names[0], output_file_name, shard_mb * 1024 * 1024);
+    }
+
+    return usage(argv[0]);
+}
@@ -0,0 +1,176 @@
+// Times turning training data into network inputs and targets, the step in front of every back propagation
+// of every epoch. The one record at a time conversion the game uses for inference is timed next to the batch
+// decoder on each kernel the CPU has, from plain records and from the columnar format. Each decodes the
+// whole file in trainer sized batches into one aligned buffer and is checked against the one at a time
+// results. Throughput is given in GB/s of inputs and targets written, along with the data read to get them.
+//
+// Usage: decoder_benchmark [--training-data FILE] [--passes N]
+
+#include "neural_network.h"
+#include "kernel_tuning.h"
+#include "convolutional_neural_network.h"
+#include "training_data.h"
+#include "columnar_training_data.h"
+
+#include "util.cpp"
+#include "simd.cpp"
+#include "neural_network.cpp"
+#include "kernel_tuning.cpp"
+#include "convolutional_neural_network.cpp"
+#include "training_data.cpp"
+#include "columnar_training_data.cpp"
+#include "tools_linux.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static constexpr u32 DECODE_BATCH_SIZE = 64;
+static constexpr u64 DECODED_RECORD_SIZE = sizeof(NeuralNetwork::InputLayer) + sizeof(NeuralNetwork::OutputLayer);
+
+struct DecodeBatch {
+    alignas(64) NeuralNetwork::InputLayer inputs[DECODE_BATCH_SIZE];
+    NeuralNetwork::OutputLayer targets[DECODE_BATCH_SIZE];
+};
+
+enum DecodeSource : u32 {
+    RECORDS_ONE_AT_A_TIME = 0,
+    RECORDS = 1,
+    COLUMNS = 2
+};
+
+struct DecodeData {
+    TrainingDataView records;
+    ColumnarTrainingDataView columns;
+};
+
+static void decode_batch(const DecodeData& data, const DecodeSource source, const KernelVariant variant, const u32 first_record, const u32 record_count, DecodeBatch& batch) {
+    if (source == DecodeSource::RECORDS_ONE_AT_A_TIME) {
+        for (u32 i = 0; i < record_count; ++i) {
+            const i8* const record = training_record(data.records, first_record + i);
+
+            BinaryGameState binary_game_state = {};
+            copy_bytes(record, sizeof(binary_game_state), reinterpret_cast<i8*>(binary_game_state));
+            binary_game_state_to_neural_network_input(binary_game_state, batch.inputs[i]);
+
+            BinaryPlayerInput encoded_player_input = 0;
+            copy_bytes(record + sizeof(binary_game_state), sizeof(encoded_player_input), reinterpret_cast<i8*>(&encoded_player_input));
+            binary_player_input_to_neural_network_output(encoded_player_input, batch.targets[i]);
+        }
+    } else if (source == DecodeSource::RECORDS) {
+        decode_training_records(training_record(data.records, first_record), TRAINING_RECORD_SIZE, record_count, variant, batch.inputs, batch.targets);
+    } else {
+        const ColumnarTrainingDataBlock& block = data.columns.blocks[first_record / COLUMNAR_BLOCK_RECORD_COUNT];
+        decode_columnar_training_data(block, first_record % COLUMNAR_BLOCK_RECORD_COUNT, record_count, variant, batch.inputs, batch.targets);
+    }
+}
+
+// Seconds for the quickest pass over every record, or a negative number if any batch decoded differently
+static f64 time_decoding(const DecodeData& data, const DecodeSource source, const KernelVariant variant, const u32 pass_count, DecodeBatch& batch, DecodeBatch& expected_batch) {
+    static_assert(COLUMNAR_BLOCK_RECORD_COUNT % DECODE_BATCH_SIZE == 0);
+
+    const u32 record_count = data.records.record_count;
+    for (u32 first_record = 0; first_record < record_count; first_record += DECODE_BATCH_SIZE) {
+        const u32 batch_size = (record_count - first_record < DECODE_BATCH_SIZE) ? record_count - first_record : DECODE_BATCH_SIZE;
+        decode_batch(data, source, variant, first_record, batch_size, batch);
+        decode_batch(data, DecodeSource::RECORDS_ONE_AT_A_TIME, KernelVariant::SCALAR, first_record, batch_size, expected_batch);
+        const bool same = memcmp(batch.inputs, expected_batch.inputs, batch_size * sizeof(NeuralNetwork::InputLayer)) == 0 &&
+            memcmp(batch.targets, expected_batch.targets, batch_size * sizeof(NeuralNetwork::OutputLayer)) == 0;
+        if (!same) {
+            return -1.0;
+        }
+    }
+
+    f64 best_seconds = 1e30;
+    for (u32 pass = 0; pass < pass_count; ++pass) {
+        const f64 start = seconds_now();
+        for (u32 first_record = 0; first_record < record_count; first_record += DECODE_BATCH_SIZE) {
+            const u32 batch_size = (record_count - first_record < DECODE_BATCH_SIZE) ? record_count - first_record : DECODE_BATCH_SIZE;
+            decode_batch(data, source, variant, first_record, batch_size, batch);
+        }
+
+        const f64 seconds = seconds_now() - start;
+        best_seconds = (seconds < best_seconds) ? seconds : best_seconds;
+    }
+
+    return best_seconds;
+}
+
+int main(const int argc, const char* const* const argv) {
+    const char* training_data_file_name = "training_data_manifest.bin";
+    u32 pass_count = 5;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--training-data") == 0 && i + 1 < argc) {
+            training_data_file_name = argv[++i];
+        } else if (strcmp(argv[i], "--passes") == 0 && i + 1 < argc) {
+            pass_count = static_cast<u32>(atoi(argv[++i]));
+        } else {
+            fprintf(stderr, "usage: %s [--training-data FILE] [--passes N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    DecodeData data = {};
+    if (!load_training_data(training_data_file_name, MADV_SEQUENTIAL, data.records)) {
+        return 1;
+    }
+
+    const u64 columnar_size = columnar_training_data_size(data.records.record_count);
+    i8* const columnar_buffer = static_cast<i8*>(aligned_alloc(alignof(ColumnarTrainingDataBlock), columnar_size));
+    columnize_training_data(data.records, columnar_buffer);
+    view_columnar_training_data(columnar_buffer, columnar_size, data.columns);
+
+    struct Decoder {
+        const char* name;
+        DecodeSource source;
+        KernelVariant variant;
+        bool supported;
+    };
+
+    const CpuFeatures& cpu = cpu_features();
+    const Decoder decoders[] = {
+        {"records one at a time", DecodeSource::RECORDS_ONE_AT_A_TIME, KernelVariant::SCALAR, true},
+        {"records scalar", DecodeSource::RECORDS, KernelVariant::SCALAR, true},
+        {"records avx2", DecodeSource::RECORDS, KernelVariant::AVX2, cpu.avx2},
+        {"records avx512", DecodeSource::RECORDS, KernelVariant::AVX512, cpu.avx512f},
+        {"columns scalar", DecodeSource::COLUMNS, KernelVariant::SCALAR, true},
+        {"columns avx2", DecodeSource::COLUMNS, KernelVariant::AVX2, cpu.avx2},
+        {"columns avx512", DecodeSource::COLUMNS, KernelVariant::AVX512, cpu.avx512f},
+    };
+
+    const u32 record_count = data.records.record_count;
+    const f64 decoded_bytes = static_cast<f64>(record_count) * DECODED_RECORD_SIZE;
+    printf("records: %u\n", record_count);
+    printf("batch size: %u\n", DECODE_BATCH_SIZE);
+    printf("%-22s %10s %12s %12s %9s\n", "decoder", "ns/record", "written GB/s", "read GB/s", "speedup");
+
+    DecodeBatch* const batch = static_cast<DecodeBatch*>(aligned_alloc(alignof(DecodeBatch), sizeof(DecodeBatch)));
+    DecodeBatch* const expected_batch = static_cast<DecodeBatch*>(aligned_alloc(alignof(DecodeBatch), sizeof(DecodeBatch)));
+    f64 baseline_seconds = 0.0;
+    bool all_same = true;
+    for (u32 i = 0; i < sizeof(decoders) / sizeof(decoders[0]); ++i) {
+        const Decoder& decoder = decoders[i];
+        if (!decoder.supported) {
+            printf("%-22s %10s\n", decoder.name, "unsupported");
+            continue;
+        }
+
+        const f64 seconds = time_decoding(data, decoder.source, decoder.variant, pass_count, *batch, *expected_batch);
+        if (seconds < 0.0) {
+            printf("%-22s %10s\n", decoder.name, "mismatch");
+            all_same = false;
+            continue;
+        }
+
+        baseline_seconds = (i == 0) ? seconds : baseline_seconds;
+        const u64 source_record_size = (decoder.source == DecodeSource::COLUMNS) ? sizeof(ColumnarTrainingDataBlock) / COLUMNAR_BLOCK_RECORD_COUNT : TRAINING_RECORD_SIZE;
+        printf("%-22s %10.1f %12.2f %12.2f %8.2fx\n",
+            decoder.name,
+            seconds * 1e9 / record_count,
+            decoded_bytes / seconds / 1e9,
+            static_cast<f64>(record_count) * source_record_size / seconds / 1e9,
+            baseline_seconds / seconds);
+    }
+
+    return all_same ? 0 : 1;
+}
@@ -0,0 +1,102 @@
+// Collapses repeated records into weighted samples for the trainer. Idle ticks, where nothing moves and
+// nothing is pressed, make up most of a recording and are exact repeats of each other, so most of the work
+// in an epoch is back propagating the same record again. One epoch is timed both ways to report the saving,
+// and the two deltas are compared to show nothing was lost beyond float rounding.
+//
+// Usage: deduplicator [--training-data FILE] [--output FILE]
+
+#include "neural_network.h"
+#include "kernel_tuning.h"
+#include "convolutional_neural_network.h"
+#include "training_data.h"
+
+#include "util.cpp"
+#include "simd.cpp"
+#include "neural_network.cpp"
+#include "kernel_tuning.cpp"
+#include "convolutional_neural_network.cpp"
+#include "training_data.cpp"
+#include "tools_linux.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static constexpr u32 DELTA_FLOAT_COUNT = sizeof(PackedNeuralNetworkDelta) / sizeof(f32);
+
+int main(const int argc, const char* const* const argv) {
+    const char* training_data_file_name = "training_data_manifest.bin";
+    const char* output_file_name = "training_data_weighted.bin";
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--training-data") == 0 && i + 1 < argc) {
+            training_data_file_name = argv[++i];
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output_file_name = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--training-data FILE] [--output FILE]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // the hash table lookups make the file reads scattered
+    TrainingDataView training_data = {};
+    if (!load_training_data(training_data_file_name, MADV_RANDOM, training_data)) {
+        return 1;
+    }
+
+    u32* const table = static_cast<u32*>(malloc(deduplication_table_size(training_data.record_count)));
+    i8* const buffer = static_cast<i8*>(aligned_alloc(alignof(WeightedTrainingSample), max_weighted_training_data_size(training_data.record_count)));
+    const f64 deduplicate_start = seconds_now();
+    const u64 weighted_size = deduplicate_training_data(training_data, table, buffer);
+    const f64 deduplicate_seconds = seconds_now() - deduplicate_start;
+    free(table);
+
+    WeightedTrainingDataView weighted_training_data = {};
+    if (!view_weighted_training_data(buffer, weighted_size, weighted_training_data) || !replace_whole_file(output_file_name, buffer, weighted_size)) {
+        fprintf(stderr, "couldn't write %s\n", output_file_name);
+        return 1;
+    }
+
+    NeuralNetwork* const neural_network = static_cast<NeuralNetwork*>(aligned_alloc(alignof(NeuralNetwork), sizeof(NeuralNetwork)));
+    PackedNeuralNetwork* const packed_neural_network = static_cast<PackedNeuralNetwork*>(aligned_alloc(alignof(PackedNeuralNetwork), sizeof(PackedNeuralNetwork)));
+    PackedNeuralNetworkDelta* const record_delta = static_cast<PackedNeuralNetworkDelta*>(aligned_alloc(alignof(PackedNeuralNetworkDelta), sizeof(PackedNeuralNetworkDelta)));
+    PackedNeuralNetworkDelta* const sample_delta = static_cast<PackedNeuralNetworkDelta*>(aligned_alloc(alignof(PackedNeuralNetworkDelta), sizeof(PackedNeuralNetworkDelta)));
+    *neural_network = random_neural_network(1);
+    invalidate_packed_neural_network(*packed_neural_network);
+    const PackedNeuralNetwork& packed = pack_neural_network(*neural_network, *packed_neural_network);
+
+    memset(record_delta, 0, sizeof(PackedNeuralNetworkDelta));
+    const f64 record_start = seconds_now();
+    accumulate_training_delta(packed, training_data.records, 0, training_data.record_count, *record_delta);
+    const f64 record_epoch_seconds = seconds_now() - record_start;
+
+    memset(sample_delta, 0, sizeof(PackedNeuralNetworkDelta));
+    const f64 sample_start = seconds_now();
+    accumulate_training_delta(packed, weighted_training_data.samples, 0, weighted_training_data.sample_count, *sample_delta);
+    const f64 sample_epoch_seconds = seconds_now() - sample_start;
+
+    // largest difference relative to the size of the delta as a whole, the sums only differ in rounding
+    const f32* const record_floats = reinterpret_cast<const f32*>(record_delta);
+    const f32* const sample_floats = reinterpret_cast<const f32*>(sample_delta);
+    f64 largest_difference = 0.0;
+    f64 largest_magnitude = 0.0;
+    for (u32 i = 0; i < DELTA_FLOAT_COUNT; ++i) {
+        const f64 difference = static_cast<f64>(record_floats[i]) - sample_floats[i];
+        const f64 magnitude = static_cast<f64>(record_floats[i]);
+        largest_difference = (difference > largest_difference) ? difference : ((-difference > largest_difference) ? -difference : largest_difference);
+        largest_magnitude = (magnitude > largest_magnitude) ? magnitude : ((-magnitude > largest_magnitude) ? -magnitude : largest_magnitude);
+    }
+
+    printf("records: %u\n", training_data.record_count);
+    printf("weighted samples: %u\n", weighted_training_data.sample_count);
+    printf("sample ratio: %.2f\n", static_cast<f64>(training_data.record_count) / weighted_training_data.sample_count);
+    printf("file size ratio: %.2f\n", static_cast<f64>(training_data.record_count) * TRAINING_RECORD_SIZE / static_cast<f64>(weighted_size));
+    printf("deduplicate seconds: %.3f\n", deduplicate_seconds);
+    printf("epoch seconds over records: %.3f\n", record_epoch_seconds);
+    printf("epoch seconds over weighted samples: %.3f\n", sample_epoch_seconds);
+    printf("epoch speedup: %.2f\n", record_epoch_seconds / sample_epoch_seconds);
+    printf("largest delta difference: %.2e of the largest delta\n", (largest_magnitude > 0.0) ? largest_difference / largest_magnitude : 0.0);
+    printf("written to: %s\n", output_file_name);
+
+    return 0;
+}
@@ -0,0 +1,105 @@
+#include "kernel_tuning.h"
+
+static constexpr i8 KERNEL_TUNING_FILE_MAGIC[] = {'T', 'A', 'I', 'T', 'U', 'N', 'E', 'S'};
+
+static KernelTuningKey current_kernel_tuning_key() {
+    KernelTuningKey key = {};
+    copy_bytes(cpu_features().brand, sizeof(key.cpu_brand), key.cpu_brand);
+    key.input_layer_size = NeuralNetwork::INPUT_LAYER_SIZE;
+    key.hidden_layer_size = NeuralNetwork::HIDDEN_LAYER_SIZE;
+    key.output_layer_size = NeuralNetwork::OUTPUT_LAYER_SIZE;
+    key.panel_width = PackedNeuralNetwork::PANEL_WIDTH;
+    key.population_block_size = NeuralNetworkPopulationBlock::POPULATION_BLOCK_SIZE;
+
+    return key;
+}
+
+static bool valid_kernel_tuning(const KernelTuning& tuning) {
+    return tuning.max_sparse_block_density >= 0.0f && tuning.max_sparse_block_density <= 1.0f &&
+        tuning.population_input_tile >= 1 && tuning.population_input_tile <= MAX_POPULATION_INPUT_TILE &&
+        tuning.population_kernel <= KernelVariant::AVX512;
+}
+
+// Number of entries in a well formed tuning file, 0 for anything else (including no file at all)
+static u32 kernel_tuning_entry_count(const i8* const buffer, const u64 buffer_size) {
+    if (buffer == nullptr || buffer_size < sizeof(KernelTuningFileHeader)) {
+        return 0;
+    }
+
+    KernelTuningFileHeader header = {};
+    copy_bytes(buffer, sizeof(header), reinterpret_cast<i8*>(&header));
+    const bool valid_header = compare_bytes(header.magic, KERNEL_TUNING_FILE_MAGIC, sizeof(KERNEL_TUNING_FILE_MAGIC)) == 0 &&
+        header.version == KERNEL_TUNING_FILE_VERSION &&
+        header.entry_count <= MAX_KERNEL_TUNING_ENTRY_COUNT &&
+        buffer_size >= sizeof(header) + header.entry_count * sizeof(KernelTuningEntry);
+    if (!valid_header) {
+        return 0;
+    }
+
+    const u32 entries_checksum = crc32c(buffer + sizeof(header), header.entry_count * sizeof(KernelTuningEntry));
+    return (entries_checksum == header.entries_checksum) ? header.entry_count : 0;
+}
+
+// Leaves tuning alone unless the buffer holds a valid entry for key
+static bool find_kernel_tuning(const i8* const buffer, const u64 buffer_size, const KernelTuningKey& key, KernelTuning& tuning) {
+    const u32 entry_count = kernel_tuning_entry_count(buffer, buffer_size);
+    for (u32 i = 0; i < entry_count; ++i) {
+        KernelTuningEntry entry = {};
+        copy_bytes(buffer + sizeof(KernelTuningFileHeader) + i * sizeof(entry), sizeof(entry), reinterpret_cast<i8*>(&entry));
+        const bool same_key = compare_bytes(reinterpret_cast<const i8*>(&entry.key), reinterpret_cast<const i8*>(&key), sizeof(key)) == 0;
+        if (same_key && valid_kernel_tuning(entry.tuning)) {
+            tuning = entry.tuning;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Writes the existing file's entries for other keys followed by the new one, dropping the oldest if the file
+// is full, and returns the new file's size. An existing file that isn't valid is replaced outright. The
+// buffer has to hold MAX_KERNEL_TUNING_FILE_SIZE bytes.
+static u32 save_kernel_tuning_to_buffer(
+    const i8* const existing_file,
+    const u64 existing_file_size,
+    const KernelTuningKey& key,
+    const KernelTuning& tuning,
+    i8* const buffer,
+    const u32 buffer_size
+) {
+    if (buffer_size < MAX_KERNEL_TUNING_FILE_SIZE) {
+        return 0;
+    }
+
+    i8* const entries = buffer + sizeof(KernelTuningFileHeader);
+    u32 entry_count = 0;
+    const u32 existing_entry_count = kernel_tuning_entry_count(existing_file, existing_file_size);
+    for (u32 i = 0; i < existing_entry_count; ++i) {
+        KernelTuningEntry entry = {};
+        copy_bytes(existing_file + sizeof(KernelTuningFileHeader) + i * sizeof(entry), sizeof(entry), reinterpret_cast<i8*>(&entry));
+        if (compare_bytes(reinterpret_cast<const i8*>(&entry.key), reinterpret_cast<const i8*>(&key), sizeof(key)) != 0) {
+            copy_bytes(reinterpret_cast<const i8*>(&entry), sizeof(entry), entries + entry_count * sizeof(entry));
+            ++entry_count;
+        }
+    }
+
+    if (entry_count == MAX_KERNEL_TUNING_ENTRY_COUNT) {
+        --entry_count;
+        copy_bytes(entries + sizeof(KernelTuningEntry), entry_count * sizeof(KernelTuningEntry), entries);
+    }
+
+    KernelTuningEntry entry = {};
+    entry.key = key;
+    entry.tuning = tuning;
+    copy_bytes(reinterpret_cast<const i8*>(&entry), sizeof(entry), entries + entry_count * sizeof(entry));
+    ++entry_count;
+
+    KernelTuningFileHeader header = {};
+    copy_bytes(KERNEL_TUNING_FILE_MAGIC, sizeof(KERNEL_TUNING_FILE_MAGIC), header.magic);
+    header.version = KERNEL_TUNING_FILE_VERSION;
+    header.entry_count = entry_count;
+    header.entries_checksum = crc32c(entries, entry_count * sizeof(KernelTuningEntry));
+    copy_bytes(reinterpret_cast<const i8*>(&header), sizeof(header), buffer);
+
+    return sizeof(header) + entry_count * sizeof(KernelTuningEntry);
+}
@@ -0,0 +1,47 @@
+#ifndef KERNEL_TUNING_H
+#define KERNEL_TUNING_H
+
+#include "neural_network.h"
+#include "types.h"
+
+// Tuning file layout (all offsets from start of file):
+//  - KernelTuningFileHeader
+//  - KernelTuningEntry[entry_count]
+// Entries are keyed by the CPU and the shapes the kernels were compiled for, so one file can be shared between
+// machines and a tuning measured against different network sizes or layouts is never picked up.
+struct KernelTuningKey {
+    i8 cpu_brand[48];
+    i32 input_layer_size;
+    i32 hidden_layer_size;
+    i32 output_layer_size;
+    i32 panel_width;
+    u32 population_block_size;
+    u32 reserved[3];
+};
+
+struct KernelTuningEntry {
+    KernelTuningKey key;
+    KernelTuning tuning;
+    u32 reserved;
+};
+
+struct KernelTuningFileHeader {
+    i8 magic[8];
+    u32 version;
+    u32 entry_count;
+    u32 entries_checksum;
+    u32 reserved[3];
+};
+
+static constexpr u32 KERNEL_TUNING_FILE_VERSION = 1;
+static constexpr u32 MAX_KERNEL_TUNING_ENTRY_COUNT = 32;
+static constexpr u32 MAX_KERNEL_TUNING_FILE_SIZE = sizeof(KernelTuningFileHeader) + MAX_KERNEL_TUNING_ENTRY_COUNT * sizeof(KernelTuningEntry);
+
+static_assert(sizeof(KernelTuningFileHeader) == 32);
+static_assert(sizeof(KernelTuningEntry) == 96);
+
+static KernelTuningKey current_kernel_tuning_key();
+static bool find_kernel_tuning(const i8* buffer, u64 buffer_size, const KernelTuningKey& key, KernelTuning& tuning);
+static u32 save_kernel_tuning_to_buffer(const i8* existing_file, u64 existing_file_size, const KernelTuningKey& key, const KernelTuning& tuning, i8* buffer, u32 buffer_size);
+
+#endif
@@ -1,6 +1,9 @@
 #include "neural_network.h"
+#include "simd.h"
 #include "util.h"
 
+#include <stddef.h>
+
 // TODO: not true that we are on domain [-1, 1] due to biases being able to be larger
 // Taylor series approximation, gives very close answers on [-1, 1] domain which is all we care about.
 // Will probably have to tweek number of terms based on accuracy/performance. Efficient expansion based
@@ -67,25 +70,16 @@ static NeuralNetwork random_neural_network(u32 rng_seed) {
     return neural_network;
 }
 
+// Unversioned model files written before the sectioned format, only kept around for loading
 static constexpr i8 NEURAL_NETWORK_HEADER[] = {'T', 'E', 'T', 'R', 'I', 'S', 'A', 'I'};
-
-static u32 save_to_buffer(const NeuralNetwork& neural_network, i8* const buffer) {
-    u32 bytes_written = 0;
-    bytes_written += copy_bytes(NEURAL_NETWORK_HEADER, sizeof(NEURAL_NETWORK_HEADER), buffer + bytes_written);
-    bytes_written += copy_bytes(reinterpret_cast<const i8*>(&NeuralNetwork::INPUT_LAYER_SIZE), sizeof(NeuralNetwork::INPUT_LAYER_SIZE), buffer + bytes_written);
-    bytes_written += copy_bytes(reinterpret_cast<const i8*>(&NeuralNetwork::HIDDEN_LAYER_SIZE), sizeof(NeuralNetwork::HIDDEN_LAYER_SIZE), buffer + bytes_written);
-    bytes_written += copy_bytes(reinterpret_cast<const i8*>(&NeuralNetwork::OUTPUT_LAYER_SIZE), sizeof(NeuralNetwork::OUTPUT_LAYER_SIZE), buffer + bytes_written);
-    bytes_written += copy_bytes(reinterpret_cast<const i8*>(&neural_network), sizeof(neural_network), buffer + bytes_written);
-
-    return bytes_written;
-}
+static constexpr u32 LEGACY_NEURAL_NETWORK_SIZE = offsetof(NeuralNetwork, output_biases) + sizeof(NeuralNetwork::OutputLayer);
 
 static u32 load_from_buffer(NeuralNetwork& neural_network, const i8* const buffer, const u32 buffer_size) {
     const u32 necessary_buffer_size = 8 +
         sizeof(NeuralNetwork::INPUT_LAYER_SIZE) +
         sizeof(NeuralNetwork::HIDDEN_LAYER_SIZE) +
         sizeof(NeuralNetwork::OUTPUT_LAYER_SIZE) +
-        sizeof(NeuralNetwork);
+        LEGACY_NEURAL_NETWORK_SIZE;
     if (buffer_size < necessary_buffer_size) {
         return 0;
     }
@@ -116,16 +110,345 @@ static u32 load_from_buffer(NeuralNetwork& neural_network, const i8* const buffe
         return 0;
     }
 
-    bytes_read += copy_bytes(buffer + bytes_read, sizeof(neural_network), reinterpret_cast<i8*>(&neural_network));
+    bytes_read += copy_bytes(buffer + bytes_read, LEGACY_NEURAL_NETWORK_SIZE, reinterpret_cast<i8*>(&neural_network));
 
     return bytes_read;
 }
 
+static constexpr i8 MODEL_FILE_MAGIC[] = {'T', 'A', 'I', 'M', 'O', 'D', 'E', 'L'};
+
+struct ModelTensorLayout {
+    ModelSectionType type;
+    u32 rows;
+    u32 columns;
+    u32 offset;     // from start of NeuralNetwork/HalfPrecisionNeuralNetwork
+};
+
+static constexpr ModelTensorLayout MODEL_TENSOR_LAYOUTS[MODEL_TENSOR_COUNT] = {
+    ModelTensorLayout{ModelSectionType::INPUT_TO_HIDDEN_WEIGHTS, NeuralNetwork::HIDDEN_LAYER_SIZE, NeuralNetwork::INPUT_LAYER_SIZE, offsetof(NeuralNetwork, input_to_hidden_weights)},
+    ModelTensorLayout{ModelSectionType::HIDDEN_BIASES, 1, NeuralNetwork::HIDDEN_LAYER_SIZE, offsetof(NeuralNetwork, hidden_biases)},
+    ModelTensorLayout{ModelSectionType::HIDDEN_TO_OUTPUT_WEIGHTS, NeuralNetwork::OUTPUT_LAYER_SIZE, NeuralNetwork::HIDDEN_LAYER_SIZE, offsetof(NeuralNetwork, hidden_to_output_weights)},
+    ModelTensorLayout{ModelSectionType::OUTPUT_BIASES, 1, NeuralNetwork::OUTPUT_LAYER_SIZE, offsetof(NeuralNetwork, output_biases)}
+};
+
+static constexpr ModelTensorLayout HALF_PRECISION_MODEL_TENSOR_LAYOUTS[MODEL_TENSOR_COUNT] = {
+    ModelTensorLayout{ModelSectionType::INPUT_TO_HIDDEN_WEIGHTS, NeuralNetwork::HIDDEN_LAYER_SIZE, NeuralNetwork::INPUT_LAYER_SIZE, offsetof(HalfPrecisionNeuralNetwork, input_to_hidden_weights)},
+    ModelTensorLayout{ModelSectionType::HIDDEN_BIASES, 1, NeuralNetwork::HIDDEN_LAYER_SIZE, offsetof(HalfPrecisionNeuralNetwork, hidden_biases)},
+    ModelTensorLayout{ModelSectionType::HIDDEN_TO_OUTPUT_WEIGHTS, NeuralNetwork::OUTPUT_LAYER_SIZE, NeuralNetwork::HIDDEN_LAYER_SIZE, offsetof(HalfPrecisionNeuralNetwork, hidden_to_output_weights)},
+    ModelTensorLayout{ModelSectionType::OUTPUT_BIASES, 1, NeuralNetwork::OUTPUT_LAYER_SIZE, offsetof(HalfPrecisionNeuralNetwork, output_biases)}
+};
+
+static constexpr u32 align_up(const u32 value, const u32 alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static constexpr u32 model_tensor_data_offset(const u32 section_count) {
+    return align_up(sizeof(ModelFileHeader) + section_count * sizeof(ModelSection), MODEL_SECTION_ALIGNMENT);
+}
+
+static u32 model_element_size(const ModelElementType element_type) {
+    return (element_type == ModelElementType::F32) ? sizeof(f32) : sizeof(u16);
+}
+
+// F32 for half_precision_type means the file only holds the f32 weights
+static u32 model_file_size(const ModelElementType half_precision_type) {
+    if (half_precision_type == ModelElementType::F32) {
+        return model_tensor_data_offset(MODEL_TENSOR_COUNT) + sizeof(NeuralNetwork);
+    }
+
+    return model_tensor_data_offset(2 * MODEL_TENSOR_COUNT) + sizeof(NeuralNetwork) + sizeof(HalfPrecisionNeuralNetwork);
+}
+
+static u32 model_header_checksum(ModelFileHeader header) {
+    header.header_checksum = 0;
+    return crc32c(reinterpret_cast<const i8*>(&header), sizeof(header));
+}
+
+static void write_model_sections(const ModelTensorLayout* const layouts, const ModelElementType element_type, const u32 tensors_offset, const i8* const buffer, ModelSection* const sections) {
+    const u32 element_size = model_element_size(element_type);
+    for (u32 i = 0; i < MODEL_TENSOR_COUNT; ++i) {
+        const ModelTensorLayout& layout = layouts[i];
+        ModelSection& section = sections[i];
+        section.type = layout.type;
+        section.element_type = element_type;
+        section.rows = layout.rows;
+        section.columns = layout.columns;
+        section.row_stride = layout.columns * element_size;
+        section.offset = tensors_offset + layout.offset;
+        section.size = layout.rows * layout.columns * element_size;
+        section.checksum = crc32c(buffer + section.offset, section.size);
+    }
+}
+
+static bool valid_model_sections(const ModelTensorLayout* const layouts, const ModelSection* const sections, const u32 tensors_offset, const u64 file_size, const i8* const buffer) {
+    const ModelElementType element_type = sections[0].element_type;
+    if (element_type != ModelElementType::F32 && element_type != ModelElementType::BF16 && element_type != ModelElementType::F16) {
+        return false;
+    }
+
+    const u32 element_size = model_element_size(element_type);
+    for (u32 i = 0; i < MODEL_TENSOR_COUNT; ++i) {
+        const ModelTensorLayout& layout = layouts[i];
+        const ModelSection& section = sections[i];
+        const bool valid_section = section.type == layout.type &&
+            section.element_type == element_type &&
+            section.rows == layout.rows &&
+            section.columns == layout.columns &&
+            section.row_stride == layout.columns * element_size &&
+            section.offset == tensors_offset + layout.offset &&
+            section.offset % MODEL_SECTION_ALIGNMENT == 0 &&
+            section.size == layout.rows * layout.columns * element_size &&
+            section.offset + section.size <= file_size;
+        if (!valid_section || crc32c(buffer + section.offset, section.size) != section.checksum) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// half_precision_neural_network can be null to only write the f32 weights
+static u32 save_model_to_buffer(
+    const NeuralNetwork& neural_network,
+    const HalfPrecisionNeuralNetwork* const half_precision_neural_network,
+    const ModelElementType half_precision_type,
+    i8* const buffer,
+    const u32 buffer_size
+) {
+    const ModelElementType file_half_precision_type = (half_precision_neural_network != nullptr) ? half_precision_type : ModelElementType::F32;
+    const u32 file_size = model_file_size(file_half_precision_type);
+    if (buffer_size < file_size) {
+        return 0;
+    }
+
+    // zero everything first so padding between sections is deterministic
+    for (u32 i = 0; i < file_size; ++i) {
+        buffer[i] = 0;
+    }
+
+    const u32 section_count = (file_half_precision_type == ModelElementType::F32) ? MODEL_TENSOR_COUNT : 2 * MODEL_TENSOR_COUNT;
+    const u32 tensors_offset = model_tensor_data_offset(section_count);
+    const u32 half_precision_tensors_offset = tensors_offset + sizeof(NeuralNetwork);
+
+    ModelSection sections[2 * MODEL_TENSOR_COUNT] = {};
+    copy_bytes(reinterpret_cast<const i8*>(&neural_network), sizeof(neural_network), buffer + tensors_offset);
+    write_model_sections(MODEL_TENSOR_LAYOUTS, ModelElementType::F32, tensors_offset, buffer, sections);
+
+    if (file_half_precision_type != ModelElementType::F32) {
+        copy_bytes(reinterpret_cast<const i8*>(half_precision_neural_network), sizeof(HalfPrecisionNeuralNetwork), buffer + half_precision_tensors_offset);
+        write_model_sections(HALF_PRECISION_MODEL_TENSOR_LAYOUTS, file_half_precision_type, half_precision_tensors_offset, buffer, sections + MODEL_TENSOR_COUNT);
+    }
+
+    const u32 section_table_size = section_count * sizeof(ModelSection);
+    copy_bytes(reinterpret_cast<const i8*>(sections), section_table_size, buffer + sizeof(ModelFileHeader));
+
+    ModelFileHeader header = {};
+    copy_bytes(MODEL_FILE_MAGIC, sizeof(MODEL_FILE_MAGIC), header.magic);
+    header.version = MODEL_FILE_VERSION;
+    header.header_size = sizeof(ModelFileHeader);
+    header.section_count = section_count;
+    header.section_alignment = MODEL_SECTION_ALIGNMENT;
+    header.input_layer_size = NeuralNetwork::INPUT_LAYER_SIZE;
+    header.hidden_layer_size = NeuralNetwork::HIDDEN_LAYER_SIZE;
+    header.output_layer_size = NeuralNetwork::OUTPUT_LAYER_SIZE;
+    header.section_table_checksum = crc32c(reinterpret_cast<const i8*>(sections), section_table_size);
+    header.file_size = file_size;
+    header.header_checksum = model_header_checksum(header);
+
+    copy_bytes(reinterpret_cast<const i8*>(&header), sizeof(header), buffer);
+
+    return file_size;
+}
+
+// Validates a model file and points model_view at the weights in place, buffer must stay alive (e.g. mapped)
+// while they're used. Fails if anything doesn't match, including tensor data not being suitably aligned.
+static bool view_model_in_buffer(const i8* const buffer, const u64 buffer_size, ModelView& model_view) {
+    model_view = {};
+    if (buffer_size < sizeof(ModelFileHeader)) {
+        return false;
+    }
+
+    ModelFileHeader header = {};
+    copy_bytes(buffer, sizeof(header), reinterpret_cast<i8*>(&header));
+
+    const bool valid_header = compare_bytes(header.magic, MODEL_FILE_MAGIC, sizeof(MODEL_FILE_MAGIC)) == 0 &&
+        header.version >= MODEL_FILE_MIN_VERSION &&
+        header.version <= MODEL_FILE_VERSION &&
+        header.header_size == sizeof(ModelFileHeader) &&
+        (header.section_count == MODEL_TENSOR_COUNT || (header.version >= 3 && header.section_count == 2 * MODEL_TENSOR_COUNT)) &&
+        header.section_alignment == MODEL_SECTION_ALIGNMENT &&
+        header.input_layer_size == NeuralNetwork::INPUT_LAYER_SIZE &&
+        header.hidden_layer_size == NeuralNetwork::HIDDEN_LAYER_SIZE &&
+        header.output_layer_size == NeuralNetwork::OUTPUT_LAYER_SIZE &&
+        header.file_size <= buffer_size &&
+        header.header_checksum == model_header_checksum(header);
+    if (!valid_header) {
+        return false;
+    }
+
+    ModelSection sections[2 * MODEL_TENSOR_COUNT] = {};
+    const u32 section_table_size = header.section_count * sizeof(ModelSection);
+    copy_bytes(buffer + sizeof(ModelFileHeader), section_table_size, reinterpret_cast<i8*>(sections));
+    if (crc32c(reinterpret_cast<const i8*>(sections), section_table_size) != header.section_table_checksum) {
+        return false;
+    }
+
+    const u32 tensors_offset = model_tensor_data_offset(header.section_count);
+    const bool valid_tensors = sections[0].element_type == ModelElementType::F32 &&
+        valid_model_sections(MODEL_TENSOR_LAYOUTS, sections, tensors_offset, header.file_size, buffer);
+    if (!valid_tensors || header.file_size < tensors_offset + sizeof(NeuralNetwork)) {
+        return false;
+    }
+
+    const i8* const tensor_data = buffer + tensors_offset;
+    if (reinterpret_cast<u64>(tensor_data) % alignof(NeuralNetwork) != 0) {
+        return false;
+    }
+
+    model_view.neural_network = reinterpret_cast<const NeuralNetwork*>(tensor_data);
+    model_view.half_precision_type = ModelElementType::F32;
+
+    if (header.section_count == 2 * MODEL_TENSOR_COUNT) {
+        const ModelSection* const half_precision_sections = sections + MODEL_TENSOR_COUNT;
+        const u32 half_precision_tensors_offset = tensors_offset + sizeof(NeuralNetwork);
+        const bool valid_half_precision_tensors = half_precision_sections[0].element_type != ModelElementType::F32 &&
+            valid_model_sections(HALF_PRECISION_MODEL_TENSOR_LAYOUTS, half_precision_sections, half_precision_tensors_offset, header.file_size, buffer) &&
+            header.file_size >= half_precision_tensors_offset + sizeof(HalfPrecisionNeuralNetwork);
+        if (!valid_half_precision_tensors) {
+            model_view = {};
+            return false;
+        }
+
+        model_view.half_precision_neural_network = reinterpret_cast<const HalfPrecisionNeuralNetwork*>(buffer + half_precision_tensors_offset);
+        model_view.half_precision_type = half_precision_sections[0].element_type;
+    }
+
+    return true;
+}
+
+static u32 f32_bits(const f32 x) {
+    u32 bits = 0;
+    copy_bytes(reinterpret_cast<const i8*>(&x), sizeof(x), reinterpret_cast<i8*>(&bits));
+    return bits;
+}
+
+static f32 f32_from_bits(const u32 bits) {
+    f32 x = 0.0f;
+    copy_bytes(reinterpret_cast<const i8*>(&bits), sizeof(bits), reinterpret_cast<i8*>(&x));
+    return x;
+}
+
+// bfloat16 is just the top half of an f32, rounded to nearest even
+static u16 f32_to_bf16(const f32 x) {
+    const u32 bits = f32_bits(x);
+    if ((bits & 0x7FFFFFFF) > 0x7F800000) {
+        return static_cast<u16>((bits >> 16) | 0x0040);     // keep NaNs quiet NaNs
+    }
+
+    const u32 rounding = 0x7FFF + ((bits >> 16) & 1);
+    return static_cast<u16>((bits + rounding) >> 16);
+}
+
+static f32 bf16_to_f32(const u16 x) {
+    return f32_from_bits(static_cast<u32>(x) << 16);
+}
+
+// IEEE half precision, rounded to nearest even with overflow going to infinity
+static u16 f32_to_f16(const f32 x) {
+    const u32 bits = f32_bits(x);
+    const u32 sign = (bits >> 16) & 0x8000;
+    const u32 magnitude = bits & 0x7FFFFFFF;
+
+    if (magnitude >= 0x7F800000) {
+        return static_cast<u16>(sign | ((magnitude > 0x7F800000) ? 0x7E00 : 0x7C00));
+    }
+
+    if (magnitude >= 0x477FF000) {    // 65520, rounds up past the largest half
+        return static_cast<u16>(sign | 0x7C00);
+    }
+
+    if (magnitude < 0x38800000) {     // 2^-14, below the smallest normal half
+        if (magnitude < 0x33000000) { // 2^-25, rounds to zero
+            return static_cast<u16>(sign);
+        }
+
+        const u32 exponent = magnitude >> 23;
+        const u32 mantissa = (magnitude & 0x007FFFFF) | 0x00800000;
+        const u32 shift = 126 - exponent;
+        const u32 halfway = 1u << (shift - 1);
+        const u32 remainder = mantissa & ((1u << shift) - 1);
+        u32 result = mantissa >> shift;
+        if (remainder > halfway || (remainder == halfway && (result & 1) != 0)) {
+            ++result;
+        }
+
+        return static_cast<u16>(sign | result);
+    }
+
+    u32 result = (magnitude >> 13) - ((127 - 15) << 10);
+    const u32 remainder = magnitude & 0x1FFF;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (result & 1) != 0)) {
+        ++result;
+    }
+
+    return static_cast<u16>(sign | result);
+}
+
+static f32 f16_to_f32(const u16 x) {
+    const u32 sign = static_cast<u32>(x & 0x8000) << 16;
+    const u32 exponent = (x >> 10) & 0x1F;
+    u32 mantissa = x & 0x03FF;
+
+    if (exponent == 0) {
+        if (mantissa == 0) {
+            return f32_from_bits(sign);
+        }
+
+        // subnormal half, normalise it as an f32 can represent it as a normal
+        u32 f32_exponent = 127 - 15 + 1;
+        while ((mantissa & 0x0400) == 0) {
+            mantissa <<= 1;
+            --f32_exponent;
+        }
+
+        return f32_from_bits(sign | (f32_exponent << 23) | ((mantissa & 0x03FF) << 13));
+    }
+
+    if (exponent == 0x1F) {
+        return f32_from_bits(sign | 0x7F800000 | (mantissa << 13));
+    }
+
+    return f32_from_bits(sign | ((exponent + 127 - 15) << 23) | (mantissa << 13));
+}
+
+static u16 f32_to_half_precision(const f32 x, const ModelElementType element_type) {
+    return (element_type == ModelElementType::BF16) ? f32_to_bf16(x) : f32_to_f16(x);
+}
+
+static f32 half_precision_to_f32(const u16 x, const ModelElementType element_type) {
+    return (element_type == ModelElementType::BF16) ? bf16_to_f32(x) : f16_to_f32(x);
+}
+
+static void convert_to_half_precision(const f32* const source, const u32 count, const ModelElementType element_type, u16* const destination) {
+    for (u32 i = 0; i < count; ++i) {
+        destination[i] = f32_to_half_precision(source[i], element_type);
+    }
+}
+
+// The f32 network stays the master copy for training, this is just re-derived from it afterwards
+static void convert_to_half_precision(const NeuralNetwork& neural_network, const ModelElementType element_type, HalfPrecisionNeuralNetwork& half_precision_neural_network) {
+    half_precision_neural_network = {};
+    convert_to_half_precision(&neural_network.input_to_hidden_weights[0][0], NeuralNetwork::HIDDEN_LAYER_SIZE * NeuralNetwork::INPUT_LAYER_SIZE, element_type, &half_precision_neural_network.input_to_hidden_weights[0][0]);
+    convert_to_half_precision(neural_network.hidden_biases, NeuralNetwork::HIDDEN_LAYER_SIZE, element_type, half_precision_neural_network.hidden_biases);
+    convert_to_half_precision(&neural_network.hidden_to_output_weights[0][0], NeuralNetwork::OUTPUT_LAYER_SIZE * NeuralNetwork::HIDDEN_LAYER_SIZE, element_type, &half_precision_neural_network.hidden_to_output_weights[0][0]);
+    convert_to_half_precision(neural_network.output_biases, NeuralNetwork::OUTPUT_LAYER_SIZE, element_type, half_precision_neural_network.output_biases);
+}
+
 static void feed_forward(const NeuralNetwork& neural_network, const NeuralNetwork::InputLayer& input, NeuralNetwork::OutputLayer& output) {
     // feed through hidden layer
     NeuralNetwork::HiddenLayer hidden_activations = {};
     for (i32 row = 0; row < NeuralNetwork::HIDDEN_LAYER_SIZE; ++row) {
-        f32 z = 0.0f;
+        f32 z = neural_network.hidden_biases[row];
         for (i32 column = 0; column < NeuralNetwork::INPUT_LAYER_SIZE; ++column) {
             z += neural_network.input_to_hidden_weights[row][column] * input[column];
         }
@@ -135,15 +458,411 @@ static void feed_forward(const NeuralNetwork& neural_network, const NeuralNetwor
 
     // feed through output layer
     for (i32 row = 0; row < NeuralNetwork::OUTPUT_LAYER_SIZE; ++row) {
-        f32 z = 0.0f;
+        f32 z = neural_network.output_biases[row];
         for (i32 column = 0; column < NeuralNetwork::HIDDEN_LAYER_SIZE; ++column) {
-            z += neural_network.hidden_to_output_weights[row][column] * input[column];
+            z += neural_network.hidden_to_output_weights[row][column] * hidden_activations[column];
         }
 
         output[row] = sigmoid(z);
     }
 }
 
+// weights * inputs for one layer, weights are row major with columns a multiple of 8. Biases and the
+// sigmoid are left to the caller so no SSE code gets called from the middle of AVX code (transition stalls).
+static void half_precision_layer(
+    const u16* const weights,
+    const f32* const inputs,
+    const i32 rows,
+    const i32 columns,
+    const ModelElementType element_type,
+    f32* const outputs
+) {
+    for (i32 row = 0; row < rows; ++row) {
+        f32 z = 0.0f;
+        for (i32 column = 0; column < columns; ++column) {
+            z += half_precision_to_f32(weights[row * columns + column], element_type) * inputs[column];
+        }
+
+        outputs[row] = z;
+    }
+}
+
+TARGET_AVX2 static __m256 load_half_precision_avx2(const u16* const x, const ModelElementType element_type) {
+    const __m128i halves = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x));
+    if (element_type == ModelElementType::BF16) {
+        return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(halves), 16));
+    }
+
+    return _mm256_cvtph_ps(halves);
+}
+
+TARGET_AVX2 static f32 horizontal_sum_avx2(const __m256 x) {
+    const __m128 sum_4 = _mm_add_ps(_mm256_castps256_ps128(x), _mm256_extractf128_ps(x, 1));
+    const __m128 sum_2 = _mm_add_ps(sum_4, _mm_movehl_ps(sum_4, sum_4));
+    const __m128 sum_1 = _mm_add_ss(sum_2, _mm_movehdup_ps(sum_2));
+    return _mm_cvtss_f32(sum_1);
+}
+
+TARGET_AVX2 static void half_precision_layer_avx2(
+    const u16* const weights,
+    const f32* const inputs,
+    const i32 rows,
+    const i32 columns,
+    const ModelElementType element_type,
+    f32* const outputs
+) {
+    for (i32 row = 0; row < rows; ++row) {
+        const u16* const row_weights = weights + row * columns;
+        __m256 z = _mm256_setzero_ps();
+        for (i32 column = 0; column < columns; column += 8) {
+            z = _mm256_fmadd_ps(load_half_precision_avx2(row_weights + column, element_type), _mm256_loadu_ps(inputs + column), z);
+        }
+
+        outputs[row] = horizontal_sum_avx2(z);
+    }
+}
+
+TARGET_AVX512_BF16 static f32 horizontal_sum_avx512(const __m512 x) {
+    alignas(64) f32 lanes[16] = {};
+    _mm512_store_ps(lanes, x);
+    return horizontal_sum_avx2(_mm256_add_ps(_mm256_load_ps(lanes), _mm256_load_ps(lanes + 8)));
+}
+
+// zero masked as GCC warns the unmasked forms use an uninitialised register
+TARGET_AVX512_BF16 static __m512 load_bf16_avx512(const u16* const x) {
+    const __m512i widened = _mm512_maskz_cvtepu16_epi32(0xFFFF, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x)));
+    return _mm512_castsi512_ps(_mm512_maskz_slli_epi32(0xFFFF, widened, 16));
+}
+
+// Activations get rounded to bf16 as well to use the dot product instruction, bar the first 32 which stay f32.
+// bf16 only holds integers up to 256 exactly and the features ahead of the grid are all in that first block,
+// rows cleared among them regularly gets past 1000. The 0/1 grid cells are exact either way, the hidden
+// activations lose a little precision. Accumulation is f32.
+TARGET_AVX512_BF16 static void bf16_layer_avx512(
+    const u16* const weights,
+    const f32* const inputs,
+    const i32 rows,
+    const i32 columns,
+    const ModelElementType,
+    f32* const outputs
+) {
+    static constexpr i32 MAX_COLUMN_BLOCKS = NeuralNetwork::INPUT_LAYER_SIZE / 32;
+
+    const __m512 exact_inputs_low = _mm512_loadu_ps(inputs);
+    const __m512 exact_inputs_high = _mm512_loadu_ps(inputs + 16);
+    __m512bh input_blocks[MAX_COLUMN_BLOCKS] = {};
+    const i32 column_blocks = columns / 32;
+    for (i32 block = 1; block < column_blocks; ++block) {
+        input_blocks[block] = _mm512_cvtne2ps_pbh(_mm512_loadu_ps(inputs + 32 * block + 16), _mm512_loadu_ps(inputs + 32 * block));
+    }
+
+    for (i32 row = 0; row < rows; ++row) {
+        const u16* const row_weights = weights + row * columns;
+        __m512 z = _mm512_mul_ps(load_bf16_avx512(row_weights), exact_inputs_low);
+        z = _mm512_fmadd_ps(load_bf16_avx512(row_weights + 16), exact_inputs_high, z);
+        for (i32 block = 1; block < column_blocks; ++block) {
+            const __m512i weight_block = _mm512_loadu_si512(row_weights + 32 * block);
+            z = _mm512_dpbf16_ps(z, (__m512bh)weight_block, input_blocks[block]);
+        }
+
+        outputs[row] = horizontal_sum_avx512(z);
+    }
+}
+
+static void feed_forward(
+    const HalfPrecisionNeuralNetwork& neural_network,
+    const ModelElementType element_type,
+    const NeuralNetwork::InputLayer& input,
+    NeuralNetwork::OutputLayer& output
+) {
+    static_assert(NeuralNetwork::INPUT_LAYER_SIZE % 32 == 0 && NeuralNetwork::HIDDEN_LAYER_SIZE % 32 == 0);
+
+    const u16* const input_to_hidden_weights = &neural_network.input_to_hidden_weights[0][0];
+    const u16* const hidden_to_output_weights = &neural_network.hidden_to_output_weights[0][0];
+
+    using LayerFunction = void(*)(const u16*, const f32*, i32, i32, ModelElementType, f32*);
+    const CpuFeatures& features = cpu_features();
+    LayerFunction layer = half_precision_layer;
+    if (element_type == ModelElementType::BF16 && features.avx512_bf16) {
+        layer = bf16_layer_avx512;
+    } else if (features.avx2) {
+        layer = half_precision_layer_avx2;
+    }
+
+    NeuralNetwork::HiddenLayer hidden_activations = {};
+    layer(input_to_hidden_weights, input, NeuralNetwork::HIDDEN_LAYER_SIZE, NeuralNetwork::INPUT_LAYER_SIZE, element_type, hidden_activations);
+    for (i32 i = 0; i < NeuralNetwork::HIDDEN_LAYER_SIZE; ++i) {
+        hidden_activations[i] = sigmoid(hidden_activations[i] + half_precision_to_f32(neural_network.hidden_biases[i], element_type));
+    }
+
+    layer(hidden_to_output_weights, hidden_activations, NeuralNetwork::OUTPUT_LAYER_SIZE, NeuralNetwork::HIDDEN_LAYER_SIZE, element_type, output);
+    for (i32 i = 0; i < NeuralNetwork::OUTPUT_LAYER_SIZE; ++i) {
+        output[i] = sigmoid(output[i] + half_precision_to_f32(neural_network.output_biases[i], element_type));
+    }
+}
+
+static u32 population_block_count(const u32 population_size) {
+    return (population_size + NeuralNetworkPopulationBlock::POPULATION_BLOCK_SIZE - 1) / NeuralNetworkPopulationBlock::POPULATION_BLOCK_SIZE;
+}
+
+static void stack_population(const NeuralNetwork* const neural_networks, const u32 population_size, NeuralNetworkPopulation& population) {
+    static constexpr u32 BLOCK_SIZE = NeuralNetworkPopulationBlock::POPULATION_BLOCK_SIZE;
+
+    population.size = population_size;
+    const u32 block_count = population_block_count(population_size);
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        NeuralNetworkPopulationBlock& block = population.blocks[block_index];
+        for (u32 lane = 0; lane < BLOCK_SIZE; ++lane) {
+            const u32 network = block_index * BLOCK_SIZE + lane;
+            const bool padding = network >= population_size;
+            const NeuralNetwork& neural_network = neural_networks[padding ? 0 : network];
+
+            for (i32 row = 0; row < NeuralNetwork::HIDDEN_LAYER_SIZE; ++row) {
+                for (i32 column = 0; column < NeuralNetwork::INPUT_LAYER_SIZE; ++column) {
+                    block.input_to_hidden_weights[column][row][lane] = padding ? 0.0f : neural_network.input_to_hidden_weights[row][column];
+                }
+
+                block.hidden_biases[row][lane] = padding ? 0.0f : neural_network.hidden_biases[row];
+            }
+
+            for (i32 row = 0; row < NeuralNetwork::OUTPUT_LAYER_SIZE; ++row) {
+                for (i32 column = 0; column < NeuralNetwork::HIDDEN_LAYER_SIZE; ++column) {
+                    block.hidden_to_output_weights[row][column][lane] = padding ? 0.0f : neural_network.hidden_to_output_weights[row][column];
+                }
+
+                block.output_biases[row][lane] = padding ? 0.0f : neural_network.output_biases[row];
+            }
+        }
+    }
+}
+
+// The population, packed and sparse kernels only visit the non-zero inputs, gathered once per input up front.
+// Only the first count entries are ever written or read so there's no need to clear it.
+struct SparseInput {
+    f32 values[NeuralNetwork::INPUT_LAYER_SIZE];
+    u16 indices[NeuralNetwork::INPUT_LAYER_SIZE];
+    i32 count;
+};
+
+TARGET_AVX512 static void gather_sparse_input_avx512(const NeuralNetwork::InputLayer& input, SparseInput& sparse_input) {
+    static_assert(NeuralNetwork::INPUT_LAYER_SIZE % 16 == 0);
+
+    i32 count = 0;
+    const __m512i lane_indices = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    for (i32 i = 0; i < NeuralNetwork::INPUT_LAYER_SIZE; i += 16) {
+        const __m512 values = _mm512_loadu_ps(input + i);
+        const __mmask16 non_zero = _mm512_cmp_ps_mask(values, _mm512_setzero_ps(), _CMP_NEQ_UQ);
+        _mm512_mask_compressstoreu_ps(sparse_input.values + count, non_zero, values);
+
+        // count <= i so the full 16 index store never runs off the end
+        const __m512i indices = _mm512_maskz_compress_epi32(non_zero, _mm512_add_epi32(lane_indices, _mm512_set1_epi32(i)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(sparse_input.indices + count), _mm512_maskz_cvtepi32_epi16(0xFFFF, indices));
+        count += __builtin_popcount(non_zero);
+    }
+
+    sparse_input.count = count;
+}
+
+// Branch free, whether a grid cell is filled is close to random so a branch here mispredicts about half the
+// time and costs more than the rest of a sparse inference
+static void gather_sparse_input(const NeuralNetwork::InputLayer& input, SparseInput& sparse_input) {
+    if (cpu_features().avx512f) {
+        gather_sparse_input_avx512(input, sparse_input);
+        return;
+    }
+
+    i32 count = 0;
+    for (i32 i = 0; i < NeuralNetwork::INPUT_LAYER_SIZE; ++i) {
+        sparse_input.values[count] = input[i];
+        sparse_input.indices[count] = static_cast<u16>(i);
+        count += (input[i] != 0.0f) ? 1 : 0;
+    }
+
+    sparse_input.count = count;
+}
+
+using PopulationOutputs = f32[NeuralNetwork::OUTPUT_LAYER_SIZE][NeuralNetworkPopulationBlock::POPULATION_BLOCK_SIZE];
+
+static void population_block_feed_forward(const NeuralNetworkPopulationBlock& block, const SparseInput& input, PopulationOutputs& outputs) {
+    static constexpr u32 BLOCK_SIZE = NeuralNetworkPopulationBlock::POPULATION_BLOCK_SIZE;
+
+    f32 hidden_activations[NeuralNetwork::HIDDEN_LAYER_SIZE][BLOCK_SIZE] = {};
+    for (i32 row = 0; row < NeuralNetwork::HIDDEN_LAYER_SIZE; ++row) {
+        for (u32 lane = 0; lane < BLOCK_SIZE; ++lane) {
+            f32 z = block.hidden_biases[row][lane];
+            for (i32 i = 0; i < input.count; ++i) {
+                z += block.input_to_hidden_weights[input.indices[i]][row][lane] * input.values[i];
+            }
+
+            hidden_activations[row][lane] = sigmoid(z);
+        }
+    }
+
+    for (i32 row = 0; row < NeuralNetwork::OUTPUT_LAYER_SIZE; ++row) {
+        for (u32 lane = 0; lane < BLOCK_SIZE; ++lane) {
+            f32 z = block.output_biases[row][lane];
+            for (i32 column = 0; column < NeuralNetwork::HIDDEN_LAYER_SIZE; ++column) {
+                z += block.hidden_to_output_weights[row][column][lane] * hidden_activations[column][lane];
+            }
+
+            outputs[row][lane] = sigmoid(z);
+        }
+    }
+}
+
+// 1/8, 1/7, ..., 1/1 for the vectorised exp() expansions below
+static constexpr f32 EXP_TERM_RECIPROCALS[8] = {1.0f / 8.0f, 1.0f / 7.0f, 1.0f / 6.0f, 1.0f / 5.0f, 1.0f / 4.0f, 1.0f / 3.0f, 1.0f / 2.0f, 1.0f};
+
+// Same expansion as exp() above but multiplying by the reciprocals and fusing the multiply-add, a division
+// per term costs more than the whole hidden layer does once the kernels skip the zero inputs
+TARGET_AVX2 static __m256 sigmoid_avx2(const __m256 x) {
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 minus_x = _mm256_sub_ps(_mm256_setzero_ps(), x);
+    __m256 result = one;
+    for (i32 term = 0; term < 8; ++term) {
+        result = _mm256_fmadd_ps(_mm256_mul_ps(minus_x, _mm256_set1_ps(EXP_TERM_RECIPROCALS[term])), result, one);
+    }
+
+    return _mm256_div_ps(one, _mm256_add_ps(one, result));
+}
+
+// A block is two registers wide, four hidden rows at a time keeps the accumulators in registers
+TARGET_AVX2 static void population_block_feed_forward_avx2(const NeuralNetworkPopulationBlock& block, const SparseInput& input, PopulationOutputs& outputs) {
+    static constexpr i32 ROWS_PER_PASS = 4;
+
+    alignas(64) f32 hidden_activations[NeuralNetwork::HIDDEN_LAYER_SIZE][NeuralNetworkPopulationBlock::POPULATION_BLOCK_SIZE];
+    for (i32 row = 0; row < NeuralNetwork::HIDDEN_LAYER_SIZE; row += ROWS_PER_PASS) {
+        __m256 z[ROWS_PER_PASS][2];
+        for (i32 i = 0; i < ROWS_PER_PASS; ++i) {
+            z[i][0] = _mm256_load_ps(block.hidden_biases[row + i]);
+            z[i][1] = _mm256_load_ps(block.hidden_biases[row + i] + 8);
+        }
+
+        for (i32 i = 0; i < input.count; ++i) {
+            const __m256 x = _mm256_set1_ps(input.values[i]);
+            const f32 (* const weights)[NeuralNetworkPopulationBlock::POPULATION_BLOCK_SIZE] = block.input_to_hidden_weights[input.indices[i]] + row;
+            for (i32 j = 0; j < ROWS_PER_PASS; ++j) {
+                z[j][0] = _mm256_fmadd_ps(_mm256_load_ps(weights[j]), x, z[j][0]);
+                z[j][1] = _mm256_fmadd_ps(_mm256_load_ps(weights[j] + 8), x, z[j][1]);
+            }
+        }
+
+        for (i32 i = 0; i < ROWS_PER_PASS; ++i) {
+            _mm256_store_ps(hidden_activations[row + i], sigmoid_avx2(z[i][0]));
+            _mm256_store_ps(hidden_activations[row + i] + 8, sigmoid_avx2(z[i][1]));
+        }
+    }
+
+    for (i32 row = 0; row < NeuralNetwork::OUTPUT_LAYER_SIZE; ++row) {
+        __m256 z_0 = _mm256_load_ps(block.output_biases[row]);
+        __m256 z_1 = _mm256_load_ps(block.output_biases[row] + 8);
+        for (i32 column = 0; column < NeuralNetwork::HIDDEN_LAYER_SIZE; ++column) {
+            z_0 = _mm256_fmadd_ps(_mm256_load_ps(block.hidden_to_output_weights[row][column]), _mm256_load_ps(hidden_activations[column]), z_0);
+            z_1 = _mm256_fmadd_ps(_mm256_load_ps(block.hidden_to_output_weights[row][column] + 8), _mm256_load_ps(hidden_activations[column] + 8), z_1);
+        }
+
+        _mm256_storeu_ps(outputs[row], sigmoid_avx2(z_0));
+        _mm256_storeu_ps(outputs[row] + 8, sigmoid_avx2(z_1));
+    }
+}
+
+TARGET_AVX512 static __m512 sigmoid_avx512(const __m512 x) {
+    const __m512 one = _mm512_set1_ps(1.0f);
+    const __m512 minus_x = _mm512_sub_ps(_mm512_setzero_ps(), x);
+    __m512 result = one;
+    for (i32 term = 0; term < 8; ++term) {
+        result = _mm512_fmadd_ps(_mm512_mul_ps(minus_x, _mm512_set1_ps(EXP_TERM_RECIPROCALS[term])), result, one);
+    }
+
+    return _mm512_div_ps(one, _mm512_add_ps(one, result));
+}
+
+// A block is exactly one register wide
+TARGET_AVX512 static void population_block_feed_forward_avx512(const NeuralNetworkPopulationBlock& block, const SparseInput& input, PopulationOutputs& outputs) {
+    static constexpr i32 ROWS_PER_PASS = 16;
+
+    alignas(64) f32 hidden_activations[NeuralNetwork::HIDDEN_LAYER_SIZE][NeuralNetworkPopulationBlock::POPULATION_BLOCK_SIZE];
+    for (i32 row = 0; row < NeuralNetwork::HIDDEN_LAYER_SIZE; row += ROWS_PER_PASS) {
+        __m512 z[ROWS_PER_PASS];
+        for (i32 i = 0; i < ROWS_PER_PASS; ++i) {
+            z[i] = _mm512_load_ps(block.hidden_biases[row + i]);
+        }
+
+        for (i32 i = 0; i < input.count; ++i) {
+            const __m512 x = _mm512_set1_ps(input.values[i]);
+            const f32 (* const weights)[NeuralNetworkPopulationBlock::POPULATION_BLOCK_SIZE] = block.input_to_hidden_weights[input.indices[i]] + row;
+            for (i32 j = 0; j < ROWS_PER_PASS; ++j) {
+                z[j] = _mm512_fmadd_ps(_mm512_load_ps(weights[j]), x, z[j]);
+            }
+        }
+
+        for (i32 i = 0; i < ROWS_PER_PASS; ++i) {
+            _mm512_store_ps(hidden_activations[row + i], sigmoid_avx512(z[i]));
+        }
+    }
+
+    for (i32 row = 0; row < NeuralNetwork::OUTPUT_LAYER_SIZE; ++row) {
+        __m512 z = _mm512_load_ps(block.output_biases[row]);
+        for (i32 column = 0; column < NeuralNetwork::HIDDEN_LAYER_SIZE; ++column) {
+            z = _mm512_fmadd_ps(_mm512_load_ps(block.hidden_to_output_weights[row][column]), _mm512_load_ps(hidden_activations[column]), z);
+        }
+
+        _mm512_storeu_ps(outputs[row], sigmoid_avx512(z));
+    }
+}
+
+// outputs[input * population.size + network]. Inputs go through in tiles and a tile's blocks are the outer loop,
+// so a block's weights stay in cache for every input in the tile and each input is only gathered once. A block is
+// bigger than most L2s so the best tile size comes down to the cache sizes, which is why it's tuned.
+static void feed_forward(
+    const NeuralNetworkPopulation& population,
+    const NeuralNetwork::InputLayer* const inputs,
+    const u32 input_count,
+    const KernelTuning& tuning,
+    NeuralNetwork::OutputLayer* const outputs
+) {
+    static constexpr u32 BLOCK_SIZE = NeuralNetworkPopulationBlock::POPULATION_BLOCK_SIZE;
+    static_assert(NeuralNetwork::HIDDEN_LAYER_SIZE % 16 == 0);
+
+    using BlockFunction = void(*)(const NeuralNetworkPopulationBlock&, const SparseInput&, PopulationOutputs&);
+    const CpuFeatures& features = cpu_features();
+    BlockFunction block_feed_forward = population_block_feed_forward;
+    if (tuning.population_kernel >= KernelVariant::AVX512 && features.avx512f) {
+        block_feed_forward = population_block_feed_forward_avx512;
+    } else if (tuning.population_kernel >= KernelVariant::AVX2 && features.avx2) {
+        block_feed_forward = population_block_feed_forward_avx2;
+    }
+
+    u32 input_tile = tuning.population_input_tile;
+    input_tile = (input_tile < 1) ? 1 : (input_tile > MAX_POPULATION_INPUT_TILE ? MAX_POPULATION_INPUT_TILE : input_tile);
+
+    SparseInput tile_inputs[MAX_POPULATION_INPUT_TILE];
+    const u32 block_count = population_block_count(population.size);
+    for (u32 first_input = 0; first_input < input_count; first_input += input_tile) {
+        const u32 tile_input_count = (input_count - first_input < input_tile) ? input_count - first_input : input_tile;
+        for (u32 i = 0; i < tile_input_count; ++i) {
+            gather_sparse_input(inputs[first_input + i], tile_inputs[i]);
+        }
+
+        for (u32 block = 0; block < block_count; ++block) {
+            const u32 first_network = block * BLOCK_SIZE;
+            const u32 network_count = (population.size - first_network < BLOCK_SIZE) ? population.size - first_network : BLOCK_SIZE;
+
+            for (u32 i = 0; i < tile_input_count; ++i) {
+                PopulationOutputs block_outputs = {};
+                block_feed_forward(population.blocks[block], tile_inputs[i], block_outputs);
+
+                NeuralNetwork::OutputLayer* const input_outputs = outputs + (first_input + i) * population.size + first_network;
+                for (u32 lane = 0; lane < network_count; ++lane) {
+                    for (i32 j = 0; j < NeuralNetwork::OUTPUT_LAYER_SIZE; ++j) {
+                        input_outputs[lane][j] = block_outputs[j][lane];
+                    }
+                }
+            }
+        }
+    }
+}
+
 static f32 cost_derivative(const f32 activation, const f32 target) {
     return activation - target;
 }
@@ -171,7 +890,7 @@ static void back_propagate(
     NeuralNetwork::OutputLayer output_activations = {};
     for (i32 row = 0; row < NeuralNetwork::OUTPUT_LAYER_SIZE; ++row) {
         for (i32 column = 0; column < NeuralNetwork::HIDDEN_LAYER_SIZE; ++column) {
-            output_zs[row] += neural_network.hidden_to_output_weights[row][column] * input[column];
+            output_zs[row] += neural_network.hidden_to_output_weights[row][column] * hidden_activations[column];
         }
 
         output_zs[row] += neural_network.output_biases[row];
@@ -218,3 +937,508 @@ static void back_propagate(
         neural_network_delta.hidden_biases[i] += input_to_hidden_gradient[i];
     }
 }
+
+// Packed deltas are transposed back to the canonical layout as they're applied
+static void apply_delta(NeuralNetwork& neural_network, const PackedNeuralNetworkDelta& neural_network_delta, const f32 step_size) {
+    for (i32 row = 0; row < NeuralNetwork::HIDDEN_LAYER_SIZE; ++row) {
+        for (i32 column = 0; column < NeuralNetwork::INPUT_LAYER_SIZE; ++column) {
+            neural_network.input_to_hidden_weights[row][column] -= step_size * neural_network_delta.input_to_hidden_columns[column][row];
+        }
+    }
+
+    for (i32 i = 0; i < NeuralNetwork::HIDDEN_LAYER_SIZE; ++i) {
+        neural_network.hidden_biases[i] -= step_size * neural_network_delta.hidden_biases[i];
+    }
+
+    for (i32 row = 0; row < NeuralNetwork::OUTPUT_LAYER_SIZE; ++row) {
+        for (i32 column = 0; column < NeuralNetwork::HIDDEN_LAYER_SIZE; ++column) {
+            neural_network.hidden_to_output_weights[row][column] -= step_size * neural_network_delta.hidden_to_output_weights[row][column];
+        }
+    }
+
+    for (i32 i = 0; i < NeuralNetwork::OUTPUT_LAYER_SIZE; ++i) {
+        neural_network.output_biases[i] -= step_size * neural_network_delta.output_biases[i];
+    }
+}
+
+// Covers the weights and biases but not the struct's tail padding, for checking two networks are bit identical
+static u32 neural_network_checksum(const NeuralNetwork& neural_network) {
+    return crc32c(reinterpret_cast<const i8*>(&neural_network), LEGACY_NEURAL_NETWORK_SIZE);
+}
+
+// Packing only happens when the canonical weights changed since the last call, see invalidate_packed_neural_network
+static const PackedNeuralNetwork& pack_neural_network(const NeuralNetwork& neural_network, PackedNeuralNetwork& packed_neural_network) {
+    static constexpr i32 PANEL_WIDTH = PackedNeuralNetwork::PANEL_WIDTH;
+
+    if (packed_neural_network.up_to_date) {
+        return packed_neural_network;
+    }
+
+    for (i32 row = 0; row < NeuralNetwork::HIDDEN_LAYER_SIZE; ++row) {
+        for (i32 column = 0; column < NeuralNetwork::INPUT_LAYER_SIZE; ++column) {
+            packed_neural_network.input_to_hidden_row_panels[row / PANEL_WIDTH][column][row % PANEL_WIDTH] = neural_network.input_to_hidden_weights[row][column];
+        }
+
+        packed_neural_network.hidden_biases[row] = neural_network.hidden_biases[row];
+    }
+
+    for (i32 column = 0; column < NeuralNetwork::HIDDEN_LAYER_SIZE; ++column) {
+        for (i32 row = 0; row < PANEL_WIDTH; ++row) {
+            packed_neural_network.hidden_to_output_row_panel[column][row] = (row < NeuralNetwork::OUTPUT_LAYER_SIZE) ? neural_network.hidden_to_output_weights[row][column] : 0.0f;
+        }
+    }
+
+    for (i32 row = 0; row < PANEL_WIDTH; ++row) {
+        packed_neural_network.output_biases[row] = (row < NeuralNetwork::OUTPUT_LAYER_SIZE) ? neural_network.output_biases[row] : 0.0f;
+    }
+
+    copy_bytes(
+        reinterpret_cast<const i8*>(neural_network.hidden_to_output_weights),
+        sizeof(neural_network.hidden_to_output_weights),
+        reinterpret_cast<i8*>(packed_neural_network.hidden_to_output_weights)
+    );
+
+    packed_neural_network.up_to_date = true;
+
+    return packed_neural_network;
+}
+
+// Call after changing the canonical weights, e.g. apply_delta or loading a different model
+static void invalidate_packed_neural_network(PackedNeuralNetwork& packed_neural_network) {
+    packed_neural_network.up_to_date = false;
+}
+
+using PackedOutputLayer = f32[PackedNeuralNetwork::PANEL_WIDTH];
+
+static void packed_forward(const PackedNeuralNetwork& neural_network, const SparseInput& input, NeuralNetwork::HiddenLayer& hidden_activations, PackedOutputLayer& output_activations) {
+    static constexpr i32 PANEL_WIDTH = PackedNeuralNetwork::PANEL_WIDTH;
+
+    for (i32 row = 0; row < NeuralNetwork::HIDDEN_LAYER_SIZE; ++row) {
+        const f32 (* const panel)[PANEL_WIDTH] = neural_network.input_to_hidden_row_panels[row / PANEL_WIDTH];
+        f32 z = neural_network.hidden_biases[row];
+        for (i32 i = 0; i < input.count; ++i) {
+            z += panel[input.indices[i]][row % PANEL_WIDTH] * input.values[i];
+        }
+
+        hidden_activations[row] = sigmoid(z);
+    }
+
+    for (i32 row = 0; row < PANEL_WIDTH; ++row) {
+        f32 z = neural_network.output_biases[row];
+        for (i32 column = 0; column < NeuralNetwork::HIDDEN_LAYER_SIZE; ++column) {
+            z += neural_network.hidden_to_output_row_panel[column][row] * hidden_activations[column];
+        }
+
+        output_activations[row] = sigmoid(z);
+    }
+}
+
+// All the outputs fit in the first register of the panel, the rest is padding. Four accumulators so the
+// adds aren't one long dependency chain.
+TARGET_AVX2 static void packed_output_layer_avx2(
+    const f32 (* const row_panel)[PackedNeuralNetwork::PANEL_WIDTH],
+    const f32* const biases,
+    const f32* const hidden_activations,
+    PackedOutputLayer& output_activations
+) {
+    static_assert(NeuralNetwork::OUTPUT_LAYER_SIZE <= 8 && NeuralNetwork::HIDDEN_LAYER_SIZE % 4 == 0);
+
+    __m256 z[4] = {_mm256_load_ps(biases), _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps()};
+    for (i32 column = 0; column < NeuralNetwork::HIDDEN_LAYER_SIZE; column += 4) {
+        for (i32 i = 0; i < 4; ++i) {
+            z[i] = _mm256_fmadd_ps(_mm256_load_ps(row_panel[column + i]), _mm256_set1_ps(hidden_activations[column + i]), z[i]);
+        }
+    }
+
+    const __m256 sum = _mm256_add_ps(_mm256_add_ps(z[0], z[1]), _mm256_add_ps(z[2], z[3]));
+    _mm256_storeu_ps(output_activations, sigmoid_avx2(sum));
+}
+
+// One panel is two registers, both panels' worth of accumulators stay in registers over the inputs
+TARGET_AVX2 static void packed_forward_avx2(const PackedNeuralNetwork& neural_network, const SparseInput& input, NeuralNetwork::HiddenLayer& hidden_activations, PackedOutputLayer& output_activations) {
+    for (i32 panel = 0; panel < PackedNeuralNetwork::HIDDEN_PANEL_COUNT; panel += 2) {
+        __m256 z[4] = {};
+        for (i32 i = 0; i < 4; ++i) {
+            z[i] = _mm256_load_ps(neural_network.hidden_biases + panel * PackedNeuralNetwork::PANEL_WIDTH + 8 * i);
+        }
+
+        for (i32 i = 0; i < input.count; ++i) {
+            const __m256 x = _mm256_set1_ps(input.values[i]);
+            const f32* const weights_0 = neural_network.input_to_hidden_row_panels[panel][input.indices[i]];
+            const f32* const weights_1 = neural_network.input_to_hidden_row_panels[panel + 1][input.indices[i]];
+            z[0] = _mm256_fmadd_ps(_mm256_load_ps(weights_0), x, z[0]);
+            z[1] = _mm256_fmadd_ps(_mm256_load_ps(weights_0 + 8), x, z[1]);
+            z[2] = _mm256_fmadd_ps(_mm256_load_ps(weights_1), x, z[2]);
+            z[3] = _mm256_fmadd_ps(_mm256_load_ps(weights_1 + 8), x, z[3]);
+        }
+
+        for (i32 i = 0; i < 4; ++i) {
+            _mm256_store_ps(hidden_activations + panel * PackedNeuralNetwork::PANEL_WIDTH + 8 * i, sigmoid_avx2(z[i]));
+        }
+    }
+
+    packed_output_layer_avx2(neural_network.hidden_to_output_row_panel, neural_network.output_biases, hidden_activations, output_activations);
+}
+
+static void packed_accumulate_columns(const SparseInput& input, const NeuralNetwork::HiddenLayer& gradient, PackedNeuralNetworkDelta& neural_network_delta) {
+    for (i32 i = 0; i < input.count; ++i) {
+        f32* const column = neural_network_delta.input_to_hidden_columns[input.indices[i]];
+        for (i32 row = 0; row < NeuralNetwork::HIDDEN_LAYER_SIZE; ++row) {
+            column[row] += gradient[row] * input.values[i];
+        }
+    }
+}
+
+TARGET_AVX2 static void packed_accumulate_columns_avx2(const SparseInput& input, const NeuralNetwork::HiddenLayer& gradient, PackedNeuralNetworkDelta& neural_network_delta) {
+    static constexpr i32 REGISTER_COUNT = NeuralNetwork::HIDDEN_LAYER_SIZE / 8;
+
+    __m256 gradients[REGISTER_COUNT] = {};
+    for (i32 i = 0; i < REGISTER_COUNT; ++i) {
+        gradients[i] = _mm256_loadu_ps(gradient + 8 * i);
+    }
+
+    for (i32 i = 0; i < input.count; ++i) {
+        const __m256 x = _mm256_set1_ps(input.values[i]);
+        f32* const column = neural_network_delta.input_to_hidden_columns[input.indices[i]];
+        for (i32 j = 0; j < REGISTER_COUNT; ++j) {
+            _mm256_store_ps(column + 8 * j, _mm256_fmadd_ps(gradients[j], x, _mm256_load_ps(column + 8 * j)));
+        }
+    }
+}
+
+static void feed_forward(const PackedNeuralNetwork& neural_network, const NeuralNetwork::InputLayer& input, NeuralNetwork::OutputLayer& output) {
+    SparseInput sparse_input;
+    gather_sparse_input(input, sparse_input);
+
+    alignas(32) NeuralNetwork::HiddenLayer hidden_activations = {};
+    alignas(32) PackedOutputLayer output_activations = {};
+    if (cpu_features().avx2) {
+        packed_forward_avx2(neural_network, sparse_input, hidden_activations, output_activations);
+    } else {
+        packed_forward(neural_network, sparse_input, hidden_activations, output_activations);
+    }
+
+    for (i32 i = 0; i < NeuralNetwork::OUTPUT_LAYER_SIZE; ++i) {
+        output[i] = output_activations[i];
+    }
+}
+
+// Same maths as back_propagate() above, sigmoid_derivative(z) is worked out from the activations we already have.
+// The gradient is linear in the output error so scaling that by weight counts the sample weight times over.
+static void back_propagate(
+    const PackedNeuralNetwork& neural_network,
+    const NeuralNetwork::InputLayer& input,
+    const NeuralNetwork::OutputLayer& target,
+    const f32 weight,
+    PackedNeuralNetworkDelta& neural_network_delta
+) {
+    const bool avx2 = cpu_features().avx2;
+
+    SparseInput sparse_input;
+    gather_sparse_input(input, sparse_input);
+
+    alignas(32) NeuralNetwork::HiddenLayer hidden_activations = {};
+    alignas(32) PackedOutputLayer output_activations = {};
+    if (avx2) {
+        packed_forward_avx2(neural_network, sparse_input, hidden_activations, output_activations);
+    } else {
+        packed_forward(neural_network, sparse_input, hidden_activations, output_activations);
+    }
+
+    NeuralNetwork::OutputLayer hidden_to_output_gradient = {};
+    for (i32 i = 0; i < NeuralNetwork::OUTPUT_LAYER_SIZE; ++i) {
+        const f32 activation = output_activations[i];
+        hidden_to_output_gradient[i] = weight * cost_derivative(activation, target[i]) * activation * (1.0f - activation);
+        neural_network_delta.output_biases[i] += hidden_to_output_gradient[i];
+    }
+
+    NeuralNetwork::HiddenLayer input_to_hidden_gradient = {};
+    for (i32 row = 0; row < NeuralNetwork::OUTPUT_LAYER_SIZE; ++row) {
+        for (i32 column = 0; column < NeuralNetwork::HIDDEN_LAYER_SIZE; ++column) {
+            neural_network_delta.hidden_to_output_weights[row][column] += hidden_to_output_gradient[row] * hidden_activations[column];
+            input_to_hidden_gradient[column] += neural_network.hidden_to_output_weights[row][column] * hidden_to_output_gradient[row];
+        }
+    }
+
+    for (i32 i = 0; i < NeuralNetwork::HIDDEN_LAYER_SIZE; ++i) {
+        input_to_hidden_gradient[i] *= hidden_activations[i] * (1.0f - hidden_activations[i]);
+        neural_network_delta.hidden_biases[i] += input_to_hidden_gradient[i];
+    }
+
+    if (avx2) {
+        packed_accumulate_columns_avx2(sparse_input, input_to_hidden_gradient, neural_network_delta);
+    } else {
+        packed_accumulate_columns(sparse_input, input_to_hidden_gradient, neural_network_delta);
+    }
+}
+
+// k-th smallest (from 0) of values, reorders values
+static f32 select_smallest(f32* const values, const u32 count, const u32 k) {
+    u32 first = 0;
+    u32 last = count - 1;
+    while (first < last) {
+        const f32 pivot = values[first + (last - first) / 2];
+        u32 i = first;
+        u32 j = last;
+        while (i <= j) {
+            while (values[i] < pivot) {
+                ++i;
+            }
+
+            while (values[j] > pivot) {
+                --j;
+            }
+
+            if (i <= j) {
+                const f32 value = values[i];
+                values[i] = values[j];
+                values[j] = value;
+                ++i;
+                if (j == 0) {
+                    break;
+                }
+
+                --j;
+            }
+        }
+
+        if (k <= j) {
+            last = j;
+        } else if (k >= i) {
+            first = i;
+        } else {
+            break;
+        }
+    }
+
+    return values[k];
+}
+
+// Which magnitudes to zero so exactly target_count of them are, ties at the threshold go in order
+static void choose_pruned(const f32* const magnitudes, const u32 count, const u32 target_count, f32* const scratch, bool* const pruned) {
+    for (u32 i = 0; i < count; ++i) {
+        scratch[i] = magnitudes[i];
+        pruned[i] = false;
+    }
+
+    if (target_count == 0) {
+        return;
+    }
+
+    const f32 threshold = select_smallest(scratch, count, target_count - 1);
+    u32 pruned_count = 0;
+    for (u32 i = 0; i < count; ++i) {
+        if (magnitudes[i] < threshold) {
+            pruned[i] = true;
+            ++pruned_count;
+        }
+    }
+
+    for (u32 i = 0; i < count && pruned_count < target_count; ++i) {
+        if (magnitudes[i] == threshold) {
+            pruned[i] = true;
+            ++pruned_count;
+        }
+    }
+}
+
+// Zeroes the smallest magnitude weights of each weight matrix so it reaches sparsity (clamped to [0, 1], NaN as 0),
+// biases are left alone.
+// Input to hidden weights go a sparse block at a time ranked by the block's summed magnitude so the zeros line up
+// with what the sparse kernel skips, the hidden to output weights are only 2.5% of the work and go one at a time.
+static void prune_neural_network(NeuralNetwork& neural_network, const f32 sparsity) {
+    static constexpr i32 BLOCK_HEIGHT = SparseNeuralNetwork::BLOCK_HEIGHT;
+    static constexpr u32 BLOCK_COUNT = SparseNeuralNetwork::MAX_BLOCK_COUNT;
+    static constexpr u32 OUTPUT_WEIGHT_COUNT = NeuralNetwork::OUTPUT_LAYER_SIZE * NeuralNetwork::HIDDEN_LAYER_SIZE;
+
+    // any more would have choose_pruned() run off the end of its candidates, NaN counts as none
+    const f32 clamped_sparsity = (sparsity > 0.0f) ? ((sparsity < 1.0f) ? sparsity : 1.0f) : 0.0f;
+
+    f32 magnitudes[BLOCK_COUNT] = {};
+    f32 scratch[BLOCK_COUNT] = {};
+    bool pruned[BLOCK_COUNT] = {};
+
+    for (i32 column = 0; column < NeuralNetwork::INPUT_LAYER_SIZE; ++column) {
+        for (i32 block_row = 0; block_row < SparseNeuralNetwork::BLOCKS_PER_COLUMN; ++block_row) {
+            f32 magnitude = 0.0f;
+            for (i32 i = 0; i < BLOCK_HEIGHT; ++i) {
+                const f32 weight = neural_network.input_to_hidden_weights[block_row * BLOCK_HEIGHT + i][column];
+                magnitude += (weight < 0.0f) ? -weight : weight;
+            }
+
+            magnitudes[column * SparseNeuralNetwork::BLOCKS_PER_COLUMN + block_row] = magnitude;
+        }
+    }
+
+    choose_pruned(magnitudes, BLOCK_COUNT, static_cast<u32>(clamped_sparsity * BLOCK_COUNT + 0.5f), scratch, pruned);
+    for (i32 column = 0; column < NeuralNetwork::INPUT_LAYER_SIZE; ++column) {
+        for (i32 block_row = 0; block_row < SparseNeuralNetwork::BLOCKS_PER_COLUMN; ++block_row) {
+            if (pruned[column * SparseNeuralNetwork::BLOCKS_PER_COLUMN + block_row]) {
+                for (i32 i = 0; i < BLOCK_HEIGHT; ++i) {
+                    neural_network.input_to_hidden_weights[block_row * BLOCK_HEIGHT + i][column] = 0.0f;
+                }
+            }
+        }
+    }
+
+    f32* const output_weights = &neural_network.hidden_to_output_weights[0][0];
+    for (u32 i = 0; i < OUTPUT_WEIGHT_COUNT; ++i) {
+        magnitudes[i] = (output_weights[i] < 0.0f) ? -output_weights[i] : output_weights[i];
+    }
+
+    choose_pruned(magnitudes, OUTPUT_WEIGHT_COUNT, static_cast<u32>(clamped_sparsity * OUTPUT_WEIGHT_COUNT + 0.5f), scratch, pruned);
+    for (u32 i = 0; i < OUTPUT_WEIGHT_COUNT; ++i) {
+        output_weights[i] = pruned[i] ? 0.0f : output_weights[i];
+    }
+}
+
+// Returns the fraction of input to hidden blocks kept, i.e. roughly how much of the dense work is left
+static f32 make_sparse_neural_network(const NeuralNetwork& neural_network, SparseNeuralNetwork& sparse_neural_network) {
+    static_assert(NeuralNetwork::INPUT_LAYER_SIZE <= 256, "block_columns are u8");
+    static constexpr i32 BLOCK_HEIGHT = SparseNeuralNetwork::BLOCK_HEIGHT;
+    static constexpr i32 PANEL_WIDTH = PackedNeuralNetwork::PANEL_WIDTH;
+
+    u32 block_count = 0;
+    for (i32 panel = 0; panel < PackedNeuralNetwork::HIDDEN_PANEL_COUNT; ++panel) {
+        sparse_neural_network.panel_starts[panel] = static_cast<u16>(block_count);
+        for (i32 column = 0; column < NeuralNetwork::INPUT_LAYER_SIZE; ++column) {
+            bool all_zero = true;
+            for (i32 i = 0; i < BLOCK_HEIGHT; ++i) {
+                all_zero = all_zero && neural_network.input_to_hidden_weights[panel * BLOCK_HEIGHT + i][column] == 0.0f;
+            }
+
+            if (!all_zero) {
+                for (i32 i = 0; i < BLOCK_HEIGHT; ++i) {
+                    sparse_neural_network.blocks[block_count][i] = neural_network.input_to_hidden_weights[panel * BLOCK_HEIGHT + i][column];
+                }
+
+                sparse_neural_network.block_columns[block_count] = static_cast<u8>(column);
+                ++block_count;
+            }
+        }
+    }
+
+    sparse_neural_network.panel_starts[PackedNeuralNetwork::HIDDEN_PANEL_COUNT] = static_cast<u16>(block_count);
+
+    for (i32 row = 0; row < NeuralNetwork::HIDDEN_LAYER_SIZE; ++row) {
+        sparse_neural_network.hidden_biases[row] = neural_network.hidden_biases[row];
+        for (i32 output = 0; output < PANEL_WIDTH; ++output) {
+            sparse_neural_network.hidden_to_output_row_panel[row][output] = (output < NeuralNetwork::OUTPUT_LAYER_SIZE) ? neural_network.hidden_to_output_weights[output][row] : 0.0f;
+        }
+    }
+
+    for (i32 output = 0; output < PANEL_WIDTH; ++output) {
+        sparse_neural_network.output_biases[output] = (output < NeuralNetwork::OUTPUT_LAYER_SIZE) ? neural_network.output_biases[output] : 0.0f;
+    }
+
+    return static_cast<f32>(block_count) / static_cast<f32>(SparseNeuralNetwork::MAX_BLOCK_COUNT);
+}
+
+// Reads the inputs directly rather than gathering the non-zero ones, intersecting the two sparsity patterns
+// needs a data dependent branch per block which costs far more than multiplying a kept block by zero
+static void sparse_forward(const SparseNeuralNetwork& neural_network, const NeuralNetwork::InputLayer& input, PackedOutputLayer& output_activations) {
+    static constexpr i32 BLOCK_HEIGHT = SparseNeuralNetwork::BLOCK_HEIGHT;
+
+    NeuralNetwork::HiddenLayer hidden_activations = {};
+    for (i32 panel = 0; panel < PackedNeuralNetwork::HIDDEN_PANEL_COUNT; ++panel) {
+        f32* const z = hidden_activations + panel * BLOCK_HEIGHT;
+        for (i32 i = 0; i < BLOCK_HEIGHT; ++i) {
+            z[i] = neural_network.hidden_biases[panel * BLOCK_HEIGHT + i];
+        }
+
+        for (u32 block = neural_network.panel_starts[panel]; block < neural_network.panel_starts[panel + 1]; ++block) {
+            const f32 x = input[neural_network.block_columns[block]];
+            for (i32 i = 0; i < BLOCK_HEIGHT; ++i) {
+                z[i] += neural_network.blocks[block][i] * x;
+            }
+        }
+
+        for (i32 i = 0; i < BLOCK_HEIGHT; ++i) {
+            z[i] = sigmoid(z[i]);
+        }
+    }
+
+    for (i32 row = 0; row < PackedNeuralNetwork::PANEL_WIDTH; ++row) {
+        f32 z = neural_network.output_biases[row];
+        for (i32 column = 0; column < NeuralNetwork::HIDDEN_LAYER_SIZE; ++column) {
+            z += neural_network.hidden_to_output_row_panel[column][row] * hidden_activations[column];
+        }
+
+        output_activations[row] = sigmoid(z);
+    }
+}
+
+// A block is two registers, alternate blocks go to separate accumulators so the adds aren't one dependency chain
+TARGET_AVX2 static void sparse_forward_avx2(const SparseNeuralNetwork& neural_network, const NeuralNetwork::InputLayer& input, PackedOutputLayer& output_activations) {
+    static constexpr i32 BLOCK_HEIGHT = SparseNeuralNetwork::BLOCK_HEIGHT;
+    static_assert(BLOCK_HEIGHT == 16);
+
+    alignas(32) NeuralNetwork::HiddenLayer hidden_activations;
+    for (i32 panel = 0; panel < PackedNeuralNetwork::HIDDEN_PANEL_COUNT; ++panel) {
+        __m256 z[4] = {
+            _mm256_load_ps(neural_network.hidden_biases + panel * BLOCK_HEIGHT),
+            _mm256_load_ps(neural_network.hidden_biases + panel * BLOCK_HEIGHT + 8),
+            _mm256_setzero_ps(),
+            _mm256_setzero_ps()
+        };
+
+        const u32 first_block = neural_network.panel_starts[panel];
+        const u32 last_block = neural_network.panel_starts[panel + 1];
+        u32 block = first_block;
+        for (; block + 1 < last_block; block += 2) {
+            const __m256 x_0 = _mm256_set1_ps(input[neural_network.block_columns[block]]);
+            const __m256 x_1 = _mm256_set1_ps(input[neural_network.block_columns[block + 1]]);
+            z[0] = _mm256_fmadd_ps(_mm256_load_ps(neural_network.blocks[block]), x_0, z[0]);
+            z[1] = _mm256_fmadd_ps(_mm256_load_ps(neural_network.blocks[block] + 8), x_0, z[1]);
+            z[2] = _mm256_fmadd_ps(_mm256_load_ps(neural_network.blocks[block + 1]), x_1, z[2]);
+            z[3] = _mm256_fmadd_ps(_mm256_load_ps(neural_network.blocks[block + 1] + 8), x_1, z[3]);
+        }
+
+        if (block < last_block) {
+            const __m256 x = _mm256_set1_ps(input[neural_network.block_columns[block]]);
+            z[0] = _mm256_fmadd_ps(_mm256_load_ps(neural_network.blocks[block]), x, z[0]);
+            z[1] = _mm256_fmadd_ps(_mm256_load_ps(neural_network.blocks[block] + 8), x, z[1]);
+        }
+
+        _mm256_store_ps(hidden_activations + panel * BLOCK_HEIGHT, sigmoid_avx2(_mm256_add_ps(z[0], z[2])));
+        _mm256_store_ps(hidden_activations + panel * BLOCK_HEIGHT + 8, sigmoid_avx2(_mm256_add_ps(z[1], z[3])));
+    }
+
+    packed_output_layer_avx2(neural_network.hidden_to_output_row_panel, neural_network.output_biases, hidden_activations, output_activations);
+}
+
+static void feed_forward(const SparseNeuralNetwork& neural_network, const NeuralNetwork::InputLayer& input, NeuralNetwork::OutputLayer& output) {
+    alignas(32) PackedOutputLayer output_activations = {};
+    if (cpu_features().avx2) {
+        sparse_forward_avx2(neural_network, input, output_activations);
+    } else {
+        sparse_forward(neural_network, input, output_activations);
+    }
+
+    for (i32 i = 0; i < NeuralNetwork::OUTPUT_LAYER_SIZE; ++i) {
+        output[i] = output_activations[i];
+    }
+}
+
+// step_size is expected to already account for the learning rate and number of samples accumulated into the delta
+static void apply_delta(NeuralNetwork& neural_network, const NeuralNetwork& neural_network_delta, const f32 step_size) {
+    for (i32 row = 0; row < NeuralNetwork::HIDDEN_LAYER_SIZE; ++row) {
+        for (i32 column = 0; column < NeuralNetwork::INPUT_LAYER_SIZE; ++column) {
+            neural_network.input_to_hidden_weights[row][column] -= step_size * neural_network_delta.input_to_hidden_weights[row][column];
+        }
+    }
+
+    for (i32 i = 0; i < NeuralNetwork::HIDDEN_LAYER_SIZE; ++i) {
+        neural_network.hidden_biases[i] -= step_size * neural_network_delta.hidden_biases[i];
+    }
+
+    for (i32 row = 0; row < NeuralNetwork::OUTPUT_LAYER_SIZE; ++row) {
+        for (i32 column = 0; column < NeuralNetwork::HIDDEN_LAYER_SIZE; ++column) {
+            neural_network.hidden_to_output_weights[row][column] -= step_size * neural_network_delta.hidden_to_output_weights[row][column];
+        }
+    }
+
+    for (i32 i = 0; i < NeuralNetwork::OUTPUT_LAYER_SIZE; ++i) {
+        neural_network.output_biases[i] -= step_size * neural_network_delta.output_biases[i];
+    }
+}
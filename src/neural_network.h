@@ -1,8 +1,9 @@
 #ifndef NEURALNETWORK_H
 #define NEURALNETWORK_H
 
-#include "tetris_ai.h"
+#include "types.h"
 
+// Every tensor is 64 byte aligned so the struct matches the tensor sections of a mapped model file
 struct NeuralNetwork {
     static constexpr i32 INPUT_LAYER_SIZE = 192;
     static constexpr i32 HIDDEN_LAYER_SIZE = 64;
@@ -14,16 +15,185 @@ struct NeuralNetwork {
     using InputToHiddenMatrix = f32[HIDDEN_LAYER_SIZE][INPUT_LAYER_SIZE];
     using HiddenToOutputMatrix = f32[OUTPUT_LAYER_SIZE][HIDDEN_LAYER_SIZE];
 
-    InputToHiddenMatrix input_to_hidden_weights;
-    HiddenLayer hidden_biases;
-    HiddenToOutputMatrix hidden_to_output_weights;
-    OutputLayer output_biases;
+    alignas(64) InputToHiddenMatrix input_to_hidden_weights;
+    alignas(64) HiddenLayer hidden_biases;
+    alignas(64) HiddenToOutputMatrix hidden_to_output_weights;
+    alignas(64) OutputLayer output_biases;
 };
 
+// Reduced precision (bf16 or f16) copy of the weights for inference, halves the memory traffic.
+// Same shape as NeuralNetwork, values are converted back to f32 in the kernels and accumulated in f32.
+struct HalfPrecisionNeuralNetwork {
+    alignas(64) u16 input_to_hidden_weights[NeuralNetwork::HIDDEN_LAYER_SIZE][NeuralNetwork::INPUT_LAYER_SIZE];
+    alignas(64) u16 hidden_biases[NeuralNetwork::HIDDEN_LAYER_SIZE];
+    alignas(64) u16 hidden_to_output_weights[NeuralNetwork::OUTPUT_LAYER_SIZE][NeuralNetwork::HIDDEN_LAYER_SIZE];
+    alignas(64) u16 output_biases[NeuralNetwork::OUTPUT_LAYER_SIZE];
+};
+
+// Kernel specific copies of the weights, rebuilt from the canonical NeuralNetwork (which is what gets saved)
+// the first time they're asked for after the canonical weights changed.
+//  - input to hidden weights as row panels, PANEL_WIDTH hidden units stored input by input so the forward
+//    pass broadcasts one input against a whole panel and skips zero inputs (most of the grid)
+//  - hidden to output weights as a single row panel with the outputs padded out to PANEL_WIDTH
+//  - hidden to output weights row major as well, backward spreads the output error over the hidden units
+//    with one contiguous multiply-add per output using those
+struct PackedNeuralNetwork {
+    static constexpr i32 PANEL_WIDTH = 16;
+    static constexpr i32 HIDDEN_PANEL_COUNT = NeuralNetwork::HIDDEN_LAYER_SIZE / PANEL_WIDTH;
+
+    alignas(64) f32 input_to_hidden_row_panels[HIDDEN_PANEL_COUNT][NeuralNetwork::INPUT_LAYER_SIZE][PANEL_WIDTH];
+    alignas(64) NeuralNetwork::HiddenLayer hidden_biases;
+    alignas(64) f32 hidden_to_output_row_panel[NeuralNetwork::HIDDEN_LAYER_SIZE][PANEL_WIDTH];
+    alignas(64) f32 output_biases[PANEL_WIDTH];
+    alignas(64) NeuralNetwork::HiddenToOutputMatrix hidden_to_output_weights;
+    bool up_to_date;    // zero initialised means it gets packed on first use
+};
+
+// Delta accumulated by the packed back propagation. Input to hidden weights are stored column by column so a
+// sample only touches the columns of its non-zero inputs, each one contiguous multiply-add.
+struct PackedNeuralNetworkDelta {
+    alignas(64) f32 input_to_hidden_columns[NeuralNetwork::INPUT_LAYER_SIZE][NeuralNetwork::HIDDEN_LAYER_SIZE];
+    alignas(64) NeuralNetwork::HiddenLayer hidden_biases;
+    alignas(64) NeuralNetwork::HiddenToOutputMatrix hidden_to_output_weights;
+    alignas(64) NeuralNetwork::OutputLayer output_biases;
+};
+
+// Input to hidden weights of a pruned network with the all zero blocks left out. A block is one input's weights for
+// a PackedNeuralNetwork row panel (PANEL_WIDTH hidden units), blocks are grouped by panel so each panel's
+// accumulators stay in registers while its blocks stream past. Built from the canonical weights on load like the
+// packed copy, the file format doesn't change.
+struct SparseNeuralNetwork {
+    static constexpr i32 BLOCK_HEIGHT = PackedNeuralNetwork::PANEL_WIDTH;
+    static constexpr i32 BLOCKS_PER_COLUMN = PackedNeuralNetwork::HIDDEN_PANEL_COUNT;
+    static constexpr i32 MAX_BLOCK_COUNT = NeuralNetwork::INPUT_LAYER_SIZE * BLOCKS_PER_COLUMN;
+
+    alignas(64) f32 blocks[MAX_BLOCK_COUNT][BLOCK_HEIGHT];
+    u8 block_columns[MAX_BLOCK_COUNT];                          // which input each block multiplies
+    u16 panel_starts[PackedNeuralNetwork::HIDDEN_PANEL_COUNT + 1]; // panel p's blocks are [panel_starts[p], panel_starts[p + 1])
+    alignas(64) NeuralNetwork::HiddenLayer hidden_biases;
+    alignas(64) f32 hidden_to_output_row_panel[NeuralNetwork::HIDDEN_LAYER_SIZE][PackedNeuralNetwork::PANEL_WIDTH];
+    alignas(64) f32 output_biases[PackedNeuralNetwork::PANEL_WIDTH];
+};
+
+// Weights of POPULATION_BLOCK_SIZE networks interleaved so the innermost index is the network, one input value
+// can then be multiplied against the same weight of every network in the block with one vector instruction.
+// Input to hidden weights are input major so zero inputs (most of the grid) can be skipped entirely.
+struct NeuralNetworkPopulationBlock {
+    static constexpr u32 POPULATION_BLOCK_SIZE = 16;
+
+    alignas(64) f32 input_to_hidden_weights[NeuralNetwork::INPUT_LAYER_SIZE][NeuralNetwork::HIDDEN_LAYER_SIZE][POPULATION_BLOCK_SIZE];
+    alignas(64) f32 hidden_biases[NeuralNetwork::HIDDEN_LAYER_SIZE][POPULATION_BLOCK_SIZE];
+    alignas(64) f32 hidden_to_output_weights[NeuralNetwork::OUTPUT_LAYER_SIZE][NeuralNetwork::HIDDEN_LAYER_SIZE][POPULATION_BLOCK_SIZE];
+    alignas(64) f32 output_biases[NeuralNetwork::OUTPUT_LAYER_SIZE][POPULATION_BLOCK_SIZE];
+};
+
+// Population of candidate networks (e.g. for neuroevolution) stacked for evaluating them all on the same inputs.
+// The caller owns the block storage, population_block_count(size) blocks, the last one padded with zero weights.
+struct NeuralNetworkPopulation {
+    static constexpr u32 MAX_SIZE = 512;
+
+    NeuralNetworkPopulationBlock* blocks;
+    u32 size;
+};
+
+enum KernelVariant : u32 {
+    SCALAR = 0,
+    AVX2 = 1,
+    AVX512 = 2
+};
+
+// Kernel choices that only change how fast the answers come (up to rounding), where the best pick depends on
+// the host CPU's caches and vector units rather than on the code. The tuner times the candidates once per
+// machine and stores the winners in a tuning file (see kernel_tuning.h), the defaults are used without one.
+struct KernelTuning {
+    f32 max_sparse_block_density;   // pruned models at or below this block density run on the sparse kernel
+    u32 population_input_tile;      // inputs run against one population block before moving to the next block
+    KernelVariant population_kernel;    // the best one the CPU has is used if it doesn't have this one
+};
+
+static constexpr u32 MAX_POPULATION_INPUT_TILE = 64;
+static constexpr KernelTuning DEFAULT_KERNEL_TUNING = {0.3f, MAX_POPULATION_INPUT_TILE, KernelVariant::AVX512};
+
+// Model file layout (all offsets from start of file):
+//  - ModelFileHeader
+//  - ModelSection[section_count]
+//  - f32 tensor data, each section starting on a MODEL_SECTION_ALIGNMENT boundary
+//  - optionally (version 3+) a bf16/f16 copy of the same tensors laid out like HalfPrecisionNeuralNetwork
+struct ModelFileHeader {
+    i8 magic[8];
+    u32 version;
+    u32 header_size;
+    u32 section_count;
+    u32 section_alignment;
+    i32 input_layer_size;
+    i32 hidden_layer_size;
+    i32 output_layer_size;
+    u32 section_table_checksum;
+    u64 file_size;
+    u32 header_checksum;    // calculated with this field set to 0
+    u32 reserved[3];
+};
+
+enum ModelSectionType : u32 {
+    INPUT_TO_HIDDEN_WEIGHTS = 0,
+    HIDDEN_BIASES = 1,
+    HIDDEN_TO_OUTPUT_WEIGHTS = 2,
+    OUTPUT_BIASES = 3
+};
+
+enum ModelElementType : u32 {
+    F32 = 0,
+    BF16 = 1,
+    F16 = 2
+};
+
+struct ModelSection {
+    ModelSectionType type;
+    ModelElementType element_type;
+    u32 rows;
+    u32 columns;
+    u32 row_stride;         // bytes between the start of consecutive rows
+    u32 checksum;
+    u64 offset;
+    u64 size;
+    u32 reserved[2];
+};
+
+struct ModelView {
+    const NeuralNetwork* neural_network;
+    const HalfPrecisionNeuralNetwork* half_precision_neural_network;   // nullptr if the file has no reduced precision copy
+    ModelElementType half_precision_type;
+};
+
+static constexpr u32 MODEL_FILE_VERSION = 3;
+static constexpr u32 MODEL_FILE_MIN_VERSION = 2;
+static constexpr u32 MODEL_SECTION_ALIGNMENT = 64;
+static constexpr u32 MODEL_TENSOR_COUNT = 4;
+
+static_assert(sizeof(ModelFileHeader) == 64);
+static_assert(sizeof(ModelSection) == 48);
+
 static NeuralNetwork random_neural_network(u32 rng_seed);
-static u32 save_to_buffer(const NeuralNetwork& neural_network, i8* buffer);
 static u32 load_from_buffer(NeuralNetwork& neural_network, const i8* buffer, u32 buffer_size);
+static u32 model_file_size(ModelElementType half_precision_type);
+static u32 save_model_to_buffer(const NeuralNetwork& neural_network, const HalfPrecisionNeuralNetwork* half_precision_neural_network, ModelElementType half_precision_type, i8* buffer, u32 buffer_size);
+static bool view_model_in_buffer(const i8* buffer, u64 buffer_size, ModelView& model_view);
+static void convert_to_half_precision(const NeuralNetwork& neural_network, ModelElementType element_type, HalfPrecisionNeuralNetwork& half_precision_neural_network);
 static void feed_forward(const NeuralNetwork& neural_network, const NeuralNetwork::InputLayer& input, NeuralNetwork::OutputLayer& output);
+static void feed_forward(const HalfPrecisionNeuralNetwork& neural_network, ModelElementType element_type, const NeuralNetwork::InputLayer& input, NeuralNetwork::OutputLayer& output);
+static const PackedNeuralNetwork& pack_neural_network(const NeuralNetwork& neural_network, PackedNeuralNetwork& packed_neural_network);
+static void invalidate_packed_neural_network(PackedNeuralNetwork& packed_neural_network);
+static void feed_forward(const PackedNeuralNetwork& neural_network, const NeuralNetwork::InputLayer& input, NeuralNetwork::OutputLayer& output);
+static void back_propagate(const PackedNeuralNetwork& neural_network, const NeuralNetwork::InputLayer& input, const NeuralNetwork::OutputLayer& target, f32 weight, PackedNeuralNetworkDelta& neural_network_delta);
+static void apply_delta(NeuralNetwork& neural_network, const PackedNeuralNetworkDelta& neural_network_delta, f32 step_size);
+static void prune_neural_network(NeuralNetwork& neural_network, f32 sparsity);
+static f32 make_sparse_neural_network(const NeuralNetwork& neural_network, SparseNeuralNetwork& sparse_neural_network);
+static void feed_forward(const SparseNeuralNetwork& neural_network, const NeuralNetwork::InputLayer& input, NeuralNetwork::OutputLayer& output);
+static u32 population_block_count(u32 population_size);
+static void stack_population(const NeuralNetwork* neural_networks, u32 population_size, NeuralNetworkPopulation& population);
+static void feed_forward(const NeuralNetworkPopulation& population, const NeuralNetwork::InputLayer* inputs, u32 input_count, const KernelTuning& tuning, NeuralNetwork::OutputLayer* outputs);
 static void back_propagate(const NeuralNetwork& neural_network, const NeuralNetwork::InputLayer& input, const NeuralNetwork::OutputLayer& target, NeuralNetwork& neural_network_delta);
+static void apply_delta(NeuralNetwork& neural_network, const NeuralNetwork& neural_network_delta, f32 step_size);
+static u32 neural_network_checksum(const NeuralNetwork& neural_network);
 
 #endif
@@ -0,0 +1,506 @@
+// Standalone benchmark for the neural network kernels, only pulls in the platform independent
+// network code so results aren't affected by anything the game or platform layer does.
+//
+// Usage: neural_network_benchmark [--quick] [--max-threads N] [--peak-gflops X] [--tuning FILE] > results.json
+// Progress goes to stderr, results go to stdout as JSON so runs can be diffed across builds.
+
+#include "neural_network.h"
+#include "kernel_tuning.h"
+#include "convolutional_neural_network.h"
+#include "training_data.h"
+
+#include "util.cpp"
+#include "simd.cpp"
+#include "neural_network.cpp"
+#include "kernel_tuning.cpp"
+#include "convolutional_neural_network.cpp"
+#include "training_data.cpp"
+#include "tools_linux.cpp"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// multiply-adds counted as two flops, activation functions not counted
+static constexpr f64 FEED_FORWARD_FLOPS = 2.0 * (
+    NeuralNetwork::HIDDEN_LAYER_SIZE * NeuralNetwork::INPUT_LAYER_SIZE +
+    NeuralNetwork::OUTPUT_LAYER_SIZE * NeuralNetwork::HIDDEN_LAYER_SIZE
+);
+
+static constexpr f64 BACK_PROPAGATE_FLOPS = FEED_FORWARD_FLOPS + 2.0 * (
+    NeuralNetwork::OUTPUT_LAYER_SIZE * NeuralNetwork::HIDDEN_LAYER_SIZE +     // hidden to output delta
+    NeuralNetwork::OUTPUT_LAYER_SIZE * NeuralNetwork::HIDDEN_LAYER_SIZE +     // error back to hidden layer
+    NeuralNetwork::HIDDEN_LAYER_SIZE * NeuralNetwork::INPUT_LAYER_SIZE        // input to hidden delta
+);
+
+static constexpr u32 SAMPLE_COUNT = 4096;
+
+struct Samples {
+    NeuralNetwork::InputLayer inputs[SAMPLE_COUNT];
+    NeuralNetwork::OutputLayer targets[SAMPLE_COUNT];
+};
+
+// inputs shaped like decoded game states: small integers for the header fields and 0/1 for the grid
+static void generate_samples(Samples& samples, u32 rng_seed) {
+    for (u32 sample = 0; sample < SAMPLE_COUNT; ++sample) {
+        NeuralNetwork::InputLayer& input = samples.inputs[sample];
+        for (i32 i = 0; i < NeuralNetwork::INPUT_LAYER_SIZE; ++i) {
+            rng_seed = random_number(rng_seed);
+            input[i] = (i < 12) ? static_cast<f32>(rng_seed % 10) : static_cast<f32>(rng_seed % 2);
+        }
+
+        rng_seed = random_number(rng_seed);
+        for (i32 i = 0; i < NeuralNetwork::OUTPUT_LAYER_SIZE; ++i) {
+            samples.targets[sample][i] = static_cast<f32>((rng_seed >> i) & 1);
+        }
+    }
+}
+
+// Theoretical single precision peak from the highest maximum core clock cpufreq advertises and the widest FMA
+// unit the CPU reports, assumes two FMA ports per core which holds for recent x64 cores. Zero when there's no
+// cpufreq to read the clock from, which is common in VMs.
+static f64 estimate_peak_gflops(const u32 core_count) {
+    f64 max_khz = 0.0;
+    for (u32 core = 0; core < core_count; ++core) {
+        char file_name[128] = {};
+        snprintf(file_name, sizeof(file_name), "/sys/devices/system/cpu/cpu%u/cpufreq/cpuinfo_max_freq", core);
+        FILE* const max_frequency_file = fopen(file_name, "r");
+        if (max_frequency_file == nullptr) {
+            continue;
+        }
+
+        f64 khz = 0.0;
+        if (fscanf(max_frequency_file, "%lf", &khz) == 1 && khz > max_khz) {
+            max_khz = khz;
+        }
+
+        fclose(max_frequency_file);
+    }
+
+    bool has_fma = false;
+    bool has_avx2 = false;
+    bool has_avx512 = false;
+    FILE* const cpu_info = fopen("/proc/cpuinfo", "r");
+    if (cpu_info != nullptr) {
+        char line[4096] = {};
+        while (fgets(line, sizeof(line), cpu_info) != nullptr) {
+            const char* const colon = strchr(line, ':');
+            if (strncmp(line, "flags", 5) != 0 || colon == nullptr) {
+                continue;
+            }
+
+            // the flags are space separated and the last one ends in the newline
+            char* save_pointer = nullptr;
+            for (char* flag = strtok_r(const_cast<char*>(colon + 1), " \t\n", &save_pointer); flag != nullptr; flag = strtok_r(nullptr, " \t\n", &save_pointer)) {
+                has_fma = has_fma || strcmp(flag, "fma") == 0;
+                has_avx2 = has_avx2 || strcmp(flag, "avx2") == 0;
+                has_avx512 = has_avx512 || strcmp(flag, "avx512f") == 0;
+            }
+
+            break;
+        }
+
+        fclose(cpu_info);
+    }
+
+    const f64 lanes = has_avx512 ? 16.0 : (has_avx2 ? 8.0 : 4.0);
+    const f64 flops_per_lane = has_fma ? 2.0 : 1.0;
+    const f64 flops_per_cycle = 2.0 * lanes * flops_per_lane;
+
+    return max_khz * 1e-6 * flops_per_cycle * static_cast<f64>(core_count);
+}
+
+// The peak figures are null in the results when the peak isn't known, inf and nan aren't valid JSON
+static const char* format_peak_gflops(const f64 peak_gflops, char* const buffer, const u32 buffer_size) {
+    if (peak_gflops <= 0.0) {
+        return "null";
+    }
+
+    snprintf(buffer, buffer_size, "%.2f", peak_gflops);
+    return buffer;
+}
+
+static const char* format_percent_of_peak(const f64 gflops, const f64 peak_gflops, char* const buffer, const u32 buffer_size) {
+    if (peak_gflops <= 0.0) {
+        return "null";
+    }
+
+    snprintf(buffer, buffer_size, "%.2f", 100.0 * gflops / peak_gflops);
+    return buffer;
+}
+
+// keeps results alive so the compiler can't throw the benchmarked work away
+static volatile f32 sink;
+
+static f64 benchmark_feed_forward(const NeuralNetwork& neural_network, const Samples& samples, const u32 iterations) {
+    NeuralNetwork::OutputLayer output = {};
+    const f64 start = seconds_now();
+    for (u32 i = 0; i < iterations; ++i) {
+        feed_forward(neural_network, samples.inputs[i % SAMPLE_COUNT], output);
+        sink = output[0];
+    }
+
+    return seconds_now() - start;
+}
+
+static f64 benchmark_half_precision_feed_forward(const HalfPrecisionNeuralNetwork& neural_network, const ModelElementType element_type, const Samples& samples, const u32 iterations) {
+    NeuralNetwork::OutputLayer output = {};
+    const f64 start = seconds_now();
+    for (u32 i = 0; i < iterations; ++i) {
+        feed_forward(neural_network, element_type, samples.inputs[i % SAMPLE_COUNT], output);
+        sink = output[0];
+    }
+
+    return seconds_now() - start;
+}
+
+static f64 benchmark_packed_feed_forward(const PackedNeuralNetwork& neural_network, const Samples& samples, const u32 iterations) {
+    NeuralNetwork::OutputLayer output = {};
+    const f64 start = seconds_now();
+    for (u32 i = 0; i < iterations; ++i) {
+        feed_forward(neural_network, samples.inputs[i % SAMPLE_COUNT], output);
+        sink = output[0];
+    }
+
+    return seconds_now() - start;
+}
+
+static f64 benchmark_packed_back_propagate(const PackedNeuralNetwork& neural_network, const Samples& samples, const u32 iterations) {
+    PackedNeuralNetworkDelta* const neural_network_delta = static_cast<PackedNeuralNetworkDelta*>(aligned_alloc(alignof(PackedNeuralNetworkDelta), sizeof(PackedNeuralNetworkDelta)));
+    memset(neural_network_delta, 0, sizeof(PackedNeuralNetworkDelta));
+    const f64 start = seconds_now();
+    for (u32 i = 0; i < iterations; ++i) {
+        const u32 sample = i % SAMPLE_COUNT;
+        back_propagate(neural_network, samples.inputs[sample], samples.targets[sample], 1.0f, *neural_network_delta);
+    }
+
+    const f64 elapsed = seconds_now() - start;
+    sink = neural_network_delta->output_biases[0];
+    free(neural_network_delta);
+
+    return elapsed;
+}
+
+static f64 benchmark_back_propagate(const NeuralNetwork& neural_network, const Samples& samples, const u32 iterations) {
+    NeuralNetwork* const neural_network_delta = static_cast<NeuralNetwork*>(calloc(1, sizeof(NeuralNetwork)));
+    const f64 start = seconds_now();
+    for (u32 i = 0; i < iterations; ++i) {
+        const u32 sample = i % SAMPLE_COUNT;
+        back_propagate(neural_network, samples.inputs[sample], samples.targets[sample], *neural_network_delta);
+    }
+
+    const f64 elapsed = seconds_now() - start;
+    sink = neural_network_delta->output_biases[0];
+    free(neural_network_delta);
+
+    return elapsed;
+}
+
+// Same shape as train(): accumulate a delta over the whole batch then take one step
+static f64 benchmark_training(NeuralNetwork& neural_network, const Samples& samples, const u32 batch_size, const u32 sample_budget) {
+    static constexpr f32 LEARNING_RATE = 0.1f;
+
+    NeuralNetwork* const neural_network_delta = static_cast<NeuralNetwork*>(calloc(1, sizeof(NeuralNetwork)));
+    const u32 step_count = (sample_budget + batch_size - 1) / batch_size;
+
+    const f64 start = seconds_now();
+    u32 sample = 0;
+    for (u32 step = 0; step < step_count; ++step) {
+        memset(neural_network_delta, 0, sizeof(NeuralNetwork));
+        for (u32 i = 0; i < batch_size; ++i) {
+            back_propagate(neural_network, samples.inputs[sample], samples.targets[sample], *neural_network_delta);
+            sample = (sample + 1) % SAMPLE_COUNT;
+        }
+
+        apply_delta(neural_network, *neural_network_delta, LEARNING_RATE / static_cast<f32>(batch_size));
+    }
+
+    const f64 elapsed = seconds_now() - start;
+    free(neural_network_delta);
+
+    return elapsed / static_cast<f64>(step_count * batch_size);
+}
+
+// Population of P networks evaluated on a batch of inputs, either one feed_forward call per network per
+// input or all of them stacked. Reports time per network inference so the two are directly comparable.
+static void benchmark_population(const Samples& samples, const u32 population_size, const u32 input_count, const u32 repeats, const KernelTuning& tuning, const bool last) {
+    NeuralNetwork* const neural_networks = static_cast<NeuralNetwork*>(aligned_alloc(alignof(NeuralNetwork), population_size * sizeof(NeuralNetwork)));
+    for (u32 i = 0; i < population_size; ++i) {
+        neural_networks[i] = random_neural_network(1000 + i);
+    }
+
+    NeuralNetworkPopulation population = {};
+    population.blocks = static_cast<NeuralNetworkPopulationBlock*>(aligned_alloc(alignof(NeuralNetworkPopulationBlock), population_block_count(population_size) * sizeof(NeuralNetworkPopulationBlock)));
+    stack_population(neural_networks, population_size, population);
+
+    NeuralNetwork::OutputLayer* const separate_outputs = static_cast<NeuralNetwork::OutputLayer*>(malloc(input_count * population_size * sizeof(NeuralNetwork::OutputLayer)));
+    NeuralNetwork::OutputLayer* const stacked_outputs = static_cast<NeuralNetwork::OutputLayer*>(malloc(input_count * population_size * sizeof(NeuralNetwork::OutputLayer)));
+
+    f64 start = seconds_now();
+    for (u32 repeat = 0; repeat < repeats; ++repeat) {
+        for (u32 input = 0; input < input_count; ++input) {
+            for (u32 network = 0; network < population_size; ++network) {
+                feed_forward(neural_networks[network], samples.inputs[input], separate_outputs[input * population_size + network]);
+            }
+        }
+    }
+
+    const f64 separate_seconds = (seconds_now() - start) / static_cast<f64>(repeats * input_count * population_size);
+
+    start = seconds_now();
+    for (u32 repeat = 0; repeat < repeats; ++repeat) {
+        feed_forward(population, samples.inputs, input_count, tuning, stacked_outputs);
+    }
+
+    const f64 stacked_seconds = (seconds_now() - start) / static_cast<f64>(repeats * input_count * population_size);
+
+    f32 max_error = 0.0f;
+    for (u32 i = 0; i < input_count * population_size; ++i) {
+        for (i32 j = 0; j < NeuralNetwork::OUTPUT_LAYER_SIZE; ++j) {
+            const f32 difference = separate_outputs[i][j] - stacked_outputs[i][j];
+            const f32 error = (difference < 0.0f) ? -difference : difference;
+            max_error = (error > max_error) ? error : max_error;
+        }
+    }
+
+    printf("    {\"population_size\": %u, \"inputs\": %u, \"separate_ns_per_inference\": %.1f, \"stacked_ns_per_inference\": %.1f, \"speedup\": %.2f, \"max_abs_error\": %.2e}%s\n",
+        population_size, input_count, separate_seconds * 1e9, stacked_seconds * 1e9, separate_seconds / stacked_seconds, max_error, last ? "" : ",");
+
+    free(stacked_outputs);
+    free(separate_outputs);
+    free(population.blocks);
+    free(neural_networks);
+}
+
+struct TrainingThreads {
+    NeuralNetwork* neural_network;
+    const Samples* samples;
+    NeuralNetwork* thread_deltas;
+    u32 thread_count;
+    u32 batch_size;
+    u32 step_count;
+    pthread_barrier_t batch_start;
+    pthread_barrier_t batch_end;
+};
+
+struct TrainingThread {
+    TrainingThreads* threads;
+    u32 index;
+};
+
+static void* training_thread_procedure(void* const data) {
+    const TrainingThread& thread = *static_cast<TrainingThread*>(data);
+    TrainingThreads& threads = *thread.threads;
+    NeuralNetwork& neural_network_delta = threads.thread_deltas[thread.index];
+
+    const u32 first_sample = threads.batch_size * thread.index / threads.thread_count;
+    const u32 last_sample = threads.batch_size * (thread.index + 1) / threads.thread_count;
+    for (u32 step = 0; step < threads.step_count; ++step) {
+        pthread_barrier_wait(&threads.batch_start);
+
+        memset(&neural_network_delta, 0, sizeof(neural_network_delta));
+        for (u32 i = first_sample; i < last_sample; ++i) {
+            const u32 sample = i % SAMPLE_COUNT;
+            back_propagate(*threads.neural_network, threads.samples->inputs[sample], threads.samples->targets[sample], neural_network_delta);
+        }
+
+        pthread_barrier_wait(&threads.batch_end);
+    }
+
+    return nullptr;
+}
+
+// Data parallel version of a training step: each thread back propagates its slice of the batch into
+// its own delta, the main thread sums the deltas and applies them while the workers wait
+static f64 benchmark_threaded_training(NeuralNetwork& neural_network, const Samples& samples, const u32 thread_count, const u32 batch_size, const u32 step_count) {
+    static constexpr f32 LEARNING_RATE = 0.1f;
+    static constexpr u32 MAX_THREAD_COUNT = 256;
+
+    TrainingThreads threads = {};
+    threads.neural_network = &neural_network;
+    threads.samples = &samples;
+    threads.thread_deltas = static_cast<NeuralNetwork*>(aligned_alloc(alignof(NeuralNetwork), thread_count * sizeof(NeuralNetwork)));
+    threads.thread_count = thread_count;
+    threads.batch_size = batch_size;
+    threads.step_count = step_count;
+    pthread_barrier_init(&threads.batch_start, nullptr, thread_count + 1);
+    pthread_barrier_init(&threads.batch_end, nullptr, thread_count + 1);
+
+    pthread_t thread_handles[MAX_THREAD_COUNT] = {};
+    TrainingThread thread_data[MAX_THREAD_COUNT] = {};
+    for (u32 i = 0; i < thread_count; ++i) {
+        thread_data[i] = TrainingThread{&threads, i};
+        pthread_create(&thread_handles[i], nullptr, training_thread_procedure, &thread_data[i]);
+    }
+
+    f32* const total_delta = reinterpret_cast<f32*>(threads.thread_deltas);
+    static constexpr u32 FLOATS_PER_NETWORK = sizeof(NeuralNetwork) / sizeof(f32);
+
+    const f64 start = seconds_now();
+    for (u32 step = 0; step < step_count; ++step) {
+        pthread_barrier_wait(&threads.batch_start);
+        pthread_barrier_wait(&threads.batch_end);
+
+        for (u32 thread = 1; thread < thread_count; ++thread) {
+            const f32* const thread_delta = reinterpret_cast<const f32*>(&threads.thread_deltas[thread]);
+            for (u32 i = 0; i < FLOATS_PER_NETWORK; ++i) {
+                total_delta[i] += thread_delta[i];
+            }
+        }
+
+        apply_delta(neural_network, threads.thread_deltas[0], LEARNING_RATE / static_cast<f32>(batch_size));
+    }
+
+    const f64 elapsed = seconds_now() - start;
+
+    for (u32 i = 0; i < thread_count; ++i) {
+        pthread_join(thread_handles[i], nullptr);
+    }
+
+    pthread_barrier_destroy(&threads.batch_start);
+    pthread_barrier_destroy(&threads.batch_end);
+    free(threads.thread_deltas);
+
+    return elapsed / static_cast<f64>(step_count * batch_size);
+}
+
+int main(const int argc, const char* const* const argv) {
+    bool quick = false;
+    u32 max_thread_count = static_cast<u32>(sysconf(_SC_NPROCESSORS_ONLN));
+    f64 peak_gflops = 0.0;
+    const char* kernel_tuning_file_name = "kernel_tuning.bin";
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            quick = true;
+        } else if (strcmp(argv[i], "--max-threads") == 0 && i + 1 < argc) {
+            max_thread_count = static_cast<u32>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--peak-gflops") == 0 && i + 1 < argc) {
+            peak_gflops = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--tuning") == 0 && i + 1 < argc) {
+            kernel_tuning_file_name = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--quick] [--max-threads N] [--peak-gflops X] [--tuning FILE]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    max_thread_count = (max_thread_count < 1) ? 1 : (max_thread_count > 256 ? 256 : max_thread_count);
+    const u32 core_count = static_cast<u32>(sysconf(_SC_NPROCESSORS_ONLN));
+    if (peak_gflops <= 0.0) {
+        peak_gflops = estimate_peak_gflops(core_count);
+        if (peak_gflops <= 0.0) {
+            fprintf(stderr, "couldn't read the maximum core clock, pass --peak-gflops for percentages of peak\n");
+        }
+    }
+
+    const f64 peak_gflops_per_core = peak_gflops / static_cast<f64>(core_count);
+    const u32 scale = quick ? 1 : 10;
+
+    Samples* const samples = static_cast<Samples*>(malloc(sizeof(Samples)));
+    generate_samples(*samples, 1234);
+
+    NeuralNetwork* const neural_network = static_cast<NeuralNetwork*>(aligned_alloc(alignof(NeuralNetwork), sizeof(NeuralNetwork)));
+    *neural_network = random_neural_network(4321);
+
+    printf("{\n");
+    printf("  \"compiler\": \"%s\",\n", __VERSION__);
+    printf("  \"core_count\": %u,\n", core_count);
+    printf("  \"cpu_features\": {\"avx2\": %s, \"avx512f\": %s, \"avx512_bf16\": %s},\n",
+        cpu_features().avx2 ? "true" : "false", cpu_features().avx512f ? "true" : "false", cpu_features().avx512_bf16 ? "true" : "false");
+    char number[32] = {};
+    printf("  \"peak_gflops\": %s,\n", format_peak_gflops(peak_gflops, number, sizeof(number)));
+    const KernelTuning kernel_tuning = load_kernel_tuning_file(kernel_tuning_file_name);
+    printf("  \"kernel_tuning\": {\"max_sparse_block_density\": %.3f, \"population_input_tile\": %u, \"population_kernel\": %u},\n",
+        kernel_tuning.max_sparse_block_density, kernel_tuning.population_input_tile, static_cast<u32>(kernel_tuning.population_kernel));
+    printf("  \"peak_gflops_per_core\": %s,\n", format_peak_gflops(peak_gflops_per_core, number, sizeof(number)));
+
+    fprintf(stderr, "feed_forward...\n");
+    const u32 feed_forward_iterations = 20000 * scale;
+    const f64 feed_forward_seconds = benchmark_feed_forward(*neural_network, *samples, feed_forward_iterations) / feed_forward_iterations;
+    const f64 feed_forward_gflops = FEED_FORWARD_FLOPS / feed_forward_seconds * 1e-9;
+    printf("  \"feed_forward\": {\"ns_per_inference\": %.1f, \"gflops\": %.3f, \"percent_of_core_peak\": %s},\n",
+        feed_forward_seconds * 1e9, feed_forward_gflops, format_percent_of_peak(feed_forward_gflops, peak_gflops_per_core, number, sizeof(number)));
+
+    fprintf(stderr, "packed feed_forward...\n");
+    PackedNeuralNetwork* const packed_neural_network = static_cast<PackedNeuralNetwork*>(aligned_alloc(alignof(PackedNeuralNetwork), sizeof(PackedNeuralNetwork)));
+    invalidate_packed_neural_network(*packed_neural_network);
+    pack_neural_network(*neural_network, *packed_neural_network);
+    const f64 packed_feed_forward_seconds = benchmark_packed_feed_forward(*packed_neural_network, *samples, feed_forward_iterations) / feed_forward_iterations;
+    const f64 packed_feed_forward_gflops = FEED_FORWARD_FLOPS / packed_feed_forward_seconds * 1e-9;
+    printf("  \"feed_forward_packed\": {\"ns_per_inference\": %.1f, \"gflops\": %.3f, \"percent_of_core_peak\": %s},\n",
+        packed_feed_forward_seconds * 1e9, packed_feed_forward_gflops, format_percent_of_peak(packed_feed_forward_gflops, peak_gflops_per_core, number, sizeof(number)));
+
+    fprintf(stderr, "half precision feed_forward...\n");
+    HalfPrecisionNeuralNetwork* const half_precision_neural_network = static_cast<HalfPrecisionNeuralNetwork*>(aligned_alloc(alignof(HalfPrecisionNeuralNetwork), sizeof(HalfPrecisionNeuralNetwork)));
+    static constexpr ModelElementType HALF_PRECISION_TYPES[] = {ModelElementType::BF16, ModelElementType::F16};
+    static constexpr const char* HALF_PRECISION_TYPE_NAMES[] = {"bf16", "f16"};
+    for (u32 i = 0; i < 2; ++i) {
+        convert_to_half_precision(*neural_network, HALF_PRECISION_TYPES[i], *half_precision_neural_network);
+        const f64 seconds = benchmark_half_precision_feed_forward(*half_precision_neural_network, HALF_PRECISION_TYPES[i], *samples, feed_forward_iterations) / feed_forward_iterations;
+        const f64 gflops = FEED_FORWARD_FLOPS / seconds * 1e-9;
+        printf("  \"feed_forward_%s\": {\"ns_per_inference\": %.1f, \"gflops\": %.3f, \"percent_of_core_peak\": %s},\n",
+            HALF_PRECISION_TYPE_NAMES[i], seconds * 1e9, gflops, format_percent_of_peak(gflops, peak_gflops_per_core, number, sizeof(number)));
+    }
+
+    free(half_precision_neural_network);
+
+    fprintf(stderr, "population feed_forward...\n");
+    static constexpr u32 POPULATION_SIZES[] = {16, 64, 256};
+    static constexpr u32 POPULATION_INPUT_COUNT = 64;
+    printf("  \"population_feed_forward\": [\n");
+    for (u32 i = 0; i < sizeof(POPULATION_SIZES) / sizeof(POPULATION_SIZES[0]); ++i) {
+        benchmark_population(*samples, POPULATION_SIZES[i], POPULATION_INPUT_COUNT, scale * 256 / POPULATION_SIZES[i], kernel_tuning, i + 1 == sizeof(POPULATION_SIZES) / sizeof(POPULATION_SIZES[0]));
+    }
+    printf("  ],\n");
+
+    fprintf(stderr, "back_propagate...\n");
+    const u32 back_propagate_iterations = 10000 * scale;
+    const f64 back_propagate_seconds = benchmark_back_propagate(*neural_network, *samples, back_propagate_iterations) / back_propagate_iterations;
+    const f64 back_propagate_gflops = BACK_PROPAGATE_FLOPS / back_propagate_seconds * 1e-9;
+    printf("  \"back_propagate\": {\"ns_per_sample\": %.1f, \"gflops\": %.3f, \"percent_of_core_peak\": %s},\n",
+        back_propagate_seconds * 1e9, back_propagate_gflops, format_percent_of_peak(back_propagate_gflops, peak_gflops_per_core, number, sizeof(number)));
+
+    fprintf(stderr, "packed back_propagate...\n");
+    const f64 packed_back_propagate_seconds = benchmark_packed_back_propagate(*packed_neural_network, *samples, back_propagate_iterations) / back_propagate_iterations;
+    const f64 packed_back_propagate_gflops = BACK_PROPAGATE_FLOPS / packed_back_propagate_seconds * 1e-9;
+    printf("  \"back_propagate_packed\": {\"ns_per_sample\": %.1f, \"gflops\": %.3f, \"percent_of_core_peak\": %s},\n",
+        packed_back_propagate_seconds * 1e9, packed_back_propagate_gflops, format_percent_of_peak(packed_back_propagate_gflops, peak_gflops_per_core, number, sizeof(number)));
+    free(packed_neural_network);
+
+    fprintf(stderr, "training batch scaling...\n");
+    static constexpr u32 BATCH_SIZES[] = {1, 8, 64, 512, 4096};
+    printf("  \"training_batch_scaling\": [\n");
+    for (u32 i = 0; i < sizeof(BATCH_SIZES) / sizeof(BATCH_SIZES[0]); ++i) {
+        const f64 seconds_per_sample = benchmark_training(*neural_network, *samples, BATCH_SIZES[i], 4096 * scale);
+        const f64 gflops = BACK_PROPAGATE_FLOPS / seconds_per_sample * 1e-9;
+        printf("    {\"batch_size\": %u, \"samples_per_second\": %.0f, \"gflops\": %.3f}%s\n",
+            BATCH_SIZES[i], 1.0 / seconds_per_sample, gflops, (i + 1 < sizeof(BATCH_SIZES) / sizeof(BATCH_SIZES[0])) ? "," : "");
+    }
+    printf("  ],\n");
+
+    fprintf(stderr, "training thread scaling...\n");
+    static constexpr u32 THREADED_BATCH_SIZE = 4096;
+    printf("  \"training_thread_scaling\": [\n");
+    f64 single_thread_samples_per_second = 0.0;
+    for (u32 thread_count = 1; thread_count <= max_thread_count; thread_count *= 2) {
+        const f64 seconds_per_sample = benchmark_threaded_training(*neural_network, *samples, thread_count, THREADED_BATCH_SIZE, 2 * scale);
+        const f64 samples_per_second = 1.0 / seconds_per_sample;
+        if (thread_count == 1) {
+            single_thread_samples_per_second = samples_per_second;
+        }
+
+        const f64 gflops = BACK_PROPAGATE_FLOPS * samples_per_second * 1e-9;
+        printf("    {\"threads\": %u, \"batch_size\": %u, \"samples_per_second\": %.0f, \"gflops\": %.3f, \"speedup\": %.2f}%s\n",
+            thread_count, THREADED_BATCH_SIZE, samples_per_second, gflops, samples_per_second / single_thread_samples_per_second,
+            (thread_count * 2 <= max_thread_count) ? "," : "");
+    }
+    printf("  ]\n");
+    printf("}\n");
+
+    free(neural_network);
+    free(samples);
+
+    return 0;
+}
@@ -0,0 +1,173 @@
+// Magnitude pruning for a trained model. Zeroes the smallest weights to the target sparsity, then reports the
+// accuracy change on held out records and the inference speedup of the sparse kernel over the dense one.
+// The pruned model is an ordinary model file, the game builds the sparse copy itself when it loads one.
+//
+// Usage: pruner --sparsity S [--model FILE] [--output FILE] [--training-data FILE] [--held-out FRACTION]
+// Held out records are the last FRACTION of the training data, i.e. the most recently recorded games.
+
+#include "neural_network.h"
+#include "kernel_tuning.h"
+#include "convolutional_neural_network.h"
+#include "training_data.h"
+
+#include "util.cpp"
+#include "simd.cpp"
+#include "neural_network.cpp"
+#include "kernel_tuning.cpp"
+#include "convolutional_neural_network.cpp"
+#include "training_data.cpp"
+#include "tools_linux.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct HeldOutRecords {
+    NeuralNetwork::InputLayer* inputs;
+    NeuralNetwork::OutputLayer* targets;
+    u32 count;
+};
+
+// Lets one evaluation and timing loop run either network representation
+typedef void InferenceFunction(const void* neural_network, const NeuralNetwork::InputLayer& input, NeuralNetwork::OutputLayer& output);
+
+static void feed_forward_packed(const void* const neural_network, const NeuralNetwork::InputLayer& input, NeuralNetwork::OutputLayer& output) {
+    feed_forward(*static_cast<const PackedNeuralNetwork*>(neural_network), input, output);
+}
+
+static void feed_forward_sparse(const void* const neural_network, const NeuralNetwork::InputLayer& input, NeuralNetwork::OutputLayer& output) {
+    feed_forward(*static_cast<const SparseNeuralNetwork*>(neural_network), input, output);
+}
+
+static volatile f32 sink;
+
+static Evaluation evaluate(InferenceFunction* const infer, const void* const neural_network, const HeldOutRecords& records) {
+    Evaluation evaluation = {};
+    for (u32 record = 0; record < records.count; ++record) {
+        NeuralNetwork::OutputLayer output = {};
+        infer(neural_network, records.inputs[record], output);
+        add_to_evaluation(output, records.targets[record], evaluation);
+    }
+
+    finish_evaluation(evaluation, records.count);
+
+    return evaluation;
+}
+
+// Nanoseconds per inference, repeats the held out set until at least a fifth of a second has gone by
+static f64 time_inference(InferenceFunction* const infer, const void* const neural_network, const HeldOutRecords& records) {
+    u64 inference_count = 0;
+    const f64 start = seconds_now();
+    f64 elapsed = 0.0;
+    while (elapsed < 0.2) {
+        for (u32 record = 0; record < records.count; ++record) {
+            NeuralNetwork::OutputLayer output = {};
+            infer(neural_network, records.inputs[record], output);
+            sink = output[0];
+        }
+
+        inference_count += records.count;
+        elapsed = seconds_now() - start;
+    }
+
+    return elapsed / static_cast<f64>(inference_count) * 1e9;
+}
+
+int main(const int argc, const char* const* const argv) {
+    f32 sparsity = -1.0f;
+    f32 held_out_fraction = 0.1f;
+    const char* training_data_file_name = "training_data_manifest.bin";
+    const char* model_file_name = "neural_network.bin";
+    const char* output_file_name = "neural_network_pruned.bin";
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--sparsity") == 0 && i + 1 < argc) {
+            sparsity = static_cast<f32>(atof(argv[++i]));
+        } else if (strcmp(argv[i], "--held-out") == 0 && i + 1 < argc) {
+            held_out_fraction = static_cast<f32>(atof(argv[++i]));
+        } else if (strcmp(argv[i], "--training-data") == 0 && i + 1 < argc) {
+            training_data_file_name = argv[++i];
+        } else if (strcmp(argv[i], "--model") == 0 && i + 1 < argc) {
+            model_file_name = argv[++i];
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output_file_name = argv[++i];
+        } else {
+            sparsity = -1.0f;
+            break;
+        }
+    }
+
+    if (sparsity < 0.0f || sparsity > 1.0f || held_out_fraction <= 0.0f || held_out_fraction > 1.0f) {
+        fprintf(stderr, "usage: %s --sparsity S [--model FILE] [--output FILE] [--training-data FILE] [--held-out FRACTION]\n", argv[0]);
+        fprintf(stderr, "sparsity and the held out fraction are between 0 and 1\n");
+        return 1;
+    }
+
+    NeuralNetwork* const neural_network = static_cast<NeuralNetwork*>(aligned_alloc(alignof(NeuralNetwork), sizeof(NeuralNetwork)));
+    if (!load_model_file(model_file_name, *neural_network)) {
+        fprintf(stderr, "couldn't load a model from %s\n", model_file_name);
+        return 1;
+    }
+
+    // only the held out records on the end get read, once and in order
+    TrainingDataView training_data = {};
+    if (!load_training_data(training_data_file_name, MADV_SEQUENTIAL, training_data)) {
+        return 1;
+    }
+
+    HeldOutRecords records = {};
+    records.count = static_cast<u32>(static_cast<f64>(training_data.record_count) * held_out_fraction);
+    records.count = (records.count == 0) ? 1 : records.count;
+    records.inputs = static_cast<NeuralNetwork::InputLayer*>(malloc(records.count * sizeof(NeuralNetwork::InputLayer)));
+    records.targets = static_cast<NeuralNetwork::OutputLayer*>(malloc(records.count * sizeof(NeuralNetwork::OutputLayer)));
+    const u32 first_held_out_record = training_data.record_count - records.count;
+    for (u32 i = 0; i < records.count; ++i) {
+        const i8* const record = training_record(training_data, first_held_out_record + i);
+
+        BinaryGameState binary_game_state = {};
+        copy_bytes(record, sizeof(binary_game_state), reinterpret_cast<i8*>(binary_game_state));
+        binary_game_state_to_neural_network_input(binary_game_state, records.inputs[i]);
+
+        BinaryPlayerInput encoded_player_input = 0;
+        copy_bytes(record + sizeof(binary_game_state), sizeof(encoded_player_input), reinterpret_cast<i8*>(&encoded_player_input));
+        binary_player_input_to_neural_network_output(encoded_player_input, records.targets[i]);
+    }
+
+    PackedNeuralNetwork* const packed_neural_network = static_cast<PackedNeuralNetwork*>(aligned_alloc(alignof(PackedNeuralNetwork), sizeof(PackedNeuralNetwork)));
+    invalidate_packed_neural_network(*packed_neural_network);
+    pack_neural_network(*neural_network, *packed_neural_network);
+    const Evaluation dense_evaluation = evaluate(feed_forward_packed, packed_neural_network, records);
+    const f64 dense_nanoseconds = time_inference(feed_forward_packed, packed_neural_network, records);
+
+    prune_neural_network(*neural_network, sparsity);
+
+    SparseNeuralNetwork* const sparse_neural_network = static_cast<SparseNeuralNetwork*>(aligned_alloc(alignof(SparseNeuralNetwork), sizeof(SparseNeuralNetwork)));
+    const f32 block_density = make_sparse_neural_network(*neural_network, *sparse_neural_network);
+    const Evaluation sparse_evaluation = evaluate(feed_forward_sparse, sparse_neural_network, records);
+    const f64 sparse_nanoseconds = time_inference(feed_forward_sparse, sparse_neural_network, records);
+
+    // the pruned file has to come back through the normal loading path unchanged
+    NeuralNetwork* const reloaded_neural_network = static_cast<NeuralNetwork*>(aligned_alloc(alignof(NeuralNetwork), sizeof(NeuralNetwork)));
+    const bool saved = save_model_file(output_file_name, *neural_network);
+    const bool reloaded = saved &&
+        load_model_file(output_file_name, *reloaded_neural_network) &&
+        neural_network_checksum(*reloaded_neural_network) == neural_network_checksum(*neural_network);
+    if (!reloaded) {
+        fprintf(stderr, "couldn't write and reload %s\n", output_file_name);
+        return 1;
+    }
+
+    printf("held out records: %u of %u\n", records.count, training_data.record_count);
+    printf("sparsity: %.3f\n", sparsity);
+    printf("input to hidden blocks kept: %.3f\n", block_density);
+    const KernelTuning kernel_tuning = load_kernel_tuning_file("kernel_tuning.bin");
+    printf("game uses the sparse kernel: %s (block density limit %.3f)\n", block_density <= kernel_tuning.max_sparse_block_density ? "yes" : "no", kernel_tuning.max_sparse_block_density);
+    print_evaluation("dense", dense_evaluation);
+    print_evaluation("pruned", sparse_evaluation);
+    printf("output accuracy change: %+.4f\n", sparse_evaluation.output_accuracy - dense_evaluation.output_accuracy);
+    printf("dense ns per inference: %.1f\n", dense_nanoseconds);
+    printf("sparse ns per inference: %.1f\n", sparse_nanoseconds);
+    printf("speedup: %.2f\n", dense_nanoseconds / sparse_nanoseconds);
+    printf("written to: %s\n", output_file_name);
+
+    return 0;
+}
@@ -0,0 +1,460 @@
+// Makes training data without anyone having to play. Scripted agents play headless games with the same rules
+// as the game (see TetrisGame), an update at a time as fast as they can, and what they see and press is
+// recorded exactly like the game records it. Games are handed out to several processes, each writing a shard of
+// its own, and a manifest listing them is written once they've all finished, so the trainer and dataset tool
+// can read the lot as one file.
+//
+// Usage: self_play [--games N] [--seconds S] [--agent heuristic|random] [--noise P] [--max-updates N]
+//                  [--processes N] [--seed N] [--output MANIFEST]
+// Stops after --games games or --seconds seconds, whichever comes first (a game still going at the deadline is
+// kept as far as it got). Game n always gets the same pieces for the same seed however many processes there are.
+// Agents:
+//  heuristic   places each piece where a weighted sum of the aggregate height, rows cleared, holes and
+//              bumpiness of the grid it leaves is best, then taps its way there, so it plays like someone
+//              who knows what they're doing. --noise is the chance it taps something at random instead.
+//  random      holds a random set of buttons for a random number of updates, then another.
+
+#include "neural_network.h"
+#include "kernel_tuning.h"
+#include "convolutional_neural_network.h"
+#include "training_data.h"
+#include "tetris_game.h"
+
+#include "util.cpp"
+#include "simd.cpp"
+#include "neural_network.cpp"
+#include "kernel_tuning.cpp"
+#include "convolutional_neural_network.cpp"
+#include "training_data.cpp"
+#include "maths.cpp"
+#include "tetris.cpp"
+#include "tetris_game.cpp"
+#include "tools_linux.cpp"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static constexpr u32 MAX_PROCESS_COUNT = 64;
+static constexpr u32 WRITE_BUFFER_RECORD_COUNT = 16 * 1024;
+static constexpr u32 UPDATES_BETWEEN_DEADLINE_CHECKS = 1024;
+
+enum SelfPlayAgent : u32 {
+    HEURISTIC_AGENT = 0,
+    RANDOM_AGENT = 1,
+    COUNT = 2
+};
+
+static constexpr const char* AGENT_NAMES[SelfPlayAgent::COUNT] = {"heuristic", "random"};
+
+struct SelfPlaySettings {
+    u64 game_count;
+    f64 deadline;           // seconds_now() to stop at, 0 for none
+    SelfPlayAgent agent;
+    f64 noise;
+    u64 max_update_count;   // a game good enough to go on forever is ended here
+    u64 rng_seed;
+};
+
+// What each process made, in shared memory for the parent to put in the manifest
+struct SelfPlayResult {
+    u64 record_count;
+    u32 checksum;
+    u64 finished_game_count;
+    u64 unfinished_game_count;
+    u64 rows_cleared;
+};
+
+struct SelfPlayShared {
+    u64 next_game;
+    SelfPlayResult results[MAX_PROCESS_COUNT];
+};
+
+static bool random_chance(u64& state, const f64 probability) {
+    return static_cast<f64>(next_random(state) >> 11) * 0x1.0p-53 < probability;
+}
+
+static constexpr u16 FULL_ROW = (1 << Tetris::Grid::COLUMN_COUNT) - 1;
+
+// Weights from Yiyuan Lee's "Tetris AI - The (Near) Perfect Bot", higher is better. Rows are bitmaps with
+// bit n set for a block in column n, like a record's grid.
+static f32 grid_score(const u16* const rows, const i32 rows_cleared) {
+    i32 heights[Tetris::Grid::COLUMN_COUNT] = {};
+    i32 hole_count = 0;
+    u16 columns_seen = 0;
+    for (i32 row = 0; row < Tetris::Grid::ROW_COUNT; ++row) {
+        const u16 new_columns = rows[row] & ~columns_seen;
+        for (i32 column = 0; column < Tetris::Grid::COLUMN_COUNT; ++column) {
+            heights[column] = ((new_columns >> column) & 1) ? Tetris::Grid::ROW_COUNT - row : heights[column];
+        }
+
+        hole_count += __builtin_popcount(~rows[row] & columns_seen);
+        columns_seen |= rows[row];
+    }
+
+    i32 aggregate_height = 0;
+    i32 bumpiness = 0;
+    for (i32 column = 0; column < Tetris::Grid::COLUMN_COUNT; ++column) {
+        aggregate_height += heights[column];
+        if (column + 1 < Tetris::Grid::COLUMN_COUNT) {
+            const i32 difference = heights[column] - heights[column + 1];
+            bumpiness += (difference < 0) ? -difference : difference;
+        }
+    }
+
+    return -0.510066f * static_cast<f32>(aggregate_height) +
+        0.760666f * static_cast<f32>(rows_cleared) -
+        0.35663f * static_cast<f32>(hole_count) -
+        0.184483f * static_cast<f32>(bumpiness);
+}
+
+// Score of the grid the tetrimino leaves when it lands where it is
+static f32 placement_score(const u16* const grid_rows, const Tetris::Tetrimino& tetrimino) {
+    u16 rows[Tetris::Grid::ROW_COUNT] = {};
+    for (i32 row = 0; row < Tetris::Grid::ROW_COUNT; ++row) {
+        rows[row] = grid_rows[row];
+    }
+
+    for (i32 block_index = 0; block_index < Tetris::Tetrimino::Blocks::COUNT; ++block_index) {
+        const Coordinates& block = tetrimino.blocks.top_left_coordinates[block_index];
+        if (block.y >= 0) {
+            rows[block.y] |= static_cast<u16>(1 << block.x);
+        }
+    }
+
+    // exactly what remove_completed_rows() does to the grid, or the agent would be planning for another game
+    i32 rows_cleared = 0;
+    for (i32 row = 0; row < Tetris::Grid::ROW_COUNT; ++row) {
+        rows_cleared += (rows[row] == FULL_ROW) ? 1 : 0;
+    }
+
+    i32 insertion_row = Tetris::Grid::ROW_COUNT - 1;
+    for (i32 row = Tetris::Grid::ROW_COUNT - 1; row >= 0; --row) {
+        if (rows[row] == FULL_ROW) {
+            insertion_row = row;
+        } else {
+            rows[insertion_row--] = rows[row];
+        }
+    }
+
+    for (i32 row = 0; row < rows_cleared; ++row) {
+        rows[row] = 0;
+    }
+
+    return grid_score(rows, rows_cleared);
+}
+
+// Tries every rotation and column the tetrimino can get to from where it is and taps towards the best, one tap
+// every other update since the game only acts on a button going down. Planned afresh every update so gravity,
+// wall kicks and the odd random tap never throw it off.
+static PlayerInput heuristic_input(const TetrisGame& game, const f64 noise, u64& rng_state) {
+    const PlayerInput& previous = game.previous_player_input;
+    PlayerInput input = {};
+    if (previous.down || previous.left || previous.right || previous.clockwise || previous.anti_clockwise) {
+        return input;
+    }
+
+    if (random_chance(rng_state, noise)) {
+        return binary_player_input_to_player_input(static_cast<BinaryPlayerInput>(1 << (next_random(rng_state) % NeuralNetwork::OUTPUT_LAYER_SIZE)));
+    }
+
+    u16 grid_rows[Tetris::Grid::ROW_COUNT] = {};
+    for (i32 row = 0; row < Tetris::Grid::ROW_COUNT; ++row) {
+        for (i32 column = 0; column < Tetris::Grid::COLUMN_COUNT; ++column) {
+            grid_rows[row] |= static_cast<u16>(!Tetris::is_empty_cell(game.grid.cells[row][column])) << column;
+        }
+    }
+
+    f32 best_score = -1e30f;
+    u32 best_rotation_count = 0;
+    i32 best_shift = 0;
+    Tetris::Tetrimino rotated = game.tetrimino;
+    for (u32 rotation_count = 0; rotation_count < 4; ++rotation_count) {
+        if (rotation_count > 0) {
+            rotated = rotate(rotated, Tetris::Rotation::CLOCKWISE);
+            if (collision(rotated, game.grid) && !resolve_rotation_collision(rotated, game.grid)) {
+                break;
+            }
+        }
+
+        for (i32 direction = -1; direction <= 1; direction += 2) {
+            Tetris::Tetrimino shifted = rotated;
+            for (i32 shift_count = (direction < 0) ? 0 : 1; shift_count <= Tetris::Grid::COLUMN_COUNT; ++shift_count) {
+                if (shift_count > 0) {
+                    shifted = shift(shifted, Coordinates{direction, 0});
+                    if (collision(shifted, game.grid)) {
+                        break;
+                    }
+                }
+
+                Tetris::Tetrimino dropped = shifted;
+                while (!collision(shift(dropped, Coordinates{0, 1}), game.grid)) {
+                    dropped = shift(dropped, Coordinates{0, 1});
+                }
+
+                const f32 score = placement_score(grid_rows, dropped);
+                if (score > best_score) {
+                    best_score = score;
+                    best_rotation_count = rotation_count;
+                    best_shift = direction * shift_count;
+                }
+            }
+        }
+    }
+
+    // three turns clockwise is one anti clockwise
+    input.clockwise = best_rotation_count == 1 || best_rotation_count == 2;
+    input.anti_clockwise = best_rotation_count == 3;
+    input.left = best_rotation_count == 0 && best_shift < 0;
+    input.right = best_rotation_count == 0 && best_shift > 0;
+    input.down = best_rotation_count == 0 && best_shift == 0;
+    return input;
+}
+
+struct RandomAgent {
+    PlayerInput held_input;
+    u32 updates_left;
+};
+
+static PlayerInput random_input(RandomAgent& agent, u64& rng_state) {
+    static constexpr u32 MAX_HOLD_UPDATE_COUNT = 20;
+
+    if (agent.updates_left == 0) {
+        const u64 random = next_random(rng_state);
+        // each button down about a quarter of the time
+        BinaryPlayerInput binary_player_input = 0;
+        for (u32 button = 0; button < NeuralNetwork::OUTPUT_LAYER_SIZE; ++button) {
+            binary_player_input |= static_cast<BinaryPlayerInput>(((random >> (2 * button)) & 3) == 0) << button;
+        }
+
+        agent.held_input = binary_player_input_to_player_input(binary_player_input);
+        agent.updates_left = 1 + static_cast<u32>((random >> 32) % MAX_HOLD_UPDATE_COUNT);
+    }
+
+    --agent.updates_left;
+    return agent.held_input;
+}
+
+// Appends the records to the shard and the shard's checksum
+static void write_records(DatasetWriter& writer, const i8* const records, const u32 record_count, SelfPlayResult& result) {
+    const u64 size = static_cast<u64>(record_count) * TRAINING_RECORD_SIZE;
+    result.checksum = extend_crc32c(result.checksum, records, size);
+    write_dataset(writer, records, size);
+}
+
+// Plays games until they run out or time does, recording every update into the shard
+static bool play_games(const SelfPlaySettings& settings, const char* const manifest_file_name, const TrainingDataShard& shard, SelfPlayShared& shared, SelfPlayResult& result) {
+    char shard_file_name[4096] = {};
+    shard_file_path(manifest_file_name, shard.file_name, shard_file_name, sizeof(shard_file_name));
+    DatasetWriter writer = {};
+    if (!open_dataset_writer(shard_file_name, writer)) {
+        return false;
+    }
+
+    i8* const records = static_cast<i8*>(malloc(static_cast<u64>(WRITE_BUFFER_RECORD_COUNT) * TRAINING_RECORD_SIZE));
+    u32 buffered_record_count = 0;
+    bool out_of_time = false;
+    while (!out_of_time) {
+        const u64 game_index = __atomic_fetch_add(&shared.next_game, 1, __ATOMIC_RELAXED);
+        if (game_index >= settings.game_count) {
+            break;
+        }
+
+        u64 rng_state = settings.rng_seed ^ (game_index * 0xD1B54A32D192ED69);
+        TetrisGame game = {};
+        start_tetris_game(game, static_cast<u32>(next_random(rng_state)));
+        RandomAgent random_agent = {};
+
+        bool game_over = false;
+        for (u64 update = 0; update < settings.max_update_count && !game_over; ++update) {
+            if (settings.deadline != 0.0 && update % UPDATES_BETWEEN_DEADLINE_CHECKS == 0 && seconds_now() >= settings.deadline) {
+                out_of_time = true;
+                break;
+            }
+
+            const PlayerInput input = (settings.agent == SelfPlayAgent::HEURISTIC_AGENT) ?
+                heuristic_input(game, settings.noise, rng_state) :
+                random_input(random_agent, rng_state);
+
+            // recorded just like update_tetris_game() in the game records it
+            i8* const record = records + static_cast<u64>(buffered_record_count) * TRAINING_RECORD_SIZE;
+            BinaryGameState binary_game_state = {};
+            tetris_game_to_binary_game_state(game, binary_game_state);
+            const BinaryPlayerInput binary_player_input = player_input_to_binary_player_input(input);
+            copy_bytes(binary_game_state, sizeof(binary_game_state), record);
+            copy_bytes(reinterpret_cast<const i8*>(&binary_player_input), sizeof(binary_player_input), record + sizeof(binary_game_state));
+            ++result.record_count;
+            if (++buffered_record_count == WRITE_BUFFER_RECORD_COUNT) {
+                write_records(writer, records, buffered_record_count, result);
+                buffered_record_count = 0;
+            }
+
+            const i32 rows_cleared = game.total_rows_cleared;
+            latch_pressed_inputs(game, input);
+            game_over = step_tetris_game(game, input);
+            game.previous_player_input = input;
+            result.rows_cleared += game_over ? static_cast<u64>(rows_cleared) : 0;
+        }
+
+        result.rows_cleared += game_over ? 0 : static_cast<u64>(game.total_rows_cleared);
+        result.finished_game_count += out_of_time ? 0 : 1;
+        result.unfinished_game_count += out_of_time ? 1 : 0;
+    }
+
+    write_records(writer, records, buffered_record_count, result);
+    free(records);
+    return close_dataset_writer(writer);
+}
+
+int main(const int argc, const char* const* const argv) {
+    u64 game_count = 0;
+    f64 seconds = 0.0;
+    SelfPlaySettings settings = {};
+    settings.agent = SelfPlayAgent::HEURISTIC_AGENT;
+    settings.noise = 0.05;
+    settings.max_update_count = 100000;
+    settings.rng_seed = 1;
+    long online_processor_count = sysconf(_SC_NPROCESSORS_ONLN);
+    u32 process_count = (online_processor_count > 0) ? static_cast<u32>(online_processor_count) : 1;
+    const char* manifest_file_name = "self_play_manifest.bin";
+    bool valid_arguments = true;
+    for (int i = 1; i < argc && valid_arguments; ++i) {
+        if (strcmp(argv[i], "--games") == 0 && i + 1 < argc) {
+            game_count = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            seconds = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--agent") == 0 && i + 1 < argc) {
+            const char* const agent_name = argv[++i];
+            valid_arguments = false;
+            for (u32 agent = 0; agent < SelfPlayAgent::COUNT; ++agent) {
+                if (strcmp(agent_name, AGENT_NAMES[agent]) == 0) {
+                    settings.agent = static_cast<SelfPlayAgent>(agent);
+                    valid_arguments = true;
+                }
+            }
+        } else if (strcmp(argv[i], "--noise") == 0 && i + 1 < argc) {
+            settings.noise = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--max-updates") == 0 && i + 1 < argc) {
+            settings.max_update_count = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--processes") == 0 && i + 1 < argc) {
+            process_count = static_cast<u32>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            settings.rng_seed = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            manifest_file_name = argv[++i];
+        } else {
+            valid_arguments = false;
+        }
+    }
+
+    if (!valid_arguments || process_count == 0 || settings.max_update_count == 0) {
+        fprintf(stderr,
+            "usage: %s [--games N] [--seconds S] [--agent heuristic|random] [--noise P] [--max-updates N]\n"
+            "       %*s [--processes N] [--seed N] [--output MANIFEST]\n",
+            argv[0], static_cast<int>(strlen(argv[0])), "");
+        return 1;
+    }
+
+    // with neither limit there'd be no end to it
+    game_count = (game_count == 0 && seconds <= 0.0) ? 100 : game_count;
+    settings.game_count = (game_count == 0) ? ~0ull : game_count;
+    process_count = (process_count < MAX_PROCESS_COUNT) ? process_count : MAX_PROCESS_COUNT;
+
+    TrainingDataShard shards[MAX_PROCESS_COUNT] = {};
+    for (u32 rank = 0; rank < process_count; ++rank) {
+        if (!manifest_shard_file_name(manifest_file_name, rank, shards[rank].file_name, sizeof(shards[rank].file_name))) {
+            fprintf(stderr, "%s makes shard file names longer than %u characters\n", manifest_file_name, static_cast<u32>(sizeof(shards[rank].file_name) - 1));
+            return 1;
+        }
+    }
+
+    SelfPlayShared* const shared = static_cast<SelfPlayShared*>(mmap(nullptr, sizeof(SelfPlayShared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    if (shared == MAP_FAILED) {
+        fprintf(stderr, "couldn't create the shared memory\n");
+        return 1;
+    }
+
+    const f64 start = seconds_now();
+    settings.deadline = (seconds > 0.0) ? start + seconds : 0.0;
+    pid_t child_process_ids[MAX_PROCESS_COUNT] = {};
+    for (u32 rank = 1; rank < process_count; ++rank) {
+        const pid_t process_id = fork();
+        if (process_id == 0) {
+            prctl(PR_SET_PDEATHSIG, SIGKILL);
+            const bool succeeded = play_games(settings, manifest_file_name, shards[rank], *shared, shared->results[rank]);
+            _exit(succeeded ? 0 : 1);
+        }
+
+        if (process_id < 0) {
+            fprintf(stderr, "couldn't start self play process %u, carrying on with %u\n", rank, rank);
+            process_count = rank;
+            break;
+        }
+
+        child_process_ids[rank] = process_id;
+    }
+
+    bool succeeded = play_games(settings, manifest_file_name, shards[0], *shared, shared->results[0]);
+    for (u32 rank = 1; rank < process_count; ++rank) {
+        int status = 0;
+        waitpid(child_process_ids[rank], &status, 0);
+        succeeded = succeeded && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
+    const f64 elapsed = seconds_now() - start;
+    if (!succeeded) {
+        fprintf(stderr, "self play failed, %s left untouched\n", manifest_file_name);
+        return 1;
+    }
+
+    // a process that never got a game has an empty shard, which isn't listed
+    u32 shard_count = 0;
+    SelfPlayResult total = {};
+    for (u32 rank = 0; rank < process_count; ++rank) {
+        const SelfPlayResult& result = shared->results[rank];
+        total.record_count += result.record_count;
+        total.finished_game_count += result.finished_game_count;
+        total.unfinished_game_count += result.unfinished_game_count;
+        total.rows_cleared += result.rows_cleared;
+        if (result.record_count == 0) {
+            char shard_file_name[4096] = {};
+            shard_file_path(manifest_file_name, shards[rank].file_name, shard_file_name, sizeof(shard_file_name));
+            remove(shard_file_name);
+            continue;
+        }
+
+        TrainingDataShard& shard = shards[shard_count++];
+        shard = shards[rank];
+        shard.record_count = result.record_count;
+        shard.checksum = result.checksum;
+        shard.flags = TRAINING_DATA_SHARD_FINISHED;
+    }
+
+    // the manifest goes last so there's never one listing shards that aren't all there
+    const u64 manifest_size = training_data_manifest_size(shard_count);
+    i8* const manifest = static_cast<i8*>(malloc(manifest_size));
+    write_training_data_manifest(shards, shard_count, manifest);
+    if (!replace_whole_file(manifest_file_name, manifest, manifest_size)) {
+        fprintf(stderr, "couldn't write %s\n", manifest_file_name);
+        return 1;
+    }
+
+    const u64 played_game_count = total.finished_game_count + total.unfinished_game_count;
+    printf("agent: %s\n", AGENT_NAMES[settings.agent]);
+    printf("processes: %u\n", process_count);
+    printf("games finished: %llu\n", static_cast<unsigned long long>(total.finished_game_count));
+    printf("games cut short: %llu\n", static_cast<unsigned long long>(total.unfinished_game_count));
+    printf("rows cleared per game: %.1f\n", (played_game_count > 0) ? static_cast<f64>(total.rows_cleared) / static_cast<f64>(played_game_count) : 0.0);
+    printf("records: %llu\n", static_cast<unsigned long long>(total.record_count));
+    printf("seconds: %.3f\n", elapsed);
+    printf("records per second: %.0f\n", static_cast<f64>(total.record_count) / elapsed);
+    printf("shards: %u\n", shard_count);
+    printf("written to: %s\n", manifest_file_name);
+
+    return 0;
+}
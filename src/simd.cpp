@@ -0,0 +1,84 @@
+#include "simd.h"
+#include "util.h"
+
+#include <cpuid.h>
+
+static u64 read_extended_control_register() {
+    u32 eax = 0;
+    u32 edx = 0;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<u64>(edx) << 32) | eax;
+}
+
+static CpuFeatures detect_cpu_features() {
+    CpuFeatures features = {};
+
+    u32 eax = 0;
+    u32 ebx = 0;
+    u32 ecx = 0;
+    u32 edx = 0;
+    __cpuid(0x80000000, eax, ebx, ecx, edx);
+    if (eax >= 0x80000004) {
+        for (u32 i = 0; i < 3; ++i) {
+            __cpuid(0x80000002 + i, eax, ebx, ecx, edx);
+            const u32 registers[4] = {eax, ebx, ecx, edx};
+            copy_bytes(reinterpret_cast<const i8*>(registers), sizeof(registers), features.brand + 16 * i);
+        }
+    }
+
+    __cpuid(0, eax, ebx, ecx, edx);
+    const u32 max_leaf = eax;
+    if (max_leaf < 1) {
+        return features;
+    }
+
+    __cpuid(1, eax, ebx, ecx, edx);
+    features.sse42 = (ecx & (1 << 20)) != 0;
+    if (max_leaf < 7) {
+        return features;
+    }
+
+    const bool fma = (ecx & (1 << 12)) != 0;
+    const bool os_saves_extended_state = (ecx & (1 << 27)) != 0;
+    const bool avx = (ecx & (1 << 28)) != 0;
+    const bool f16c = (ecx & (1 << 29)) != 0;
+    if (!os_saves_extended_state || !avx) {
+        return features;
+    }
+
+    // the OS has to preserve the ymm (and zmm) registers across context switches for us to use them
+    const u64 enabled_state = read_extended_control_register();
+    const bool os_saves_ymm = (enabled_state & 0x06) == 0x06;
+    const bool os_saves_zmm = (enabled_state & 0xE6) == 0xE6;
+
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    const u32 max_leaf_7_subleaf = eax;
+    const bool avx2 = (ebx & (1 << 5)) != 0;
+    const bool avx512f = (ebx & (1 << 16)) != 0;
+
+    bool avx512_bf16 = false;
+    if (max_leaf_7_subleaf >= 1) {
+        __cpuid_count(7, 1, eax, ebx, ecx, edx);
+        avx512_bf16 = (eax & (1 << 5)) != 0;
+    }
+
+    features.avx2 = os_saves_ymm && avx2 && fma && f16c;
+    features.avx512f = features.avx2 && os_saves_zmm && avx512f;
+    features.avx512_bf16 = features.avx512f && avx512_bf16;
+
+    return features;
+}
+
+// not a function local static as thread safe static initialisation needs the CRT, detecting
+// twice from separate threads is harmless anyway since both get the same answer
+static CpuFeatures detected_cpu_features;
+static bool cpu_features_detected;
+
+static const CpuFeatures& cpu_features() {
+    if (!cpu_features_detected) {
+        detected_cpu_features = detect_cpu_features();
+        cpu_features_detected = true;
+    }
+
+    return detected_cpu_features;
+}
@@ -0,0 +1,25 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include "types.h"
+
+#include <immintrin.h>
+
+// Kernels are compiled for their instruction set with these and picked at runtime from the detected
+// features, the build itself only assumes x64 (i.e. SSE2)
+#define TARGET_SSE42 __attribute__((target("sse4.2")))
+#define TARGET_AVX2 __attribute__((target("avx2,fma,f16c")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx2,fma,f16c")))
+#define TARGET_AVX512_BF16 __attribute__((target("avx512f,avx512bf16,avx2,fma,f16c")))
+
+struct CpuFeatures {
+    bool sse42;     // for the crc32 instruction
+    bool avx2;      // also implies FMA and F16C, we don't bother with CPUs that have one but not the others
+    bool avx512f;
+    bool avx512_bf16;
+    i8 brand[48];   // processor brand string, zero padded, all zeros on CPUs too old to report one
+};
+
+static const CpuFeatures& cpu_features();
+
+#endif
@@ -5,15 +5,29 @@
 #include "maths.h"
 #include "types.h"
 #include "util.h"
+#include "simd.h"
 
 #include "rendering.cpp"
 #include "tetris.cpp"
 #include "maths.cpp"
 #include "util.cpp"
+#include "simd.cpp"
 
 #include "neural_network.h"
 #include "neural_network.cpp"
 
+#include "kernel_tuning.h"
+#include "kernel_tuning.cpp"
+
+#include "convolutional_neural_network.h"
+#include "convolutional_neural_network.cpp"
+
+#include "training_data.h"
+#include "training_data.cpp"
+
+#include "tetris_game.h"
+#include "tetris_game.cpp"
+
 #define DEBUG_ASSERT(condition) if (!(condition)) platform.show_error_box("Debug Assert", #condition)
 
 enum GameMode : i32 {
@@ -24,32 +38,24 @@ enum GameMode : i32 {
     COUNT = 4
 };
 
+// Result of the last inference keyed by the encoded game state, update and render share it
+// so the network only runs again when the state it sees actually changes
+struct InferenceCache {
+    u64 key;
+    BinaryGameState binary_game_state;
+    const void* weights;
+    NeuralNetwork::InputLayer input;
+    NeuralNetwork::OutputLayer output;
+    u64 hit_count;      // both shown in the AI controlled and playback modes
+    u64 miss_count;
+};
+
 struct GameState {
     GameMode game_mode;
     GameMode selected_game_mode_in_main_menu;
 
-    PlayerInput previous_player_input;
+    TetrisGame game;   // the one played in the player and AI controlled modes, the menus use its inputs too
 
-    Tetris::Grid grid;
-    Tetris::Tetrimino tetrimino;
-    Tetris::Tetrimino next_tetrimino;
-
-    i32 player_score;
-    i32 total_rows_cleared;
-    i32 updates_since_last_drop;
-
-    u32 updates_down_held_count;
-    u32 updates_left_held_count;
-    u32 updates_right_held_count;
-    u32 updates_clockwise_held_count;
-    u32 updates_anti_clockwise_held_count;
-
-    bool down_was_pressed;
-    bool left_was_pressed;
-    bool right_was_pressed;
-    bool clockwise_was_pressed;
-    bool anti_clockwise_was_pressed;
-    
     GLuint vertex_array_object;
     GLuint vertex_buffer_object;
     GLuint ui_vertex_array_object;
@@ -63,191 +69,324 @@ struct GameState {
     i64 previous_tick_count;
     f32 accumulated_time;
 
-    u32 rng_seed;
-
     NeuralNetwork neural_network;
-    File training_data_file;
+    PackedNeuralNetwork packed_neural_network;  // of whatever inference_model.neural_network points at
+    SparseNeuralNetwork sparse_neural_network;  // likewise, only used when the model has been pruned
+    bool use_sparse_neural_network;
+    KernelTuning kernel_tuning;     // from the tuner's file when it has an entry for this machine
+    HalfPrecisionNeuralNetwork half_precision_neural_network;
+    ModelView inference_model;  // points at the networks above or at weights mapped straight from file
+    MappedFile neural_network_mapping;
+    InferenceCache inference_cache;
+    File training_data_file;            // the last shard, what's being recorded into
+    RecordingBuffer* recording_buffer;  // owned by the platform, drained into training_data_file
+
+    TrainingDataShard training_data_shards[MAX_TRAINING_DATA_SHARD_COUNT];  // as in the manifest
+    u32 training_data_shard_count;
+    u64 recording_shard_size;       // of the frames appended to the last shard, whether flushed yet or not
+    u32 recording_shard_checksum;   // crc32c of their records
+    bool training_data_manifest_outdated;   // rewritten once the writer has switched to the new shard
+
+    MappedFile playback_mapping;
+    TrainingDataView playback_data;     // in playback_mapping, records is the start of the file when it's framed
+    bool playback_framed;
+    u32 playback_shard_index;
+    u32 playback_record_index;          // within the shard
+    u64 playback_shard_first_records[MAX_TRAINING_DATA_SHARD_COUNT + 1];   // where each shard starts in the whole recording
+    u64 playback_position;              // record shown out of the whole recording
+    u32 playback_speed_index;           // into PLAYBACK_SPEEDS
+    PlayerInput playback_player_input;  // what was recorded with the record shown
 };
 
 static_assert(sizeof(GameState) < GameMemory::PERMANENT_STORAGE_SIZE);
 
-static i32 calculate_difficulty_level(const i32 total_rows_cleared) {
-    return total_rows_cleared / 10 + 1;
-}
-
-static void game_state_to_neural_network_input(
-    const i32 total_rows_cleared,
-    const Tetris::Tetrimino::Type next_tetrimino_type,
-    const Tetris::Tetrimino& tetrimino,
-    const Tetris::Grid& grid,
-    NeuralNetwork::InputLayer& input
-) {
-    const i32 difficulty_level = calculate_difficulty_level(total_rows_cleared);
-    input[0] = static_cast<f32>(difficulty_level);
-    input[1] = static_cast<f32>(total_rows_cleared);
-    input[2] = static_cast<f32>(next_tetrimino_type);
-    input[3] = static_cast<f32>(tetrimino.type);
-
-    for (i32 i = 0; i < 4; ++i) {
-        input[4 + i + 0] = static_cast<f32>(tetrimino.blocks.top_left_coordinates[i].x);
-        input[4 + i + 1] = static_cast<f32>(tetrimino.blocks.top_left_coordinates[i].y);
-    }
-
-    i32 i = 12;
-    for (i32 row = 0; row < Tetris::Grid::ROW_COUNT; ++row) {
-        for (i32 column = 0; column < Tetris::Grid::COLUMN_COUNT; ++column) {
-            const bool cell_has_block = !Tetris::is_empty_cell(grid.cells[row][column]);
-            input[i++] = static_cast<f32>(cell_has_block);
-        }
+// Set to BF16 or F16 to have the AI run on a reduced precision copy of the weights, the copy is stored
+// in the model file next to the f32 weights which are still what gets trained
+static constexpr ModelElementType INFERENCE_WEIGHT_TYPE = ModelElementType::F32;
+
+static const NeuralNetwork::OutputLayer& cached_feed_forward(GameState& game_state) {
+    BinaryGameState binary_game_state = {};
+    tetris_game_to_binary_game_state(game_state.game, binary_game_state);
+
+    InferenceCache& cache = game_state.inference_cache;
+    const u64 key = hash_bytes(binary_game_state, sizeof(binary_game_state));
+    const ModelView& model = game_state.inference_model;
+    const void* const weights = (model.half_precision_neural_network != nullptr) ? static_cast<const void*>(model.half_precision_neural_network) : model.neural_network;
+    const bool hit = cache.weights == weights &&
+        cache.key == key &&
+        compare_bytes(cache.binary_game_state, binary_game_state, sizeof(binary_game_state)) == 0;
+    if (hit) {
+        ++cache.hit_count;
+        return cache.output;
     }
+
+    ++cache.miss_count;
+    cache.key = key;
+    copy_bytes(binary_game_state, sizeof(binary_game_state), cache.binary_game_state);
+    cache.weights = weights;
+
+    // same decoding as training so the network sees exactly what it was trained on
+    binary_game_state_to_neural_network_input(binary_game_state, cache.input);
+    if (model.half_precision_neural_network != nullptr) {
+        feed_forward(*model.half_precision_neural_network, model.half_precision_type, cache.input, cache.output);
+    } else if (game_state.use_sparse_neural_network) {
+        feed_forward(game_state.sparse_neural_network, cache.input, cache.output);
+    } else {
+        feed_forward(pack_neural_network(*model.neural_network, game_state.packed_neural_network), cache.input, cache.output);
+    }
+
+    return cache.output;
 }
 
-static constexpr u8 BINARY_GAME_STATE_SIZE = 54;
-using BinaryGameState = i8[BINARY_GAME_STATE_SIZE];
-using BinaryPlayerInput = u16;
+// Reads the training data a chunk at a time so its size isn't limited by transient storage. The next chunk is
+// read in the background while the current one is trained on. The shard files are read one after the other,
+// and the stream wraps back to the start of the first after the last one. A single file that fits in one
+// chunk is only read once. Framed files are unframed a chunk at a time in place, leaving out damaged frames.
+struct TrainingDataStream {
+    // whole frames and whole records so a chunk never splits either
+    static constexpr u32 CHUNK_SIZE = 126 * TRAINING_DATA_FRAME_SIZE;
+    static_assert(CHUNK_SIZE % TRAINING_RECORD_SIZE == 0);
+
+    const File* files;
+    u32 file_count;
+    u32 reading_file;       // the file the read in flight is from
+    i8* buffers[2];
+    u32 reading_buffer;     // the buffer the read in flight is filling
+    u64 read_offset;        // where in the file the read in flight started
+    BackgroundRead read;
+    bool reading_framed_file;       // going by the start of the file
+    u32 previous_frame_checksum;    // where the frame before the chunk being read left the checksum
+    bool whole_file_buffered;
+    u32 whole_file_size;
+};
 
-static u32 game_state_to_binary_game_state(
-    const i32 total_rows_cleared,
-    const Tetris::Tetrimino::Type next_tetrimino_type,
-    const Tetris::Tetrimino& tetrimino,
-    const Tetris::Grid& grid,
-    BinaryGameState& binary_game_state
-) {
-    u32 bytes_written = 0;
-    const i32 difficulty_level = calculate_difficulty_level(total_rows_cleared);
-    bytes_written += copy_bytes(reinterpret_cast<const i8*>(&difficulty_level), sizeof(difficulty_level), binary_game_state + bytes_written);
-    bytes_written += copy_bytes(reinterpret_cast<const i8*>(&total_rows_cleared), sizeof(total_rows_cleared), binary_game_state + bytes_written);
+struct TrainingDataChunk {
+    const i8* records;
+    u32 record_count;
+    bool last_in_pass;
+};
 
-    binary_game_state[bytes_written++] = static_cast<i8>(next_tetrimino_type);
-    binary_game_state[bytes_written++] = static_cast<i8>(tetrimino.type);
+// The stream's buffers take the first 2 * CHUNK_SIZE bytes of storage, the files have to outlive the stream
+static void open_training_data_stream(const File* const files, const u32 file_count, void* const storage, const Platform& platform, TrainingDataStream& stream) {
+    stream = {};
+    stream.files = files;
+    stream.file_count = file_count;
+    stream.buffers[0] = static_cast<i8*>(storage);
+    stream.buffers[1] = stream.buffers[0] + TrainingDataStream::CHUNK_SIZE;
+    platform.start_background_read(stream.files[0], 0, stream.buffers[0], TrainingDataStream::CHUNK_SIZE, stream.read);
+}
 
-    for (i32 block_index = 0; block_index < 4; ++block_index) {
-        const i8 block_top_left_x = static_cast<i8>(tetrimino.blocks.top_left_coordinates[block_index].x);
-        binary_game_state[bytes_written++] = block_top_left_x;
-        const i8 block_top_left_y = static_cast<i8>(tetrimino.blocks.top_left_coordinates[block_index].y);
-        binary_game_state[bytes_written++] = block_top_left_y;
+static TrainingDataChunk next_training_data_chunk(TrainingDataStream& stream, const Platform& platform) {
+    TrainingDataChunk chunk = {};
+    if (stream.whole_file_buffered) {
+        chunk.records = stream.buffers[0];
+        chunk.record_count = stream.whole_file_size / TRAINING_RECORD_SIZE;
+        chunk.last_in_pass = true;
+        return chunk;
     }
 
-    for (i32 row = 0; row < Tetris::Grid::ROW_COUNT; ++row) {
-        u16 binary_row_state = 0;
-        for (i32 column = 0; column < Tetris::Grid::COLUMN_COUNT; ++column) {
-            const bool cell_has_block = !Tetris::is_empty_cell(grid.cells[row][column]);
-            binary_row_state |= (static_cast<u16>(cell_has_block) << column);
-        }
+    // a short read means the end of the file, any partial record on the end is left out
+    const u32 bytes_read = platform.finish_background_read(stream.read);
+    const bool last_in_file = bytes_read < TrainingDataStream::CHUNK_SIZE;
+    i8* const buffer = stream.buffers[stream.reading_buffer];
+    if (stream.read_offset == 0) {
+        stream.reading_framed_file = is_framed_training_data(buffer, bytes_read);
+        stream.previous_frame_checksum = 0;
+    }
 
-        bytes_written += copy_bytes(reinterpret_cast<const i8*>(&binary_row_state), sizeof(binary_row_state), binary_game_state + bytes_written);
+    chunk.records = buffer;
+    chunk.record_count = bytes_read / TRAINING_RECORD_SIZE;
+    if (stream.reading_framed_file) {
+        u64 damaged_frame_count = 0;
+        const u64 first_frame_index = stream.read_offset / TRAINING_DATA_FRAME_SIZE;
+        chunk.record_count = static_cast<u32>(unframe_training_data(buffer, bytes_read, first_frame_index, stream.previous_frame_checksum, buffer, damaged_frame_count));
     }
 
-    return bytes_written;
-}
+    chunk.last_in_pass = last_in_file && stream.reading_file + 1 == stream.file_count;
 
-// TODO: assert bytes_read is as expected at various points throughout
-static void binary_game_state_to_neural_network_input(const BinaryGameState& binary_game_state, NeuralNetwork::InputLayer& input) {
-    u32 bytes_read = 0;
+    if (chunk.last_in_pass && stream.read_offset == 0 && stream.file_count == 1) {
+        stream.whole_file_buffered = true;
+        stream.whole_file_size = chunk.record_count * TRAINING_RECORD_SIZE;
+        return chunk;
+    }
 
-    i32 difficulty_level = 0;
-    bytes_read += copy_bytes(binary_game_state + bytes_read, sizeof(difficulty_level), reinterpret_cast<i8*>(&difficulty_level));
-    input[0] = static_cast<f32>(difficulty_level);
+    stream.read_offset = last_in_file ? 0 : stream.read_offset + bytes_read;
+    stream.reading_file = last_in_file ? (stream.reading_file + 1) % stream.file_count : stream.reading_file;
+    stream.reading_buffer ^= 1;
+    platform.start_background_read(stream.files[stream.reading_file], stream.read_offset, stream.buffers[stream.reading_buffer], TrainingDataStream::CHUNK_SIZE, stream.read);
 
-    i32 rows_cleared = 0;
-    bytes_read += copy_bytes(binary_game_state + bytes_read, sizeof(rows_cleared), reinterpret_cast<i8*>(&rows_cleared));
-    input[1] = static_cast<f32>(rows_cleared);
-    
-    const i8 next_tetrimino_type = binary_game_state[bytes_read++];
-    input[2] = static_cast<f32>(next_tetrimino_type);
-
-    const i8 current_tetrimino_type = binary_game_state[bytes_read++];
-    input[3] = static_cast<f32>(current_tetrimino_type);
-
-    // read current tetrimino block positions
-    for (i32 input_index = 4; input_index < 12; input_index += 2) {
-        const i8 block_top_left_x = binary_game_state[bytes_read++];
-        input[input_index] = static_cast<f32>(block_top_left_x);
-        const i8 block_top_left_y = binary_game_state[bytes_read++];
-        input[input_index + 1] = static_cast<f32>(block_top_left_y);
-    }
-
-    // read grid state
-    i32 input_index = 12;
-    for (i32 row = 0; row < Tetris::Grid::ROW_COUNT; ++row) {
-        u16 encoded_row = 0;
-        bytes_read += copy_bytes(binary_game_state + bytes_read, sizeof(encoded_row), reinterpret_cast<i8*>(&encoded_row));
-        for (i32 column = 0; column < Tetris::Grid::COLUMN_COUNT; ++column) {
-            const bool cell_has_block = (encoded_row & (1 << column)) != 0;
-            input[input_index++] = static_cast<f32>(cell_has_block);
-        }
+    return chunk;
+}
+
+static void close_training_data_stream(TrainingDataStream& stream, const Platform& platform) {
+    platform.finish_background_read(stream.read);
+    stream = {};
+}
+
+// One full batch step over a pass of the stream, the delta is the same sum whether the data came in one chunk or many
+static void train(NeuralNetwork& neural_network, PackedNeuralNetwork& packed_neural_network, TrainingDataStream& training_data, const Platform& platform) {
+    PackedNeuralNetworkDelta neural_network_delta = {};
+    const PackedNeuralNetwork& packed = pack_neural_network(neural_network, packed_neural_network);
+
+    u64 record_count = 0;
+    TrainingDataChunk chunk = {};
+    do {
+        chunk = next_training_data_chunk(training_data, platform);
+        accumulate_training_delta(packed, chunk.records, 0, chunk.record_count, neural_network_delta);
+        record_count += chunk.record_count;
+    } while (!chunk.last_in_pass);
+
+    if (record_count > 0) {
+        apply_delta(neural_network, neural_network_delta, LEARNING_RATE / static_cast<f32>(record_count));
+        invalidate_packed_neural_network(packed_neural_network);
     }
 }
 
-static BinaryPlayerInput player_input_to_binary_player_input(const PlayerInput& player_input) {
-    BinaryPlayerInput binary_player_input = 0;
+// Writes to a temporary file first and then swaps it in so a crash never leaves a truncated file behind
+static bool replace_file_contents(const i8* const file_name, const i8* const temp_file_name, const i8* const buffer, const u64 bytes_to_write, const Platform& platform) {
+    File temp_file = {};
+    if (!platform.open_file(temp_file_name, FileAccessFlags::WRITE, FileCreationFlags::ALWAYS_CREATE, temp_file)) {
+        return false;
+    }
 
-    binary_player_input |= static_cast<BinaryPlayerInput>(player_input.down);
-    binary_player_input |= (static_cast<BinaryPlayerInput>(player_input.left) << 1);
-    binary_player_input |= (static_cast<BinaryPlayerInput>(player_input.right) << 2);
-    binary_player_input |= (static_cast<BinaryPlayerInput>(player_input.clockwise) << 3);
-    binary_player_input |= (static_cast<BinaryPlayerInput>(player_input.anti_clockwise) << 4);
+    const u64 bytes_written = platform.write_buffer_into_file(temp_file, buffer, bytes_to_write);
+    const bool flushed = platform.flush_file(temp_file);
+    platform.close_file(temp_file);
+    if (bytes_written != bytes_to_write || !flushed) {
+        return false;
+    }
 
-    return binary_player_input;
+    return platform.replace_file(temp_file_name, file_name);
 }
 
-static void binary_player_input_to_neural_network_output(const BinaryPlayerInput encoded_outputs, NeuralNetwork::OutputLayer& output) {
-    for (i32 i = 0; i < NeuralNetwork::OUTPUT_LAYER_SIZE; ++i) {
-        const bool val = (encoded_outputs & (1 << i)) != 0;
-        output[i] = static_cast<f32>(val);
-    }
+static bool save_neural_network(const ModelView& model, const i8* const file_name, const i8* const temp_file_name, const GameMemory& game_memory, const Platform& platform) {
+    i8* const buffer = static_cast<i8*>(game_memory.transient_storage);
+    const u32 bytes_to_write = save_model_to_buffer(
+        *model.neural_network,
+        model.half_precision_neural_network,
+        model.half_precision_type,
+        buffer,
+        static_cast<u32>(game_memory.TRANSIENT_STORAGE_SIZE)
+    );
+    DEBUG_ASSERT(bytes_to_write != 0);
+
+    return replace_file_contents(file_name, temp_file_name, buffer, bytes_to_write, platform);
 }
 
-// TODO: should be averaging over batches
-static void train(NeuralNetwork& neural_network, const i8* training_data, const u32 training_data_size) {
-    // TODO: assert training data size is multiple of binary game state + player input
+static constexpr const i8* TRAINING_DATA_FILE_NAME = "training_data.bin";
+static constexpr const i8* TRAINING_DATA_MANIFEST_FILE_NAME = "training_data_manifest.bin";
+static constexpr const i8* TRAINING_DATA_MANIFEST_TEMP_FILE_NAME = "training_data_manifest.bin.tmp";
+
+// Recording moves on to a new shard once the current one has this many frames in it
+static constexpr u64 TRAINING_DATA_SHARD_SIZE = 1024 * TRAINING_DATA_FRAME_SIZE;
+
+// The first shard is training_data.bin, where everything got recorded before there were shards, then
+// training_data_00001.bin and so on
+static void training_data_shard_file_name(u32 shard_index, i8* const file_name) {
+    static constexpr i8 PREFIX[] = "training_data_";
+    static constexpr i8 SUFFIX[] = ".bin";
+    static constexpr u32 DIGIT_COUNT = 5;
+    static_assert(sizeof(PREFIX) - 1 + DIGIT_COUNT + sizeof(SUFFIX) <= sizeof(TrainingDataShard::file_name));
+
+    if (shard_index == 0) {
+        u32 length = 0;
+        while (TRAINING_DATA_FILE_NAME[length] != 0) {
+            ++length;
+        }
 
-    NeuralNetwork neural_network_delta = {};
+        copy_bytes(TRAINING_DATA_FILE_NAME, length + 1, file_name);
+        return;
+    }
 
-    u32 bytes_read = 0;
-    while (bytes_read < training_data_size) {
-        BinaryGameState binary_game_state = {};
-        bytes_read += copy_bytes(training_data + bytes_read, sizeof(binary_game_state), reinterpret_cast<i8*>(binary_game_state));
+    u32 length = copy_bytes(PREFIX, sizeof(PREFIX) - 1, file_name);
+    for (u32 digit = DIGIT_COUNT; digit-- != 0;) {
+        file_name[length + digit] = static_cast<i8>('0' + shard_index % 10);
+        shard_index /= 10;
+    }
 
-        BinaryPlayerInput encoded_player_input = 0;
-        bytes_read += copy_bytes(training_data + bytes_read, sizeof(encoded_player_input), reinterpret_cast<i8*>(&encoded_player_input));
+    length += DIGIT_COUNT;
+    copy_bytes(SUFFIX, sizeof(SUFFIX), file_name + length);
+}
 
-        NeuralNetwork::InputLayer game_state = {};
-        binary_game_state_to_neural_network_input(binary_game_state, game_state);
+// A new empty shard on the end of the list, false if there's no room for one
+static bool add_training_data_shard(GameState& game_state) {
+    if (game_state.training_data_shard_count == MAX_TRAINING_DATA_SHARD_COUNT) {
+        return false;
+    }
 
-        NeuralNetwork::OutputLayer player_input = {};
-        binary_player_input_to_neural_network_output(encoded_player_input, player_input);
+    TrainingDataShard& shard = game_state.training_data_shards[game_state.training_data_shard_count];
+    shard = {};
+    training_data_shard_file_name(game_state.training_data_shard_count, shard.file_name);
+    ++game_state.training_data_shard_count;
 
-        back_propagate(neural_network, game_state, player_input, neural_network_delta);
-    }
+    return true;
+}
 
-    static constexpr f32 LEARNING_RATE = 0.1f;
-    const f32 batch_size = static_cast<f32>(training_data_size / (BINARY_GAME_STATE_SIZE + 2));
+// False when there's no manifest to load, recordings from before there were any carry on as the first shard
+static bool load_training_data_manifest(GameState& game_state, const Platform& platform) {
+    game_state.training_data_shard_count = 0;
+    MappedFile manifest_mapping = {};
+    if (platform.map_file(TRAINING_DATA_MANIFEST_FILE_NAME, MappedFileAccess::SEQUENTIAL, manifest_mapping)) {
+        TrainingDataManifestView manifest = {};
+        if (view_training_data_manifest(manifest_mapping.data, manifest_mapping.size, manifest)) {
+            for (u32 i = 0; i < manifest.shard_count; ++i) {
+                game_state.training_data_shards[i] = manifest.shards[i];
+            }
 
-    for (i32 row = 0; row < NeuralNetwork::HIDDEN_LAYER_SIZE; ++row) {
-        for (i32 column = 0; column < NeuralNetwork::INPUT_LAYER_SIZE; ++column) {
-            neural_network.input_to_hidden_weights[row][column] -= LEARNING_RATE * neural_network_delta.input_to_hidden_weights[row][column] / batch_size;
+            game_state.training_data_shard_count = manifest.shard_count;
         }
+
+        platform.unmap_file(manifest_mapping);
     }
 
-    for (i32 i = 0; i < NeuralNetwork::HIDDEN_LAYER_SIZE; ++i) {
-        neural_network.hidden_biases[i] -= LEARNING_RATE * neural_network_delta.hidden_biases[i] / batch_size;
+    if (game_state.training_data_shard_count == 0) {
+        add_training_data_shard(game_state);
+        return false;
     }
 
-    for (i32 row = 0; row < NeuralNetwork::OUTPUT_LAYER_SIZE; ++row) {
-        for (i32 column = 0; column < NeuralNetwork::HIDDEN_LAYER_SIZE; ++column) {
-            neural_network.hidden_to_output_weights[row][column] -= LEARNING_RATE * neural_network_delta.hidden_to_output_weights[row][column] / batch_size;
-        }
+    return true;
+}
+
+static bool save_training_data_manifest(const GameState& game_state, const Platform& platform) {
+    i8 buffer[MAX_TRAINING_DATA_MANIFEST_SIZE] = {};
+    const u64 manifest_size = write_training_data_manifest(game_state.training_data_shards, game_state.training_data_shard_count, buffer);
+    return replace_file_contents(TRAINING_DATA_MANIFEST_FILE_NAME, TRAINING_DATA_MANIFEST_TEMP_FILE_NAME, buffer, manifest_size, platform);
+}
+
+// Finishes the shard being recorded into and has the writer carry on in a new one from the next record. The
+// manifest is left until the writer has put the rest of the finished shard in its file, so it never lists a
+// finished shard that isn't all there yet.
+static void start_next_training_data_shard(GameState& game_state, const Platform& platform) {
+    RecordingBuffer& recording_buffer = *game_state.recording_buffer;
+    if (__atomic_load_n(&recording_buffer.next_file_pending, __ATOMIC_ACQUIRE) != 0 || !add_training_data_shard(game_state)) {
+        return;
     }
 
-    for (i32 i = 0; i < NeuralNetwork::OUTPUT_LAYER_SIZE; ++i) {
-        neural_network.output_biases[i] -= LEARNING_RATE * neural_network_delta.output_biases[i] / batch_size;
+    const u32 shard_count = game_state.training_data_shard_count;
+    const FileAccessFlags read_write_access = static_cast<FileAccessFlags>(FileAccessFlags::WRITE | FileAccessFlags::READ);
+    File next_file = {};
+    if (!platform.open_file(game_state.training_data_shards[shard_count - 1].file_name, read_write_access, FileCreationFlags::ALWAYS_CREATE, next_file)) {
+        --game_state.training_data_shard_count;
+        return;
     }
+
+    // only ever called with the last frame full
+    TrainingDataShard& finished_shard = game_state.training_data_shards[shard_count - 2];
+    finished_shard.record_count = game_state.recording_shard_size / TRAINING_DATA_FRAME_SIZE * TRAINING_DATA_FRAME_RECORD_COUNT;
+    finished_shard.checksum = game_state.recording_shard_checksum;
+    finished_shard.flags |= TRAINING_DATA_SHARD_FINISHED;
+
+    game_state.training_data_file = next_file;
+    game_state.recording_shard_size = 0;
+    game_state.recording_shard_checksum = 0;
+    game_state.training_data_manifest_outdated = true;
+
+    recording_buffer.next_file = next_file;
+    recording_buffer.next_file_position = recording_buffer.append_position;
+    __atomic_store_n(&recording_buffer.next_file_pending, 1, __ATOMIC_RELEASE);
 }
 
 static constexpr u32 MAX_BUFFER_TILE_COUNT = 1024;
-static constexpr Coordinates TETRIMINO_SPAWN_LOCATION = Coordinates{4, 0};
-static constexpr Coordinates NEXT_TETRIMINO_DISPLAY_LOCATION = Coordinates{15, 13};
 
 extern "C" void initialise_game(const GameMemory& game_memory, const i32 client_width, const i32 client_height, const Platform& platform) {
     DEBUG_ASSERT(game_memory.permanent_storage != nullptr);
@@ -369,95 +508,312 @@ extern "C" void initialise_game(const GameMemory& game_memory, const i32 client_
     game_state.tick_frequency = platform.query_performance_frequency();
     game_state.previous_tick_count = platform.query_performance_counter();
 
-    game_state.rng_seed = static_cast<u32>(game_state.previous_tick_count);
+    start_tetris_game(game_state.game, static_cast<u32>(game_state.previous_tick_count));
+    game_state.accumulated_time = 0.0f;
 
-    game_state.grid = {};
+    static constexpr const i8* NEURAL_NETWORK_FILE_NAME = "neural_network.bin";
+    static constexpr const i8* NEURAL_NETWORK_TEMP_FILE_NAME = "neural_network.bin.tmp";
+    static constexpr const i8* KERNEL_TUNING_FILE_NAME = "kernel_tuning.bin";
+
+    game_state.kernel_tuning = DEFAULT_KERNEL_TUNING;
+    MappedFile kernel_tuning_mapping = {};
+    if (platform.map_file(KERNEL_TUNING_FILE_NAME, MappedFileAccess::SEQUENTIAL, kernel_tuning_mapping)) {
+        find_kernel_tuning(static_cast<const i8*>(kernel_tuning_mapping.data), kernel_tuning_mapping.size, current_kernel_tuning_key(), game_state.kernel_tuning);
+        platform.unmap_file(kernel_tuning_mapping);
+    }
 
-    game_state.rng_seed = random_number(game_state.rng_seed);
-    const Tetris::Tetrimino::Type tetrimino_type = static_cast<Tetris::Tetrimino::Type>(game_state.rng_seed % Tetris::Tetrimino::Type::COUNT);
-    game_state.tetrimino = construct_tetrimino(tetrimino_type, TETRIMINO_SPAWN_LOCATION);
+    // Current model files are used in place from the mapping, older unversioned ones get copied out and rewritten
+    game_state.inference_model = {};
+    game_state.neural_network_mapping = {};
+    bool neural_network_modified = true;
+    // inference keeps going back over the weights for as long as they stay mapped
+    if (platform.map_file(NEURAL_NETWORK_FILE_NAME, MappedFileAccess::RANDOM, game_state.neural_network_mapping)) {
+        const i8* const model_data = static_cast<const i8*>(game_state.neural_network_mapping.data);
+        const u64 model_size = game_state.neural_network_mapping.size;
+        if (view_model_in_buffer(model_data, model_size, game_state.inference_model)) {
+            // a reduced precision copy of the wrong type (or when we don't want one) is ignored, not having one we want means rewriting the file
+            if (game_state.inference_model.half_precision_type != INFERENCE_WEIGHT_TYPE) {
+                game_state.inference_model.half_precision_neural_network = nullptr;
+                game_state.inference_model.half_precision_type = ModelElementType::F32;
+            }
 
-    game_state.rng_seed = random_number(game_state.rng_seed);
-    const Tetris::Tetrimino::Type initial_next_tetrimino_type = static_cast<Tetris::Tetrimino::Type>(game_state.rng_seed % Tetris::Tetrimino::Type::COUNT);
-    game_state.next_tetrimino = construct_tetrimino(initial_next_tetrimino_type, NEXT_TETRIMINO_DISPLAY_LOCATION);
+            neural_network_modified = game_state.inference_model.half_precision_type != INFERENCE_WEIGHT_TYPE;
+            if (neural_network_modified) {
+                game_state.neural_network = *game_state.inference_model.neural_network;
+                game_state.inference_model = {};
+                platform.unmap_file(game_state.neural_network_mapping);
+            }
+        } else {
+            const u32 bytes_read = load_from_buffer(game_state.neural_network, model_data, static_cast<u32>(model_size));
+            if (bytes_read == 0) {
+                game_state.neural_network = random_neural_network(game_state.game.rng_seed);
+            }
 
-    game_state.player_score = 0;
-    game_state.total_rows_cleared = 0;
-    game_state.updates_since_last_drop = 0;
+            platform.unmap_file(game_state.neural_network_mapping);
+        }
+    } else {
+        game_state.neural_network = random_neural_network(game_state.game.rng_seed);
+    }
 
-    game_state.accumulated_time = 0.0f;
+    invalidate_packed_neural_network(game_state.packed_neural_network);
 
-    game_state.updates_down_held_count = 0;
-    game_state.updates_left_held_count = 0;
-    game_state.updates_right_held_count = 0;
-    game_state.updates_clockwise_held_count = 0;
-    game_state.updates_anti_clockwise_held_count = 0;
+    game_state.training_data_manifest_outdated = !load_training_data_manifest(game_state, platform);
 
-    game_state.down_was_pressed = false;
-    game_state.left_was_pressed = false;
-    game_state.right_was_pressed = false;
-    game_state.clockwise_was_pressed = false;
-    game_state.anti_clockwise_was_pressed = false;
+    // shards that have gone missing are left out of training rather than stopping it
+    File shard_files[MAX_TRAINING_DATA_SHARD_COUNT] = {};
+    u32 shard_file_count = 0;
+    for (u32 i = 0; i < game_state.training_data_shard_count; ++i) {
+        if (platform.open_file(game_state.training_data_shards[i].file_name, FileAccessFlags::READ, FileCreationFlags::USE_EXISTING, shard_files[shard_file_count])) {
+            ++shard_file_count;
+        }
+    }
 
-    static constexpr const i8* NEURAL_NETWORK_FILE_NAME = "neural_network.bin";
-    static constexpr const i8* TRAINING_DATA_FILE_NAME = "training_data.bin";
+    if (shard_file_count > 0) {
+        static_assert(2 * TrainingDataStream::CHUNK_SIZE <= GameMemory::TRANSIENT_STORAGE_SIZE);
+        TrainingDataStream training_data = {};
+        open_training_data_stream(shard_files, shard_file_count, game_memory.transient_storage, platform, training_data);
 
-    File neural_network_file = {};
-    if (platform.open_file(NEURAL_NETWORK_FILE_NAME, FileAccessFlags::READ, FileCreationFlags::USE_EXISTING, neural_network_file)) {
-        const u32 neural_network_file_size = platform.get_file_size(neural_network_file);
+        // training needs writable weights and the model file gets replaced afterwards so let go of the mapping
+        if (!neural_network_modified) {
+            game_state.neural_network = *game_state.inference_model.neural_network;
+            game_state.inference_model = {};
+            platform.unmap_file(game_state.neural_network_mapping);
+        }
 
-        const u32 bytes_read_from_file = platform.read_file_into_buffer(neural_network_file, game_memory.transient_storage, neural_network_file_size);
-        DEBUG_ASSERT(bytes_read_from_file == neural_network_file_size);
+        for (i32 i = 0; i < 100; ++i) {
+            train(game_state.neural_network, game_state.packed_neural_network, training_data, platform);
+        }
 
-        const u32 bytes_read = load_from_buffer(game_state.neural_network, reinterpret_cast<const i8*>(game_memory.transient_storage), static_cast<u32>(game_memory.TRANSIENT_STORAGE_SIZE));
-        DEBUG_ASSERT(bytes_read == neural_network_file_size);
+        neural_network_modified = true;
 
-        platform.close_file(neural_network_file);
-    } else {
-        game_state.neural_network = random_neural_network(game_state.rng_seed);
+        close_training_data_stream(training_data, platform);
+        for (u32 i = 0; i < shard_file_count; ++i) {
+            platform.close_file(shard_files[i]);
+        }
     }
 
-    // TODO: can only read as much into memory as transient storage allows, make sure we read file in chunks if file size > transient storage
-    game_state.training_data_file = {};
-    if (platform.open_file(TRAINING_DATA_FILE_NAME, FileAccessFlags::READ, FileCreationFlags::USE_EXISTING, game_state.training_data_file)) {
-        const u32 training_data_file_size = platform.get_file_size(game_state.training_data_file);
+    if (neural_network_modified) {
+        game_state.inference_model = {};
+        game_state.inference_model.neural_network = &game_state.neural_network;
+        game_state.inference_model.half_precision_type = INFERENCE_WEIGHT_TYPE;
+        if (INFERENCE_WEIGHT_TYPE != ModelElementType::F32) {
+            convert_to_half_precision(game_state.neural_network, INFERENCE_WEIGHT_TYPE, game_state.half_precision_neural_network);
+            game_state.inference_model.half_precision_neural_network = &game_state.half_precision_neural_network;
+        }
 
-        const u32 bytes_read_from_file = platform.read_file_into_buffer(game_state.training_data_file, game_memory.transient_storage, training_data_file_size);
-        DEBUG_ASSERT(bytes_read_from_file == training_data_file_size);
+        const bool saved = save_neural_network(game_state.inference_model, NEURAL_NETWORK_FILE_NAME, NEURAL_NETWORK_TEMP_FILE_NAME, game_memory, platform);
+        DEBUG_ASSERT(saved);
+    }
 
-        for (i32 i = 0; i < 100; ++i) {
-            train(game_state.neural_network, reinterpret_cast<const i8*>(game_memory.transient_storage), training_data_file_size);
+    // the sparse kernel ignores input sparsity so it only beats the packed one once most blocks are gone
+    const f32 block_density = make_sparse_neural_network(*game_state.inference_model.neural_network, game_state.sparse_neural_network);
+    game_state.use_sparse_neural_network = block_density <= game_state.kernel_tuning.max_sparse_block_density;
+
+    game_state.inference_cache = {};
+
+    // a shard recorded before framing is finished as it is, any partial record a crash left on the end and all
+    TrainingDataShard& last_shard = game_state.training_data_shards[game_state.training_data_shard_count - 1];
+    MappedFile recording_shard_mapping = {};
+    if ((last_shard.flags & TRAINING_DATA_SHARD_FINISHED) == 0 && platform.map_file(last_shard.file_name, MappedFileAccess::SEQUENTIAL, recording_shard_mapping)) {
+        if (!is_framed_training_data(recording_shard_mapping.data, recording_shard_mapping.size) && recording_shard_mapping.size >= TRAINING_RECORD_SIZE) {
+            last_shard.record_count = recording_shard_mapping.size / TRAINING_RECORD_SIZE;
+            last_shard.checksum = crc32c(static_cast<const i8*>(recording_shard_mapping.data), last_shard.record_count * TRAINING_RECORD_SIZE);
+            last_shard.flags |= TRAINING_DATA_SHARD_FINISHED;
+            game_state.training_data_manifest_outdated = true;
         }
 
-        platform.close_file(game_state.training_data_file);
+        platform.unmap_file(recording_shard_mapping);
     }
 
-    if (platform.open_file(NEURAL_NETWORK_FILE_NAME, FileAccessFlags::WRITE, FileCreationFlags::ALWAYS_CREATE, neural_network_file)) {
-        const u32 bytes_written = save_to_buffer(game_state.neural_network, reinterpret_cast<i8*>(game_memory.transient_storage));
-        DEBUG_ASSERT(bytes_written < game_memory.TRANSIENT_STORAGE_SIZE);
-        
-        const u32 bytes_written_to_file = platform.write_buffer_into_file(neural_network_file, game_memory.transient_storage, bytes_written);
-        DEBUG_ASSERT(bytes_written_to_file == bytes_written);
+    // a set of shards that are all finished (put together by the dataset tool, say) gets a new one to record into
+    if ((last_shard.flags & TRAINING_DATA_SHARD_FINISHED) != 0 && add_training_data_shard(game_state)) {
+        game_state.training_data_manifest_outdated = true;
+    }
 
-        platform.close_file(neural_network_file);
+    // Recording carries on from the last good frame, over the top of whatever a crash left after it. The size
+    // and checksum so far come from the end of the file alone, and a partial last frame goes back in the ring
+    // to be filled up and written out again whole.
+    DEBUG_ASSERT(game_memory.recording_buffer != nullptr);
+    game_state.recording_buffer = game_memory.recording_buffer;
+    const TrainingDataShard& recording_shard = game_state.training_data_shards[game_state.training_data_shard_count - 1];
+    game_state.recording_shard_size = 0;
+    game_state.recording_shard_checksum = 0;
+    u32 resumed_frame_size = 0;
+    if ((recording_shard.flags & TRAINING_DATA_SHARD_FINISHED) == 0 && platform.map_file(recording_shard.file_name, MappedFileAccess::SEQUENTIAL, recording_shard_mapping)) {
+        FramedTrainingDataEnd end = {};
+        if (find_framed_training_data_end(recording_shard_mapping.data, recording_shard_mapping.size, end)) {
+            game_state.recording_shard_size = end.size;
+            game_state.recording_shard_checksum = end.checksum;
+            resumed_frame_size = static_cast<u32>(end.size % TRAINING_DATA_FRAME_SIZE);
+            const i8* const resumed_frame = static_cast<const i8*>(recording_shard_mapping.data) + (end.size - resumed_frame_size);
+            copy_bytes(resumed_frame, resumed_frame_size, game_state.recording_buffer->data);
+        }
+
+        platform.unmap_file(recording_shard_mapping);
     }
 
+    game_state.training_data_file = {};
     const FileAccessFlags read_write_access = static_cast<FileAccessFlags>(FileAccessFlags::WRITE | FileAccessFlags::READ);
-    const bool file_opened = platform.open_file(TRAINING_DATA_FILE_NAME, read_write_access, FileCreationFlags::ALWAYS_OPEN, game_state.training_data_file);
-    DEBUG_ASSERT(file_opened);
+    if ((recording_shard.flags & TRAINING_DATA_SHARD_FINISHED) == 0) {
+        const bool file_opened = platform.open_file(recording_shard.file_name, read_write_access, FileCreationFlags::ALWAYS_OPEN, game_state.training_data_file);
+        DEBUG_ASSERT(file_opened);
+    }
+
+    if (game_state.training_data_manifest_outdated) {
+        const bool saved = save_training_data_manifest(game_state, platform);
+        DEBUG_ASSERT(saved);
+        game_state.training_data_manifest_outdated = false;
+    }
+
+    game_state.recording_buffer->file_offset = game_state.recording_shard_size - resumed_frame_size;
+    game_state.recording_buffer->file = game_state.training_data_file;
+    __atomic_store_n(&game_state.recording_buffer->append_position, resumed_frame_size, __ATOMIC_RELEASE);
+
+    game_state.playback_mapping = {};
+    game_state.playback_data = {};
 
     game_state.previous_tick_count = platform.query_performance_counter();
 }
 
-static u32 update_held_count(const bool pressed, const bool previously_pressed, const u32 updates_held_count) {
-    return (pressed && previously_pressed) ? (updates_held_count + 1) : 0;
+// Records moved on per update, left and right step through them so going backwards is slowing down past pausing
+static constexpr i32 PLAYBACK_SPEEDS[] = {-16, -8, -4, -2, -1, 0, 1, 2, 4, 8, 16};
+static constexpr u32 PLAYBACK_SPEED_COUNT = sizeof(PLAYBACK_SPEEDS) / sizeof(PLAYBACK_SPEEDS[0]);
+static constexpr u32 PLAYBACK_NORMAL_SPEED_INDEX = 6;
+static constexpr u64 PLAYBACK_JUMP_RECORD_COUNT = 60 * 60;   // a minute of updates
+
+// Maps the shard and points playback_data at its records, false (and left unmapped) if it has none
+static bool map_playback_shard(GameState& game_state, const u32 shard_index, const Platform& platform) {
+    if (!platform.map_file(game_state.training_data_shards[shard_index].file_name, MappedFileAccess::SEQUENTIAL, game_state.playback_mapping)) {
+        return false;
+    }
+
+    // the end of a framed file is wherever its last good frame is
+    const void* const data = game_state.playback_mapping.data;
+    const u64 size = game_state.playback_mapping.size;
+    FramedTrainingDataEnd end = {};
+    bool has_records = false;
+    game_state.playback_framed = find_framed_training_data_end(data, size, end);
+    if (game_state.playback_framed) {
+        game_state.playback_data = {};
+        game_state.playback_data.records = static_cast<const i8*>(data);
+        game_state.playback_data.record_count = static_cast<u32>(end.record_count);
+        has_records = end.record_count > 0;
+    } else {
+        has_records = view_training_data(data, size, game_state.playback_data);
+    }
+
+    if (!has_records) {
+        platform.unmap_file(game_state.playback_mapping);
+        game_state.playback_data = {};
+        return false;
+    }
+
+    game_state.playback_shard_index = shard_index;
+    return true;
 }
 
-static bool is_actionable_input(const bool pressed, const bool previously_pressed, const u32 updates_in_held_state) {
-    static constexpr i32 DELAY = 3;
+static void stop_training_data_playback(GameState& game_state, const Platform& platform) {
+    platform.unmap_file(game_state.playback_mapping);
+    game_state.playback_data = {};
+    game_state.playback_framed = false;
+    game_state.playback_shard_index = 0;
+    game_state.playback_record_index = 0;
+}
+
+// Moves playback to a record of the whole recording, only mapping another shard when it's in a different one
+static bool seek_training_data_playback(GameState& game_state, const u64 position, const Platform& platform) {
+    const u64* const first_records = game_state.playback_shard_first_records;
+    DEBUG_ASSERT(position < first_records[game_state.training_data_shard_count]);
+
+    u32 shard_index = 0;
+    while (first_records[shard_index + 1] <= position) {
+        ++shard_index;
+    }
+
+    const bool mapped = game_state.playback_data.records != nullptr;
+    if (!mapped || shard_index != game_state.playback_shard_index) {
+        stop_training_data_playback(game_state, platform);
+        // only shards with records get any of the index
+        if (!map_playback_shard(game_state, shard_index, platform) || game_state.playback_data.record_count != first_records[shard_index + 1] - first_records[shard_index]) {
+            stop_training_data_playback(game_state, platform);
+            return false;
+        }
+    }
 
-    const bool held = pressed && previously_pressed;
-    return held && (updates_in_held_state > 30) && (updates_in_held_state % DELAY) == 0;
+    game_state.playback_record_index = static_cast<u32>(position - first_records[shard_index]);
+    game_state.playback_position = position;
+    return true;
+}
+
+// Moves playback on by record_count_to_move records (back when negative), wrapping round at either end.
+// Moving within the shard is only arithmetic, crossing into another one maps it.
+static bool move_training_data_playback(GameState& game_state, const i64 record_count_to_move, const Platform& platform) {
+    const i64 record_index = static_cast<i64>(game_state.playback_record_index) + record_count_to_move;
+    if (record_index >= 0 && record_index < static_cast<i64>(game_state.playback_data.record_count)) {
+        game_state.playback_record_index = static_cast<u32>(record_index);
+        game_state.playback_position = static_cast<u64>(static_cast<i64>(game_state.playback_position) + record_count_to_move);
+        return true;
+    }
+
+    const i64 record_count = static_cast<i64>(game_state.playback_shard_first_records[game_state.training_data_shard_count]);
+    i64 position = (static_cast<i64>(game_state.playback_position) + record_count_to_move) % record_count;
+    position += (position < 0) ? record_count : 0;
+    return seek_training_data_playback(game_state, static_cast<u64>(position), platform);
+}
+
+// Maps every shard once to index where each one's records start, so moving about the recording after that
+// only maps the shard being moved into. False if nothing has been recorded.
+static bool start_training_data_playback(GameState& game_state, const Platform& platform) {
+    u64 record_count = 0;
+    for (u32 shard_index = 0; shard_index < game_state.training_data_shard_count; ++shard_index) {
+        game_state.playback_shard_first_records[shard_index] = record_count;
+        if (map_playback_shard(game_state, shard_index, platform)) {
+            record_count += game_state.playback_data.record_count;
+            stop_training_data_playback(game_state, platform);
+        }
+    }
+
+    game_state.playback_shard_first_records[game_state.training_data_shard_count] = record_count;
+    game_state.playback_speed_index = PLAYBACK_NORMAL_SPEED_INDEX;
+    return record_count > 0 && seek_training_data_playback(game_state, 0, platform);
+}
+
+// Either the whole record goes in or none of it does, so falling behind never leaves a torn record in the file.
+// Records are framed as they go in (see TrainingDataFrameHeader), shard_size and checksum being where the
+// recording has got to without and with the record. The frame's header is rewritten with every record so
+// whatever the writer gets to write, a whole frame or the partial one on the end when it's stopped, is a good
+// frame. Returns the number of bytes the recording grew by, 0 if the record was dropped.
+static u32 append_to_recording(RecordingBuffer& recording_buffer, const u64 shard_size, const u32 checksum, const i8* const record) {
+    const u32 offset_in_frame = static_cast<u32>(shard_size % TRAINING_DATA_FRAME_SIZE);
+    const u32 header_size = (offset_in_frame == 0) ? sizeof(TrainingDataFrameHeader) : 0;
+    const u32 bytes_to_append = header_size + TRAINING_RECORD_SIZE;
+
+    const u64 append_position = recording_buffer.append_position;
+    const u64 unflushed_size = append_position - __atomic_load_n(&recording_buffer.flushed_position, __ATOMIC_ACQUIRE);
+    if (unflushed_size + bytes_to_append > RecordingBuffer::SIZE) {
+        ++recording_buffer.dropped_record_count;
+        return 0;
+    }
+
+    const u64 record_position = append_position + header_size;
+    for (u32 i = 0; i < TRAINING_RECORD_SIZE; ++i) {
+        recording_buffer.data[(record_position + i) % RecordingBuffer::SIZE] = record[i];
+    }
+
+    i8 header[sizeof(TrainingDataFrameHeader)] = {};
+    const u32 frame_record_count = (offset_in_frame + header_size - sizeof(TrainingDataFrameHeader)) / TRAINING_RECORD_SIZE + 1;
+    write_training_data_frame_header(static_cast<u32>(shard_size / TRAINING_DATA_FRAME_SIZE), frame_record_count, checksum, header);
+    const u64 frame_position = append_position - offset_in_frame;
+    for (u32 i = 0; i < sizeof(header); ++i) {
+        recording_buffer.data[(frame_position + i) % RecordingBuffer::SIZE] = header[i];
+    }
+
+    __atomic_store_n(&recording_buffer.append_position, append_position + bytes_to_append, __ATOMIC_RELEASE);
+    if (unflushed_size + bytes_to_append > recording_buffer.peak_unflushed_size) {
+        recording_buffer.peak_unflushed_size = unflushed_size + bytes_to_append;
+    }
+
+    return bytes_to_append;
 }
 
 static constexpr f32 DELTA_TIME = 1000.0f / 60.0f;
@@ -468,43 +824,45 @@ static void update_main_menu(GameState& game_state, const PlayerInput& player_in
     game_state.accumulated_time += frame_duration;
     game_state.previous_tick_count = tick_count;
 
-    if (!game_state.down_was_pressed && player_input.down && !game_state.previous_player_input.down) {
-        game_state.down_was_pressed = true;
+    if (!game_state.game.down_was_pressed && player_input.down && !game_state.game.previous_player_input.down) {
+        game_state.game.down_was_pressed = true;
     }
 
-    if (!game_state.clockwise_was_pressed && player_input.clockwise && !game_state.previous_player_input.clockwise) {
-        game_state.clockwise_was_pressed = true;
+    if (!game_state.game.clockwise_was_pressed && player_input.clockwise && !game_state.game.previous_player_input.clockwise) {
+        game_state.game.clockwise_was_pressed = true;
     }
     
-    if (!game_state.anti_clockwise_was_pressed && player_input.anti_clockwise && !game_state.previous_player_input.anti_clockwise) {
-        game_state.anti_clockwise_was_pressed = true;
+    if (!game_state.game.anti_clockwise_was_pressed && player_input.anti_clockwise && !game_state.game.previous_player_input.anti_clockwise) {
+        game_state.game.anti_clockwise_was_pressed = true;
     }
 
     while (game_state.accumulated_time >= DELTA_TIME) {
         // TODO: should also be able to use 'up' key
         // TODO: maybe use arrow keys and/or ENTER?
-        const PlayerInput& previous_player_input = game_state.previous_player_input;
+        const PlayerInput& previous_player_input = game_state.game.previous_player_input;
 
-        game_state.updates_down_held_count = update_held_count(player_input.down, previous_player_input.down, game_state.updates_down_held_count);
+        game_state.game.updates_down_held_count = update_held_count(player_input.down, previous_player_input.down, game_state.game.updates_down_held_count);
         
-        if (game_state.down_was_pressed || is_actionable_input(player_input.down, previous_player_input.down, game_state.updates_down_held_count)) {
+        if (game_state.game.down_was_pressed || is_actionable_input(player_input.down, previous_player_input.down, game_state.game.updates_down_held_count)) {
             i32 game_mode = (game_state.selected_game_mode_in_main_menu + 1) % GameMode::COUNT;
             game_mode = (game_mode < 1) ? 1 : game_mode;
             game_state.selected_game_mode_in_main_menu = static_cast<GameMode>(game_mode);
         }
 
-        if (game_state.clockwise_was_pressed || game_state.anti_clockwise_was_pressed) {
-            game_state.game_mode = game_state.selected_game_mode_in_main_menu;
+        if (game_state.game.clockwise_was_pressed || game_state.game.anti_clockwise_was_pressed) {
+            const bool can_start = game_state.selected_game_mode_in_main_menu != GameMode::TRAINING_DATA_PLAYBACK ||
+                start_training_data_playback(game_state, platform);
+            game_state.game_mode = can_start ? game_state.selected_game_mode_in_main_menu : game_state.game_mode;
         }
 
-        game_state.down_was_pressed = false;
-        game_state.clockwise_was_pressed = false;
-        game_state.anti_clockwise_was_pressed = false;
+        game_state.game.down_was_pressed = false;
+        game_state.game.clockwise_was_pressed = false;
+        game_state.game.anti_clockwise_was_pressed = false;
 
         game_state.accumulated_time -= DELTA_TIME;
     }
 
-    game_state.previous_player_input = player_input;
+    game_state.game.previous_player_input = player_input;
 }
 
 static void update_tetris_game(GameState& game_state, const PlayerInput& player_input, const Platform& platform) {
@@ -513,189 +871,134 @@ static void update_tetris_game(GameState& game_state, const PlayerInput& player_
     game_state.accumulated_time += frame_duration;
     game_state.previous_tick_count = tick_count;
 
-    if (!game_state.down_was_pressed && player_input.down && !game_state.previous_player_input.down) {
-        game_state.down_was_pressed = true;
-    }
-
-    if (!game_state.left_was_pressed && player_input.left && !game_state.previous_player_input.left) {
-        game_state.left_was_pressed = true;
-    }
-    
-    if (!game_state.right_was_pressed && player_input.right && !game_state.previous_player_input.right) {
-        game_state.right_was_pressed = true;
-    }
-    
-    if (!game_state.clockwise_was_pressed && player_input.clockwise && !game_state.previous_player_input.clockwise) {
-        game_state.clockwise_was_pressed = true;
-    }
-    
-    if (!game_state.anti_clockwise_was_pressed && player_input.anti_clockwise && !game_state.previous_player_input.anti_clockwise) {
-        game_state.anti_clockwise_was_pressed = true;
-    }
+    latch_pressed_inputs(game_state.game, player_input);
 
     while (game_state.accumulated_time >= DELTA_TIME) {
         // dump game state for training data
         BinaryGameState binary_game_state = {};
-        const u32 bytes_written = game_state_to_binary_game_state(
-            game_state.total_rows_cleared,
-            game_state.next_tetrimino.type,
-            game_state.tetrimino,
-            game_state.grid,
-            binary_game_state
-        );
+        const u32 bytes_written = tetris_game_to_binary_game_state(game_state.game, binary_game_state);
 
         DEBUG_ASSERT(bytes_written == sizeof(binary_game_state));
 
         const BinaryPlayerInput binary_player_input = player_input_to_binary_player_input(player_input);
 
-        u32 bytes_written_to_file = 0;
-        bytes_written_to_file += platform.write_buffer_into_file(game_state.training_data_file, binary_game_state, sizeof(binary_game_state));
-        DEBUG_ASSERT(bytes_written_to_file == sizeof(binary_game_state));
-
-        bytes_written_to_file += platform.write_buffer_into_file(game_state.training_data_file, &binary_player_input, sizeof(binary_player_input));
-        DEBUG_ASSERT(bytes_written_to_file == sizeof(binary_game_state) + sizeof(binary_player_input));
-
-        const PlayerInput& previous_player_input = game_state.previous_player_input;
-
-        game_state.updates_down_held_count = update_held_count(player_input.down, previous_player_input.down, game_state.updates_down_held_count);
-        game_state.updates_left_held_count = update_held_count(player_input.left, previous_player_input.left, game_state.updates_left_held_count);
-        game_state.updates_right_held_count = update_held_count(player_input.right, previous_player_input.right, game_state.updates_right_held_count);
-        game_state.updates_clockwise_held_count = update_held_count(player_input.clockwise, previous_player_input.clockwise, game_state.updates_clockwise_held_count);
-        game_state.updates_anti_clockwise_held_count = update_held_count(player_input.anti_clockwise, previous_player_input.anti_clockwise, game_state.updates_anti_clockwise_held_count);
-
-        const bool should_move_tetrimino_left = game_state.left_was_pressed || is_actionable_input(player_input.left, previous_player_input.left, game_state.updates_left_held_count);
-        if (should_move_tetrimino_left) {
-            game_state.tetrimino = shift(game_state.tetrimino, Coordinates{-1, 0});
-            if (collision(game_state.tetrimino, game_state.grid)) {
-                game_state.tetrimino = shift(game_state.tetrimino, Coordinates{1, 0});
-            }
-        }
-
-        const bool should_move_tetrimino_right = game_state.right_was_pressed || is_actionable_input(player_input.right, previous_player_input.right, game_state.updates_right_held_count);
-        if (should_move_tetrimino_right) {
-            game_state.tetrimino = shift(game_state.tetrimino, Coordinates{1, 0});
-            if (collision(game_state.tetrimino, game_state.grid)) {
-                game_state.tetrimino = shift(game_state.tetrimino, Coordinates{-1, 0});
-            }
-        }
-
-        // Fastest we can get is 6 drops per second
-        const i32 difficulty_level = calculate_difficulty_level(game_state.total_rows_cleared);
-        const i32 updates_allowed = 120 - 5 * (difficulty_level - 1);
-        const i32 updates_allowed_before_drop = (updates_allowed < 10) ? 10 : updates_allowed;
-
-        bool should_merge_tetrimino_with_grid = false;
-        const bool should_move_tetrimino_down = game_state.down_was_pressed || is_actionable_input(player_input.down, previous_player_input.down, game_state.updates_down_held_count) || game_state.updates_since_last_drop >= updates_allowed_before_drop;
-        if (should_move_tetrimino_down) {
-            game_state.tetrimino = shift(game_state.tetrimino, Coordinates{0, 1});
-            if (collision(game_state.tetrimino, game_state.grid)) {   // Then we need to merge tetrimino to grid and spawn another
-                game_state.tetrimino = shift(game_state.tetrimino, Coordinates{0, -1});
-                should_merge_tetrimino_with_grid = true;
+        // dropped records are counted in the buffer, losing a few is better than stalling the game
+        i8 record[TRAINING_RECORD_SIZE] = {};
+        copy_bytes(binary_game_state, sizeof(binary_game_state), record);
+        copy_bytes(reinterpret_cast<const i8*>(&binary_player_input), sizeof(binary_player_input), record + sizeof(binary_game_state));
+        const u32 checksum = extend_crc32c(game_state.recording_shard_checksum, record, sizeof(record));
+        const u32 bytes_appended = append_to_recording(*game_state.recording_buffer, game_state.recording_shard_size, checksum, record);
+        if (bytes_appended != 0) {
+            game_state.recording_shard_checksum = checksum;
+            game_state.recording_shard_size += bytes_appended;
+            if (game_state.recording_shard_size >= TRAINING_DATA_SHARD_SIZE) {
+                start_next_training_data_shard(game_state, platform);
             }
-            
-            game_state.updates_since_last_drop = 0;
         }
 
-        // TODO: should this go before attempting to drop tetrimino down/left/right?
-        if (!should_merge_tetrimino_with_grid) {
-            const bool should_rotate_tetrimino_clockwise = game_state.clockwise_was_pressed || is_actionable_input(player_input.clockwise, previous_player_input.clockwise, game_state.updates_clockwise_held_count);
-            if (should_rotate_tetrimino_clockwise) {
-                game_state.tetrimino = rotate(game_state.tetrimino, Tetris::Rotation::CLOCKWISE);
-                if (collision(game_state.tetrimino, game_state.grid) && !resolve_rotation_collision(game_state.tetrimino, game_state.grid)) {
-                    game_state.tetrimino = rotate(game_state.tetrimino, Tetris::Rotation::ANTI_CLOCKWISE);
-                }
-            }
-
-            const bool should_rotate_tetrimino_anti_clockwise = game_state.anti_clockwise_was_pressed || is_actionable_input(player_input.anti_clockwise, previous_player_input.anti_clockwise, game_state.updates_anti_clockwise_held_count);
-            if (should_rotate_tetrimino_anti_clockwise) {
-                game_state.tetrimino = rotate(game_state.tetrimino, Tetris::Rotation::ANTI_CLOCKWISE);
-                if (collision(game_state.tetrimino, game_state.grid) && !resolve_rotation_collision(game_state.tetrimino, game_state.grid)) {
-                    game_state.tetrimino = rotate(game_state.tetrimino, Tetris::Rotation::CLOCKWISE);
-                }
-            }
-        } else {
-            merge(game_state.tetrimino, game_state.grid);
-            game_state.tetrimino = construct_tetrimino(game_state.next_tetrimino.type, TETRIMINO_SPAWN_LOCATION);
-            if (collision(game_state.tetrimino, game_state.grid)) {
-                // game over, reset
-                game_state.player_score = 0;
-                game_state.total_rows_cleared = 0;
-                game_state.updates_since_last_drop = 0;
-                game_state.grid = {};
-            }
-
-            game_state.rng_seed = random_number(game_state.rng_seed);
-            const Tetris::Tetrimino::Type next_tetrimino_type = static_cast<Tetris::Tetrimino::Type>(game_state.rng_seed % Tetris::Tetrimino::Type::COUNT);
-            game_state.next_tetrimino = construct_tetrimino(next_tetrimino_type, NEXT_TETRIMINO_DISPLAY_LOCATION);
+        if (game_state.training_data_manifest_outdated && __atomic_load_n(&game_state.recording_buffer->next_file_pending, __ATOMIC_ACQUIRE) == 0) {
+            const bool saved = save_training_data_manifest(game_state, platform);
+            DEBUG_ASSERT(saved);
+            game_state.training_data_manifest_outdated = false;
         }
 
-        const i32 rows_cleared = remove_completed_rows(game_state.grid);
-        game_state.total_rows_cleared += rows_cleared;
-        game_state.player_score += rows_cleared * 100 * difficulty_level;
-
-        game_state.down_was_pressed = false;
-        game_state.left_was_pressed = false;
-        game_state.right_was_pressed = false;
-        game_state.clockwise_was_pressed = false;
-        game_state.anti_clockwise_was_pressed = false;
-
-        ++game_state.updates_since_last_drop;
+        step_tetris_game(game_state.game, player_input);
         game_state.accumulated_time -= DELTA_TIME;
     }
 
-    game_state.previous_player_input = player_input;
+    game_state.game.previous_player_input = player_input;
 }
 
-// TODO: this doesn't handle running out of training data to show so it just asserts when it finishes
-static void update_training_data_playback(GameState& game_state, const Platform& platform) {
+// Plays the shards through as one recording, looping at either end. Left and right change the speed (see
+// PLAYBACK_SPEEDS), the rotations jump a minute forwards or backwards and down goes back to the main menu.
+static void update_training_data_playback(GameState& game_state, const PlayerInput& player_input, const Platform& platform) {
     const i64 tick_count = platform.query_performance_counter();
     const f32 frame_duration = static_cast<f32>(tick_count - game_state.previous_tick_count) / static_cast<f32>(game_state.tick_frequency) * 1000.0f;
     game_state.accumulated_time += frame_duration;
     game_state.previous_tick_count = tick_count;
 
+    const PlayerInput& previous_player_input = game_state.game.previous_player_input;
+    game_state.game.down_was_pressed = game_state.game.down_was_pressed || (player_input.down && !previous_player_input.down);
+    game_state.game.left_was_pressed = game_state.game.left_was_pressed || (player_input.left && !previous_player_input.left);
+    game_state.game.right_was_pressed = game_state.game.right_was_pressed || (player_input.right && !previous_player_input.right);
+    game_state.game.clockwise_was_pressed = game_state.game.clockwise_was_pressed || (player_input.clockwise && !previous_player_input.clockwise);
+    game_state.game.anti_clockwise_was_pressed = game_state.game.anti_clockwise_was_pressed || (player_input.anti_clockwise && !previous_player_input.anti_clockwise);
+    game_state.game.previous_player_input = player_input;
+
     while (game_state.accumulated_time >= DELTA_TIME) {
+        if (game_state.game.down_was_pressed) {
+            stop_training_data_playback(game_state, platform);
+            game_state.game_mode = GameMode::MAIN_MENU;
+            game_state.game.down_was_pressed = false;
+            game_state.accumulated_time = 0.0f;
+            return;
+        }
+
+        u32 speed_index = game_state.playback_speed_index;
+        speed_index += (game_state.game.right_was_pressed && speed_index + 1 < PLAYBACK_SPEED_COUNT) ? 1 : 0;
+        speed_index -= (game_state.game.left_was_pressed && speed_index > 0) ? 1 : 0;
+        game_state.playback_speed_index = speed_index;
+
+        i64 jump = 0;
+        jump += game_state.game.clockwise_was_pressed ? static_cast<i64>(PLAYBACK_JUMP_RECORD_COUNT) : 0;
+        jump -= game_state.game.anti_clockwise_was_pressed ? static_cast<i64>(PLAYBACK_JUMP_RECORD_COUNT) : 0;
+
+        game_state.game.left_was_pressed = false;
+        game_state.game.right_was_pressed = false;
+        game_state.game.clockwise_was_pressed = false;
+        game_state.game.anti_clockwise_was_pressed = false;
+
+        // a jump shows where it lands, otherwise it's the record the last update moved on to
+        if (jump != 0 && !move_training_data_playback(game_state, jump, platform)) {
+            game_state.game_mode = GameMode::MAIN_MENU;
+            game_state.accumulated_time = 0.0f;
+            return;
+        }
+
+        const i8* const record = game_state.playback_framed ?
+            framed_training_record(game_state.playback_data.records, game_state.playback_record_index) :
+            training_record(game_state.playback_data, game_state.playback_record_index);
         BinaryGameState binary_game_state = {};
-        platform.read_file_into_buffer(game_state.training_data_file, &binary_game_state, sizeof(binary_game_state));
+        copy_bytes(record, sizeof(binary_game_state), reinterpret_cast<i8*>(binary_game_state));
 
         u32 bytes_read = 0;
 
         i32 difficulty_level = 0;
         bytes_read += copy_bytes(binary_game_state + bytes_read, sizeof(difficulty_level), reinterpret_cast<i8*>(&difficulty_level));
 
-        bytes_read += copy_bytes(binary_game_state + bytes_read, sizeof(game_state.total_rows_cleared), reinterpret_cast<i8*>(&game_state.total_rows_cleared));
+        bytes_read += copy_bytes(binary_game_state + bytes_read, sizeof(game_state.game.total_rows_cleared), reinterpret_cast<i8*>(&game_state.game.total_rows_cleared));
 
         const Tetris::Tetrimino::Type next_tetrimino_type = static_cast<Tetris::Tetrimino::Type>(binary_game_state[bytes_read++]);
-        game_state.next_tetrimino = construct_tetrimino(next_tetrimino_type, NEXT_TETRIMINO_DISPLAY_LOCATION);
+        game_state.game.next_tetrimino = construct_tetrimino(next_tetrimino_type, NEXT_TETRIMINO_DISPLAY_LOCATION);
 
-        game_state.tetrimino = {};
-        game_state.tetrimino.type = static_cast<Tetris::Tetrimino::Type>(binary_game_state[bytes_read++]);
+        game_state.game.tetrimino = {};
+        game_state.game.tetrimino.type = static_cast<Tetris::Tetrimino::Type>(binary_game_state[bytes_read++]);
         for (i32 block_index = 0; block_index < 4; ++block_index) {
-            game_state.tetrimino.blocks.top_left_coordinates[block_index].x = static_cast<i32>(binary_game_state[bytes_read++]);
-            game_state.tetrimino.blocks.top_left_coordinates[block_index].y = static_cast<i32>(binary_game_state[bytes_read++]);
+            game_state.game.tetrimino.blocks.top_left_coordinates[block_index].x = static_cast<i32>(binary_game_state[bytes_read++]);
+            game_state.game.tetrimino.blocks.top_left_coordinates[block_index].y = static_cast<i32>(binary_game_state[bytes_read++]);
         }
 
-        game_state.grid = {};
+        game_state.game.grid = {};
         for (i32 row = 0; row < Tetris::Grid::ROW_COUNT; ++row) {
             u16 binary_row_state = 0;
             bytes_read += copy_bytes(binary_game_state + bytes_read, sizeof(binary_row_state), reinterpret_cast<i8*>(&binary_row_state));
             for (i32 column = 0; column < Tetris::Grid::COLUMN_COUNT; ++column) {
                 const bool cell_has_block = (binary_row_state & (1 << column)) != 0;
                 const f32 colour = static_cast<f32>(cell_has_block);
-                game_state.grid.cells[row][column] = Colour{colour, colour, colour, colour};
+                game_state.game.grid.cells[row][column] = Colour{colour, colour, colour, colour};
             }
         }
 
         BinaryPlayerInput binary_player_input = 0;
-        platform.read_file_into_buffer(game_state.training_data_file, &binary_player_input, sizeof(binary_player_input));
+        copy_bytes(record + sizeof(binary_game_state), sizeof(binary_player_input), reinterpret_cast<i8*>(&binary_player_input));
 
-        // this is a bit weird assigning the input to the previous player input but it's not being used for
-        // anything else and didn't want to introduce another member of the game state just for this game mode
-        game_state.previous_player_input = {};
-        game_state.previous_player_input.down = (binary_player_input & 0x01) != 0;
-        game_state.previous_player_input.left = (binary_player_input & 0x02) != 0;
-        game_state.previous_player_input.right = (binary_player_input & 0x04) != 0;
-        game_state.previous_player_input.clockwise = (binary_player_input & 0x08) != 0;
-        game_state.previous_player_input.anti_clockwise = (binary_player_input & 0x10) != 0;
+        game_state.playback_player_input = binary_player_input_to_player_input(binary_player_input);
+
+        if (!move_training_data_playback(game_state, PLAYBACK_SPEEDS[game_state.playback_speed_index], platform)) {
+            game_state.game_mode = GameMode::MAIN_MENU;
+            game_state.accumulated_time = 0.0f;
+            return;
+        }
 
         game_state.accumulated_time -= DELTA_TIME;
     }
@@ -715,17 +1018,7 @@ extern "C" void update_game(const GameMemory& game_memory, const PlayerInput& pl
         } break;
 
         case GameMode::AI_CONTROLLED: {
-            NeuralNetwork::InputLayer nn_input = {};
-            game_state_to_neural_network_input(
-                game_state.total_rows_cleared,
-                game_state.next_tetrimino.type,
-                game_state.tetrimino,
-                game_state.grid,
-                nn_input
-            );
-
-            NeuralNetwork::OutputLayer nn_output = {};
-            feed_forward(game_state.neural_network, nn_input, nn_output);
+            const NeuralNetwork::OutputLayer& nn_output = cached_feed_forward(game_state);
 
             static constexpr f32 AI_INPUT_THRESHOLD = 0.75f;
 
@@ -740,13 +1033,18 @@ extern "C" void update_game(const GameMemory& game_memory, const PlayerInput& pl
         } break;
 
         case GameMode::TRAINING_DATA_PLAYBACK: {
-            update_training_data_playback(game_state, platform);
+            update_training_data_playback(game_state, player_input, platform);
         } break;
 
         case GameMode::COUNT: {
             DEBUG_ASSERT(false);
         } break;
     }
+
+    // refresh for the state about to be rendered, the next update reuses it unless the state changes
+    if (game_state.game_mode == GameMode::AI_CONTROLLED || game_state.game_mode == GameMode::TRAINING_DATA_PLAYBACK) {
+        cached_feed_forward(game_state);
+    }
 }
 
 static void render_grid(Vertices& vertices, const Tetris::Grid& grid) {
@@ -792,6 +1090,20 @@ static void render_next_text(Vertices& vertices) {
     render_text(vertices, "NEXT", 13.0f, 10.0f, WHITE);
 }
 
+// Counts past what an i32 holds (over a year of ticks) stick at the largest one rather than going negative
+static i32 displayable_count(const u64 count) {
+    static constexpr u64 MAX_DISPLAYABLE_COUNT = 0x7FFFFFFF;
+    return static_cast<i32>((count < MAX_DISPLAYABLE_COUNT) ? count : MAX_DISPLAYABLE_COUNT);
+}
+
+// How often the network got to skip running because the state it would see hadn't changed
+static void render_inference_cache_counts(Vertices& vertices, const InferenceCache& cache) {
+    render_text(vertices, "HITS", 13.0f, 6.0f, WHITE);
+    render_integer(vertices, displayable_count(cache.hit_count), 18.0f, 7.0f, WHITE);
+    render_text(vertices, "MISSES", 13.0f, 8.0f, WHITE);
+    render_integer(vertices, displayable_count(cache.miss_count), 18.0f, 9.0f, WHITE);
+}
+
 static void render_player_input(Vertices& vertices, const PlayerInput& player_input, const f32 x, const f32 y) {
     if (player_input.left) {
         render_character(vertices, '\x11', x + 0.0f, y, WHITE);
@@ -848,66 +1160,44 @@ extern "C" void render_game(const GameMemory& game_memory, const Platform& platf
         } break;
 
         case GameMode::PLAYER_CONTROLLED: {
-            render_tetrimino(vertices, game_state.tetrimino);
-            render_tetrimino(vertices, game_state.next_tetrimino);
-            render_grid(vertices, game_state.grid);
+            render_tetrimino(vertices, game_state.game.tetrimino);
+            render_tetrimino(vertices, game_state.game.next_tetrimino);
+            render_grid(vertices, game_state.game.grid);
 
-            render_score(ui_vertices, game_state.player_score);
-            const i32 difficulty_level = calculate_difficulty_level(game_state.total_rows_cleared);
+            render_score(ui_vertices, game_state.game.player_score);
+            const i32 difficulty_level = calculate_difficulty_level(game_state.game.total_rows_cleared);
             render_difficulty_level(ui_vertices, difficulty_level);
             render_next_text(ui_vertices);
         } break;
 
         case GameMode::AI_CONTROLLED: {
-            render_tetrimino(vertices, game_state.tetrimino);
-            render_tetrimino(vertices, game_state.next_tetrimino);
-            render_grid(vertices, game_state.grid);
+            render_tetrimino(vertices, game_state.game.tetrimino);
+            render_tetrimino(vertices, game_state.game.next_tetrimino);
+            render_grid(vertices, game_state.game.grid);
 
-            render_score(ui_vertices, game_state.player_score);
-            const i32 difficulty_level = calculate_difficulty_level(game_state.total_rows_cleared);
+            render_score(ui_vertices, game_state.game.player_score);
+            const i32 difficulty_level = calculate_difficulty_level(game_state.game.total_rows_cleared);
             render_difficulty_level(ui_vertices, difficulty_level);
             render_next_text(ui_vertices);
 
-            NeuralNetwork::InputLayer nn_input = {};
-            game_state_to_neural_network_input(
-                game_state.total_rows_cleared,
-                game_state.next_tetrimino.type,
-                game_state.tetrimino,
-                game_state.grid,
-                nn_input
-            );
-
-            NeuralNetwork::OutputLayer nn_output = {};
-            feed_forward(game_state.neural_network, nn_input, nn_output);
-
-            render_neural_network_output(ui_vertices, nn_output, 0.0f, 0.0f);
+            render_neural_network_output(ui_vertices, game_state.inference_cache.output, 0.0f, 0.0f);
+            render_inference_cache_counts(ui_vertices, game_state.inference_cache);
         } break;
 
         case GameMode::TRAINING_DATA_PLAYBACK: {
-            render_tetrimino(vertices, game_state.tetrimino);
-            render_tetrimino(vertices, game_state.next_tetrimino);
-            render_grid(vertices, game_state.grid);
+            render_tetrimino(vertices, game_state.game.tetrimino);
+            render_tetrimino(vertices, game_state.game.next_tetrimino);
+            render_grid(vertices, game_state.game.grid);
 
             render_score(ui_vertices, 999999);
-            const i32 difficulty_level = calculate_difficulty_level(game_state.total_rows_cleared);
+            const i32 difficulty_level = calculate_difficulty_level(game_state.game.total_rows_cleared);
             render_difficulty_level(ui_vertices, difficulty_level);
             render_next_text(ui_vertices);
 
-            render_player_input(ui_vertices, game_state.previous_player_input, 0.0f, 0.0f);
-
-            NeuralNetwork::InputLayer nn_input = {};
-            game_state_to_neural_network_input(
-                game_state.total_rows_cleared,
-                game_state.next_tetrimino.type,
-                game_state.tetrimino,
-                game_state.grid,
-                nn_input
-            );
-
-            NeuralNetwork::OutputLayer nn_output = {};
-            feed_forward(game_state.neural_network, nn_input, nn_output);
+            render_player_input(ui_vertices, game_state.playback_player_input, 0.0f, 0.0f);
 
-            render_neural_network_output(ui_vertices, nn_output, 0.0f, 1.0f);
+            render_neural_network_output(ui_vertices, game_state.inference_cache.output, 0.0f, 1.0f);
+            render_inference_cache_counts(ui_vertices, game_state.inference_cache);
         } break;
 
         case GameMode::COUNT: {
@@ -12,11 +12,29 @@ struct File {
     void* handle;
 };
 
+struct MappedFile {
+    const void* data;
+    u64 size;
+    void* file_handle;
+    void* mapping_handle;
+};
+
+// A read running on a platform thread, handle is null when there's nothing in flight
+struct BackgroundRead {
+    void* handle;
+};
+
 enum FileAccessFlags {
     READ = 1,
     WRITE = 2
 };
 
+// How a mapping is going to be read so the OS can pick its read ahead
+enum MappedFileAccess {
+    SEQUENTIAL = 0,
+    RANDOM = 1
+};
+
 enum FileCreationFlags {
     USE_EXISTING = 0,
     ALWAYS_CREATE = 1,
@@ -29,10 +47,24 @@ struct Platform {
     i64(*query_performance_counter)();
     Resource(*load_resource)(i32 resource_id);
     bool(*open_file)(const i8* file_name, FileAccessFlags file_access_flags, FileCreationFlags file_creation_flag, File& file);
-    u32(*get_file_size)(const File& file);
-    u32(*read_file_into_buffer)(const File& file, void* buffer, u32 bytes_to_read);
-    u32(*write_buffer_into_file)(const File& file, const void* buffer, u32 bytes_to_write);
+    u64(*get_file_size)(const File& file);
+    u64(*read_file_into_buffer)(const File& file, void* buffer, u64 bytes_to_read);
+    u64(*write_buffer_into_file)(const File& file, const void* buffer, u64 bytes_to_write);
+
+    // Read or write starting at offset whatever the file position is, so threads sharing a file don't have to
+    // agree on where it is. Reads come up short at the end of the file.
+    u64(*read_file_at)(const File& file, u64 offset, void* buffer, u64 bytes_to_read);
+    u64(*write_file_at)(const File& file, u64 offset, const void* buffer, u64 bytes_to_write);
     void(*close_file)(File& file);
+    bool(*flush_file)(const File& file);
+    bool(*replace_file)(const i8* source_file_name, const i8* destination_file_name);
+    bool(*map_file)(const i8* file_name, MappedFileAccess access, MappedFile& mapped_file);
+    void(*unmap_file)(MappedFile& mapped_file);
+
+    // reads from offset without touching the file position, finishing blocks until the read is done and returns
+    // how many bytes it got (short at the end of the file), the file mustn't be used for anything else meanwhile
+    bool(*start_background_read)(const File& file, u64 offset, void* buffer, u32 bytes_to_read, BackgroundRead& read);
+    u32(*finish_background_read)(BackgroundRead& read);
 
     void(*glViewport)(GLint, GLint, GLsizei, GLsizei);
     void(*glGenVertexArrays)(GLsizei, GLuint*);
@@ -71,11 +103,44 @@ struct PlayerInput {
     bool anti_clockwise;
 };
 
+// Lock free single producer, single consumer ring for recorded training data. The game appends whole records
+// and never waits, the platform's writer thread drains it into file a block at a time so recording costs the
+// game loop no file system calls and a stalled disk only shows up as the ring filling. Positions only ever
+// grow, byte p lives at data[p % SIZE]. The platform logs the back-pressure counters when it shuts down.
+struct RecordingBuffer {
+    static constexpr u32 BLOCK_SIZE = 64 * 1024;
+    static constexpr u32 BLOCK_COUNT = 16;
+    static constexpr u32 SIZE = BLOCK_SIZE * BLOCK_COUNT;  // about five minutes of play
+
+    File file;          // set by the game before it appends anything
+    u64 file_offset;    // where position 0 goes in the file, likewise
+
+    // Set by the game to have everything from next_file_position on go into next_file, the writer closes
+    // file once everything before it is written and clears next_file_pending once it's switched over
+    File next_file;
+    u64 next_file_position;
+    u32 next_file_pending;
+
+    // written by the game thread
+    alignas(64) u64 append_position;
+    u64 dropped_record_count;   // back-pressure, records lost because the writer had fallen a whole ring behind
+    u64 peak_unflushed_size;
+
+    // written by the writer thread
+    alignas(64) u64 flushed_position;
+    u64 write_count;
+    u64 failed_write_count;     // short or failed writes, retried on the next poll
+    i64 longest_write_ticks;    // query_performance_counter ticks
+
+    alignas(64) i8 data[SIZE];
+};
+
 struct GameMemory {
     static constexpr u64 PERMANENT_STORAGE_SIZE = 1024 * 1024;
     void* permanent_storage;
     static constexpr u64 TRANSIENT_STORAGE_SIZE = 64 * 1024 * 1024;
     void* transient_storage;
+    RecordingBuffer* recording_buffer;
 };
 
 extern "C" {
@@ -64,42 +64,104 @@ static bool open_file(const i8* const file_name, const FileAccessFlags file_acce
     static constexpr DWORD CREATION_FLAGS_TRANSLATION[] = {OPEN_EXISTING, CREATE_ALWAYS, OPEN_ALWAYS};
     const DWORD creation = CREATION_FLAGS_TRANSLATION[file_creation_flag];
 
-    file.handle = CreateFileA(file_name, access, 0, NULL, creation, FILE_ATTRIBUTE_NORMAL, NULL);
+    // shared for reading so the training data can be mapped for playback while it's open for recording
+    file.handle = CreateFileA(file_name, access, FILE_SHARE_READ, NULL, creation, FILE_ATTRIBUTE_NORMAL, NULL);
     return file.handle != INVALID_HANDLE_VALUE;
 }
 
-static u32 get_file_size(const File& file) {
+static u64 get_file_size(const File& file) {
     DEBUG_ASSERT(is_valid_handle(file.handle));
 
     LARGE_INTEGER file_size = {};
     const BOOL got_file_size = GetFileSizeEx(file.handle, &file_size);
     DEBUG_ASSERT(got_file_size != FALSE);
 
-    return static_cast<u32>(file_size.QuadPart);
+    return static_cast<u64>(file_size.QuadPart);
 }
 
-static u32 read_file_into_buffer(const File& file, void* const buffer, const u32 bytes_to_read) {
+// ReadFile and WriteFile only take a DWORD count so anything bigger goes in pieces
+static constexpr u64 MAX_FILE_IO_CHUNK_SIZE = 1024 * 1024 * 1024;
+
+// With an OVERLAPPED on a handle that isn't overlapped the transfer starts at its offset and still completes
+// before returning. Null offset means carry on from the file position.
+static u64 read_file_chunks(const HANDLE file_handle, const u64* const offset, i8* const buffer, const u64 bytes_to_read) {
+    u64 total_bytes_read = 0;
+    while (total_bytes_read < bytes_to_read) {
+        const u64 bytes_left = bytes_to_read - total_bytes_read;
+        const DWORD chunk_size = static_cast<DWORD>((bytes_left < MAX_FILE_IO_CHUNK_SIZE) ? bytes_left : MAX_FILE_IO_CHUNK_SIZE);
+
+        OVERLAPPED overlapped = {};
+        if (offset != nullptr) {
+            const u64 chunk_offset = *offset + total_bytes_read;
+            overlapped.Offset = static_cast<DWORD>(chunk_offset);
+            overlapped.OffsetHigh = static_cast<DWORD>(chunk_offset >> 32);
+        }
+
+        DWORD bytes_read = 0;
+        const BOOL file_read = ReadFile(file_handle, buffer + total_bytes_read, chunk_size, &bytes_read, (offset != nullptr) ? &overlapped : nullptr);
+        total_bytes_read += bytes_read;
+        if (file_read == FALSE || bytes_read < chunk_size) {
+            break;
+        }
+    }
+
+    return total_bytes_read;
+}
+
+static u64 write_file_chunks(const HANDLE file_handle, const u64* const offset, const i8* const buffer, const u64 bytes_to_write) {
+    u64 total_bytes_written = 0;
+    while (total_bytes_written < bytes_to_write) {
+        const u64 bytes_left = bytes_to_write - total_bytes_written;
+        const DWORD chunk_size = static_cast<DWORD>((bytes_left < MAX_FILE_IO_CHUNK_SIZE) ? bytes_left : MAX_FILE_IO_CHUNK_SIZE);
+
+        OVERLAPPED overlapped = {};
+        if (offset != nullptr) {
+            const u64 chunk_offset = *offset + total_bytes_written;
+            overlapped.Offset = static_cast<DWORD>(chunk_offset);
+            overlapped.OffsetHigh = static_cast<DWORD>(chunk_offset >> 32);
+        }
+
+        DWORD bytes_written = 0;
+        const BOOL file_written = WriteFile(file_handle, buffer + total_bytes_written, chunk_size, &bytes_written, (offset != nullptr) ? &overlapped : nullptr);
+        total_bytes_written += bytes_written;
+        if (file_written == FALSE || bytes_written < chunk_size) {
+            break;
+        }
+    }
+
+    return total_bytes_written;
+}
+
+static u64 read_file_into_buffer(const File& file, void* const buffer, const u64 bytes_to_read) {
     DEBUG_ASSERT(is_valid_handle(file.handle));
 
-    DWORD bytes_read = 0;
-    const BOOL file_read = ReadFile(file.handle, buffer, static_cast<DWORD>(bytes_to_read), &bytes_read, nullptr);
-    DEBUG_ASSERT(file_read != FALSE);
+    const u64 bytes_read = read_file_chunks(file.handle, nullptr, static_cast<i8*>(buffer), bytes_to_read);
     DEBUG_ASSERT(bytes_read == bytes_to_read);
 
     return bytes_read;
 }
 
-static u32 write_buffer_into_file(const File& file, const void* const buffer, const u32 bytes_to_write) {
+static u64 write_buffer_into_file(const File& file, const void* const buffer, const u64 bytes_to_write) {
     DEBUG_ASSERT(is_valid_handle(file.handle));
 
-    DWORD bytes_written = 0;
-    const BOOL file_written = WriteFile(file.handle, buffer, static_cast<DWORD>(bytes_to_write), &bytes_written, nullptr);
-    DEBUG_ASSERT(file_written != FALSE);
+    const u64 bytes_written = write_file_chunks(file.handle, nullptr, static_cast<const i8*>(buffer), bytes_to_write);
     DEBUG_ASSERT(bytes_written == bytes_to_write);
 
     return bytes_written;
 }
 
+static u64 read_file_at(const File& file, const u64 offset, void* const buffer, const u64 bytes_to_read) {
+    DEBUG_ASSERT(is_valid_handle(file.handle));
+
+    return read_file_chunks(file.handle, &offset, static_cast<i8*>(buffer), bytes_to_read);
+}
+
+static u64 write_file_at(const File& file, const u64 offset, const void* const buffer, const u64 bytes_to_write) {
+    DEBUG_ASSERT(is_valid_handle(file.handle));
+
+    return write_file_chunks(file.handle, &offset, static_cast<const i8*>(buffer), bytes_to_write);
+}
+
 static void close_file(File& file) {
     DEBUG_ASSERT(is_valid_handle(file.handle));
 
@@ -107,6 +169,252 @@ static void close_file(File& file) {
     file.handle = NULL;
 }
 
+static bool flush_file(const File& file) {
+    DEBUG_ASSERT(is_valid_handle(file.handle));
+
+    return FlushFileBuffers(file.handle) != FALSE;
+}
+
+// Atomically swaps destination for source, used to write files via a temporary so
+// a crash part way through writing never leaves a truncated destination file
+static bool replace_file(const i8* const source_file_name, const i8* const destination_file_name) {
+    return MoveFileExA(source_file_name, destination_file_name, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != FALSE;
+}
+
+static bool map_file(const i8* const file_name, const MappedFileAccess access, MappedFile& mapped_file) {
+    mapped_file = {};
+
+    // the cache manager's read ahead for the mapping follows the hints on the file handle behind it
+    const DWORD access_hint = (access == MappedFileAccess::RANDOM) ? FILE_FLAG_RANDOM_ACCESS : FILE_FLAG_SEQUENTIAL_SCAN;
+    const DWORD share_mode = FILE_SHARE_READ | FILE_SHARE_WRITE;
+    const HANDLE file_handle = CreateFileA(file_name, GENERIC_READ, share_mode, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | access_hint, NULL);
+    if (!is_valid_handle(file_handle)) {
+        return false;
+    }
+
+    LARGE_INTEGER file_size = {};
+    if (GetFileSizeEx(file_handle, &file_size) == FALSE || file_size.QuadPart == 0) {
+        CloseHandle(file_handle);
+        return false;
+    }
+
+    const HANDLE mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping_handle == NULL) {
+        CloseHandle(file_handle);
+        return false;
+    }
+
+    const void* const data = MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+    if (data == nullptr) {
+        CloseHandle(mapping_handle);
+        CloseHandle(file_handle);
+        return false;
+    }
+
+    mapped_file.data = data;
+    mapped_file.size = static_cast<u64>(file_size.QuadPart);
+    mapped_file.file_handle = file_handle;
+    mapped_file.mapping_handle = mapping_handle;
+
+    return true;
+}
+
+static void unmap_file(MappedFile& mapped_file) {
+    DEBUG_ASSERT(mapped_file.data != nullptr);
+
+    const BOOL unmapped = UnmapViewOfFile(mapped_file.data);
+    DEBUG_ASSERT(unmapped != FALSE);
+    CloseHandle(mapped_file.mapping_handle);
+    CloseHandle(mapped_file.file_handle);
+
+    mapped_file = {};
+}
+
+struct BackgroundReadRequest {
+    HANDLE file_handle;
+    u64 offset;
+    void* buffer;
+    u32 bytes_to_read;
+    u32 bytes_read;
+    HANDLE finished_event;  // NULL while the request slot is free
+};
+
+// Only the game thread hands out and frees slots, the double buffered training data reader needs one at a time
+static constexpr u32 MAX_BACKGROUND_READ_COUNT = 4;
+static BackgroundReadRequest background_read_requests[MAX_BACKGROUND_READ_COUNT];
+
+static DWORD WINAPI background_read_work(void* const parameter) {
+    BackgroundReadRequest& request = *static_cast<BackgroundReadRequest*>(parameter);
+
+    // running off the end of the file just gives a short read
+    request.bytes_read = static_cast<u32>(read_file_chunks(request.file_handle, &request.offset, static_cast<i8*>(request.buffer), request.bytes_to_read));
+    SetEvent(request.finished_event);
+
+    return 0;
+}
+
+static bool start_background_read(const File& file, const u64 offset, void* const buffer, const u32 bytes_to_read, BackgroundRead& read) {
+    DEBUG_ASSERT(is_valid_handle(file.handle));
+
+    read = {};
+    for (u32 i = 0; i < MAX_BACKGROUND_READ_COUNT; ++i) {
+        BackgroundReadRequest& request = background_read_requests[i];
+        if (request.finished_event != NULL) {
+            continue;
+        }
+
+        request.finished_event = CreateEventA(NULL, TRUE, FALSE, NULL);
+        if (request.finished_event == NULL) {
+            return false;
+        }
+
+        request.file_handle = file.handle;
+        request.offset = offset;
+        request.buffer = buffer;
+        request.bytes_to_read = bytes_to_read;
+        request.bytes_read = 0;
+        if (QueueUserWorkItem(background_read_work, &request, WT_EXECUTELONGFUNCTION) == FALSE) {
+            CloseHandle(request.finished_event);
+            request = {};
+            return false;
+        }
+
+        read.handle = &request;
+        return true;
+    }
+
+    return false;
+}
+
+static u32 finish_background_read(BackgroundRead& read) {
+    if (read.handle == nullptr) {
+        return 0;
+    }
+
+    BackgroundReadRequest& request = *static_cast<BackgroundReadRequest*>(read.handle);
+    WaitForSingleObject(request.finished_event, INFINITE);
+    CloseHandle(request.finished_event);
+
+    const u32 bytes_read = request.bytes_read;
+    request = {};
+    read = {};
+
+    return bytes_read;
+}
+
+struct RecordingWriter {
+    RecordingBuffer* recording_buffer;
+    u32 stop;
+};
+
+// Drains the recording buffer from block boundary to block boundary so every write bar the first and last is
+// a whole aligned block, the partial block at the end only goes out once we're asked to stop
+static DWORD WINAPI recording_writer_thread(void* const parameter) {
+    static constexpr DWORD POLL_INTERVAL_MILLISECONDS = 50;
+
+    RecordingWriter& writer = *static_cast<RecordingWriter*>(parameter);
+    RecordingBuffer& recording_buffer = *writer.recording_buffer;
+    for (;;) {
+        const bool stopping = __atomic_load_n(&writer.stop, __ATOMIC_ACQUIRE) != 0;
+        // loaded before the append position so the switch point is never past it
+        const bool switching_file = __atomic_load_n(&recording_buffer.next_file_pending, __ATOMIC_ACQUIRE) != 0;
+        const u64 append_position = __atomic_load_n(&recording_buffer.append_position, __ATOMIC_ACQUIRE);
+        u64 write_end = stopping ? append_position : append_position - append_position % RecordingBuffer::BLOCK_SIZE;
+        // the old file gets everything up to the switch, partial block and all, before anything goes in the new one
+        write_end = switching_file ? recording_buffer.next_file_position : write_end;
+
+        u64 flushed_position = recording_buffer.flushed_position;
+        while (flushed_position < write_end && is_valid_handle(recording_buffer.file.handle)) {
+            const u32 offset = static_cast<u32>(flushed_position % RecordingBuffer::SIZE);
+            const u64 bytes_left = write_end - flushed_position;
+            const u32 bytes_to_write = (bytes_left < RecordingBuffer::SIZE - offset) ? static_cast<u32>(bytes_left) : RecordingBuffer::SIZE - offset;
+
+            const i64 start_ticks = query_performance_counter();
+            const u64 bytes_written = write_file_at(recording_buffer.file, recording_buffer.file_offset + flushed_position, recording_buffer.data + offset, bytes_to_write);
+            const i64 write_ticks = query_performance_counter() - start_ticks;
+
+            // a full disk or I/O error leaves the bytes in the ring to try again next poll, if the game catches
+            // up with them first its records are dropped and counted like any other back-pressure
+            if (bytes_written != bytes_to_write) {
+                ++recording_buffer.failed_write_count;
+                break;
+            }
+
+            ++recording_buffer.write_count;
+            recording_buffer.longest_write_ticks = (write_ticks > recording_buffer.longest_write_ticks) ? write_ticks : recording_buffer.longest_write_ticks;
+            flushed_position += bytes_to_write;
+            __atomic_store_n(&recording_buffer.flushed_position, flushed_position, __ATOMIC_RELEASE);
+        }
+
+        if (switching_file && flushed_position == write_end) {
+            if (is_valid_handle(recording_buffer.file.handle)) {
+                flush_file(recording_buffer.file);
+                close_file(recording_buffer.file);
+            }
+
+            // wraps round so next_file_position lands at the start of the new file
+            recording_buffer.file = recording_buffer.next_file;
+            recording_buffer.file_offset = 0 - recording_buffer.next_file_position;
+            recording_buffer.next_file = {};
+            __atomic_store_n(&recording_buffer.next_file_pending, 0, __ATOMIC_RELEASE);
+            continue;
+        }
+
+        if (stopping) {
+            return 0;
+        }
+
+        Sleep(POLL_INTERVAL_MILLISECONDS);
+    }
+}
+
+// There's no CRT to format with, these append to text at length and return the new length
+static u32 append_text(i8* const text, u32 length, const i8* appended) {
+    while (*appended != '\0') {
+        text[length++] = *appended++;
+    }
+
+    return length;
+}
+
+static u32 append_decimal(i8* const text, u32 length, u64 value) {
+    i8 digits[20] = {};
+    u32 digit_count = 0;
+    do {
+        digits[digit_count++] = static_cast<i8>('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    while (digit_count != 0) {
+        text[length++] = digits[--digit_count];
+    }
+
+    return length;
+}
+
+// Back-pressure on the recording ring over the whole session, to the debugger output once the writer's done
+static void log_recording_statistics(const RecordingBuffer& recording_buffer) {
+    const u64 longest_write_microseconds = static_cast<u64>(recording_buffer.longest_write_ticks) * 1000000 / static_cast<u64>(query_performance_frequency());
+
+    i8 text[256] = {};
+    u32 length = append_text(text, 0, "recording: ");
+    length = append_decimal(text, length, recording_buffer.write_count);
+    length = append_text(text, length, " writes, ");
+    length = append_decimal(text, length, recording_buffer.failed_write_count);
+    length = append_text(text, length, " failed, longest ");
+    length = append_decimal(text, length, longest_write_microseconds);
+    length = append_text(text, length, " us, peak unflushed ");
+    length = append_decimal(text, length, recording_buffer.peak_unflushed_size);
+    length = append_text(text, length, " of ");
+    length = append_decimal(text, length, RecordingBuffer::SIZE);
+    length = append_text(text, length, " bytes, ");
+    length = append_decimal(text, length, recording_buffer.dropped_record_count);
+    length = append_text(text, length, " records dropped\n");
+    text[length] = '\0';
+
+    OutputDebugStringA(text);
+}
+
 struct KeyboardInput {
     bool a;
     bool d;
@@ -378,7 +686,15 @@ extern "C" [[noreturn]] void WinMainCRTStartup() {
     platform.get_file_size = get_file_size;
     platform.read_file_into_buffer = read_file_into_buffer;
     platform.write_buffer_into_file = write_buffer_into_file;
+    platform.read_file_at = read_file_at;
+    platform.write_file_at = write_file_at;
     platform.close_file = close_file;
+    platform.flush_file = flush_file;
+    platform.replace_file = replace_file;
+    platform.map_file = map_file;
+    platform.unmap_file = unmap_file;
+    platform.start_background_read = start_background_read;
+    platform.finish_background_read = finish_background_read;
 
     platform.glViewport = glViewport;
     platform.glGenTextures = glGenTextures;
@@ -455,6 +771,13 @@ extern "C" [[noreturn]] void WinMainCRTStartup() {
     DEBUG_ASSERT(game_memory.permanent_storage != nullptr);
     game_memory.transient_storage = VirtualAlloc(0, game_memory.TRANSIENT_STORAGE_SIZE, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
     DEBUG_ASSERT(game_memory.transient_storage != nullptr);
+    game_memory.recording_buffer = static_cast<RecordingBuffer*>(VirtualAlloc(0, sizeof(RecordingBuffer), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+    DEBUG_ASSERT(game_memory.recording_buffer != nullptr);
+
+    RecordingWriter recording_writer = {};
+    recording_writer.recording_buffer = game_memory.recording_buffer;
+    const HANDLE recording_writer_thread_handle = CreateThread(NULL, 0, recording_writer_thread, &recording_writer, 0, NULL);
+    DEBUG_ASSERT(recording_writer_thread_handle != NULL);
 
     game_code.initialise_proc(game_memory, client_width, client_height, platform);
 
@@ -494,5 +817,15 @@ extern "C" [[noreturn]] void WinMainCRTStartup() {
         }
     }
 
+    // whatever's still in the ring, including the partial last block, has to reach the disk before we go
+    __atomic_store_n(&recording_writer.stop, 1, __ATOMIC_RELEASE);
+    WaitForSingleObject(recording_writer_thread_handle, INFINITE);
+    CloseHandle(recording_writer_thread_handle);
+    if (is_valid_handle(game_memory.recording_buffer->file.handle)) {
+        flush_file(game_memory.recording_buffer->file);
+    }
+
+    log_recording_statistics(*game_memory.recording_buffer);
+
     ExitProcess(0);
 }
@@ -0,0 +1,209 @@
+#include "tetris_game.h"
+#include "tetris.h"
+#include "types.h"
+#include "util.h"
+
+static i32 calculate_difficulty_level(const i32 total_rows_cleared) {
+    return total_rows_cleared / 10 + 1;
+}
+
+static u32 game_state_to_binary_game_state(
+    const i32 total_rows_cleared,
+    const Tetris::Tetrimino::Type next_tetrimino_type,
+    const Tetris::Tetrimino& tetrimino,
+    const Tetris::Grid& grid,
+    BinaryGameState& binary_game_state
+) {
+    u32 bytes_written = 0;
+    const i32 difficulty_level = calculate_difficulty_level(total_rows_cleared);
+    bytes_written += copy_bytes(reinterpret_cast<const i8*>(&difficulty_level), sizeof(difficulty_level), binary_game_state + bytes_written);
+    bytes_written += copy_bytes(reinterpret_cast<const i8*>(&total_rows_cleared), sizeof(total_rows_cleared), binary_game_state + bytes_written);
+
+    binary_game_state[bytes_written++] = static_cast<i8>(next_tetrimino_type);
+    binary_game_state[bytes_written++] = static_cast<i8>(tetrimino.type);
+
+    for (i32 block_index = 0; block_index < 4; ++block_index) {
+        const i8 block_top_left_x = static_cast<i8>(tetrimino.blocks.top_left_coordinates[block_index].x);
+        binary_game_state[bytes_written++] = block_top_left_x;
+        const i8 block_top_left_y = static_cast<i8>(tetrimino.blocks.top_left_coordinates[block_index].y);
+        binary_game_state[bytes_written++] = block_top_left_y;
+    }
+
+    for (i32 row = 0; row < Tetris::Grid::ROW_COUNT; ++row) {
+        u16 binary_row_state = 0;
+        for (i32 column = 0; column < Tetris::Grid::COLUMN_COUNT; ++column) {
+            const bool cell_has_block = !Tetris::is_empty_cell(grid.cells[row][column]);
+            binary_row_state |= (static_cast<u16>(cell_has_block) << column);
+        }
+
+        bytes_written += copy_bytes(reinterpret_cast<const i8*>(&binary_row_state), sizeof(binary_row_state), binary_game_state + bytes_written);
+    }
+
+    return bytes_written;
+}
+
+static u32 tetris_game_to_binary_game_state(const TetrisGame& game, BinaryGameState& binary_game_state) {
+    return game_state_to_binary_game_state(game.total_rows_cleared, game.next_tetrimino.type, game.tetrimino, game.grid, binary_game_state);
+}
+
+static BinaryPlayerInput player_input_to_binary_player_input(const PlayerInput& player_input) {
+    BinaryPlayerInput binary_player_input = 0;
+
+    binary_player_input |= static_cast<BinaryPlayerInput>(player_input.down);
+    binary_player_input |= (static_cast<BinaryPlayerInput>(player_input.left) << 1);
+    binary_player_input |= (static_cast<BinaryPlayerInput>(player_input.right) << 2);
+    binary_player_input |= (static_cast<BinaryPlayerInput>(player_input.clockwise) << 3);
+    binary_player_input |= (static_cast<BinaryPlayerInput>(player_input.anti_clockwise) << 4);
+
+    return binary_player_input;
+}
+
+static PlayerInput binary_player_input_to_player_input(const BinaryPlayerInput binary_player_input) {
+    PlayerInput player_input = {};
+    player_input.down = (binary_player_input & 0x01) != 0;
+    player_input.left = (binary_player_input & 0x02) != 0;
+    player_input.right = (binary_player_input & 0x04) != 0;
+    player_input.clockwise = (binary_player_input & 0x08) != 0;
+    player_input.anti_clockwise = (binary_player_input & 0x10) != 0;
+    return player_input;
+}
+
+static u32 update_held_count(const bool pressed, const bool previously_pressed, const u32 updates_held_count) {
+    return (pressed && previously_pressed) ? (updates_held_count + 1) : 0;
+}
+
+static bool is_actionable_input(const bool pressed, const bool previously_pressed, const u32 updates_in_held_state) {
+    static constexpr i32 DELAY = 3;
+
+    const bool held = pressed && previously_pressed;
+    return held && (updates_in_held_state > 30) && (updates_in_held_state % DELAY) == 0;
+}
+
+static void start_tetris_game(TetrisGame& game, const u32 rng_seed) {
+    game = {};
+    game.rng_seed = random_number(rng_seed);
+    const Tetris::Tetrimino::Type tetrimino_type = static_cast<Tetris::Tetrimino::Type>(game.rng_seed % Tetris::Tetrimino::Type::COUNT);
+    game.tetrimino = construct_tetrimino(tetrimino_type, TETRIMINO_SPAWN_LOCATION);
+
+    game.rng_seed = random_number(game.rng_seed);
+    const Tetris::Tetrimino::Type initial_next_tetrimino_type = static_cast<Tetris::Tetrimino::Type>(game.rng_seed % Tetris::Tetrimino::Type::COUNT);
+    game.next_tetrimino = construct_tetrimino(initial_next_tetrimino_type, NEXT_TETRIMINO_DISPLAY_LOCATION);
+}
+
+// Inputs can change more often than the game updates, so presses are held on to until the next update
+static void latch_pressed_inputs(TetrisGame& game, const PlayerInput& player_input) {
+    if (!game.down_was_pressed && player_input.down && !game.previous_player_input.down) {
+        game.down_was_pressed = true;
+    }
+
+    if (!game.left_was_pressed && player_input.left && !game.previous_player_input.left) {
+        game.left_was_pressed = true;
+    }
+    
+    if (!game.right_was_pressed && player_input.right && !game.previous_player_input.right) {
+        game.right_was_pressed = true;
+    }
+    
+    if (!game.clockwise_was_pressed && player_input.clockwise && !game.previous_player_input.clockwise) {
+        game.clockwise_was_pressed = true;
+    }
+    
+    if (!game.anti_clockwise_was_pressed && player_input.anti_clockwise && !game.previous_player_input.anti_clockwise) {
+        game.anti_clockwise_was_pressed = true;
+    }
+}
+
+// Plays one update with the input as it is now. Moving previous_player_input on is left to the caller, the game
+// does it once a frame however many updates that frame had. Returns true if the game was lost, in which case
+// it has already started over.
+static bool step_tetris_game(TetrisGame& game, const PlayerInput& player_input) {
+    const PlayerInput& previous_player_input = game.previous_player_input;
+
+    game.updates_down_held_count = update_held_count(player_input.down, previous_player_input.down, game.updates_down_held_count);
+    game.updates_left_held_count = update_held_count(player_input.left, previous_player_input.left, game.updates_left_held_count);
+    game.updates_right_held_count = update_held_count(player_input.right, previous_player_input.right, game.updates_right_held_count);
+    game.updates_clockwise_held_count = update_held_count(player_input.clockwise, previous_player_input.clockwise, game.updates_clockwise_held_count);
+    game.updates_anti_clockwise_held_count = update_held_count(player_input.anti_clockwise, previous_player_input.anti_clockwise, game.updates_anti_clockwise_held_count);
+
+    const bool should_move_tetrimino_left = game.left_was_pressed || is_actionable_input(player_input.left, previous_player_input.left, game.updates_left_held_count);
+    if (should_move_tetrimino_left) {
+        game.tetrimino = shift(game.tetrimino, Coordinates{-1, 0});
+        if (collision(game.tetrimino, game.grid)) {
+            game.tetrimino = shift(game.tetrimino, Coordinates{1, 0});
+        }
+    }
+
+    const bool should_move_tetrimino_right = game.right_was_pressed || is_actionable_input(player_input.right, previous_player_input.right, game.updates_right_held_count);
+    if (should_move_tetrimino_right) {
+        game.tetrimino = shift(game.tetrimino, Coordinates{1, 0});
+        if (collision(game.tetrimino, game.grid)) {
+            game.tetrimino = shift(game.tetrimino, Coordinates{-1, 0});
+        }
+    }
+
+    // Fastest we can get is 6 drops per second
+    const i32 difficulty_level = calculate_difficulty_level(game.total_rows_cleared);
+    const i32 updates_allowed = 120 - 5 * (difficulty_level - 1);
+    const i32 updates_allowed_before_drop = (updates_allowed < 10) ? 10 : updates_allowed;
+
+    bool should_merge_tetrimino_with_grid = false;
+    bool game_over = false;
+    const bool should_move_tetrimino_down = game.down_was_pressed || is_actionable_input(player_input.down, previous_player_input.down, game.updates_down_held_count) || game.updates_since_last_drop >= updates_allowed_before_drop;
+    if (should_move_tetrimino_down) {
+        game.tetrimino = shift(game.tetrimino, Coordinates{0, 1});
+        if (collision(game.tetrimino, game.grid)) {   // Then we need to merge tetrimino to grid and spawn another
+            game.tetrimino = shift(game.tetrimino, Coordinates{0, -1});
+            should_merge_tetrimino_with_grid = true;
+        }
+        
+        game.updates_since_last_drop = 0;
+    }
+
+    // TODO: should this go before attempting to drop tetrimino down/left/right?
+    if (!should_merge_tetrimino_with_grid) {
+        const bool should_rotate_tetrimino_clockwise = game.clockwise_was_pressed || is_actionable_input(player_input.clockwise, previous_player_input.clockwise, game.updates_clockwise_held_count);
+        if (should_rotate_tetrimino_clockwise) {
+            game.tetrimino = rotate(game.tetrimino, Tetris::Rotation::CLOCKWISE);
+            if (collision(game.tetrimino, game.grid) && !resolve_rotation_collision(game.tetrimino, game.grid)) {
+                game.tetrimino = rotate(game.tetrimino, Tetris::Rotation::ANTI_CLOCKWISE);
+            }
+        }
+
+        const bool should_rotate_tetrimino_anti_clockwise = game.anti_clockwise_was_pressed || is_actionable_input(player_input.anti_clockwise, previous_player_input.anti_clockwise, game.updates_anti_clockwise_held_count);
+        if (should_rotate_tetrimino_anti_clockwise) {
+            game.tetrimino = rotate(game.tetrimino, Tetris::Rotation::ANTI_CLOCKWISE);
+            if (collision(game.tetrimino, game.grid) && !resolve_rotation_collision(game.tetrimino, game.grid)) {
+                game.tetrimino = rotate(game.tetrimino, Tetris::Rotation::CLOCKWISE);
+            }
+        }
+    } else {
+        merge(game.tetrimino, game.grid);
+        game.tetrimino = construct_tetrimino(game.next_tetrimino.type, TETRIMINO_SPAWN_LOCATION);
+        game_over = collision(game.tetrimino, game.grid);
+        if (game_over) {
+            // reset
+            game.player_score = 0;
+            game.total_rows_cleared = 0;
+            game.updates_since_last_drop = 0;
+            game.grid = {};
+        }
+
+        game.rng_seed = random_number(game.rng_seed);
+        const Tetris::Tetrimino::Type next_tetrimino_type = static_cast<Tetris::Tetrimino::Type>(game.rng_seed % Tetris::Tetrimino::Type::COUNT);
+        game.next_tetrimino = construct_tetrimino(next_tetrimino_type, NEXT_TETRIMINO_DISPLAY_LOCATION);
+    }
+
+    const i32 rows_cleared = remove_completed_rows(game.grid);
+    game.total_rows_cleared += rows_cleared;
+    game.player_score += rows_cleared * 100 * difficulty_level;
+
+    game.down_was_pressed = false;
+    game.left_was_pressed = false;
+    game.right_was_pressed = false;
+    game.clockwise_was_pressed = false;
+    game.anti_clockwise_was_pressed = false;
+
+    ++game.updates_since_last_drop;
+
+    return game_over;
+}
@@ -0,0 +1,51 @@
+#ifndef TETRIS_GAME_H
+#define TETRIS_GAME_H
+
+#include "tetris_ai.h"
+#include "tetris.h"
+#include "training_data.h"
+#include "types.h"
+
+// A game of Tetris and nothing else, no drawing, timing or files, so the game and the headless self play tool
+// play by exactly the same rules. It moves on an update at a time.
+struct TetrisGame {
+    PlayerInput previous_player_input;
+
+    Tetris::Grid grid;
+    Tetris::Tetrimino tetrimino;
+    Tetris::Tetrimino next_tetrimino;
+
+    i32 player_score;
+    i32 total_rows_cleared;
+    i32 updates_since_last_drop;
+
+    u32 updates_down_held_count;
+    u32 updates_left_held_count;
+    u32 updates_right_held_count;
+    u32 updates_clockwise_held_count;
+    u32 updates_anti_clockwise_held_count;
+
+    bool down_was_pressed;
+    bool left_was_pressed;
+    bool right_was_pressed;
+    bool clockwise_was_pressed;
+    bool anti_clockwise_was_pressed;
+
+    u32 rng_seed;
+};
+
+static constexpr Coordinates TETRIMINO_SPAWN_LOCATION = Coordinates{4, 0};
+static constexpr Coordinates NEXT_TETRIMINO_DISPLAY_LOCATION = Coordinates{15, 13};
+
+static i32 calculate_difficulty_level(i32 total_rows_cleared);
+static u32 game_state_to_binary_game_state(i32 total_rows_cleared, Tetris::Tetrimino::Type next_tetrimino_type, const Tetris::Tetrimino& tetrimino, const Tetris::Grid& grid, BinaryGameState& binary_game_state);
+static u32 tetris_game_to_binary_game_state(const TetrisGame& game, BinaryGameState& binary_game_state);
+static BinaryPlayerInput player_input_to_binary_player_input(const PlayerInput& player_input);
+static PlayerInput binary_player_input_to_player_input(BinaryPlayerInput binary_player_input);
+static u32 update_held_count(bool pressed, bool previously_pressed, u32 updates_held_count);
+static bool is_actionable_input(bool pressed, bool previously_pressed, u32 updates_in_held_state);
+static void start_tetris_game(TetrisGame& game, u32 rng_seed);
+static void latch_pressed_inputs(TetrisGame& game, const PlayerInput& player_input);
+static bool step_tetris_game(TetrisGame& game, const PlayerInput& player_input);
+
+#endif
@@ -0,0 +1,402 @@
+// Helpers shared by the Linux command line tools, these stand in for the Platform layer the game gets
+// from tetris_ai_win32.cpp. Expects neural_network.cpp, kernel_tuning.cpp and training_data.cpp to be included
+// first.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static f64 seconds_now() {
+    timespec time = {};
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return static_cast<f64>(time.tv_sec) + static_cast<f64>(time.tv_nsec) * 1e-9;
+}
+
+// advice is the madvise() hint for how this use reads the file, MADV_NORMAL when it doesn't matter
+static const void* map_whole_file(const char* const file_name, const int advice, u64& size) {
+    const int file = open(file_name, O_RDONLY);
+    if (file < 0) {
+        return nullptr;
+    }
+
+    struct stat file_stat = {};
+    void* data = MAP_FAILED;
+    if (fstat(file, &file_stat) == 0 && file_stat.st_size > 0) {
+        data = mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    }
+
+    if (data != MAP_FAILED) {
+        madvise(data, static_cast<size_t>(file_stat.st_size), advice);
+    }
+
+    close(file);
+    size = static_cast<u64>(file_stat.st_size);
+
+    return (data == MAP_FAILED) ? nullptr : data;
+}
+
+static bool load_model_file(const char* const file_name, NeuralNetwork& neural_network) {
+    u64 size = 0;
+    const i8* const data = static_cast<const i8*>(map_whole_file(file_name, MADV_NORMAL, size));
+    if (data == nullptr) {
+        return false;
+    }
+
+    ModelView model_view = {};
+    bool loaded = view_model_in_buffer(data, size, model_view);
+    if (loaded) {
+        neural_network = *model_view.neural_network;
+    } else {
+        loaded = size <= 0xFFFFFFFF && load_from_buffer(neural_network, data, static_cast<u32>(size)) == size;
+    }
+
+    munmap(const_cast<i8*>(data), size);
+
+    return loaded;
+}
+
+// Same temporary file and rename dance as the game so a failed run never leaves a truncated file
+static bool replace_whole_file(const char* const file_name, const i8* const data, const u64 size) {
+    char temp_file_name[4096] = {};
+    snprintf(temp_file_name, sizeof(temp_file_name), "%s.tmp", file_name);
+
+    bool saved = false;
+    FILE* const file = fopen(temp_file_name, "wb");
+    if (file != nullptr) {
+        saved = fwrite(data, 1, size, file) == size;
+        saved = fflush(file) == 0 && fsync(fileno(file)) == 0 && saved;
+        saved = fclose(file) == 0 && saved;
+        saved = saved && rename(temp_file_name, file_name) == 0;
+    }
+
+    return saved;
+}
+
+static bool save_model_file(const char* const file_name, const NeuralNetwork& neural_network) {
+    const u32 file_size = model_file_size(ModelElementType::F32);
+    i8* const buffer = static_cast<i8*>(aligned_alloc(MODEL_SECTION_ALIGNMENT, file_size));
+    const u32 bytes_to_write = save_model_to_buffer(neural_network, nullptr, ModelElementType::F32, buffer, file_size);
+    const bool saved = replace_whole_file(file_name, buffer, bytes_to_write);
+    free(buffer);
+
+    return saved;
+}
+
+// Shard file names in a training data manifest are relative to the directory the manifest is in
+static void shard_file_path(const char* const manifest_file_name, const char* const shard_file_name, char* const path, const u64 path_size) {
+    const char* const last_slash = strrchr(manifest_file_name, '/');
+    const int directory_length = (last_slash != nullptr) ? static_cast<int>(last_slash + 1 - manifest_file_name) : 0;
+    snprintf(path, path_size, "%.*s%s", directory_length, manifest_file_name, shard_file_name);
+}
+
+// Shards are named after the manifest without its extension, false if the name doesn't fit
+static bool manifest_shard_file_name(const char* const manifest_file_name, const u32 shard_index, char* const file_name, const u64 file_name_size) {
+    const char* const last_slash = strrchr(manifest_file_name, '/');
+    const char* const base_name = (last_slash != nullptr) ? last_slash + 1 : manifest_file_name;
+    const char* const extension = strrchr(base_name, '.');
+    const int stem_length = (extension != nullptr && extension != base_name) ? static_cast<int>(extension - base_name) : static_cast<int>(strlen(base_name));
+    const int name_length = snprintf(file_name, file_name_size, "%.*s_%05u.bin", stem_length, base_name, shard_index);
+    return name_length >= 0 && static_cast<u64>(name_length) < file_name_size;
+}
+
+// Most records a framed file of this size can unframe to
+static u64 max_unframed_training_data_size(const u64 framed_size) {
+    const u64 frame_count = (framed_size + TRAINING_DATA_FRAME_SIZE - 1) / TRAINING_DATA_FRAME_SIZE;
+    return frame_count * TRAINING_DATA_FRAME_RECORD_COUNT * TRAINING_RECORD_SIZE;
+}
+
+// A framed file's records (see TrainingDataFrameHeader) into records, any damaged frames are left out. Returns
+// the number of records.
+static u64 unframe_training_records(const char* const file_name, const void* const framed_file, const u64 size, i8* const records) {
+    u32 previous_checksum = 0;
+    u64 damaged_frame_count = 0;
+    const u64 record_count = unframe_training_data(framed_file, size, 0, previous_checksum, records, damaged_frame_count);
+    if (damaged_frame_count != 0) {
+        fprintf(stderr, "left out %llu damaged frames of %s\n", static_cast<unsigned long long>(damaged_frame_count), file_name);
+    }
+
+    return record_count;
+}
+
+// Same in memory of their own. Takes the mapping over and unmaps it, size goes from the file's to the records'.
+static const void* unframe_training_data_file(const char* const file_name, const void* const framed_file, u64& size) {
+    void* const records = mmap(nullptr, max_unframed_training_data_size(size), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    const u64 record_count = (records != MAP_FAILED) ? unframe_training_records(file_name, framed_file, size, static_cast<i8*>(records)) : 0;
+    munmap(const_cast<void*>(framed_file), size);
+    size = record_count * TRAINING_RECORD_SIZE;
+
+    return (records == MAP_FAILED) ? nullptr : records;
+}
+
+// Goes through training data a piece at a time so no more than one shard of a manifest has to be in memory. A
+// manifest's pieces are its shards in order, anything else is a single piece, unframed first if the game
+// recorded it. Finished shards are checked against the manifest as they're read.
+struct TrainingDataPieces {
+    const char* file_name;
+    const void* data;                   // the file as given to open_training_data_pieces()
+    u64 size;
+    TrainingDataManifestView manifest;  // no shards unless the file is a manifest
+    bool is_manifest;
+    u32 next_piece;
+    const void* shard_file;             // mapped while its shard is the current piece
+    u64 shard_file_size;
+    i8* records;                        // unframed records of the current piece, reused for every one
+    u64 records_capacity;
+    bool failed;                        // a piece couldn't be read, as opposed to there being none left
+};
+
+// data is the mapped file, or records already in memory, and is left to the caller. False if it's a damaged
+// manifest.
+static bool open_training_data_pieces(const char* const file_name, const void* const data, const u64 size, TrainingDataPieces& pieces) {
+    pieces = {};
+    pieces.file_name = file_name;
+    pieces.data = data;
+    pieces.size = size;
+    pieces.is_manifest = is_training_data_manifest(data, size);
+    if (pieces.is_manifest && !view_training_data_manifest(data, size, pieces.manifest)) {
+        fprintf(stderr, "%s is damaged\n", file_name);
+        return false;
+    }
+
+    return true;
+}
+
+static bool view_training_data_piece(TrainingDataPieces& pieces, const char* const file_name, const void* const data, const u64 size, TrainingDataView& piece) {
+    u64 records_size = size;
+    const void* records = data;
+    if (is_framed_training_data(data, size)) {
+        const u64 max_records_size = max_unframed_training_data_size(size);
+        if (max_records_size > pieces.records_capacity) {
+            free(pieces.records);
+            pieces.records = static_cast<i8*>(malloc(max_records_size));
+            pieces.records_capacity = max_records_size;
+        }
+
+        records_size = unframe_training_records(file_name, data, size, pieces.records) * TRAINING_RECORD_SIZE;
+        records = pieces.records;
+    }
+
+    if (!view_training_data(records, records_size, piece)) {
+        fprintf(stderr, "couldn't map any training records from %s\n", file_name);
+        return false;
+    }
+
+    if (piece.trailing_byte_count != 0) {
+        fprintf(stderr, "ignoring %u trailing bytes of a partial record in %s\n", piece.trailing_byte_count, file_name);
+    }
+
+    return true;
+}
+
+// False once there are no pieces left or one couldn't be read, see failed. The piece is only good until the
+// next call.
+static bool next_training_data_piece(TrainingDataPieces& pieces, TrainingDataView& piece) {
+    if (pieces.shard_file != nullptr) {
+        munmap(const_cast<void*>(pieces.shard_file), pieces.shard_file_size);
+        pieces.shard_file = nullptr;
+    }
+
+    if (pieces.failed) {
+        return false;
+    }
+
+    if (!pieces.is_manifest) {
+        if (pieces.next_piece++ != 0) {
+            return false;
+        }
+
+        pieces.failed = !view_training_data_piece(pieces, pieces.file_name, pieces.data, pieces.size, piece);
+        return !pieces.failed;
+    }
+
+    while (pieces.next_piece < pieces.manifest.shard_count) {
+        const TrainingDataShard& shard = pieces.manifest.shards[pieces.next_piece++];
+        char shard_file_name[4096] = {};
+        shard_file_path(pieces.file_name, shard.file_name, shard_file_name, sizeof(shard_file_name));
+
+        // the shard being recorded into can be empty or not there yet
+        const bool finished = (shard.flags & TRAINING_DATA_SHARD_FINISHED) != 0;
+        struct stat shard_stat = {};
+        if (!finished && (stat(shard_file_name, &shard_stat) != 0 || shard_stat.st_size < static_cast<off_t>(TRAINING_RECORD_SIZE))) {
+            continue;
+        }
+
+        pieces.shard_file = map_whole_file(shard_file_name, MADV_SEQUENTIAL, pieces.shard_file_size);
+        if (pieces.shard_file == nullptr) {
+            fprintf(stderr, "couldn't map %s\n", shard_file_name);
+            pieces.failed = true;
+            return false;
+        }
+
+        if (!view_training_data_piece(pieces, shard_file_name, pieces.shard_file, pieces.shard_file_size, piece)) {
+            pieces.failed = true;
+            return false;
+        }
+
+        const bool intact = !finished || (piece.record_count == shard.record_count &&
+            crc32c(piece.records, static_cast<u64>(piece.record_count) * TRAINING_RECORD_SIZE) == shard.checksum);
+        if (!intact) {
+            fprintf(stderr, "%s doesn't match the manifest\n", shard_file_name);
+            pieces.failed = true;
+            return false;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+static void close_training_data_pieces(TrainingDataPieces& pieces) {
+    if (pieces.shard_file != nullptr) {
+        munmap(const_cast<void*>(pieces.shard_file), pieces.shard_file_size);
+    }
+
+    free(pieces.records);
+    pieces = {};
+}
+
+// Sets view to the records of a mapped training data file, whether plain records, a framed file the game
+// recorded or a manifest for a set of shards of either, which are copied one after the other into a single
+// buffer. Takes the mapping over, anything else it might be is read as plain records so tools that take other
+// formats have to check for them first.
+static bool view_training_data_file(const char* const file_name, const void* const data, const u64 size, TrainingDataView& view) {
+    TrainingDataPieces pieces = {};
+    if (!open_training_data_pieces(file_name, data, size, pieces)) {
+        munmap(const_cast<void*>(data), size);
+        return false;
+    }
+
+    // the one piece is either the mapping itself or records unframed from it, which the view keeps
+    if (!pieces.is_manifest) {
+        const bool loaded = next_training_data_piece(pieces, view);
+        if (pieces.records != nullptr) {
+            munmap(const_cast<void*>(data), size);
+        }
+
+        return loaded;
+    }
+
+    i8* records = nullptr;
+    u64 records_size = 0;
+    TrainingDataView piece = {};
+    while (next_training_data_piece(pieces, piece)) {
+        const u64 piece_size = static_cast<u64>(piece.record_count) * TRAINING_RECORD_SIZE;
+        records = static_cast<i8*>(realloc(records, records_size + piece_size));
+        memcpy(records + records_size, piece.records, piece_size);
+        records_size += piece_size;
+    }
+
+    const bool loaded = !pieces.failed;
+    close_training_data_pieces(pieces);
+    munmap(const_cast<void*>(data), size);
+    if (loaded && !view_training_data(records, records_size, view)) {
+        fprintf(stderr, "couldn't load any training records from the shards of %s\n", file_name);
+        return false;
+    }
+
+    return loaded;
+}
+
+// advice is for how the records get read, it only makes a difference to a file of plain records since those are
+// used in place, the others are read through once into memory of their own
+static bool load_training_data(const char* const file_name, const int advice, TrainingDataView& view) {
+    u64 size = 0;
+    const void* const data = map_whole_file(file_name, advice, size);
+    if (data == nullptr) {
+        fprintf(stderr, "couldn't map %s\n", file_name);
+        return false;
+    }
+
+    return view_training_data_file(file_name, data, size, view);
+}
+
+// Streams a file out to a temporary file, renamed over the real one only once it's all safely on disk
+struct DatasetWriter {
+    FILE* file;
+    const char* file_name;
+    char temp_file_name[4096];
+    bool failed;
+};
+
+static bool open_dataset_writer(const char* const file_name, DatasetWriter& writer) {
+    writer = {};
+    writer.file_name = file_name;
+    snprintf(writer.temp_file_name, sizeof(writer.temp_file_name), "%s.tmp", file_name);
+    writer.file = fopen(writer.temp_file_name, "wb");
+    if (writer.file == nullptr) {
+        fprintf(stderr, "couldn't create %s\n", writer.temp_file_name);
+        return false;
+    }
+
+    return true;
+}
+
+static void write_dataset(DatasetWriter& writer, const void* const data, const u64 size) {
+    writer.failed = writer.failed || fwrite(data, 1, size, writer.file) != size;
+}
+
+static bool close_dataset_writer(DatasetWriter& writer) {
+    bool saved = !writer.failed;
+    saved = fflush(writer.file) == 0 && fsync(fileno(writer.file)) == 0 && saved;
+    saved = fclose(writer.file) == 0 && saved;
+    saved = saved && rename(writer.temp_file_name, writer.file_name) == 0;
+    if (!saved) {
+        remove(writer.temp_file_name);
+        fprintf(stderr, "couldn't write %s\n", writer.file_name);
+    }
+
+    return saved;
+}
+
+// The tuner's settings for this machine, or the defaults when the file has none
+static KernelTuning load_kernel_tuning_file(const char* const file_name) {
+    KernelTuning tuning = DEFAULT_KERNEL_TUNING;
+    u64 size = 0;
+    const i8* const data = static_cast<const i8*>(map_whole_file(file_name, MADV_NORMAL, size));
+    if (data != nullptr) {
+        find_kernel_tuning(data, size, current_kernel_tuning_key(), tuning);
+        munmap(const_cast<i8*>(data), size);
+    }
+
+    return tuning;
+}
+
+// Held out accuracy of a model, the cost is the same quadratic cost back propagation minimises
+struct Evaluation {
+    f64 cost;
+    f64 output_accuracy;        // fraction of individual outputs on the right side of 0.5
+    f64 exact_match_accuracy;   // fraction of records with every output right
+};
+
+// Call once per record, then finish_evaluation() turns the totals into means
+static void add_to_evaluation(const NeuralNetwork::OutputLayer& output, const NeuralNetwork::OutputLayer& target, Evaluation& evaluation) {
+    bool exact_match = true;
+    for (i32 i = 0; i < NeuralNetwork::OUTPUT_LAYER_SIZE; ++i) {
+        const f32 error = output[i] - target[i];
+        evaluation.cost += 0.5 * error * error;
+
+        const bool correct = (output[i] >= 0.5f) == (target[i] >= 0.5f);
+        evaluation.output_accuracy += correct ? 1.0 : 0.0;
+        exact_match = exact_match && correct;
+    }
+
+    evaluation.exact_match_accuracy += exact_match ? 1.0 : 0.0;
+}
+
+static void finish_evaluation(Evaluation& evaluation, const u32 record_count) {
+    evaluation.cost /= record_count;
+    evaluation.output_accuracy /= static_cast<f64>(record_count) * NeuralNetwork::OUTPUT_LAYER_SIZE;
+    evaluation.exact_match_accuracy /= record_count;
+}
+
+static void print_evaluation(const char* const name, const Evaluation& evaluation) {
+    printf("%s cost: %.6f\n", name, evaluation.cost);
+    printf("%s output accuracy: %.4f\n", name, evaluation.output_accuracy);
+    printf("%s exact match accuracy: %.4f\n", name, evaluation.exact_match_accuracy);
+}
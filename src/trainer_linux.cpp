@@ -0,0 +1,745 @@
+// Offline trainer, runs the same full batch training as the game but split across several local processes.
+// Each process owns a contiguous shard of the training data and the per epoch deltas are summed with a ring
+// all-reduce over shared memory, after which every process applies the same delta to its copy of the weights.
+//
+// Usage: trainer [--processes N] [--epochs N] [--seed N] [--deterministic] [--stratified-batch N] [--balance B]
+//                [--held-out FRACTION] [--training-data FILE] [--model FILE] [--output FILE]
+// Starts from the model file if there is one, otherwise from random weights generated from the seed. For the same
+// starting weights, data and process count the result is bit identical run to run, with one process it's also
+// identical to what the game's train() produces.
+//
+// --deterministic drops the dependence on the process count too, for comparing runs on different machines or with
+// different settings. The records are split into REDUCTION_GROUP_COUNT fixed groups each summed in file order,
+// then the group deltas are added with a fixed pairwise tree in shared memory. Processes only decide who does
+// which part of that work, never the order of any addition. It costs a little speed and matches train() no longer.
+// A weights checksum is printed after every epoch either way so runs can be compared as they go.
+//
+// The training data can also be a file from the compressor or a framed one the game recorded, either is decoded
+// once up front before the processes start, or a weighted file from the deduplicator, whose samples are what
+// gets split between the processes, or a columnar file from the columnizer, which trains to the same weights as
+// the records it was made from, or a manifest for a set of shards, whose records are trained on as if they were
+// all in one file in shard order. Every shard is loaded on its own and finished ones are checked against their
+// checksums before training.
+//
+// --stratified-batch N trains on mini-batches of about N samples instead, an epoch being as many batches as it
+// takes to draw about as many samples as there are. The samples are indexed by the buttons held in them and each
+// batch draws a quota from every combination that turns up, in proportion to its record count to the power 1 - B
+// for --balance B (0.5 unless given, 0 is proportional, 1 an equal share each). Each draw's loss weight puts its
+// class back to the share it has of the data, so rare rotations and sideways moves get steadier estimates without
+// changing what's being fitted. Every rank draws the same batches from the seed, so results are as reproducible
+// as full batch training's.
+//
+// --held-out FRACTION keeps the last FRACTION of the samples, the most recently recorded games, out of training
+// and prints their cost and accuracy after every epoch, to see how quickly different settings converge. Samples
+// of a weighted file count once each however many records they stand for.
+
+#include "neural_network.h"
+#include "kernel_tuning.h"
+#include "convolutional_neural_network.h"
+#include "training_data.h"
+#include "compressed_training_data.h"
+#include "columnar_training_data.h"
+#include "all_reduce.h"
+
+#include "util.cpp"
+#include "simd.cpp"
+#include "neural_network.cpp"
+#include "kernel_tuning.cpp"
+#include "convolutional_neural_network.cpp"
+#include "training_data.cpp"
+#include "compressed_training_data.cpp"
+#include "columnar_training_data.cpp"
+#include "all_reduce.cpp"
+#include "tools_linux.cpp"
+
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static constexpr u32 MAX_PROCESS_COUNT = 64;
+static constexpr u32 DELTA_FLOAT_COUNT = sizeof(PackedNeuralNetworkDelta) / sizeof(f32);
+static constexpr u32 REDUCTION_GROUP_COUNT = MAX_PROCESS_COUNT;    // leaves of the deterministic reduction tree
+
+// Single producer, single consumer mailbox owned by the receiving rank, holds one chunk at a time
+struct alignas(64) SharedMemorySlot {
+    u64 sent_count;
+    alignas(64) u64 received_count;
+    alignas(64) f32 data[DELTA_FLOAT_COUNT / 2 + 1];
+};
+
+struct SharedMemoryRing {
+    alignas(64) u32 failed;
+    SharedMemorySlot slots[MAX_PROCESS_COUNT];
+
+    // deterministic mode only, the pages aren't touched otherwise
+    alignas(64) u32 barrier_arrived_count;
+    alignas(64) u32 barrier_generation;
+    PackedNeuralNetworkDelta group_deltas[REDUCTION_GROUP_COUNT];
+};
+
+struct SharedMemoryTransport {
+    SharedMemoryRing* ring;
+    u32 rank;
+    u32 rank_count;
+    const pid_t* child_process_ids;     // rank 0 only, used to notice a worker dying while we wait on it
+};
+
+static bool wait_for_ring(SharedMemoryTransport& transport) {
+    if (__atomic_load_n(&transport.ring->failed, __ATOMIC_ACQUIRE) != 0) {
+        return false;
+    }
+
+    if (transport.rank == 0) {
+        // a worker that finished cleanly may exit while we're still reading what it last sent, only a worker
+        // that died or failed breaks the ring, and it's left unreaped for main to collect
+        for (u32 i = 1; i < transport.rank_count; ++i) {
+            siginfo_t child_info = {};
+            const int result = waitid(P_PID, static_cast<id_t>(transport.child_process_ids[i]), &child_info, WEXITED | WNOHANG | WNOWAIT);
+            const bool exited_cleanly = child_info.si_code == CLD_EXITED && child_info.si_status == 0;
+            if (result != 0 || (child_info.si_pid != 0 && !exited_cleanly)) {
+                __atomic_store_n(&transport.ring->failed, 1, __ATOMIC_RELEASE);
+                return false;
+            }
+        }
+    }
+
+    sched_yield();
+    return true;
+}
+
+static bool shared_memory_send_to_next_rank(void* const context, const f32* const data, const u32 count) {
+    SharedMemoryTransport& transport = *static_cast<SharedMemoryTransport*>(context);
+    SharedMemorySlot& slot = transport.ring->slots[(transport.rank + 1) % transport.rank_count];
+    if (count > sizeof(slot.data) / sizeof(f32)) {
+        return false;
+    }
+
+    while (__atomic_load_n(&slot.received_count, __ATOMIC_ACQUIRE) != slot.sent_count) {
+        if (!wait_for_ring(transport)) {
+            return false;
+        }
+    }
+
+    memcpy(slot.data, data, count * sizeof(f32));
+    __atomic_store_n(&slot.sent_count, slot.sent_count + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+static bool shared_memory_receive_from_previous_rank(void* const context, f32* const data, const u32 count) {
+    SharedMemoryTransport& transport = *static_cast<SharedMemoryTransport*>(context);
+    SharedMemorySlot& slot = transport.ring->slots[transport.rank];
+    while (__atomic_load_n(&slot.sent_count, __ATOMIC_ACQUIRE) == slot.received_count) {
+        if (!wait_for_ring(transport)) {
+            return false;
+        }
+    }
+
+    memcpy(data, slot.data, count * sizeof(f32));
+    __atomic_store_n(&slot.received_count, slot.received_count + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+// Decodes into memory the child processes share with the parent, unmaps the compressed file either way. Sets
+// size to the decoded size, returns null if the file is damaged.
+static const void* decompress_training_data_file(const i8* const compressed_file, u64& size) {
+    CompressedTrainingDataView compressed_training_data = {};
+    void* records = MAP_FAILED;
+    if (view_compressed_training_data(compressed_file, size, compressed_training_data)) {
+        const u64 records_size = static_cast<u64>(compressed_training_data.header.record_count) * TRAINING_RECORD_SIZE;
+        records = mmap(nullptr, records_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (records != MAP_FAILED && !decompress_training_data(compressed_training_data, static_cast<i8*>(records))) {
+            munmap(records, records_size);
+            records = MAP_FAILED;
+        }
+
+        munmap(const_cast<i8*>(compressed_file), size);
+        size = records_size;
+    } else {
+        munmap(const_cast<i8*>(compressed_file), size);
+    }
+
+    return (records == MAP_FAILED) ? nullptr : records;
+}
+
+struct TrainingJob {
+    const TrainingDataView* shards;         // one for a single file of records
+    u32 shard_count;
+    const WeightedTrainingSample* samples;  // trained on instead of shards when there are any
+    ColumnarTrainingDataView columnar;      // likewise when it has any blocks
+    u32 sample_count;   // records or weighted samples, whichever the ranks split between them
+    u32 record_count;   // the delta is averaged over these either way
+    u32 epoch_count;
+    bool deterministic;
+
+    // stratified mini-batches instead of full batches when there's an index
+    const TrainingActionIndex* action_index;
+    const u32* class_quotas;
+    u32 batch_draw_count;
+    u32 batches_per_epoch;
+    u64 rng_seed;
+
+    u32 held_out_count;     // samples after the sample_count trained on, evaluated on after every epoch
+};
+
+// Copies out one of the samples the ranks split between them and returns how many records it stands for
+static u32 copy_job_sample(const TrainingJob& job, const u32 sample_index, i8* const record) {
+    if (job.samples != nullptr) {
+        memcpy(record, job.samples[sample_index].record, TRAINING_RECORD_SIZE);
+        return job.samples[sample_index].weight;
+    }
+
+    if (job.columnar.blocks != nullptr) {
+        columnar_training_record(job.columnar, sample_index, record);
+        return 1;
+    }
+
+    u32 shard = 0;
+    u32 shard_first_record = 0;
+    while (sample_index - shard_first_record >= job.shards[shard].record_count) {
+        shard_first_record += job.shards[shard].record_count;
+        ++shard;
+    }
+
+    memcpy(record, training_record(job.shards[shard], sample_index - shard_first_record), TRAINING_RECORD_SIZE);
+    return 1;
+}
+
+// Back propagates draws [first_draw, last_draw) of a stratified batch, each scaled by its loss weight
+static void accumulate_draws_delta(const TrainingJob& job, const StratifiedDraw* const draws, const PackedNeuralNetwork& packed_neural_network, const u32 first_draw, const u32 last_draw, PackedNeuralNetworkDelta& neural_network_delta) {
+    alignas(64) NeuralNetwork::InputLayer inputs[TRAINING_DECODE_BATCH_SIZE];
+    NeuralNetwork::OutputLayer targets[TRAINING_DECODE_BATCH_SIZE];
+    i8 records[TRAINING_DECODE_BATCH_SIZE * TRAINING_RECORD_SIZE];
+    f32 weights[TRAINING_DECODE_BATCH_SIZE];
+    for (u32 draw = first_draw; draw < last_draw; draw += TRAINING_DECODE_BATCH_SIZE) {
+        const u32 draws_left = last_draw - draw;
+        const u32 batch_size = (draws_left < TRAINING_DECODE_BATCH_SIZE) ? draws_left : TRAINING_DECODE_BATCH_SIZE;
+        for (u32 i = 0; i < batch_size; ++i) {
+            const u32 sample_weight = copy_job_sample(job, draws[draw + i].sample_index, records + i * TRAINING_RECORD_SIZE);
+            weights[i] = draws[draw + i].loss_weight * static_cast<f32>(sample_weight);
+        }
+
+        decode_training_records(records, TRAINING_RECORD_SIZE, batch_size, KernelVariant::AVX512, inputs, targets);
+        for (u32 i = 0; i < batch_size; ++i) {
+            back_propagate(packed_neural_network, inputs[i], targets[i], weights[i], neural_network_delta);
+        }
+    }
+}
+
+// Cost and accuracy over the held out samples, decoded afresh every time so they take no memory between epochs
+static Evaluation evaluate_held_out(const TrainingJob& job, const PackedNeuralNetwork& packed_neural_network) {
+    alignas(64) NeuralNetwork::InputLayer inputs[TRAINING_DECODE_BATCH_SIZE];
+    NeuralNetwork::OutputLayer targets[TRAINING_DECODE_BATCH_SIZE];
+    i8 records[TRAINING_DECODE_BATCH_SIZE * TRAINING_RECORD_SIZE];
+    Evaluation evaluation = {};
+    const u32 last_sample = job.sample_count + job.held_out_count;
+    for (u32 sample = job.sample_count; sample < last_sample; sample += TRAINING_DECODE_BATCH_SIZE) {
+        const u32 samples_left = last_sample - sample;
+        const u32 batch_size = (samples_left < TRAINING_DECODE_BATCH_SIZE) ? samples_left : TRAINING_DECODE_BATCH_SIZE;
+        for (u32 i = 0; i < batch_size; ++i) {
+            copy_job_sample(job, sample + i, records + i * TRAINING_RECORD_SIZE);
+        }
+
+        decode_training_records(records, TRAINING_RECORD_SIZE, batch_size, KernelVariant::AVX512, inputs, targets);
+        for (u32 i = 0; i < batch_size; ++i) {
+            NeuralNetwork::OutputLayer output = {};
+            feed_forward(packed_neural_network, inputs[i], output);
+            add_to_evaluation(output, targets[i], evaluation);
+        }
+    }
+
+    finish_evaluation(evaluation, job.held_out_count);
+
+    return evaluation;
+}
+
+// The range is of draws when there are any, otherwise of samples
+static void accumulate_job_delta(const TrainingJob& job, const StratifiedDraw* const draws, const PackedNeuralNetwork& packed_neural_network, const u32 first_sample, const u32 last_sample, PackedNeuralNetworkDelta& neural_network_delta) {
+    if (draws != nullptr) {
+        accumulate_draws_delta(job, draws, packed_neural_network, first_sample, last_sample, neural_network_delta);
+    } else if (job.samples != nullptr) {
+        accumulate_training_delta(packed_neural_network, job.samples, first_sample, last_sample - first_sample, neural_network_delta);
+    } else if (job.columnar.blocks != nullptr) {
+        accumulate_training_delta(packed_neural_network, job.columnar, first_sample, last_sample - first_sample, neural_network_delta);
+    } else {
+        // the part of the range in each shard in turn, which adds up in the same order as one file would
+        u32 shard_first_record = 0;
+        for (u32 i = 0; i < job.shard_count && shard_first_record < last_sample; ++i) {
+            const TrainingDataView& shard = job.shards[i];
+            const u32 shard_last_record = shard_first_record + shard.record_count;
+            const u32 first_record = (first_sample > shard_first_record) ? first_sample : shard_first_record;
+            const u32 last_record = (last_sample < shard_last_record) ? last_sample : shard_last_record;
+            if (first_record < last_record) {
+                accumulate_training_delta(packed_neural_network, shard.records, first_record - shard_first_record, last_record - first_record, neural_network_delta);
+            }
+
+            shard_first_record = shard_last_record;
+        }
+    }
+}
+
+// Maps every shard in the manifest, false if any are missing or don't match what the manifest says about them
+static bool map_training_data_shards(const char* const manifest_file_name, const TrainingDataManifestView& manifest, const int advice, TrainingDataView* const shards, u32& record_count) {
+    record_count = 0;
+    for (u32 i = 0; i < manifest.shard_count; ++i) {
+        const TrainingDataShard& shard = manifest.shards[i];
+        char shard_file_name[4096] = {};
+        shard_file_path(manifest_file_name, shard.file_name, shard_file_name, sizeof(shard_file_name));
+
+        // a shard still being recorded into can be empty, or not even created yet
+        u64 shard_size = 0;
+        const void* shard_data = map_whole_file(shard_file_name, advice, shard_size);
+        if (is_framed_training_data(shard_data, shard_size)) {
+            shard_data = unframe_training_data_file(shard_file_name, shard_data, shard_size);
+        }
+
+        const bool finished = (shard.flags & TRAINING_DATA_SHARD_FINISHED) != 0;
+        shards[i] = {};
+        if (!view_training_data(shard_data, shard_size, shards[i]) && (finished || shard_size >= TRAINING_RECORD_SIZE)) {
+            fprintf(stderr, "couldn't map any training records from %s\n", shard_file_name);
+            return false;
+        }
+
+        const u64 records_size = static_cast<u64>(shards[i].record_count) * TRAINING_RECORD_SIZE;
+        const bool intact = !finished ||
+            (shards[i].record_count == shard.record_count && crc32c(shards[i].records, records_size) == shard.checksum);
+        if (!intact) {
+            fprintf(stderr, "%s doesn't match the manifest\n", shard_file_name);
+            return false;
+        }
+
+        if (static_cast<u64>(record_count) + shards[i].record_count > MAX_TRAINING_RECORD_COUNT) {
+            fprintf(stderr, "more than %llu records in the shards\n", static_cast<unsigned long long>(MAX_TRAINING_RECORD_COUNT));
+            return false;
+        }
+
+        record_count += shards[i].record_count;
+    }
+
+    return true;
+}
+
+// Sense reversing barrier across every rank, gives up like the ring does when a rank has died
+static bool wait_for_all_ranks(SharedMemoryTransport& transport) {
+    SharedMemoryRing& ring = *transport.ring;
+    const u32 generation = __atomic_load_n(&ring.barrier_generation, __ATOMIC_ACQUIRE);
+    if (__atomic_add_fetch(&ring.barrier_arrived_count, 1, __ATOMIC_ACQ_REL) == transport.rank_count) {
+        __atomic_store_n(&ring.barrier_arrived_count, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&ring.barrier_generation, generation + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    while (__atomic_load_n(&ring.barrier_generation, __ATOMIC_ACQUIRE) == generation) {
+        if (!wait_for_ring(transport)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static u32 share_start(const u32 share, const u32 count, const u32 share_count) {
+    return static_cast<u32>(static_cast<u64>(count) * share / share_count);
+}
+
+// Leaves the step's summed delta over item_count samples or draws in neural_network_delta. Each rank fills in its
+// groups' leaves, then adds up its slice of the floats across all the leaves, so no addition depends on how many
+// ranks there are.
+static bool reduce_deterministically(SharedMemoryTransport& transport, const TrainingJob& job, const StratifiedDraw* const draws, const u32 item_count, const PackedNeuralNetwork& packed_neural_network, PackedNeuralNetworkDelta& neural_network_delta) {
+    PackedNeuralNetworkDelta* const group_deltas = transport.ring->group_deltas;
+    const u32 first_group = share_start(transport.rank, REDUCTION_GROUP_COUNT, transport.rank_count);
+    const u32 last_group = share_start(transport.rank + 1, REDUCTION_GROUP_COUNT, transport.rank_count);
+    for (u32 group = first_group; group < last_group; ++group) {
+        const u32 first_item = share_start(group, item_count, REDUCTION_GROUP_COUNT);
+        const u32 last_item = share_start(group + 1, item_count, REDUCTION_GROUP_COUNT);
+        memset(&group_deltas[group], 0, sizeof(PackedNeuralNetworkDelta));
+        accumulate_job_delta(job, draws, packed_neural_network, first_item, last_item, group_deltas[group]);
+    }
+
+    if (!wait_for_all_ranks(transport)) {
+        return false;
+    }
+
+    const u32 first_float = share_start(transport.rank, DELTA_FLOAT_COUNT, transport.rank_count);
+    const u32 last_float = share_start(transport.rank + 1, DELTA_FLOAT_COUNT, transport.rank_count);
+    pairwise_tree_reduce(reinterpret_cast<f32*>(group_deltas), REDUCTION_GROUP_COUNT, DELTA_FLOAT_COUNT, first_float, last_float);
+    if (!wait_for_all_ranks(transport)) {
+        return false;
+    }
+
+    memcpy(&neural_network_delta, &group_deltas[0], sizeof(PackedNeuralNetworkDelta));
+
+    // nobody may start overwriting the leaves for the next epoch until everyone has the sum
+    return wait_for_all_ranks(transport);
+}
+
+// Runs every epoch for one rank, outside deterministic mode the shard is rank's share of the records in file order
+// or of each stratified batch's draws
+static bool train_rank(const TrainingJob& job, SharedMemoryTransport& shared_memory_transport, NeuralNetwork& neural_network) {
+    const AllReduceTransport transport = {&shared_memory_transport, shared_memory_transport.rank, shared_memory_transport.rank_count, shared_memory_send_to_next_rank, shared_memory_receive_from_previous_rank};
+
+    PackedNeuralNetwork* const packed_neural_network = static_cast<PackedNeuralNetwork*>(aligned_alloc(alignof(PackedNeuralNetwork), sizeof(PackedNeuralNetwork)));
+    PackedNeuralNetworkDelta* const neural_network_delta = static_cast<PackedNeuralNetworkDelta*>(aligned_alloc(alignof(PackedNeuralNetworkDelta), sizeof(PackedNeuralNetworkDelta)));
+    f32* const scratch = static_cast<f32*>(malloc(sizeof(SharedMemorySlot::data)));
+    StratifiedDraw* const draws = (job.action_index != nullptr) ? static_cast<StratifiedDraw*>(malloc(job.batch_draw_count * sizeof(StratifiedDraw))) : nullptr;
+    const u32 step_count = (job.action_index != nullptr) ? job.batches_per_epoch : 1;
+    u64 rng_state = job.rng_seed;
+    invalidate_packed_neural_network(*packed_neural_network);
+
+    bool succeeded = true;
+    for (u32 epoch = 0; epoch < job.epoch_count && succeeded; ++epoch) {
+        for (u32 step = 0; step < step_count && succeeded; ++step) {
+            // every rank draws the same batch, the weighted sum over it estimates the full batch sum so the step
+            // size is the same as for a full batch
+            const u32 item_count = (draws != nullptr) ? draw_stratified_batch(*job.action_index, job.class_quotas, rng_state, draws) : job.sample_count;
+            const PackedNeuralNetwork& packed = pack_neural_network(neural_network, *packed_neural_network);
+            if (job.deterministic) {
+                succeeded = reduce_deterministically(shared_memory_transport, job, draws, item_count, packed, *neural_network_delta);
+            } else {
+                const u32 first_item = share_start(transport.rank, item_count, transport.rank_count);
+                const u32 last_item = share_start(transport.rank + 1, item_count, transport.rank_count);
+                memset(neural_network_delta, 0, sizeof(PackedNeuralNetworkDelta));
+                accumulate_job_delta(job, draws, packed, first_item, last_item, *neural_network_delta);
+                succeeded = ring_all_reduce(transport, reinterpret_cast<f32*>(neural_network_delta), DELTA_FLOAT_COUNT, scratch);
+            }
+
+            apply_delta(neural_network, *neural_network_delta, LEARNING_RATE / static_cast<f32>(job.record_count));
+            invalidate_packed_neural_network(*packed_neural_network);
+        }
+
+        if (succeeded && transport.rank == 0) {
+            printf("epoch %u weights checksum: %08x\n", epoch + 1, neural_network_checksum(neural_network));
+            if (job.held_out_count != 0) {
+                char name[64] = {};
+                snprintf(name, sizeof(name), "epoch %u held out", epoch + 1);
+                print_evaluation(name, evaluate_held_out(job, pack_neural_network(neural_network, *packed_neural_network)));
+            }
+        }
+    }
+
+    free(draws);
+    free(scratch);
+    free(neural_network_delta);
+    free(packed_neural_network);
+
+    return succeeded;
+}
+
+// Quota for each class that turns up, in proportion to its record count to the power 1 - balance and at least
+// one, returns the quotas' sum
+static u32 stratified_class_quotas(const TrainingActionIndex& index, const u32 batch_size, const f64 balance, u32* const class_quotas) {
+    f64 class_shares[ACTION_CLASS_COUNT] = {};
+    f64 share_sum = 0.0;
+    for (u32 c = 0; c < ACTION_CLASS_COUNT; ++c) {
+        // the builtin as math.h's exp() would clash with the network's own
+        class_shares[c] = (index.class_record_counts[c] != 0) ? __builtin_pow(static_cast<f64>(index.class_record_counts[c]), 1.0 - balance) : 0.0;
+        share_sum += class_shares[c];
+    }
+
+    u32 quota_sum = 0;
+    for (u32 c = 0; c < ACTION_CLASS_COUNT; ++c) {
+        class_quotas[c] = 0;
+        if (class_shares[c] != 0.0) {
+            const u32 quota = static_cast<u32>(batch_size * class_shares[c] / share_sum + 0.5);
+            class_quotas[c] = (quota > 0) ? quota : 1;
+        }
+
+        quota_sum += class_quotas[c];
+    }
+
+    return quota_sum;
+}
+
+// Indexes every sample the ranks split between them by the buttons held in it
+static bool index_job_actions(const TrainingJob& job, TrainingActionIndex& index) {
+    u8* const sample_classes = static_cast<u8*>(malloc(job.sample_count));
+    u32* const sample_weights = static_cast<u32*>(malloc(static_cast<u64>(job.sample_count) * sizeof(u32)));
+    index.sample_indices = static_cast<u32*>(malloc(static_cast<u64>(job.sample_count) * sizeof(u32)));
+    if (sample_classes == nullptr || sample_weights == nullptr || index.sample_indices == nullptr) {
+        free(sample_weights);
+        free(sample_classes);
+        return false;
+    }
+
+    for (u32 i = 0; i < job.sample_count; ++i) {
+        i8 record[TRAINING_RECORD_SIZE];
+        sample_weights[i] = copy_job_sample(job, i, record);
+        sample_classes[i] = static_cast<u8>(training_record_action_class(record));
+    }
+
+    index_training_actions(sample_classes, sample_weights, job.sample_count, index);
+    free(sample_weights);
+    free(sample_classes);
+
+    return true;
+}
+
+static void print_action_classes(const TrainingActionIndex& index, const u32* const class_quotas, const u32 record_count) {
+    static const char* const BUTTON_NAMES[NeuralNetwork::OUTPUT_LAYER_SIZE] = {"down", "left", "right", "clockwise", "anti clockwise"};
+
+    printf("%-40s %12s %8s %6s %12s\n", "buttons", "records", "share", "quota", "loss weight");
+    for (u32 c = 0; c < ACTION_CLASS_COUNT; ++c) {
+        if (index.class_record_counts[c] == 0) {
+            continue;
+        }
+
+        char name[64] = "none";
+        u32 name_length = 0;
+        for (u32 button = 0; button < NeuralNetwork::OUTPUT_LAYER_SIZE; ++button) {
+            if ((c & (1 << button)) != 0) {
+                name_length += snprintf(name + name_length, sizeof(name) - name_length, "%s%s", (name_length != 0) ? " + " : "", BUTTON_NAMES[button]);
+            }
+        }
+
+        const u32 class_sample_count = index.class_starts[c + 1] - index.class_starts[c];
+        printf("%-40s %12llu %7.3f%% %6u %12.3f\n", name, static_cast<unsigned long long>(index.class_record_counts[c]),
+            100.0 * static_cast<f64>(index.class_record_counts[c]) / record_count, class_quotas[c], static_cast<f64>(class_sample_count) / class_quotas[c]);
+    }
+}
+
+int main(const int argc, const char* const* const argv) {
+    u32 process_count = 1;
+    u32 epoch_count = 100;
+    u32 rng_seed = 1;
+    const char* training_data_file_name = "training_data_manifest.bin";
+    const char* model_file_name = "neural_network.bin";
+    const char* output_file_name = nullptr;
+    bool deterministic = false;
+    u32 stratified_batch_size = 0;
+    f64 balance = 0.5;
+    f64 held_out_fraction = 0.0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--processes") == 0 && i + 1 < argc) {
+            process_count = static_cast<u32>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--epochs") == 0 && i + 1 < argc) {
+            epoch_count = static_cast<u32>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            rng_seed = static_cast<u32>(strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--deterministic") == 0) {
+            deterministic = true;
+        } else if (strcmp(argv[i], "--stratified-batch") == 0 && i + 1 < argc) {
+            stratified_batch_size = static_cast<u32>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--balance") == 0 && i + 1 < argc) {
+            balance = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--held-out") == 0 && i + 1 < argc) {
+            held_out_fraction = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--training-data") == 0 && i + 1 < argc) {
+            training_data_file_name = argv[++i];
+        } else if (strcmp(argv[i], "--model") == 0 && i + 1 < argc) {
+            model_file_name = argv[++i];
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output_file_name = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--processes N] [--epochs N] [--seed N] [--deterministic] [--stratified-batch N] [--balance B] [--held-out FRACTION] [--training-data FILE] [--model FILE] [--output FILE]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    output_file_name = (output_file_name != nullptr) ? output_file_name : model_file_name;
+    if (process_count < 1 || process_count > MAX_PROCESS_COUNT) {
+        fprintf(stderr, "process count must be between 1 and %u\n", MAX_PROCESS_COUNT);
+        return 1;
+    }
+
+    if (balance < 0.0 || balance > 1.0) {
+        fprintf(stderr, "balance must be between 0 and 1\n");
+        return 1;
+    }
+
+    if (held_out_fraction < 0.0 || held_out_fraction >= 1.0) {
+        fprintf(stderr, "the held out fraction must be at least 0 and less than 1\n");
+        return 1;
+    }
+
+    // full batches have every rank read its share of the records front to back each epoch, stratified batches
+    // draw them from all over the file
+    const int advice = (stratified_batch_size != 0) ? MADV_RANDOM : MADV_SEQUENTIAL;
+    u64 training_data_size = 0;
+    const void* training_data_file = map_whole_file(training_data_file_name, advice, training_data_size);
+    if (is_compressed_training_data(static_cast<const i8*>(training_data_file), training_data_size)) {
+        training_data_file = decompress_training_data_file(static_cast<const i8*>(training_data_file), training_data_size);
+    } else if (is_framed_training_data(training_data_file, training_data_size)) {
+        training_data_file = unframe_training_data_file(training_data_file_name, training_data_file, training_data_size);
+    }
+
+    TrainingJob job = {};
+    job.epoch_count = epoch_count;
+    job.deterministic = deterministic;
+    TrainingDataView single_shard = {};
+    if (is_training_data_manifest(training_data_file, training_data_size)) {
+        TrainingDataManifestView manifest = {};
+        if (!view_training_data_manifest(training_data_file, training_data_size, manifest)) {
+            fprintf(stderr, "%s is damaged\n", training_data_file_name);
+            return 1;
+        }
+
+        TrainingDataView* const shards = static_cast<TrainingDataView*>(malloc(manifest.shard_count * sizeof(TrainingDataView)));
+        u32 record_count = 0;
+        if (!map_training_data_shards(training_data_file_name, manifest, advice, shards, record_count)) {
+            return 1;
+        }
+
+        if (record_count == 0) {
+            fprintf(stderr, "no training records in the shards of %s\n", training_data_file_name);
+            return 1;
+        }
+
+        job.shards = shards;
+        job.shard_count = manifest.shard_count;
+        job.sample_count = record_count;
+        job.record_count = record_count;
+    } else if (is_weighted_training_data(training_data_file, training_data_size)) {
+        WeightedTrainingDataView weighted_training_data = {};
+        if (!view_weighted_training_data(training_data_file, training_data_size, weighted_training_data)) {
+            fprintf(stderr, "%s is damaged\n", training_data_file_name);
+            return 1;
+        }
+
+        job.samples = weighted_training_data.samples;
+        job.sample_count = weighted_training_data.sample_count;
+        job.record_count = static_cast<u32>(weighted_training_data.record_count);
+    } else if (is_columnar_training_data(training_data_file, training_data_size)) {
+        if (!view_columnar_training_data(training_data_file, training_data_size, job.columnar)) {
+            fprintf(stderr, "%s is damaged\n", training_data_file_name);
+            return 1;
+        }
+
+        job.sample_count = job.columnar.record_count;
+        job.record_count = job.columnar.record_count;
+    } else {
+        TrainingDataView training_data = {};
+        if (!view_training_data(training_data_file, training_data_size, training_data)) {
+            fprintf(stderr, "couldn't map any training records from %s\n", training_data_file_name);
+            return 1;
+        }
+
+        if (training_data.trailing_byte_count != 0) {
+            fprintf(stderr, "ignoring %u trailing bytes of a partial record\n", training_data.trailing_byte_count);
+        }
+
+        single_shard = training_data;
+        job.shards = &single_shard;
+        job.shard_count = 1;
+        job.sample_count = training_data.record_count;
+        job.record_count = training_data.record_count;
+    }
+
+    if (held_out_fraction > 0.0) {
+        job.held_out_count = static_cast<u32>(job.sample_count * held_out_fraction);
+        job.held_out_count = (job.held_out_count == 0) ? 1 : job.held_out_count;
+        if (job.held_out_count >= job.sample_count) {
+            fprintf(stderr, "too few samples to hold any out and still train\n");
+            return 1;
+        }
+
+        job.sample_count -= job.held_out_count;
+        job.record_count = job.sample_count;
+        if (job.samples != nullptr) {
+            u64 record_count = 0;
+            for (u32 i = 0; i < job.sample_count; ++i) {
+                record_count += job.samples[i].weight;
+            }
+
+            job.record_count = static_cast<u32>(record_count);
+        }
+    }
+
+    TrainingActionIndex action_index = {};
+    u32 class_quotas[ACTION_CLASS_COUNT] = {};
+    if (stratified_batch_size != 0) {
+        if (!index_job_actions(job, action_index)) {
+            fprintf(stderr, "couldn't index the training data's actions\n");
+            return 1;
+        }
+
+        job.action_index = &action_index;
+        job.class_quotas = class_quotas;
+        job.batch_draw_count = stratified_class_quotas(action_index, stratified_batch_size, balance, class_quotas);
+        job.batches_per_epoch = (job.sample_count > job.batch_draw_count) ? job.sample_count / job.batch_draw_count : 1;
+        job.rng_seed = rng_seed;
+        print_action_classes(action_index, class_quotas, job.record_count);
+    }
+
+    NeuralNetwork* const neural_network = static_cast<NeuralNetwork*>(aligned_alloc(alignof(NeuralNetwork), sizeof(NeuralNetwork)));
+    const bool loaded_model = load_model_file(model_file_name, *neural_network);
+    if (!loaded_model) {
+        *neural_network = random_neural_network(rng_seed);
+    }
+
+    SharedMemoryRing* const ring = static_cast<SharedMemoryRing*>(mmap(nullptr, sizeof(SharedMemoryRing), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    if (ring == MAP_FAILED) {
+        fprintf(stderr, "couldn't create the shared memory ring\n");
+        return 1;
+    }
+
+    pid_t child_process_ids[MAX_PROCESS_COUNT] = {};
+    SharedMemoryTransport shared_memory_transport = {ring, 0, process_count, child_process_ids};
+
+    const f64 start = seconds_now();
+    for (u32 rank = 1; rank < process_count; ++rank) {
+        const pid_t process_id = fork();
+        if (process_id == 0) {
+            prctl(PR_SET_PDEATHSIG, SIGKILL);
+            shared_memory_transport.rank = rank;
+            shared_memory_transport.child_process_ids = nullptr;
+            const bool succeeded = train_rank(job, shared_memory_transport, *neural_network);
+            if (!succeeded) {
+                __atomic_store_n(&ring->failed, 1, __ATOMIC_RELEASE);
+            }
+
+            _exit(succeeded ? 0 : 1);
+        }
+
+        if (process_id < 0) {
+            fprintf(stderr, "couldn't start training process %u\n", rank);
+            __atomic_store_n(&ring->failed, 1, __ATOMIC_RELEASE);
+            process_count = rank;
+            break;
+        }
+
+        child_process_ids[rank] = process_id;
+    }
+
+    bool succeeded = train_rank(job, shared_memory_transport, *neural_network);
+    for (u32 rank = 1; rank < process_count; ++rank) {
+        int status = 0;
+        waitpid(child_process_ids[rank], &status, 0);
+        succeeded = succeeded && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
+    const f64 elapsed = seconds_now() - start;
+    succeeded = succeeded && __atomic_load_n(&ring->failed, __ATOMIC_ACQUIRE) == 0;
+    if (!succeeded) {
+        fprintf(stderr, "training failed, %s left untouched\n", output_file_name);
+        return 1;
+    }
+
+    if (!save_model_file(output_file_name, *neural_network)) {
+        fprintf(stderr, "couldn't write %s\n", output_file_name);
+        return 1;
+    }
+
+    printf("processes: %u\n", process_count);
+    printf("records: %u\n", job.record_count);
+    printf("samples trained on: %u\n", job.sample_count);
+    printf("samples held out: %u\n", job.held_out_count);
+    printf("epochs: %u\n", epoch_count);
+    printf("deterministic: %s\n", deterministic ? "yes" : "no");
+    if (job.action_index != nullptr) {
+        printf("stratified batches: %u an epoch of %u draws, balance %.2f\n", job.batches_per_epoch, job.batch_draw_count, balance);
+    }
+    printf("initial weights: %s\n", loaded_model ? model_file_name : "random");
+    printf("seconds: %.3f\n", elapsed);
+    const f64 samples_per_epoch = (job.action_index != nullptr) ? static_cast<f64>(job.batches_per_epoch) * job.batch_draw_count : job.record_count;
+    printf("samples per second: %.0f\n", samples_per_epoch * epoch_count / elapsed);
+    printf("weights checksum: %08x\n", neural_network_checksum(*neural_network));
+
+    return 0;
+}
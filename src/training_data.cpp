@@ -0,0 +1,613 @@
+#include "training_data.h"
+#include "simd.h"
+#include "tetris.h"
+#include "util.h"
+
+// False when there's nothing to use (no data, no whole records or more than MAX_TRAINING_RECORD_COUNT)
+static bool view_training_data(const void* const data, const u64 size, TrainingDataView& view) {
+    view = {};
+    const u64 record_count = size / TRAINING_RECORD_SIZE;
+    if (data == nullptr || record_count == 0 || record_count > MAX_TRAINING_RECORD_COUNT) {
+        return false;
+    }
+
+    view.records = static_cast<const i8*>(data);
+    view.record_count = static_cast<u32>(record_count);
+    view.trailing_byte_count = static_cast<u32>(size % TRAINING_RECORD_SIZE);
+
+    return true;
+}
+
+static const i8* training_record(const TrainingDataView& view, const u32 record_index) {
+    return view.records + static_cast<u64>(record_index) * TRAINING_RECORD_SIZE;
+}
+
+static constexpr i8 WEIGHTED_TRAINING_DATA_MAGIC[] = {'T', 'A', 'I', 'W', 'E', 'I', 'G', 'H'};
+
+// Open addressing over sample indices, at most half full so probe chains stay short
+static u64 deduplication_table_slot_count(const u32 record_count) {
+    u64 slot_count = 1;
+    while (slot_count < 2 * static_cast<u64>(record_count)) {
+        slot_count *= 2;
+    }
+
+    return slot_count;
+}
+
+static u64 deduplication_table_size(const u32 record_count) {
+    return deduplication_table_slot_count(record_count) * sizeof(u32);
+}
+
+static u64 max_weighted_training_data_size(const u32 record_count) {
+    return sizeof(WeightedTrainingDataHeader) + static_cast<u64>(record_count) * sizeof(WeightedTrainingSample);
+}
+
+// Writes the weighted file into buffer (max_weighted_training_data_size() bytes) and returns its size, table
+// is deduplication_table_size() bytes of scratch
+static u64 deduplicate_training_data(const TrainingDataView& training_data, u32* const table, i8* const buffer) {
+    const u64 slot_mask = deduplication_table_slot_count(training_data.record_count) - 1;
+    for (u64 slot = 0; slot <= slot_mask; ++slot) {
+        table[slot] = 0;
+    }
+
+    // slots hold sample index + 1 so zero can mean empty
+    WeightedTrainingSample* const samples = reinterpret_cast<WeightedTrainingSample*>(buffer + sizeof(WeightedTrainingDataHeader));
+    u32 sample_count = 0;
+    for (u32 record_index = 0; record_index < training_data.record_count; ++record_index) {
+        const i8* const record = training_record(training_data, record_index);
+        u64 slot = hash_bytes(record, TRAINING_RECORD_SIZE) & slot_mask;
+        while (table[slot] != 0 && compare_bytes(samples[table[slot] - 1].record, record, TRAINING_RECORD_SIZE) != 0) {
+            slot = (slot + 1) & slot_mask;
+        }
+
+        if (table[slot] == 0) {
+            WeightedTrainingSample& sample = samples[sample_count++];
+            sample.weight = 0;
+            copy_bytes(record, TRAINING_RECORD_SIZE, sample.record);
+            table[slot] = sample_count;
+        }
+
+        ++samples[table[slot] - 1].weight;
+    }
+
+    WeightedTrainingDataHeader header = {};
+    copy_bytes(WEIGHTED_TRAINING_DATA_MAGIC, sizeof(WEIGHTED_TRAINING_DATA_MAGIC), header.magic);
+    header.version = WEIGHTED_TRAINING_DATA_VERSION;
+    header.sample_count = sample_count;
+    header.record_count = training_data.record_count;
+    copy_bytes(reinterpret_cast<const i8*>(&header), sizeof(header), buffer);
+
+    return sizeof(header) + static_cast<u64>(sample_count) * sizeof(WeightedTrainingSample);
+}
+
+static bool is_weighted_training_data(const void* const data, const u64 size) {
+    return data != nullptr && size >= sizeof(WeightedTrainingDataHeader) &&
+        compare_bytes(static_cast<const i8*>(data), WEIGHTED_TRAINING_DATA_MAGIC, sizeof(WEIGHTED_TRAINING_DATA_MAGIC)) == 0;
+}
+
+// The data has to be 4 byte aligned (a mapping always is). Checks the weights add up to the record count.
+static bool view_weighted_training_data(const void* const data, const u64 size, WeightedTrainingDataView& view) {
+    view = {};
+    if (!is_weighted_training_data(data, size)) {
+        return false;
+    }
+
+    WeightedTrainingDataHeader header = {};
+    copy_bytes(static_cast<const i8*>(data), sizeof(header), reinterpret_cast<i8*>(&header));
+    const bool valid_header = header.version == WEIGHTED_TRAINING_DATA_VERSION &&
+        header.sample_count > 0 &&
+        size == sizeof(header) + static_cast<u64>(header.sample_count) * sizeof(WeightedTrainingSample);
+    if (!valid_header) {
+        return false;
+    }
+
+    const WeightedTrainingSample* const samples = reinterpret_cast<const WeightedTrainingSample*>(static_cast<const i8*>(data) + sizeof(header));
+    u64 record_count = 0;
+    for (u32 i = 0; i < header.sample_count; ++i) {
+        record_count += samples[i].weight;
+    }
+
+    if (record_count != header.record_count || record_count > MAX_TRAINING_RECORD_COUNT) {
+        return false;
+    }
+
+    view.samples = samples;
+    view.sample_count = header.sample_count;
+    view.record_count = record_count;
+
+    return true;
+}
+
+static constexpr i8 TRAINING_DATA_FRAME_MAGIC[] = {'T', 'A', 'I', 'F'};
+
+// A plain file can't be mistaken for a framed one, its first record would have to be on level 0x46494154
+static bool is_framed_training_data(const void* const data, const u64 size) {
+    return data != nullptr && size >= sizeof(TrainingDataFrameHeader) &&
+        compare_bytes(static_cast<const i8*>(data), TRAINING_DATA_FRAME_MAGIC, sizeof(TRAINING_DATA_FRAME_MAGIC)) == 0;
+}
+
+static void write_training_data_frame_header(const u32 frame_index, const u32 record_count, const u32 checksum, i8* const frame) {
+    TrainingDataFrameHeader header = {};
+    copy_bytes(TRAINING_DATA_FRAME_MAGIC, sizeof(TRAINING_DATA_FRAME_MAGIC), header.magic);
+    header.frame_index = frame_index;
+    header.record_count = record_count;
+    header.checksum = checksum;
+    copy_bytes(reinterpret_cast<const i8*>(&header), sizeof(header), frame);
+}
+
+// Whether the header is one for the frame at frame_index, regardless of whether its records are all there
+static bool read_training_data_frame_header(const i8* const frame, const u64 bytes_left, const u64 frame_index, TrainingDataFrameHeader& header) {
+    header = {};
+    if (bytes_left < sizeof(header)) {
+        return false;
+    }
+
+    copy_bytes(frame, sizeof(header), reinterpret_cast<i8*>(&header));
+    return compare_bytes(header.magic, TRAINING_DATA_FRAME_MAGIC, sizeof(TRAINING_DATA_FRAME_MAGIC)) == 0 &&
+        header.frame_index == frame_index &&
+        header.record_count > 0 &&
+        header.record_count <= TRAINING_DATA_FRAME_RECORD_COUNT;
+}
+
+// Whether the frame's records are all there and carry the checksum on from previous_checksum to the header's
+static bool is_good_training_data_frame(const i8* const frame, const u64 bytes_left, const u64 frame_index, const u32 previous_checksum, TrainingDataFrameHeader& header) {
+    if (!read_training_data_frame_header(frame, bytes_left, frame_index, header)) {
+        return false;
+    }
+
+    const u64 records_size = static_cast<u64>(header.record_count) * TRAINING_RECORD_SIZE;
+    return sizeof(header) + records_size <= bytes_left &&
+        extend_crc32c(previous_checksum, frame + sizeof(header), records_size) == header.checksum;
+}
+
+// Only reads the last frame or two, the whole file only when both of those are bad which a crash alone can't do
+static bool find_framed_training_data_end(const void* const data, const u64 size, FramedTrainingDataEnd& end) {
+    end = {};
+    if (!is_framed_training_data(data, size)) {
+        return false;
+    }
+
+    const i8* const file = static_cast<const i8*>(data);
+    const u64 frames_in_file = (size + TRAINING_DATA_FRAME_SIZE - 1) / TRAINING_DATA_FRAME_SIZE;
+    TrainingDataFrameHeader header = {};
+    for (u64 frames_back = 0; frames_back < 2 && frames_back < frames_in_file; ++frames_back) {
+        const u64 frame_index = frames_in_file - 1 - frames_back;
+        const u64 frame_offset = frame_index * TRAINING_DATA_FRAME_SIZE;
+
+        // the frame before says where the checksum got to
+        TrainingDataFrameHeader previous_header = {};
+        const bool has_previous_header = frame_index == 0 ||
+            read_training_data_frame_header(file + frame_offset - TRAINING_DATA_FRAME_SIZE, TRAINING_DATA_FRAME_SIZE, frame_index - 1, previous_header);
+        if (has_previous_header && is_good_training_data_frame(file + frame_offset, size - frame_offset, frame_index, previous_header.checksum, header)) {
+            end.frame_count = frame_index + 1;
+            end.last_frame_record_count = header.record_count;
+            end.checksum = header.checksum;
+            end.record_count = frame_index * TRAINING_DATA_FRAME_RECORD_COUNT + header.record_count;
+            end.size = frame_offset + sizeof(header) + static_cast<u64>(header.record_count) * TRAINING_RECORD_SIZE;
+            return true;
+        }
+    }
+
+    end.scanned = true;
+    for (u64 frame_offset = 0; frame_offset < size; frame_offset += TRAINING_DATA_FRAME_SIZE) {
+        if (!is_good_training_data_frame(file + frame_offset, size - frame_offset, end.frame_count, end.checksum, header)) {
+            break;
+        }
+
+        ++end.frame_count;
+        end.last_frame_record_count = header.record_count;
+        end.checksum = header.checksum;
+        end.record_count += header.record_count;
+        end.size = frame_offset + sizeof(header) + static_cast<u64>(header.record_count) * TRAINING_RECORD_SIZE;
+        if (header.record_count < TRAINING_DATA_FRAME_RECORD_COUNT) {
+            break;
+        }
+    }
+
+    return true;
+}
+
+// Every frame but the last is full so a record's place follows from its index alone
+static const i8* framed_training_record(const void* const data, const u32 record_index) {
+    const u64 frame_index = record_index / TRAINING_DATA_FRAME_RECORD_COUNT;
+    const u64 slot = record_index % TRAINING_DATA_FRAME_RECORD_COUNT;
+    return static_cast<const i8*>(data) + frame_index * TRAINING_DATA_FRAME_SIZE + sizeof(TrainingDataFrameHeader) + slot * TRAINING_RECORD_SIZE;
+}
+
+// Copies the records of every good frame in data, whole frames from first_frame_index on with the last one
+// allowed to be short, one after the other into records, which can be data itself. previous_checksum is
+// where the frame before first_frame_index left the checksum and is left where the last frame says it got to,
+// so a file can be unframed a piece at a time. Returns the number of records copied.
+static u64 unframe_training_data(
+    const void* const data,
+    const u64 size,
+    const u64 first_frame_index,
+    u32& previous_checksum,
+    i8* const records,
+    u64& damaged_frame_count
+) {
+    const i8* const frames = static_cast<const i8*>(data);
+    u64 record_count = 0;
+    for (u64 frame_offset = 0; frame_offset < size; frame_offset += TRAINING_DATA_FRAME_SIZE) {
+        const u64 frame_index = first_frame_index + frame_offset / TRAINING_DATA_FRAME_SIZE;
+        TrainingDataFrameHeader header = {};
+        const bool good = is_good_training_data_frame(frames + frame_offset, size - frame_offset, frame_index, previous_checksum, header);
+        if (good) {
+            // never overtakes the frame being read as the records always start further in than where they go
+            const u32 records_size = header.record_count * TRAINING_RECORD_SIZE;
+            copy_bytes(frames + frame_offset + sizeof(header), records_size, records + record_count * TRAINING_RECORD_SIZE);
+            record_count += header.record_count;
+        } else {
+            ++damaged_frame_count;
+        }
+
+        // a bad frame's header still says where the checksum got to as long as it can be read at all
+        if (good || read_training_data_frame_header(frames + frame_offset, size - frame_offset, frame_index, header)) {
+            previous_checksum = header.checksum;
+        }
+    }
+
+    return record_count;
+}
+
+static constexpr i8 TRAINING_DATA_MANIFEST_MAGIC[] = {'T', 'A', 'I', 'S', 'H', 'A', 'R', 'D'};
+
+static u64 training_data_manifest_size(const u32 shard_count) {
+    return sizeof(TrainingDataManifestHeader) + static_cast<u64>(shard_count) * sizeof(TrainingDataShard);
+}
+
+// Writes the manifest into buffer (training_data_manifest_size() bytes) and returns its size
+static u64 write_training_data_manifest(const TrainingDataShard* const shards, const u32 shard_count, i8* const buffer) {
+    TrainingDataManifestHeader header = {};
+    copy_bytes(TRAINING_DATA_MANIFEST_MAGIC, sizeof(TRAINING_DATA_MANIFEST_MAGIC), header.magic);
+    header.version = TRAINING_DATA_MANIFEST_VERSION;
+    header.record_version = TRAINING_RECORD_VERSION;
+    header.record_size = TRAINING_RECORD_SIZE;
+    header.shard_count = shard_count;
+    copy_bytes(reinterpret_cast<const i8*>(&header), sizeof(header), buffer);
+    copy_bytes(reinterpret_cast<const i8*>(shards), shard_count * sizeof(TrainingDataShard), buffer + sizeof(header));
+
+    return training_data_manifest_size(shard_count);
+}
+
+static bool is_training_data_manifest(const void* const data, const u64 size) {
+    return data != nullptr && size >= sizeof(TrainingDataManifestHeader) &&
+        compare_bytes(static_cast<const i8*>(data), TRAINING_DATA_MANIFEST_MAGIC, sizeof(TRAINING_DATA_MANIFEST_MAGIC)) == 0;
+}
+
+// The data has to be 8 byte aligned (a mapping always is). Shards whose records aren't the kind this build
+// reads, or that aren't all finished bar the last, don't make a valid manifest.
+static bool view_training_data_manifest(const void* const data, const u64 size, TrainingDataManifestView& view) {
+    view = {};
+    if (!is_training_data_manifest(data, size)) {
+        return false;
+    }
+
+    TrainingDataManifestHeader header = {};
+    copy_bytes(static_cast<const i8*>(data), sizeof(header), reinterpret_cast<i8*>(&header));
+    const bool valid_header = header.version == TRAINING_DATA_MANIFEST_VERSION &&
+        header.record_version == TRAINING_RECORD_VERSION &&
+        header.record_size == TRAINING_RECORD_SIZE &&
+        header.shard_count > 0 &&
+        header.shard_count <= MAX_TRAINING_DATA_SHARD_COUNT &&
+        size == training_data_manifest_size(header.shard_count);
+    if (!valid_header) {
+        return false;
+    }
+
+    const TrainingDataShard* const shards = reinterpret_cast<const TrainingDataShard*>(static_cast<const i8*>(data) + sizeof(header));
+    for (u32 i = 0; i < header.shard_count; ++i) {
+        const TrainingDataShard& shard = shards[i];
+        bool name_terminated = false;
+        for (u32 c = 0; c < sizeof(shard.file_name) && !name_terminated; ++c) {
+            name_terminated = shard.file_name[c] == 0;
+        }
+
+        const bool finished = (shard.flags & TRAINING_DATA_SHARD_FINISHED) != 0;
+        if (!name_terminated || shard.file_name[0] == 0 || (!finished && i + 1 != header.shard_count)) {
+            return false;
+        }
+    }
+
+    view.shards = shards;
+    view.shard_count = header.shard_count;
+
+    return true;
+}
+
+// TODO: assert bytes_read is as expected at various points throughout
+// The inputs ahead of the grid, returns how many bytes of the encoded state they took up
+static u32 binary_game_state_to_features(const BinaryGameState& binary_game_state, f32* const features) {
+    u32 bytes_read = 0;
+
+    i32 difficulty_level = 0;
+    bytes_read += copy_bytes(binary_game_state + bytes_read, sizeof(difficulty_level), reinterpret_cast<i8*>(&difficulty_level));
+    features[0] = static_cast<f32>(difficulty_level);
+
+    i32 rows_cleared = 0;
+    bytes_read += copy_bytes(binary_game_state + bytes_read, sizeof(rows_cleared), reinterpret_cast<i8*>(&rows_cleared));
+    features[1] = static_cast<f32>(rows_cleared);
+    
+    const i8 next_tetrimino_type = binary_game_state[bytes_read++];
+    features[2] = static_cast<f32>(next_tetrimino_type);
+
+    const i8 current_tetrimino_type = binary_game_state[bytes_read++];
+    features[3] = static_cast<f32>(current_tetrimino_type);
+
+    // read current tetrimino block positions
+    for (i32 feature_index = 4; feature_index < 12; feature_index += 2) {
+        const i8 block_top_left_x = binary_game_state[bytes_read++];
+        features[feature_index] = static_cast<f32>(block_top_left_x);
+        const i8 block_top_left_y = binary_game_state[bytes_read++];
+        features[feature_index + 1] = static_cast<f32>(block_top_left_y);
+    }
+
+    return bytes_read;
+}
+
+static void binary_game_state_to_neural_network_input(const BinaryGameState& binary_game_state, NeuralNetwork::InputLayer& input) {
+    u32 bytes_read = binary_game_state_to_features(binary_game_state, input);
+
+    // read grid state
+    i32 input_index = 12;
+    for (i32 row = 0; row < Tetris::Grid::ROW_COUNT; ++row) {
+        u16 encoded_row = 0;
+        bytes_read += copy_bytes(binary_game_state + bytes_read, sizeof(encoded_row), reinterpret_cast<i8*>(&encoded_row));
+        for (i32 column = 0; column < Tetris::Grid::COLUMN_COUNT; ++column) {
+            const bool cell_has_block = (encoded_row & (1 << column)) != 0;
+            input[input_index++] = static_cast<f32>(cell_has_block);
+        }
+    }
+}
+
+static void binary_game_state_to_convolutional_input(const BinaryGameState& binary_game_state, ConvolutionalInput& input) {
+    static_assert(ConvolutionalNeuralNetwork::ROW_COUNT == Tetris::Grid::ROW_COUNT && ConvolutionalNeuralNetwork::COLUMN_COUNT == Tetris::Grid::COLUMN_COUNT);
+
+    f32 features[ConvolutionalNeuralNetwork::FEATURE_COUNT] = {};
+    const u32 bytes_read = binary_game_state_to_features(binary_game_state, features);
+
+    u16 encoded_rows[Tetris::Grid::ROW_COUNT] = {};
+    copy_bytes(binary_game_state + bytes_read, sizeof(encoded_rows), reinterpret_cast<i8*>(encoded_rows));
+    make_convolutional_input(features, encoded_rows, input);
+}
+
+static void binary_player_input_to_neural_network_output(const BinaryPlayerInput encoded_outputs, NeuralNetwork::OutputLayer& output) {
+    for (i32 i = 0; i < NeuralNetwork::OUTPUT_LAYER_SIZE; ++i) {
+        const bool val = (encoded_outputs & (1 << i)) != 0;
+        output[i] = static_cast<f32>(val);
+    }
+}
+
+// Where the grid rows start in an encoded game state, see binary_game_state_to_neural_network_input()
+static constexpr u32 BINARY_GRID_OFFSET = 18;
+
+static_assert(INPUT_FEATURE_COUNT + Tetris::Grid::ROW_COUNT * Tetris::Grid::COLUMN_COUNT == NeuralNetwork::INPUT_LAYER_SIZE);
+static_assert(Tetris::Grid::COLUMN_COUNT <= 16);
+
+// The encoded rows are 18 unaligned u16s, each goes in 10 bits further on than the one before
+static void pack_grid_bitmap(const i8* const encoded_rows, u64* const grid_bitmap) {
+    static constexpr u64 ROW_MASK = (1 << Tetris::Grid::COLUMN_COUNT) - 1;
+
+    for (u32 word = 0; word < GRID_BITMAP_WORD_COUNT; ++word) {
+        grid_bitmap[word] = 0;
+    }
+
+    for (i32 row = 0; row < Tetris::Grid::ROW_COUNT; ++row) {
+        u16 encoded_row = 0;
+        copy_bytes(encoded_rows + row * sizeof(encoded_row), sizeof(encoded_row), reinterpret_cast<i8*>(&encoded_row));
+
+        const u32 first_bit = INPUT_FEATURE_COUNT + row * Tetris::Grid::COLUMN_COUNT;
+        const u32 shift = first_bit % 64;
+        const u64 row_bits = encoded_row & ROW_MASK;
+        grid_bitmap[first_bit / 64] |= row_bits << shift;
+        if (shift + Tetris::Grid::COLUMN_COUNT > 64) {
+            grid_bitmap[first_bit / 64 + 1] |= row_bits >> (64 - shift);
+        }
+    }
+}
+
+// features is 16 floats, the last 4 zero, which lets the vector versions load them whole
+static void expand_neural_network_input_scalar(const f32* const features, const u64* const grid_bitmap, f32* const input) {
+    for (u32 word = 0; word < GRID_BITMAP_WORD_COUNT; ++word) {
+        const u64 bits = grid_bitmap[word];
+        for (u32 bit = 0; bit < 64; ++bit) {
+            input[word * 64 + bit] = static_cast<f32>((bits >> bit) & 1);
+        }
+    }
+
+    for (u32 i = 0; i < INPUT_FEATURE_COUNT; ++i) {
+        input[i] = features[i];
+    }
+}
+
+// Each byte of the bitmap is broadcast, masked with a different bit per lane and compared back to the mask,
+// which gives all ones where the bit is set and 1.0f once anded with it
+TARGET_AVX2 static void expand_neural_network_input_avx2(const f32* const features, const u64* const grid_bitmap, f32* const input) {
+    static_assert(INPUT_FEATURE_COUNT <= 16);
+
+    const __m256i lane_bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    const __m256 ones = _mm256_set1_ps(1.0f);
+    const u8* const bitmap_bytes = reinterpret_cast<const u8*>(grid_bitmap);
+    for (u32 byte = 0; byte < GRID_BITMAP_WORD_COUNT * sizeof(u64); ++byte) {
+        const __m256i masked = _mm256_and_si256(_mm256_set1_epi32(bitmap_bytes[byte]), lane_bits);
+        __m256 values = _mm256_and_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(masked, lane_bits)), ones);
+        if (byte < 2) {
+            // the features sit over clear bits
+            values = _mm256_or_ps(values, _mm256_loadu_ps(features + byte * 8));
+        }
+
+        _mm256_store_ps(input + byte * 8, values);
+    }
+}
+
+// Every 16 bits of the bitmap are a lane mask as they are
+TARGET_AVX512 static void expand_neural_network_input_avx512(const f32* const features, const u64* const grid_bitmap, f32* const input) {
+    const __m512 ones = _mm512_set1_ps(1.0f);
+    const u16* const bitmap_halves = reinterpret_cast<const u16*>(grid_bitmap);
+    _mm512_store_ps(input, _mm512_mask_mov_ps(_mm512_loadu_ps(features), bitmap_halves[0], ones));
+    for (u32 half = 1; half < GRID_BITMAP_WORD_COUNT * 4; ++half) {
+        _mm512_store_ps(input + half * 16, _mm512_maskz_mov_ps(bitmap_halves[half], ones));
+    }
+}
+
+// input has to be 64 byte aligned for the vector versions, the best one the CPU has is used if it doesn't have variant
+static void expand_neural_network_input(const f32* const features, const u64* const grid_bitmap, const KernelVariant variant, NeuralNetwork::InputLayer& input) {
+    const CpuFeatures& cpu = cpu_features();
+    if (variant >= KernelVariant::AVX512 && cpu.avx512f) {
+        expand_neural_network_input_avx512(features, grid_bitmap, input);
+    } else if (variant >= KernelVariant::AVX2 && cpu.avx2) {
+        expand_neural_network_input_avx2(features, grid_bitmap, input);
+    } else {
+        expand_neural_network_input_scalar(features, grid_bitmap, input);
+    }
+}
+
+// Batch version of binary_game_state_to_neural_network_input() and binary_player_input_to_neural_network_output()
+// with the same results, records are record_stride bytes apart and inputs is 64 byte aligned
+static void decode_training_records(
+    const i8* const records,
+    const u32 record_stride,
+    const u32 record_count,
+    const KernelVariant variant,
+    NeuralNetwork::InputLayer* const inputs,
+    NeuralNetwork::OutputLayer* const targets
+) {
+    for (u32 i = 0; i < record_count; ++i) {
+        const i8* const record = records + static_cast<u64>(i) * record_stride;
+
+        f32 features[16] = {};
+        binary_game_state_to_features(*reinterpret_cast<const BinaryGameState*>(record), features);
+
+        u64 grid_bitmap[GRID_BITMAP_WORD_COUNT];
+        pack_grid_bitmap(record + BINARY_GRID_OFFSET, grid_bitmap);
+        expand_neural_network_input(features, grid_bitmap, variant, inputs[i]);
+
+        BinaryPlayerInput encoded_player_input = 0;
+        copy_bytes(record + BINARY_GAME_STATE_SIZE, sizeof(encoded_player_input), reinterpret_cast<i8*>(&encoded_player_input));
+        binary_player_input_to_neural_network_output(encoded_player_input, targets[i]);
+    }
+}
+
+// Records are decoded this many at a time ahead of back propagating them
+static constexpr u32 TRAINING_DECODE_BATCH_SIZE = 32;
+
+// Back propagates records [first_record, first_record + record_count) into the delta in file order
+static void accumulate_training_delta(
+    const PackedNeuralNetwork& neural_network,
+    const i8* const training_data,
+    const u32 first_record,
+    const u32 record_count,
+    PackedNeuralNetworkDelta& neural_network_delta
+) {
+    alignas(64) NeuralNetwork::InputLayer inputs[TRAINING_DECODE_BATCH_SIZE];
+    NeuralNetwork::OutputLayer targets[TRAINING_DECODE_BATCH_SIZE];
+    for (u32 record = first_record; record < first_record + record_count; record += TRAINING_DECODE_BATCH_SIZE) {
+        const u32 records_left = first_record + record_count - record;
+        const u32 batch_size = (records_left < TRAINING_DECODE_BATCH_SIZE) ? records_left : TRAINING_DECODE_BATCH_SIZE;
+        decode_training_records(training_data + static_cast<u64>(record) * TRAINING_RECORD_SIZE, TRAINING_RECORD_SIZE, batch_size, KernelVariant::AVX512, inputs, targets);
+        for (u32 i = 0; i < batch_size; ++i) {
+            back_propagate(neural_network, inputs[i], targets[i], 1.0f, neural_network_delta);
+        }
+    }
+}
+
+// Same delta as the records the samples were made from, give or take rounding, for a fraction of the work
+static void accumulate_training_delta(
+    const PackedNeuralNetwork& neural_network,
+    const WeightedTrainingSample* const samples,
+    const u32 first_sample,
+    const u32 sample_count,
+    PackedNeuralNetworkDelta& neural_network_delta
+) {
+    alignas(64) NeuralNetwork::InputLayer inputs[TRAINING_DECODE_BATCH_SIZE];
+    NeuralNetwork::OutputLayer targets[TRAINING_DECODE_BATCH_SIZE];
+    for (u32 sample = first_sample; sample < first_sample + sample_count; sample += TRAINING_DECODE_BATCH_SIZE) {
+        const u32 samples_left = first_sample + sample_count - sample;
+        const u32 batch_size = (samples_left < TRAINING_DECODE_BATCH_SIZE) ? samples_left : TRAINING_DECODE_BATCH_SIZE;
+        decode_training_records(samples[sample].record, sizeof(WeightedTrainingSample), batch_size, KernelVariant::AVX512, inputs, targets);
+        for (u32 i = 0; i < batch_size; ++i) {
+            back_propagate(neural_network, inputs[i], targets[i], static_cast<f32>(samples[sample + i].weight), neural_network_delta);
+        }
+    }
+}
+
+static u32 training_record_action_class(const i8* const record) {
+    BinaryPlayerInput encoded_player_input = 0;
+    copy_bytes(record + BINARY_GAME_STATE_SIZE, sizeof(encoded_player_input), reinterpret_cast<i8*>(&encoded_player_input));
+
+    // only the bits the network has outputs for, same as binary_player_input_to_neural_network_output()
+    return encoded_player_input & (ACTION_CLASS_COUNT - 1);
+}
+
+// Counting sort of the samples by class, sample_weights can be null when every sample is a single record
+static void index_training_actions(const u8* const sample_classes, const u32* const sample_weights, const u32 sample_count, TrainingActionIndex& index) {
+    u32 class_sample_counts[ACTION_CLASS_COUNT] = {};
+    for (u32 c = 0; c < ACTION_CLASS_COUNT; ++c) {
+        index.class_record_counts[c] = 0;
+    }
+
+    for (u32 i = 0; i < sample_count; ++i) {
+        ++class_sample_counts[sample_classes[i]];
+        index.class_record_counts[sample_classes[i]] += (sample_weights != nullptr) ? sample_weights[i] : 1;
+    }
+
+    u32 next_slots[ACTION_CLASS_COUNT] = {};
+    index.class_starts[0] = 0;
+    for (u32 c = 0; c < ACTION_CLASS_COUNT; ++c) {
+        next_slots[c] = index.class_starts[c];
+        index.class_starts[c + 1] = index.class_starts[c] + class_sample_counts[c];
+    }
+
+    for (u32 i = 0; i < sample_count; ++i) {
+        index.sample_indices[next_slots[sample_classes[i]]++] = i;
+    }
+}
+
+// Draws class_quotas[c] samples from each class with replacement, class by class, and returns how many that was.
+// Classes with no samples are skipped whatever their quota.
+static u32 draw_stratified_batch(const TrainingActionIndex& index, const u32* const class_quotas, u64& rng_state, StratifiedDraw* const draws) {
+    u32 draw_count = 0;
+    for (u32 c = 0; c < ACTION_CLASS_COUNT; ++c) {
+        const u32 class_sample_count = index.class_starts[c + 1] - index.class_starts[c];
+        if (class_sample_count == 0 || class_quotas[c] == 0) {
+            continue;
+        }
+
+        const f32 loss_weight = static_cast<f32>(class_sample_count) / static_cast<f32>(class_quotas[c]);
+        for (u32 i = 0; i < class_quotas[c]; ++i) {
+            // top 32 bits scaled into the class, no division and close enough to uniform for these counts
+            const u64 slot = ((next_random(rng_state) >> 32) * class_sample_count) >> 32;
+            draws[draw_count].sample_index = index.sample_indices[index.class_starts[c] + slot];
+            draws[draw_count].loss_weight = loss_weight;
+            ++draw_count;
+        }
+    }
+
+    return draw_count;
+}
+
+static void accumulate_training_delta(
+    const ConvolutionalNeuralNetwork& neural_network,
+    const i8* const training_data,
+    const u32 first_record,
+    const u32 record_count,
+    ConvolutionalNeuralNetwork& neural_network_delta
+) {
+    for (u32 record = first_record; record < first_record + record_count; ++record) {
+        const i8* const record_data = training_data + static_cast<u64>(record) * TRAINING_RECORD_SIZE;
+
+        BinaryGameState binary_game_state = {};
+        copy_bytes(record_data, sizeof(binary_game_state), reinterpret_cast<i8*>(binary_game_state));
+
+        BinaryPlayerInput encoded_player_input = 0;
+        copy_bytes(record_data + sizeof(binary_game_state), sizeof(encoded_player_input), reinterpret_cast<i8*>(&encoded_player_input));
+
+        ConvolutionalInput game_state;
+        binary_game_state_to_convolutional_input(binary_game_state, game_state);
+
+        NeuralNetwork::OutputLayer player_input = {};
+        binary_player_input_to_neural_network_output(encoded_player_input, player_input);
+
+        back_propagate(neural_network, game_state, player_input, neural_network_delta);
+    }
+}
@@ -0,0 +1,179 @@
+#ifndef TRAINING_DATA_H
+#define TRAINING_DATA_H
+
+#include "neural_network.h"
+#include "convolutional_neural_network.h"
+#include "types.h"
+
+// training_data.bin is a flat array of records, each an encoded game state followed by the player input for it
+static constexpr u8 BINARY_GAME_STATE_SIZE = 54;
+using BinaryGameState = i8[BINARY_GAME_STATE_SIZE];
+using BinaryPlayerInput = u16;
+
+static constexpr u32 TRAINING_RECORD_SIZE = BINARY_GAME_STATE_SIZE + sizeof(BinaryPlayerInput);
+static constexpr f32 LEARNING_RATE = 0.1f;
+
+// The network inputs are INPUT_FEATURE_COUNT features then one per grid cell. Batch decoding packs the grid
+// into a bitmap laid out like the inputs, bit i set when input i is a filled cell, so the bits under the
+// features are always clear.
+static constexpr u32 INPUT_FEATURE_COUNT = 12;
+static constexpr u32 GRID_BITMAP_WORD_COUNT = NeuralNetwork::INPUT_LAYER_SIZE / 64;
+static_assert(NeuralNetwork::INPUT_LAYER_SIZE % 64 == 0);
+
+// Record indices are u32 everywhere training data gets used
+static constexpr u64 MAX_TRAINING_RECORD_COUNT = 0xFFFFFFFF;
+
+// A training data file used in place (normally mapped) as an array of records. The file is only ever appended
+// to, so anything that isn't a whole record can only be a partial one on the end from an interrupted write.
+struct TrainingDataView {
+    const i8* records;
+    u32 record_count;
+    u32 trailing_byte_count;    // of the partial record on the end, left out
+};
+
+// Weighted training data layout (all offsets from start of file):
+//  - WeightedTrainingDataHeader
+//  - WeightedTrainingSample[sample_count]
+// Each distinct record once, in the order it first turns up, with the number of times it was recorded. Most
+// recorded ticks are idle ones with nothing changing, training on these gives the same full batch delta.
+struct WeightedTrainingDataHeader {
+    i8 magic[8];
+    u32 version;
+    u32 sample_count;
+    u64 record_count;   // weights add up to this
+    u64 reserved;
+};
+
+struct WeightedTrainingSample {
+    u32 weight;
+    i8 record[TRAINING_RECORD_SIZE];
+};
+
+static_assert(sizeof(WeightedTrainingDataHeader) == 32);
+static_assert(sizeof(WeightedTrainingSample) == 60);
+
+static constexpr u32 WEIGHTED_TRAINING_DATA_VERSION = 1;
+
+struct WeightedTrainingDataView {
+    const WeightedTrainingSample* samples;
+    u32 sample_count;
+    u64 record_count;
+};
+
+// Framed training data layout (all offsets from start of file):
+//  - frame_count frames of TRAINING_DATA_FRAME_SIZE bytes, the last one stopping after its records
+// Each frame is a TrainingDataFrameHeader then record_count records. This is how the game records, a crash
+// can only ever tear the frame being written and everything before it stays readable. Every frame but the
+// last is full so the last good frame is always one of the last two in the file, and each frame's checksum
+// carries on from the one before's (see extend_crc32c()) so the last good frame also has the checksum of
+// every record up to it. Picking up where a recording left off never has to read the rest of the file.
+struct TrainingDataFrameHeader {
+    i8 magic[4];
+    u32 frame_index;    // from the start of the file
+    u32 record_count;
+    u32 checksum;       // crc32c of every record in the file up to the end of this frame
+};
+
+static constexpr u32 TRAINING_DATA_FRAME_SIZE = 64 * 1024;
+static constexpr u32 TRAINING_DATA_FRAME_RECORD_COUNT = (TRAINING_DATA_FRAME_SIZE - sizeof(TrainingDataFrameHeader)) / TRAINING_RECORD_SIZE;
+
+static_assert(sizeof(TrainingDataFrameHeader) == 16);
+static_assert(sizeof(TrainingDataFrameHeader) + TRAINING_DATA_FRAME_RECORD_COUNT * TRAINING_RECORD_SIZE == TRAINING_DATA_FRAME_SIZE);
+
+// Where the good frames of a framed file end
+struct FramedTrainingDataEnd {
+    u64 size;               // of the good frames, the last one may not be full
+    u64 frame_count;
+    u32 last_frame_record_count;
+    u32 checksum;           // of every record in the good frames
+    u64 record_count;
+    bool scanned;           // the last two frames were both bad so the whole file had to be read
+};
+
+// Training data manifest layout (all offsets from start of file):
+//  - TrainingDataManifestHeader
+//  - TrainingDataShard[shard_count]
+// A recording split over shard files, so a reader can take a shard to itself with nothing shared and no one
+// file grows without limit. Shards are framed, or plain arrays of records from before there was framing, and
+// tell which by whether they start with a frame. Every shard is finished, with a record count and checksum
+// that won't change, bar the last which may still be being recorded into. That one's records are however many
+// its file holds.
+struct TrainingDataManifestHeader {
+    i8 magic[8];
+    u32 version;
+    u32 record_version;     // of the records in the shards, TRAINING_RECORD_VERSION when they're as above
+    u32 record_size;
+    u32 shard_count;
+    u64 reserved;
+};
+
+static constexpr u32 TRAINING_DATA_SHARD_FINISHED = 1;
+
+struct TrainingDataShard {
+    i8 file_name[48];   // zero terminated, in the same directory as the manifest
+    u64 record_count;   // only once finished
+    u32 checksum;       // crc32c of the records, likewise
+    u32 flags;
+};
+
+static_assert(sizeof(TrainingDataManifestHeader) == 32);
+static_assert(sizeof(TrainingDataShard) == 64);
+
+static constexpr u32 TRAINING_DATA_MANIFEST_VERSION = 1;
+static constexpr u32 TRAINING_RECORD_VERSION = 1;
+static constexpr u32 MAX_TRAINING_DATA_SHARD_COUNT = 256;
+static constexpr u64 MAX_TRAINING_DATA_MANIFEST_SIZE = sizeof(TrainingDataManifestHeader) + MAX_TRAINING_DATA_SHARD_COUNT * sizeof(TrainingDataShard);
+
+struct TrainingDataManifestView {
+    const TrainingDataShard* shards;
+    u32 shard_count;
+};
+
+// Every combination of held buttons a record's BinaryPlayerInput can have is a class of its own. Idle ticks and
+// holding down make up nearly all of a recording, rotations and moving sideways are rare, so the index lets
+// mini-batches be drawn with a quota from each class rather than in proportion to how often it was recorded.
+static constexpr u32 ACTION_CLASS_COUNT = 1 << NeuralNetwork::OUTPUT_LAYER_SIZE;
+
+struct TrainingActionIndex {
+    u32* sample_indices;                            // caller allocated, every sample grouped by class, in order within each
+    u32 class_starts[ACTION_CLASS_COUNT + 1];       // class c is sample_indices[class_starts[c], class_starts[c + 1])
+    u64 class_record_counts[ACTION_CLASS_COUNT];    // sample weights summed, records for a plain file
+};
+
+// The loss weight makes up for how over or under drawn the class is, so a batch's weighted delta is an unbiased
+// estimate of the full batch one whatever the quotas. Multiply in the sample's own weight for a weighted file.
+struct StratifiedDraw {
+    u32 sample_index;
+    f32 loss_weight;
+};
+
+static bool view_training_data(const void* data, u64 size, TrainingDataView& view);
+static const i8* training_record(const TrainingDataView& view, u32 record_index);
+static void binary_game_state_to_neural_network_input(const BinaryGameState& binary_game_state, NeuralNetwork::InputLayer& input);
+static void binary_game_state_to_convolutional_input(const BinaryGameState& binary_game_state, ConvolutionalInput& input);
+static void binary_player_input_to_neural_network_output(BinaryPlayerInput encoded_outputs, NeuralNetwork::OutputLayer& output);
+static void pack_grid_bitmap(const i8* encoded_rows, u64* grid_bitmap);
+static void expand_neural_network_input(const f32* features, const u64* grid_bitmap, KernelVariant variant, NeuralNetwork::InputLayer& input);
+static void decode_training_records(const i8* records, u32 record_stride, u32 record_count, KernelVariant variant, NeuralNetwork::InputLayer* inputs, NeuralNetwork::OutputLayer* targets);
+static void accumulate_training_delta(const PackedNeuralNetwork& neural_network, const i8* training_data, u32 first_record, u32 record_count, PackedNeuralNetworkDelta& neural_network_delta);
+static u64 deduplication_table_size(u32 record_count);
+static u64 max_weighted_training_data_size(u32 record_count);
+static u64 deduplicate_training_data(const TrainingDataView& training_data, u32* table, i8* buffer);
+static bool is_weighted_training_data(const void* data, u64 size);
+static bool view_weighted_training_data(const void* data, u64 size, WeightedTrainingDataView& view);
+static void accumulate_training_delta(const PackedNeuralNetwork& neural_network, const WeightedTrainingSample* samples, u32 first_sample, u32 sample_count, PackedNeuralNetworkDelta& neural_network_delta);
+static bool is_framed_training_data(const void* data, u64 size);
+static bool find_framed_training_data_end(const void* data, u64 size, FramedTrainingDataEnd& end);
+static const i8* framed_training_record(const void* data, u32 record_index);
+static u64 unframe_training_data(const void* data, u64 size, u64 first_frame_index, u32& previous_checksum, i8* records, u64& damaged_frame_count);
+static void write_training_data_frame_header(u32 frame_index, u32 record_count, u32 checksum, i8* frame);
+static u64 training_data_manifest_size(u32 shard_count);
+static u64 write_training_data_manifest(const TrainingDataShard* shards, u32 shard_count, i8* buffer);
+static bool is_training_data_manifest(const void* data, u64 size);
+static bool view_training_data_manifest(const void* data, u64 size, TrainingDataManifestView& view);
+static u32 training_record_action_class(const i8* record);
+static void index_training_actions(const u8* sample_classes, const u32* sample_weights, u32 sample_count, TrainingActionIndex& index);
+static u32 draw_stratified_batch(const TrainingActionIndex& index, const u32* class_quotas, u64& rng_state, StratifiedDraw* draws);
+static void accumulate_training_delta(const ConvolutionalNeuralNetwork& neural_network, const i8* training_data, u32 first_record, u32 record_count, ConvolutionalNeuralNetwork& neural_network_delta);
+
+#endif
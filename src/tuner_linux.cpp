@@ -0,0 +1,228 @@
+// One-time kernel tuning pass for this machine. Times the candidates for each KernelTuning setting on the network
+// shapes this build was compiled with and adds the winners to the tuning file, keyed by CPU and shape, which the
+// game and the tools load at startup. Nothing is timed if the file already has an entry for this machine.
+//
+// Usage: tuner [--tuning FILE] [--training-data FILE] [--retune]
+// Timing inputs are records spread through the training data when there is any, random boards otherwise.
+
+#include "neural_network.h"
+#include "kernel_tuning.h"
+#include "training_data.h"
+
+#include "util.cpp"
+#include "simd.cpp"
+#include "neural_network.cpp"
+#include "kernel_tuning.cpp"
+#include "convolutional_neural_network.cpp"
+#include "training_data.cpp"
+#include "tools_linux.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static constexpr u32 TIMING_INPUT_COUNT = 256;
+static constexpr u32 TIMING_PASS_COUNT = 5;         // best of, the quickest pass is the one least disturbed by anything else
+static constexpr u32 TUNING_POPULATION_SIZE = 64;
+
+static constexpr const char* KERNEL_VARIANT_NAMES[] = {"scalar", "avx2", "avx512"};
+
+static volatile f32 sink;
+
+// True if the inputs came from the training data
+static bool make_timing_inputs(const char* const training_data_file_name, NeuralNetwork::InputLayer* const inputs) {
+    // a few hundred records scattered through the file, reading ahead of each one would be wasted
+    TrainingDataView training_data = {};
+    if (load_training_data(training_data_file_name, MADV_RANDOM, training_data)) {
+        for (u32 i = 0; i < TIMING_INPUT_COUNT; ++i) {
+            const u32 record_index = static_cast<u32>(static_cast<u64>(i) * training_data.record_count / TIMING_INPUT_COUNT);
+            BinaryGameState binary_game_state = {};
+            copy_bytes(training_record(training_data, record_index), sizeof(binary_game_state), reinterpret_cast<i8*>(binary_game_state));
+            binary_game_state_to_neural_network_input(binary_game_state, inputs[i]);
+        }
+    }
+
+    if (training_data.record_count > 0) {
+        return true;
+    }
+
+    // roughly as sparse as real boards, which is what the kernels that skip zero inputs care about
+    u32 rng_seed = 1;
+    for (u32 i = 0; i < TIMING_INPUT_COUNT; ++i) {
+        for (i32 j = 0; j < NeuralNetwork::INPUT_LAYER_SIZE; ++j) {
+            rng_seed = random_number(rng_seed);
+            inputs[i][j] = (rng_seed % 100 < 40) ? static_cast<f32>((rng_seed >> 8) % 100 + 1) / 100.0f : 0.0f;
+        }
+    }
+
+    return false;
+}
+
+typedef void InferenceFunction(const void* neural_network, const NeuralNetwork::InputLayer& input, NeuralNetwork::OutputLayer& output);
+
+static void feed_forward_packed(const void* const neural_network, const NeuralNetwork::InputLayer& input, NeuralNetwork::OutputLayer& output) {
+    feed_forward(*static_cast<const PackedNeuralNetwork*>(neural_network), input, output);
+}
+
+static void feed_forward_sparse(const void* const neural_network, const NeuralNetwork::InputLayer& input, NeuralNetwork::OutputLayer& output) {
+    feed_forward(*static_cast<const SparseNeuralNetwork*>(neural_network), input, output);
+}
+
+// Nanoseconds per inference
+static f64 time_inference(InferenceFunction* const infer, const void* const neural_network, const NeuralNetwork::InputLayer* const inputs) {
+    static constexpr u32 REPEAT_COUNT = 20;
+
+    f64 best_seconds = 1e30;
+    for (u32 pass = 0; pass < TIMING_PASS_COUNT; ++pass) {
+        const f64 start = seconds_now();
+        for (u32 repeat = 0; repeat < REPEAT_COUNT; ++repeat) {
+            for (u32 i = 0; i < TIMING_INPUT_COUNT; ++i) {
+                NeuralNetwork::OutputLayer output = {};
+                infer(neural_network, inputs[i], output);
+                sink = output[0];
+            }
+        }
+
+        const f64 seconds = seconds_now() - start;
+        best_seconds = (seconds < best_seconds) ? seconds : best_seconds;
+    }
+
+    return best_seconds / static_cast<f64>(REPEAT_COUNT * TIMING_INPUT_COUNT) * 1e9;
+}
+
+// Nanoseconds per network per input
+static f64 time_population(const NeuralNetworkPopulation& population, const NeuralNetwork::InputLayer* const inputs, const KernelTuning& tuning, NeuralNetwork::OutputLayer* const outputs) {
+    f64 best_seconds = 1e30;
+    for (u32 pass = 0; pass < TIMING_PASS_COUNT; ++pass) {
+        const f64 start = seconds_now();
+        feed_forward(population, inputs, TIMING_INPUT_COUNT, tuning, outputs);
+        const f64 seconds = seconds_now() - start;
+        best_seconds = (seconds < best_seconds) ? seconds : best_seconds;
+        sink = outputs[0][0];
+    }
+
+    return best_seconds / static_cast<f64>(TIMING_INPUT_COUNT * population.size) * 1e9;
+}
+
+// The scalar kernel is only a candidate on CPUs without AVX2, it's never close and would take most of the time
+static void tune_population(const NeuralNetwork::InputLayer* const inputs, KernelTuning& tuning) {
+    NeuralNetwork* const neural_networks = static_cast<NeuralNetwork*>(aligned_alloc(alignof(NeuralNetwork), TUNING_POPULATION_SIZE * sizeof(NeuralNetwork)));
+    for (u32 i = 0; i < TUNING_POPULATION_SIZE; ++i) {
+        neural_networks[i] = random_neural_network(1000 + i);
+    }
+
+    NeuralNetworkPopulation population = {};
+    population.blocks = static_cast<NeuralNetworkPopulationBlock*>(aligned_alloc(alignof(NeuralNetworkPopulationBlock), population_block_count(TUNING_POPULATION_SIZE) * sizeof(NeuralNetworkPopulationBlock)));
+    stack_population(neural_networks, TUNING_POPULATION_SIZE, population);
+    NeuralNetwork::OutputLayer* const outputs = static_cast<NeuralNetwork::OutputLayer*>(malloc(TIMING_INPUT_COUNT * TUNING_POPULATION_SIZE * sizeof(NeuralNetwork::OutputLayer)));
+
+    const CpuFeatures& features = cpu_features();
+    const KernelVariant best_variant = features.avx512f ? KernelVariant::AVX512 : (features.avx2 ? KernelVariant::AVX2 : KernelVariant::SCALAR);
+    const KernelVariant worst_variant = features.avx2 ? KernelVariant::AVX2 : KernelVariant::SCALAR;
+
+    f64 best_nanoseconds = 1e30;
+    for (u32 variant = worst_variant; variant <= best_variant; ++variant) {
+        for (u32 input_tile = 1; input_tile <= MAX_POPULATION_INPUT_TILE; input_tile *= 2) {
+            KernelTuning candidate = tuning;
+            candidate.population_kernel = static_cast<KernelVariant>(variant);
+            candidate.population_input_tile = input_tile;
+            const f64 nanoseconds = time_population(population, inputs, candidate, outputs);
+            printf("population %s kernel, input tile %u: %.2f ns per inference\n", KERNEL_VARIANT_NAMES[variant], input_tile, nanoseconds);
+            if (nanoseconds < best_nanoseconds) {
+                best_nanoseconds = nanoseconds;
+                tuning.population_kernel = candidate.population_kernel;
+                tuning.population_input_tile = candidate.population_input_tile;
+            }
+        }
+    }
+
+    free(outputs);
+    free(population.blocks);
+    free(neural_networks);
+}
+
+// Prunes a random network harder and harder, the limit is the densest the sparse kernel still won at
+static void tune_sparse_block_density(const NeuralNetwork::InputLayer* const inputs, KernelTuning& tuning) {
+    NeuralNetwork* const neural_network = static_cast<NeuralNetwork*>(aligned_alloc(alignof(NeuralNetwork), sizeof(NeuralNetwork)));
+    PackedNeuralNetwork* const packed_neural_network = static_cast<PackedNeuralNetwork*>(aligned_alloc(alignof(PackedNeuralNetwork), sizeof(PackedNeuralNetwork)));
+    SparseNeuralNetwork* const sparse_neural_network = static_cast<SparseNeuralNetwork*>(aligned_alloc(alignof(SparseNeuralNetwork), sizeof(SparseNeuralNetwork)));
+    *neural_network = random_neural_network(1);
+    invalidate_packed_neural_network(*packed_neural_network);
+    pack_neural_network(*neural_network, *packed_neural_network);
+    const f64 packed_nanoseconds = time_inference(feed_forward_packed, packed_neural_network, inputs);
+    printf("packed kernel: %.1f ns per inference\n", packed_nanoseconds);
+
+    tuning.max_sparse_block_density = 0.0f;
+    for (u32 percent = 0; percent < 100; percent += 5) {
+        prune_neural_network(*neural_network, static_cast<f32>(percent) / 100.0f);
+        const f32 block_density = make_sparse_neural_network(*neural_network, *sparse_neural_network);
+        const f64 sparse_nanoseconds = time_inference(feed_forward_sparse, sparse_neural_network, inputs);
+        printf("sparse kernel, block density %.3f: %.1f ns per inference\n", block_density, sparse_nanoseconds);
+        if (sparse_nanoseconds < packed_nanoseconds && block_density > tuning.max_sparse_block_density) {
+            tuning.max_sparse_block_density = block_density;
+        }
+    }
+
+    free(sparse_neural_network);
+    free(packed_neural_network);
+    free(neural_network);
+}
+
+static void print_kernel_tuning(const KernelTuningKey& key, const KernelTuning& tuning) {
+    printf("cpu: %.48s\n", key.cpu_brand);
+    printf("max sparse block density: %.3f\n", tuning.max_sparse_block_density);
+    printf("population input tile: %u\n", tuning.population_input_tile);
+    printf("population kernel: %s\n", KERNEL_VARIANT_NAMES[tuning.population_kernel]);
+}
+
+int main(const int argc, const char* const* const argv) {
+    const char* kernel_tuning_file_name = "kernel_tuning.bin";
+    const char* training_data_file_name = "training_data_manifest.bin";
+    bool retune = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--tuning") == 0 && i + 1 < argc) {
+            kernel_tuning_file_name = argv[++i];
+        } else if (strcmp(argv[i], "--training-data") == 0 && i + 1 < argc) {
+            training_data_file_name = argv[++i];
+        } else if (strcmp(argv[i], "--retune") == 0) {
+            retune = true;
+        } else {
+            fprintf(stderr, "usage: %s [--tuning FILE] [--training-data FILE] [--retune]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    const KernelTuningKey key = current_kernel_tuning_key();
+    u64 existing_file_size = 0;
+    const i8* const existing_file = static_cast<const i8*>(map_whole_file(kernel_tuning_file_name, MADV_NORMAL, existing_file_size));
+
+    KernelTuning tuning = DEFAULT_KERNEL_TUNING;
+    if (!retune && find_kernel_tuning(existing_file, existing_file_size, key, tuning)) {
+        printf("already tuned for this machine in %s, --retune to time it again\n", kernel_tuning_file_name);
+        print_kernel_tuning(key, tuning);
+        return 0;
+    }
+
+    NeuralNetwork::InputLayer* const inputs = static_cast<NeuralNetwork::InputLayer*>(malloc(TIMING_INPUT_COUNT * sizeof(NeuralNetwork::InputLayer)));
+    const bool real_inputs = make_timing_inputs(training_data_file_name, inputs);
+    printf("timing inputs: %s\n", real_inputs ? training_data_file_name : "random boards");
+
+    tune_sparse_block_density(inputs, tuning);
+    tune_population(inputs, tuning);
+
+    i8* const buffer = static_cast<i8*>(malloc(MAX_KERNEL_TUNING_FILE_SIZE));
+    const u32 file_size = save_kernel_tuning_to_buffer(existing_file, existing_file_size, key, tuning, buffer, MAX_KERNEL_TUNING_FILE_SIZE);
+    if (existing_file != nullptr) {
+        munmap(const_cast<i8*>(existing_file), existing_file_size);
+    }
+
+    if (!replace_whole_file(kernel_tuning_file_name, buffer, file_size)) {
+        fprintf(stderr, "couldn't write %s\n", kernel_tuning_file_name);
+        return 1;
+    }
+
+    print_kernel_tuning(key, tuning);
+    printf("written to: %s\n", kernel_tuning_file_name);
+
+    return 0;
+}
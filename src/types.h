@@ -9,5 +9,6 @@ using u32 = unsigned int;
 using i64 = long long;
 using u64 = unsigned long long;
 using f32 = float;
+using f64 = double;
 
 #endif
@@ -1,4 +1,5 @@
 #include "util.h"
+#include "simd.h"
 
 static u32 random_number(const u32 seed) {
     static constexpr u32 m = (1 << 16) + 1;
@@ -8,6 +9,16 @@ static u32 random_number(const u32 seed) {
     return (a * seed + c) % m;
 }
 
+// splitmix64, for when random_number()'s 65537 states repeat far too soon, e.g. shuffling millions of records
+static u64 next_random(u64& state) {
+    state += 0x9E3779B97F4A7C15ull;
+    u64 z = state;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+
+    return z ^ (z >> 31);
+}
+
 static u32 copy_bytes(const i8* source, u32 count, i8* destination) {
     const u32 bytes_written = count;
     while (count-- != 0) {
@@ -25,3 +36,71 @@ static u32 compare_bytes(const i8* lhs, const i8* rhs, u32 count) {
 
     return difference;
 }
+
+// FNV-1a, only used for lookups so doesn't need to be anything stronger
+static u64 hash_bytes(const i8* data, u64 count) {
+    u64 hash = 0xCBF29CE484222325;
+    while (count-- != 0) {
+        hash ^= static_cast<u8>(*data++);
+        hash *= 0x100000001B3;
+    }
+
+    return hash;
+}
+
+struct Crc32cTable {
+    u32 entries[256];
+};
+
+// Castagnoli polynomial (reflected), same checksum as the SSE4.2 crc32 instruction
+static constexpr Crc32cTable make_crc32c_table() {
+    Crc32cTable table = {};
+    for (u32 i = 0; i < 256; ++i) {
+        u32 crc = i;
+        for (i32 bit = 0; bit < 8; ++bit) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78 : (crc >> 1);
+        }
+
+        table.entries[i] = crc;
+    }
+
+    return table;
+}
+
+static constexpr Crc32cTable CRC32C_TABLE = make_crc32c_table();
+
+static u32 extend_crc32c_scalar(u32 crc, const i8* data, u64 count) {
+    while (count-- != 0) {
+        crc = CRC32C_TABLE.entries[(crc ^ static_cast<u8>(*data++)) & 0xFF] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+// The crc32 instruction does 8 bytes at a time against the table's 1
+TARGET_SSE42 static u32 extend_crc32c_sse42(const u32 crc, const i8* data, u64 count) {
+    u64 crc64 = crc;
+    for (; count >= sizeof(u64); count -= sizeof(u64), data += sizeof(u64)) {
+        const u64 word = static_cast<u64>(_mm_cvtsi128_si64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(data))));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+
+    u32 crc32 = static_cast<u32>(crc64);
+    for (; count != 0; --count) {
+        crc32 = _mm_crc32_u8(crc32, static_cast<u8>(*data++));
+    }
+
+    return crc32;
+}
+
+// Carries on a checksum from where crc32c() of the data before left off, so data that turns up in pieces can
+// be checksummed as it goes: extend_crc32c(crc32c(a), b) == crc32c(a followed by b)
+static u32 extend_crc32c(const u32 crc32c_so_far, const i8* const data, const u64 count) {
+    const u32 crc = crc32c_so_far ^ 0xFFFFFFFF;
+    const u32 extended_crc = cpu_features().sse42 ? extend_crc32c_sse42(crc, data, count) : extend_crc32c_scalar(crc, data, count);
+    return extended_crc ^ 0xFFFFFFFF;
+}
+
+static u32 crc32c(const i8* const data, const u64 count) {
+    return extend_crc32c(0, data, count);
+}
@@ -4,8 +4,13 @@
 #include "types.h"
 
 static u32 random_number(u32 seed);
+static u64 next_random(u64& state);
 
 static u32 copy_bytes(const i8* source, u32 count, i8* destination);
 static u32 compare_bytes(const i8* lhs, const i8* rhs, u32 count);
 
+static u32 crc32c(const i8* data, u64 count);
+static u32 extend_crc32c(u32 crc32c_so_far, const i8* data, u64 count);
+static u64 hash_bytes(const i8* data, u64 count);
+
 #endif